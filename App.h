@@ -15,6 +15,9 @@ using namespace Urho3D;
 
 const float TOUCH_SENSITIVITY = 2.0f;
 
+class FrameGraph;
+class MemoryView;
+
 class App : public Application
 {
 	URHO3D_OBJECT(App, Application);
@@ -52,6 +55,18 @@ private:
 	unsigned screenJoystickIndex_;
 	/// Screen joystick index for settings (mobile platforms only).
 	unsigned screenJoystickSettingsIndex_;
+	/// Length of a benchmark run in seconds, zero to run until exit.
+	float runTime_;
+	/// Time since start.
+	float elapsedTime_;
+	/// File to write metrics to on exit. Defaults to the log directory in headless mode.
+	String metricsFileName_;
+	/// Frame time graph overlay, toggled with F3.
+	SharedPtr<FrameGraph> frameGraph_;
+#ifdef MEMORY_TAGS
+	/// Memory category tree overlay, toggled with F9.
+	SharedPtr<MemoryView> memoryView_;
+#endif
 
 	// Ustawienie tytulu okna i ikonki
 	void SetWindowTitleAndIcon();
@@ -61,6 +76,8 @@ private:
 	void HandleMouseModeChange(StringHash eventType, VariantMap& eventData);
 
 	void HandleKeyDown(StringHash eventType, VariantMap& eventData);
+	// Zakonczenie przebiegu po -runtime sekundach
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
 
 	// Update kamery
 	void HandleSceneUpdate(StringHash eventType, VariantMap& eventData);
@@ -15,10 +15,19 @@
 #include <Urho3D/UI/Sprite.h>
 #include <Urho3D/Graphics/Texture2D.h>
 #include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/ProcessUtils.h>
 #include <Urho3D/UI/UI.h>
 #include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/IO/Log.h>
 
+#include "CachedHandle.h"
+#include "EventStats.h"
+#include "FrameGraph.h"
+#include "MemoryTracker.h"
+#include "MetricsExport.h"
+#include "ResourceProfiler.h"
+
 App::App(Context* context) :
 	Application(context),
 	yaw_(0.0f),
@@ -27,8 +36,25 @@ App::App(Context* context) :
 	screenJoystickIndex_(M_MAX_UNSIGNED),
 	screenJoystickSettingsIndex_(M_MAX_UNSIGNED),
 	paused_(false),
-	useMouseMode_(MM_ABSOLUTE)
+	useMouseMode_(MM_ABSOLUTE),
+	runTime_(0.0f),
+	elapsedTime_(0.0f)
 {
+	// Observe resource loads from the very start so that engine startup loads are included in the report
+	context->RegisterSubsystem(new ResourceProfiler(context));
+	context->RegisterSubsystem(new MetricsExport(context));
+	context->RegisterSubsystem(new FrameSampler(context));
+#ifdef MEMORY_TAGS
+	// Before the physics world exists, so that every physics allocation is freed by the allocator that made it
+	InstallPhysicsAllocator();
+	context->RegisterSubsystem(new MemoryTracker(context));
+#endif
+#ifdef EVENT_PROFILING
+	context->RegisterSubsystem(new EventStats(context));
+#endif
+#ifdef LOOKUP_STATS
+	context->RegisterSubsystem(new HandleStats(context));
+#endif
 }
 void App::Setup()
 {
@@ -36,11 +62,31 @@ void App::Setup()
 	engineParameters_["WindowTitle"] = GetTypeName();
 	engineParameters_["LogName"] = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") + GetTypeName() + ".log";
 	engineParameters_["FullScreen"] = false;
-	engineParameters_["Headless"] = false;
+	// Headless runs (-headless) are used for benchmarking, so only default to windowed mode
+	if (!engineParameters_.Contains("Headless"))
+		engineParameters_["Headless"] = false;
 	engineParameters_["Sound"] = true;
 
+#ifdef EVENT_PROFILING
+	// Liczniki wyslan i czas handlerow wszystkich eventow
+	engineParameters_["EventProfiler"] = true;
+#endif
+
 	if (!engineParameters_.Contains("ResourcePrefixPaths"))
 		engineParameters_["ResourcePrefixPaths"] = ";../share/Resources;../share/Urho3D/Resources";
+
+	// Parametry benchmarku: -runtime <sekundy> -metrics <plik.json>
+	const Vector<String>& arguments = GetArguments();
+	for (unsigned i = 0; i + 1 < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		if (argument == "-runtime")
+			runTime_ = ToFloat(arguments[++i]);
+		else if (argument == "-metrics")
+			metricsFileName_ = arguments[++i];
+	}
+	if (metricsFileName_.Empty() && engineParameters_["Headless"].GetBool())
+		metricsFileName_ = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") + GetTypeName() + "Metrics.json";
 }
 void App::Start()
 {
@@ -49,20 +95,28 @@ void App::Start()
 		InitTouchInput();
 	else if (GetSubsystem<Input>()->GetNumJoysticks() == 0)
 		// On desktop platform, do not detect touch when we already got a joystick
-		SubscribeToEvent(E_TOUCHBEGIN, URHO3D_HANDLER(App, HandleTouchBegin));
+		SubscribeToEvent(E_TOUCHBEGIN, GAME_HANDLER(App, HandleTouchBegin));
 
 	SetWindowTitleAndIcon();
 
 	CreateConsoleAndDebugHud();
 
-	SubscribeToEvent(E_KEYDOWN, URHO3D_HANDLER(App, HandleKeyDown));
+	SubscribeToEvent(E_KEYDOWN, GAME_HANDLER(App, HandleKeyDown));
+
+	SubscribeToEvent(E_SCENEUPDATE, GAME_HANDLER(App, HandleSceneUpdate));
 
-	SubscribeToEvent(E_SCENEUPDATE, URHO3D_HANDLER(App, HandleSceneUpdate));
+	if (runTime_ > 0.0f)
+		SubscribeToEvent(E_ENDFRAME, GAME_HANDLER(App, HandleEndFrame));
 }
 
 void App::Stop()
 {
 	engine_->DumpResources(true);
+	URHO3D_LOGINFO(GetSubsystem<ResourceProfiler>()->GetReport());
+	URHO3D_LOGINFO(GetSubsystem<FrameSampler>()->GetHitchReport());
+
+	if (!metricsFileName_.Empty())
+		GetSubsystem<MetricsExport>()->Save(metricsFileName_);
 }
 
 void App::InitTouchInput()
@@ -106,8 +160,8 @@ void App::InitMouseMode(MouseMode mode)
 	else
 	{
 		input->SetMouseVisible(true);
-		SubscribeToEvent(E_MOUSEBUTTONDOWN, URHO3D_HANDLER(App, HandleMouseModeRequest));
-		SubscribeToEvent(E_MOUSEMODECHANGED, URHO3D_HANDLER(App, HandleMouseModeChange));
+		SubscribeToEvent(E_MOUSEBUTTONDOWN, GAME_HANDLER(App, HandleMouseModeRequest));
+		SubscribeToEvent(E_MOUSEMODECHANGED, GAME_HANDLER(App, HandleMouseModeChange));
 	}
 }
 
@@ -115,6 +169,8 @@ void App::SetWindowTitleAndIcon()
 {
 	ResourceCache* cache = GetSubsystem<ResourceCache>();
 	Graphics* graphics = GetSubsystem<Graphics>();
+	if (!graphics)
+		return;
 	// Ikonka na pasku tytulu
 	Image* icon = cache->GetResource<Image>("Textures/UrhoIcon.png");
 	graphics->SetWindowIcon(icon);
@@ -124,18 +180,36 @@ void App::SetWindowTitleAndIcon()
 
 void App::CreateConsoleAndDebugHud()
 {
+	MemoryScope memoryScope(MEMTAG_UI);
 	// Get default style
 	ResourceCache* cache = GetSubsystem<ResourceCache>();
 	XMLFile* xmlFile = cache->GetResource<XMLFile>("UI/DefaultStyle.xml");
 
 	// Create console
 	Console* console = engine_->CreateConsole();
+	// Brak konsoli i HUD w trybie headless
+	if (!console)
+		return;
 	console->SetDefaultStyle(xmlFile);
 	console->GetBackground()->SetOpacity(0.8f);
 
 	// Create debug HUD.
 	DebugHud* debugHud = engine_->CreateDebugHud();
 	debugHud->SetDefaultStyle(xmlFile);
+
+	// Wykres czasu klatek, F3
+	frameGraph_ = new FrameGraph(context_);
+	frameGraph_->SetAlignment(HA_LEFT, VA_BOTTOM);
+	frameGraph_->SetVisible(false);
+	GetSubsystem<UI>()->GetRoot()->AddChild(frameGraph_);
+
+#ifdef MEMORY_TAGS
+	// Drzewo pamieci wedlug kategorii, F9
+	memoryView_ = new MemoryView(context_);
+	memoryView_->SetAlignment(HA_RIGHT, VA_TOP);
+	memoryView_->SetVisible(false);
+	GetSubsystem<UI>()->GetRoot()->AddChild(memoryView_);
+#endif
 }
 
 
@@ -155,6 +229,17 @@ void App::HandleKeyDown(StringHash eventType, VariantMap& eventData)
 	// Toggle debug HUD with F2
 	else if (key == KEY_F2)
 		GetSubsystem<DebugHud>()->ToggleAll();
+	// Toggle frame time graph with F3, write the hitch dump its spike markers refer to with F4
+	else if (key == KEY_F3 && frameGraph_)
+		frameGraph_->SetVisible(!frameGraph_->IsVisible());
+	else if (key == KEY_F4)
+		GetSubsystem<FrameSampler>()->SaveHitchReport(GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") +
+			GetTypeName() + "Hitches.txt");
+#ifdef MEMORY_TAGS
+	// Toggle memory category tree with F9
+	else if (key == KEY_F9 && memoryView_)
+		memoryView_->SetVisible(!memoryView_->IsVisible());
+#endif
 	else if (!GetSubsystem<UI>()->GetFocusElement())
 	{
 		Renderer* renderer = GetSubsystem<Renderer>();
@@ -177,6 +262,14 @@ void App::HandleKeyDown(StringHash eventType, VariantMap& eventData)
 	}
 }
 
+void App::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	// Koniec przebiegu benchmarku
+	elapsedTime_ += GetSubsystem<Time>()->GetTimeStep();
+	if (elapsedTime_ >= runTime_)
+		engine_->Exit();
+}
+
 void App::HandleSceneUpdate(StringHash eventType, VariantMap& eventData)
 {
 	// Move the camera by touch, if the camera node is initialized by descendant sample class
@@ -0,0 +1,233 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/ResourceEvents.h>
+#include <Urho3D/Resource/XMLFile.h>
+
+#include "AssetPrefetcher.h"
+#include "EventStats.h"
+#include "MetricsExport.h"
+
+AssetPrefetcher::AssetPrefetcher(Context* context) :
+	Object(context),
+	maxInFlight_(DEFAULT_PREFETCH_IN_FLIGHT),
+	numInFlight_(0),
+	numRequested_(0),
+	numLoaded_(0),
+	numFailed_(0),
+	numCancelled_(0),
+	numReleased_(0),
+	totalLatencyUSec_(0),
+	maxLatencyUSec_(0)
+{
+	SubscribeToEvent(E_RESOURCEBACKGROUNDLOADED, GAME_HANDLER(AssetPrefetcher, HandleResourceBackgroundLoaded));
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(AssetPrefetcher, HandleCollectMetrics));
+}
+
+AssetPrefetcher::~AssetPrefetcher()
+{
+	for (HashMap<String, Entry>::Iterator i = entries_.Begin(); i != entries_.End(); ++i)
+		Release(i->second_);
+}
+
+void AssetPrefetcher::Request(StringHash type, const String& name, int priority, unsigned group)
+{
+	if (name.Empty())
+		return;
+
+	HashMap<String, Entry>::Iterator i = entries_.Find(name);
+	if (i == entries_.End())
+	{
+		i = entries_.Insert(MakePair(name, Entry()));
+		i->second_.type_ = type;
+		i->second_.name_ = name;
+		i->second_.groups_ = 0;
+		i->second_.state_ = PREFETCH_QUEUED;
+		i->second_.startUSec_ = 0;
+		++numRequested_;
+	}
+
+	Entry& entry = i->second_;
+	entry.priority_ = priority;
+	entry.groups_ |= 1u << group;
+	// A loaded XML file may have been requested before by another group only, its references follow the new one
+	if (entry.state_ == PREFETCH_LOADED && entry.resource_->GetType() == XMLFile::GetTypeStatic())
+		RequestReferences(static_cast<XMLFile*>(entry.resource_.Get())->GetRoot(), priority, entry.groups_);
+}
+
+void AssetPrefetcher::ReleaseGroup(unsigned group)
+{
+	unsigned mask = 1u << group;
+	for (HashMap<String, Entry>::Iterator i = entries_.Begin(); i != entries_.End();)
+	{
+		Entry& entry = i->second_;
+		if (!(entry.groups_ & mask))
+		{
+			++i;
+			continue;
+		}
+
+		entry.groups_ &= ~mask;
+		// Loads with the background loader cannot be recalled, they are released when they finish
+		if (entry.groups_ || entry.state_ == PREFETCH_LOADING)
+		{
+			++i;
+			continue;
+		}
+
+		if (entry.state_ == PREFETCH_QUEUED)
+			++numCancelled_;
+		else
+			Release(entry);
+		i = entries_.Erase(i);
+	}
+}
+
+void AssetPrefetcher::Update()
+{
+	while (numInFlight_ < maxInFlight_)
+	{
+		Entry* next = 0;
+		for (HashMap<String, Entry>::Iterator i = entries_.Begin(); i != entries_.End(); ++i)
+		{
+			if (i->second_.state_ == PREFETCH_QUEUED && (!next || i->second_.priority_ > next->priority_))
+				next = &i->second_;
+		}
+		if (!next)
+			break;
+		Start(*next);
+	}
+}
+
+unsigned AssetPrefetcher::GetNumPending() const
+{
+	unsigned count = 0;
+	for (HashMap<String, Entry>::ConstIterator i = entries_.Begin(); i != entries_.End(); ++i)
+	{
+		if (i->second_.state_ == PREFETCH_QUEUED || i->second_.state_ == PREFETCH_LOADING)
+			++count;
+	}
+	return count;
+}
+
+bool AssetPrefetcher::IsLoaded(const String& name) const
+{
+	HashMap<String, Entry>::ConstIterator i = entries_.Find(name);
+	return i != entries_.End() && i->second_.state_ == PREFETCH_LOADED;
+}
+
+void AssetPrefetcher::Start(Entry& entry)
+{
+	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	entry.startUSec_ = timer_.GetUSec(false);
+
+	// Already in the cache, e.g. loaded at startup: only hold it
+	Resource* existing = cache->GetExistingResource(entry.type_, entry.name_);
+	if (existing)
+	{
+		entry.state_ = PREFETCH_LOADED;
+		entry.resource_ = existing;
+		if (existing->GetType() == XMLFile::GetTypeStatic())
+			RequestReferences(static_cast<XMLFile*>(existing)->GetRoot(), entry.priority_, entry.groups_);
+		return;
+	}
+
+	// A load already queued by someone else finishes with the same event
+	entry.state_ = PREFETCH_LOADING;
+	++numInFlight_;
+	cache->BackgroundLoadResource(entry.type_, entry.name_, true);
+}
+
+void AssetPrefetcher::Release(Entry& entry)
+{
+	if (!entry.resource_)
+		return;
+
+	entry.resource_.Reset();
+	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	if (cache)
+		cache->ReleaseResource(entry.type_, entry.name_, false);
+	++numReleased_;
+}
+
+void AssetPrefetcher::RequestReferences(const XMLElement& element, int priority, unsigned groups)
+{
+	// Resource reference attributes are stored as "type;name", lists as "type;name;name..."
+	for (XMLElement attribute = element.GetChild("attribute"); attribute; attribute = attribute.GetNext("attribute"))
+	{
+		String value = attribute.GetAttribute("value");
+		if (!value.Contains(';'))
+			continue;
+		Vector<String> values = value.Split(';');
+		StringHash type(values[0]);
+		if (!context_->GetObjectFactories().Contains(type))
+			continue;
+		for (unsigned i = 1; i < values.Size(); ++i)
+		{
+			for (unsigned group = 0; group < 32; ++group)
+			{
+				if (groups & (1u << group))
+					Request(type, values[i], priority, group);
+			}
+		}
+	}
+
+	for (XMLElement child = element.GetChild(); child; child = child.GetNext())
+	{
+		if (child.GetName() != "attribute")
+			RequestReferences(child, priority, groups);
+	}
+}
+
+void AssetPrefetcher::HandleResourceBackgroundLoaded(StringHash eventType, VariantMap& eventData)
+{
+	using namespace ResourceBackgroundLoaded;
+
+	HashMap<String, Entry>::Iterator i = entries_.Find(eventData[P_RESOURCENAME].GetString());
+	if (i == entries_.End() || i->second_.state_ != PREFETCH_LOADING)
+		return;
+
+	Entry& entry = i->second_;
+	--numInFlight_;
+	if (!eventData[P_SUCCESS].GetBool())
+	{
+		entry.state_ = PREFETCH_FAILED;
+		++numFailed_;
+		URHO3D_LOGWARNING("Could not prefetch " + entry.name_);
+		return;
+	}
+
+	long long latency = timer_.GetUSec(false) - entry.startUSec_;
+	totalLatencyUSec_ += latency;
+	maxLatencyUSec_ = Max(maxLatencyUSec_, latency);
+	++numLoaded_;
+	entry.state_ = PREFETCH_LOADED;
+	entry.resource_ = static_cast<Resource*>(eventData[P_RESOURCE].GetPtr());
+
+	// Every group was released while it loaded
+	if (!entry.groups_)
+	{
+		Release(entry);
+		entries_.Erase(i);
+		return;
+	}
+
+	if (entry.resource_ && entry.resource_->GetType() == XMLFile::GetTypeStatic())
+		RequestReferences(static_cast<XMLFile*>(entry.resource_.Get())->GetRoot(), entry.priority_, entry.groups_);
+}
+
+void AssetPrefetcher::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& prefetch = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["assetPrefetch"];
+	prefetch["requested"] = numRequested_;
+	prefetch["loaded"] = numLoaded_;
+	prefetch["failed"] = numFailed_;
+	prefetch["cancelled"] = numCancelled_;
+	prefetch["released"] = numReleased_;
+	prefetch["pending"] = GetNumPending();
+	prefetch["held"] = entries_.Size();
+	prefetch["meanLatencyMs"] = numLoaded_ ? totalLatencyUSec_ / 1000.0 / numLoaded_ : 0.0;
+	prefetch["maxLatencyMs"] = maxLatencyUSec_ / 1000.0;
+}
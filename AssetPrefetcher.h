@@ -0,0 +1,108 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Resource/Resource.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class XMLElement;
+}
+
+/// Default number of loads handed to the background loader at a time.
+const unsigned DEFAULT_PREFETCH_IN_FLIGHT = 4;
+
+/// Prefetch request state.
+enum PrefetchState
+{
+	PREFETCH_QUEUED = 0,
+	PREFETCH_LOADING,
+	PREFETCH_LOADED,
+	PREFETCH_FAILED
+};
+
+/// Loads resources before they are needed on the resource cache's background loader. Requests belong to groups, e.g. track
+/// themes, and have a priority; only a few loads are handed to the background loader at a time, so that a more urgent request
+/// does not wait behind everything queued before it. Resources referenced by a loaded XML file, such as the model and material
+/// of a prefab, are requested along with it. Releasing a group cancels its queued loads and releases its loaded resources from
+/// the cache, unless another group still wants them.
+class AssetPrefetcher : public Object
+{
+	URHO3D_OBJECT(AssetPrefetcher, Object);
+
+public:
+	/// Construct.
+	AssetPrefetcher(Context* context);
+	/// Destruct. Releases all prefetched resources.
+	~AssetPrefetcher();
+
+	/// Request a resource for a group, 0 to 31. A repeated request sets the priority. Higher priorities start loading first.
+	void Request(StringHash type, const String& name, int priority, unsigned group);
+	/// Drop a group's requests.
+	void ReleaseGroup(unsigned group);
+	/// Start queued loads, highest priority first, up to the in-flight limit.
+	void Update();
+	/// Set number of loads handed to the background loader at a time.
+	void SetMaxInFlight(unsigned count) { maxInFlight_ = Max(count, 1U); }
+
+	/// Return number of requests queued or loading.
+	unsigned GetNumPending() const;
+	/// Return whether a resource has been prefetched.
+	bool IsLoaded(const String& name) const;
+
+private:
+	/// Requested resource.
+	struct Entry
+	{
+		/// Resource type.
+		StringHash type_;
+		/// Resource name.
+		String name_;
+		/// Priority.
+		int priority_;
+		/// Groups wanting the resource, one bit each. Zero for a load left running after all its groups were released.
+		unsigned groups_;
+		/// State.
+		PrefetchState state_;
+		/// Loaded resource, held until released.
+		SharedPtr<Resource> resource_;
+		/// Time the load was handed to the background loader.
+		long long startUSec_;
+	};
+
+	/// Hand a load to the background loader.
+	void Start(Entry& entry);
+	/// Drop the held resource and release it from the cache if nothing else uses it.
+	void Release(Entry& entry);
+	/// Request the resources referenced by attributes under an XML element.
+	void RequestReferences(const XMLElement& element, int priority, unsigned groups);
+	/// Handle a finished background load.
+	void HandleResourceBackgroundLoaded(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Requests by resource name.
+	HashMap<String, Entry> entries_;
+	/// Time base for load latency.
+	HiresTimer timer_;
+	/// Loads handed to the background loader at a time.
+	unsigned maxInFlight_;
+	/// Loads with the background loader.
+	unsigned numInFlight_;
+	/// Requests made.
+	unsigned numRequested_;
+	/// Resources loaded.
+	unsigned numLoaded_;
+	/// Loads failed.
+	unsigned numFailed_;
+	/// Queued loads cancelled.
+	unsigned numCancelled_;
+	/// Loaded resources released.
+	unsigned numReleased_;
+	/// Load latency summed over the loaded resources.
+	long long totalLatencyUSec_;
+	/// Longest load latency.
+	long long maxLatencyUSec_;
+};
@@ -0,0 +1,61 @@
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/IO/FileSystem.h>
+
+#include "BenchmarkApp.h"
+#include "Character.h"
+#include "GameBenchmarks.h"
+#include "MicroBenchmark.h"
+#include "ResourceProfiler.h"
+#include "TrackInstanceGroup.h"
+#include "TrackPrefab.h"
+
+URHO3D_DEFINE_APPLICATION_MAIN(BenchmarkApp)
+
+BenchmarkApp::BenchmarkApp(Context* context) :
+	Application(context)
+{
+	// The game's components and the subsystems they use
+	Character::RegisterObject(context);
+	TrackInstanceGroup::RegisterObject(context);
+	context->RegisterSubsystem(new ResourceProfiler(context));
+	context->RegisterSubsystem(new TrackPrefabLibrary(context));
+}
+
+void BenchmarkApp::Setup()
+{
+	engineParameters_["Headless"] = true;
+	engineParameters_["Sound"] = false;
+	engineParameters_["LogName"] = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") + GetTypeName() + ".log";
+	if (!engineParameters_.Contains("ResourcePrefixPaths"))
+		engineParameters_["ResourcePrefixPaths"] = ";../share/Resources;../share/Urho3D/Resources";
+}
+
+void BenchmarkApp::Start()
+{
+	SharedPtr<MicroBenchmarkRunner> runner(new MicroBenchmarkRunner(context_));
+	AddGameBenchmarks(runner);
+
+	String filter;
+	String jsonFileName;
+	const Vector<String>& arguments = GetArguments();
+	for (unsigned i = 0; i + 1 < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		if (argument == "-filter")
+			filter = arguments[++i];
+		else if (argument == "-json")
+			jsonFileName = arguments[++i];
+		else if (argument == "-samples")
+			runner->SetSamples(ToUInt(arguments[++i]));
+		else if (argument == "-warmup")
+			runner->SetWarmup(ToUInt(arguments[++i]));
+		else if (argument == "-sampleusec")
+			runner->SetSampleUSec(ToUInt(arguments[++i]));
+	}
+
+	runner->Run(filter);
+	if (!jsonFileName.Empty())
+		runner->SaveJSON(jsonFileName);
+	engine_->Exit();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Urho3D/Engine/Application.h>
+
+using namespace Urho3D;
+
+/// Headless application running the game's microbenchmarks and exiting. Options: -filter <text> runs the cases whose name
+/// contains the text, -samples <n> and -warmup <n> set the sample counts, -sampleusec <n> the shortest sample, and
+/// -json <file> writes the results for diffing between builds.
+class BenchmarkApp : public Application
+{
+	URHO3D_OBJECT(BenchmarkApp, Application);
+
+public:
+	/// Construct.
+	BenchmarkApp(Context* context);
+
+	/// Setup before engine initialization.
+	virtual void Setup();
+	/// Run the benchmarks after engine initialization.
+	virtual void Start();
+};
@@ -0,0 +1,350 @@
+#include <cmath>
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "Character.h"
+#include "GameBenchmarks.h"
+#include "RunnerView.h"
+#include "TrackBuilder.h"
+#include "TrackEntities.h"
+#include "TrackLayout.h"
+#include "TrackPrefab.h"
+#include "Touch.h"
+
+/// Track seed of the benchmark scenes.
+static const unsigned BENCHMARK_SEED = 12345;
+/// Contacts per collision event, a runner standing on the floor next to an obstacle.
+static const unsigned NUM_CONTACTS = 4;
+/// Physics step of Character::FixedUpdate.
+static const float FIXED_TIMESTEP = 1.0f / 60.0f;
+/// Track content behind the runner that keeps its physics body, as in the game.
+static const float PROMOTE_BEHIND = 10.0f;
+/// Track content ahead of the runner that gets a physics body, as in the game.
+static const float PROMOTE_AHEAD = 30.0f;
+/// Distance the runner moves per spawning step, about a frame at full speed.
+static const float SPAWN_STEP = 0.2f;
+/// Obstacles and pickups each on the spawning benchmark track, denser than the default track.
+static const unsigned SPAWN_ITEMS = 1000;
+
+/// Keeps the results of measured work alive.
+static volatile unsigned sink = 0;
+
+/// Create a scene with the game's scene components.
+static Scene* CreateScene(Context* context)
+{
+	Scene* scene = new Scene(context);
+	scene->CreateComponent<Octree>();
+	scene->CreateComponent<PhysicsWorld>();
+	return scene;
+}
+
+/// Score and position lines of the HUD, formatted every frame.
+class HudTextBenchmark : public MicroBenchmark
+{
+public:
+	HudTextBenchmark() :
+		MicroBenchmark("hudText"),
+		time_(0.0f)
+	{
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			time_ += 0.01f;
+			String score = FormatScoreText(time_);
+			String position = FormatPositionText(Vector3(1.5f, 1.1f, time_ * 10.0f));
+			sink += score.Length() + position.Length();
+		}
+	}
+
+private:
+	/// Run time.
+	float time_;
+};
+
+/// Ground contact parsing of a collision event, sent to the runner node as the physics world does.
+class ContactParseBenchmark : public MicroBenchmark
+{
+public:
+	ContactParseBenchmark() :
+		MicroBenchmark("contactParse")
+	{
+	}
+
+	virtual bool Setup(Context* context)
+	{
+		scene_ = CreateScene(context);
+		Character* character = CreateRunner(scene_);
+		node_ = character->GetNode();
+		// Start() normally runs before the first scene update
+		character->Start();
+
+		VectorBuffer contacts;
+		for (unsigned i = 0; i < NUM_CONTACTS; ++i)
+		{
+			bool ground = i < NUM_CONTACTS / 2;
+			contacts.WriteVector3(ground ? Vector3(0.2f * i, 0.0f, 0.1f) : Vector3(0.5f, 1.5f, 0.6f));
+			contacts.WriteVector3(ground ? Vector3::UP : Vector3::BACK);
+			contacts.WriteFloat(0.01f);
+			contacts.WriteFloat(0.5f);
+		}
+
+		using namespace NodeCollision;
+		eventData_[P_BODY] = node_->GetComponent<RigidBody>();
+		eventData_[P_OTHERNODE] = scene_.Get();
+		eventData_[P_TRIGGER] = false;
+		eventData_[P_CONTACTS] = contacts.GetBuffer();
+		return true;
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		for (unsigned i = 0; i < iterations; ++i)
+			node_->SendEvent(E_NODECOLLISION, eventData_);
+	}
+
+	virtual void TearDown()
+	{
+		node_.Reset();
+		scene_.Reset();
+	}
+
+private:
+	/// Scene.
+	SharedPtr<Scene> scene_;
+	/// Runner node.
+	SharedPtr<Node> node_;
+	/// Collision event data.
+	VariantMap eventData_;
+};
+
+/// Third person camera raycast against the track walls and clamp, for a runner moving along the track.
+class CameraRaycastBenchmark : public MicroBenchmark
+{
+public:
+	CameraRaycastBenchmark() :
+		MicroBenchmark("cameraRaycast"),
+		step_(0)
+	{
+	}
+
+	virtual bool Setup(Context* context)
+	{
+		layout_.Generate(BENCHMARK_SEED);
+		scene_ = CreateScene(context);
+		CreateTrackPieces(scene_, layout_.GetSpline());
+		world_ = scene_->GetComponent<PhysicsWorld>();
+		// The broadphase is filled by a collision update, as after the first physics step
+		world_->UpdateCollisions();
+		cameraNode_ = new Node(context);
+		return true;
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		const TrackSpline& spline = layout_.GetSpline();
+		float length = spline.GetLength();
+		for (unsigned i = 0; i < iterations; ++i, ++step_)
+		{
+			// Lanes and pitch vary so that some rays hit the walls and some do not
+			float z = fmodf(step_ * SPAWN_STEP, length);
+			Vector3 position = spline.ToWorld(Vector3(TrackLayout::GetLaneX((int)(step_ % 3) - 1), 1.1f, z));
+			float pitch = (float)(step_ % 60) - 30.0f;
+			sink += (unsigned)UpdateThirdPersonCamera(world_, cameraNode_, position, spline.GetRotation(z), pitch, CAMERA_INITIAL_DIST);
+		}
+	}
+
+	virtual void TearDown()
+	{
+		cameraNode_.Reset();
+		world_.Reset();
+		scene_.Reset();
+	}
+
+private:
+	/// Track.
+	TrackLayout layout_;
+	/// Scene.
+	SharedPtr<Scene> scene_;
+	/// Physics world.
+	SharedPtr<PhysicsWorld> world_;
+	/// Camera node.
+	SharedPtr<Node> cameraNode_;
+	/// Runner steps taken.
+	unsigned step_;
+};
+
+/// Character::FixedUpdate on a physics world that is not stepped, alternating grounded and airborne, with changing controls.
+class CharacterUpdateBenchmark : public MicroBenchmark
+{
+public:
+	CharacterUpdateBenchmark() :
+		MicroBenchmark("characterFixedUpdate"),
+		step_(0)
+	{
+	}
+
+	virtual bool Setup(Context* context)
+	{
+		scene_ = CreateScene(context);
+		character_ = CreateRunner(scene_);
+		return character_->GetNode()->GetComponent<AnimatedModel>()->GetModel() != 0;
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		for (unsigned i = 0; i < iterations; ++i, ++step_)
+		{
+			character_->controls_.Set(CTRL_FORWARD, true);
+			character_->controls_.Set(CTRL_LEFT, (step_ & 32) != 0);
+			character_->controls_.Set(CTRL_RIGHT, (step_ & 64) != 0);
+			character_->controls_.Set(CTRL_JUMP, (step_ & 127) == 0);
+			character_->SetGroundState((step_ & 3) != 0, character_->IsOkToJump(), character_->GetInAirTimer());
+			character_->FixedUpdate(FIXED_TIMESTEP);
+		}
+	}
+
+	virtual void TearDown()
+	{
+		character_.Reset();
+		scene_.Reset();
+	}
+
+private:
+	/// Scene.
+	SharedPtr<Scene> scene_;
+	/// Character.
+	SharedPtr<Character> character_;
+	/// Steps taken.
+	unsigned step_;
+};
+
+/// Obstacle and pickup spawning: the promotion window moves along the track, creating prefab nodes with physics bodies ahead
+/// of the runner and removing them behind.
+class ObstacleSpawnBenchmark : public MicroBenchmark
+{
+public:
+	ObstacleSpawnBenchmark() :
+		MicroBenchmark("obstacleSpawn"),
+		distance_(0.0f)
+	{
+	}
+
+	virtual bool Setup(Context* context)
+	{
+		layout_.Generate(BENCHMARK_SEED, SPAWN_ITEMS, SPAWN_ITEMS);
+		scene_ = CreateScene(context);
+		Node* contentNode = scene_->CreateChild("TrackContent", LOCAL);
+		if (!AddTrackContent(entities_, contentNode, layout_, context->GetSubsystem<TrackPrefabLibrary>()))
+			return false;
+		length_ = layout_.GetSpline().GetLength();
+		return true;
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			// Wrapping around removes the whole window once per lap, as a restart does
+			distance_ += SPAWN_STEP;
+			if (distance_ > length_)
+				distance_ = 0.0f;
+			entities_.UpdatePromotion(scene_, distance_ - PROMOTE_BEHIND, distance_ + PROMOTE_AHEAD);
+		}
+		sink += entities_.GetNumPromoted();
+	}
+
+	virtual void TearDown()
+	{
+		entities_.Clear();
+		scene_.Reset();
+	}
+
+private:
+	/// Track.
+	TrackLayout layout_;
+	/// Scene.
+	SharedPtr<Scene> scene_;
+	/// Track content.
+	TrackEntityStore entities_;
+	/// Runner distance.
+	float distance_;
+	/// Track length.
+	float length_;
+};
+
+/// Scene snapshot save or load as the game's quick save does, of a scene with the track pieces and the runner.
+class SceneSnapshotBenchmark : public MicroBenchmark
+{
+public:
+	SceneSnapshotBenchmark(bool load) :
+		MicroBenchmark(load ? "sceneLoad" : "sceneSave"),
+		load_(load)
+	{
+	}
+
+	virtual bool Setup(Context* context)
+	{
+		TrackLayout layout;
+		layout.Generate(BENCHMARK_SEED);
+		scene_ = CreateScene(context);
+		CreateTrackPieces(scene_, layout.GetSpline());
+		CreateRunner(scene_);
+		scene_->SaveXML(snapshot_);
+		return true;
+	}
+
+	virtual void Run(unsigned iterations)
+	{
+		for (unsigned i = 0; i < iterations; ++i)
+		{
+			if (load_)
+			{
+				MemoryBuffer source(snapshot_.GetData(), snapshot_.GetSize());
+				sink += scene_->LoadXML(source);
+			}
+			else
+			{
+				VectorBuffer dest;
+				scene_->SaveXML(dest);
+				sink += dest.GetSize();
+			}
+		}
+	}
+
+	virtual void TearDown()
+	{
+		scene_.Reset();
+		snapshot_.Clear();
+	}
+
+private:
+	/// Load instead of save.
+	bool load_;
+	/// Scene.
+	SharedPtr<Scene> scene_;
+	/// Saved scene.
+	VectorBuffer snapshot_;
+};
+
+void AddGameBenchmarks(MicroBenchmarkRunner* runner)
+{
+	runner->Add(new HudTextBenchmark());
+	runner->Add(new ContactParseBenchmark());
+	runner->Add(new CameraRaycastBenchmark());
+	runner->Add(new CharacterUpdateBenchmark());
+	runner->Add(new ObstacleSpawnBenchmark());
+	runner->Add(new SceneSnapshotBenchmark(false));
+	runner->Add(new SceneSnapshotBenchmark(true));
+}
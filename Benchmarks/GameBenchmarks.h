@@ -0,0 +1,7 @@
+#pragma once
+
+#include "MicroBenchmark.h"
+
+/// Add the game's microbenchmark cases to a runner: HUD text formatting, ground contact parsing, the camera raycast,
+/// Character::FixedUpdate, obstacle spawning and scene snapshot save and load.
+void AddGameBenchmarks(MicroBenchmarkRunner* runner);
@@ -0,0 +1,165 @@
+#include <cmath>
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/JSONFile.h>
+
+#include "MicroBenchmark.h"
+
+/// Two-sided 95% quantiles of Student's t distribution for 1 to 30 degrees of freedom.
+static const double T95[] =
+{
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/// Scale from the median absolute deviation to the standard deviation of a normal distribution.
+static const double MAD_TO_STDDEV = 1.4826;
+
+static double GetT95(unsigned degreesOfFreedom)
+{
+	return degreesOfFreedom <= 30 ? T95[Max(degreesOfFreedom, 1U) - 1] : 1.96;
+}
+
+static double GetMedian(const PODVector<double>& sorted)
+{
+	unsigned half = sorted.Size() / 2;
+	return sorted.Size() & 1 ? sorted[half] : 0.5 * (sorted[half - 1] + sorted[half]);
+}
+
+MicroBenchmarkRunner::MicroBenchmarkRunner(Context* context) :
+	Object(context),
+	samples_(DEFAULT_BENCHMARK_SAMPLES),
+	warmup_(DEFAULT_BENCHMARK_WARMUP),
+	sampleUSec_(DEFAULT_BENCHMARK_SAMPLE_USEC)
+{
+}
+
+void MicroBenchmarkRunner::Run(const String& filter)
+{
+	results_.Clear();
+	for (unsigned i = 0; i < benchmarks_.Size(); ++i)
+	{
+		MicroBenchmark* benchmark = benchmarks_[i];
+		if (!filter.Empty() && !benchmark->GetName().Contains(filter, false))
+			continue;
+		if (!benchmark->Setup(context_))
+		{
+			URHO3D_LOGWARNING("Skipped benchmark " + benchmark->GetName());
+			continue;
+		}
+
+		MicroBenchmarkResult result = Measure(benchmark);
+		benchmark->TearDown();
+		results_.Push(result);
+		URHO3D_LOGINFO(ToString("%-24s %12.1f ns +- %.1f (median %.1f, sd %.1f, min %.1f, max %.1f), %u x %u, %u outliers",
+			result.name_.CString(), result.meanNs_, result.ci95Ns_, result.medianNs_, result.stdDevNs_, result.minNs_, result.maxNs_,
+			result.samples_, result.iterations_, result.outliers_));
+	}
+}
+
+MicroBenchmarkResult MicroBenchmarkRunner::Measure(MicroBenchmark* benchmark) const
+{
+	// Double the iterations until a sample is long enough that the timer resolution does not matter. This also warms up
+	HiresTimer timer;
+	unsigned iterations = 1;
+	for (;;)
+	{
+		timer.Reset();
+		benchmark->Run(iterations);
+		if (timer.GetUSec(false) >= sampleUSec_ || iterations >= MAX_BENCHMARK_ITERATIONS)
+			break;
+		iterations *= 2;
+	}
+
+	for (unsigned i = 0; i < warmup_; ++i)
+		benchmark->Run(iterations);
+
+	PODVector<double> samples(samples_);
+	for (unsigned i = 0; i < samples_; ++i)
+	{
+		timer.Reset();
+		benchmark->Run(iterations);
+		samples[i] = timer.GetUSec(false) * 1000.0 / iterations;
+	}
+
+	MicroBenchmarkResult result;
+	result.name_ = benchmark->GetName();
+	result.iterations_ = iterations;
+	result.samples_ = samples_;
+
+	double sum = 0.0;
+	for (unsigned i = 0; i < samples.Size(); ++i)
+		sum += samples[i];
+	result.meanNs_ = sum / samples.Size();
+	double squares = 0.0;
+	for (unsigned i = 0; i < samples.Size(); ++i)
+		squares += (samples[i] - result.meanNs_) * (samples[i] - result.meanNs_);
+	result.stdDevNs_ = sqrt(squares / (samples.Size() - 1));
+	result.ci95Ns_ = GetT95(samples.Size() - 1) * result.stdDevNs_ / sqrt((double)samples.Size());
+
+	Sort(samples.Begin(), samples.End());
+	result.minNs_ = samples.Front();
+	result.maxNs_ = samples.Back();
+	result.medianNs_ = GetMedian(samples);
+
+	// Outliers by the median absolute deviation, which the outliers themselves hardly move
+	PODVector<double> deviations(samples.Size());
+	for (unsigned i = 0; i < samples.Size(); ++i)
+		deviations[i] = Abs(samples[i] - result.medianNs_);
+	Sort(deviations.Begin(), deviations.End());
+	double limit = 3.0 * MAD_TO_STDDEV * GetMedian(deviations);
+	result.outliers_ = 0;
+	for (unsigned i = 0; i < samples.Size(); ++i)
+	{
+		if (Abs(samples[i] - result.medianNs_) > limit)
+			++result.outliers_;
+	}
+	return result;
+}
+
+bool MicroBenchmarkRunner::SaveJSON(const String& fileName) const
+{
+	SharedPtr<JSONFile> json(new JSONFile(context_));
+	JSONValue& root = json->GetRoot();
+	root["samples"] = samples_;
+	root["warmup"] = warmup_;
+	root["sampleUSec"] = sampleUSec_;
+#ifdef NDEBUG
+	root["build"] = "release";
+#else
+	root["build"] = "debug";
+#endif
+	root["compiled"] = String(__DATE__) + " " + __TIME__;
+
+	// Keyed by name, so that two result files diff case by case
+	JSONValue& benchmarks = root["benchmarks"];
+	for (unsigned i = 0; i < results_.Size(); ++i)
+	{
+		const MicroBenchmarkResult& result = results_[i];
+		JSONValue& entry = benchmarks[result.name_];
+		entry["meanNs"] = result.meanNs_;
+		entry["ci95Ns"] = result.ci95Ns_;
+		entry["medianNs"] = result.medianNs_;
+		entry["stdDevNs"] = result.stdDevNs_;
+		entry["minNs"] = result.minNs_;
+		entry["maxNs"] = result.maxNs_;
+		entry["iterations"] = result.iterations_;
+		entry["samples"] = result.samples_;
+		entry["outliers"] = result.outliers_;
+	}
+
+	File file(context_, fileName, FILE_WRITE);
+	if (!file.IsOpen() || !json->Save(file, "\t"))
+	{
+		URHO3D_LOGERROR("Could not write benchmark results to " + fileName);
+		return false;
+	}
+
+	URHO3D_LOGINFO("Benchmark results written to " + fileName);
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Resource/JSONValue.h>
+
+using namespace Urho3D;
+
+/// Default timed samples per benchmark.
+const unsigned DEFAULT_BENCHMARK_SAMPLES = 30;
+/// Default untimed warm-up samples per benchmark.
+const unsigned DEFAULT_BENCHMARK_WARMUP = 5;
+/// Default shortest sample in microseconds. The iterations per sample are doubled until a sample takes this long.
+const unsigned DEFAULT_BENCHMARK_SAMPLE_USEC = 2000;
+/// Most iterations per sample.
+const unsigned MAX_BENCHMARK_ITERATIONS = 1 << 24;
+
+/// Microbenchmark case. Only Run() is timed.
+class MicroBenchmark : public RefCounted
+{
+public:
+	/// Construct with a name.
+	MicroBenchmark(const String& name) :
+		name_(name)
+	{
+	}
+
+	/// Prepare the data the case works on. Return false to skip the case.
+	virtual bool Setup(Context* context) { return true; }
+	/// Perform the measured operation a number of times.
+	virtual void Run(unsigned iterations) = 0;
+	/// Release the data.
+	virtual void TearDown() {}
+
+	/// Return name.
+	const String& GetName() const { return name_; }
+
+private:
+	/// Name.
+	String name_;
+};
+
+/// Timing statistics of a case, per operation.
+struct MicroBenchmarkResult
+{
+	/// Case name.
+	String name_;
+	/// Iterations per sample.
+	unsigned iterations_;
+	/// Timed samples.
+	unsigned samples_;
+	/// Mean in nanoseconds.
+	double meanNs_;
+	/// Median in nanoseconds.
+	double medianNs_;
+	/// Sample standard deviation in nanoseconds.
+	double stdDevNs_;
+	/// Half width of the 95% confidence interval of the mean in nanoseconds.
+	double ci95Ns_;
+	/// Fastest sample in nanoseconds.
+	double minNs_;
+	/// Slowest sample in nanoseconds.
+	double maxNs_;
+	/// Samples further than three robust standard deviations from the median.
+	unsigned outliers_;
+};
+
+/// Runs microbenchmark cases: the iterations per sample are calibrated so that a sample is long enough for the timer, a few
+/// untimed samples warm up the caches and the allocator, and the timed samples give the mean, the median, the spread and a
+/// confidence interval per operation. Results go to the log and optionally to a JSON file for diffing between builds.
+class MicroBenchmarkRunner : public Object
+{
+	URHO3D_OBJECT(MicroBenchmarkRunner, Object);
+
+public:
+	/// Construct.
+	MicroBenchmarkRunner(Context* context);
+
+	/// Add a case.
+	void Add(MicroBenchmark* benchmark) { benchmarks_.Push(SharedPtr<MicroBenchmark>(benchmark)); }
+	/// Run the cases whose name contains the filter, or all with an empty filter.
+	void Run(const String& filter = String::EMPTY);
+	/// Save the results as JSON. Return true on success.
+	bool SaveJSON(const String& fileName) const;
+
+	/// Set timed samples per case.
+	void SetSamples(unsigned samples) { samples_ = Max(samples, 2U); }
+	/// Set warm-up samples per case.
+	void SetWarmup(unsigned warmup) { warmup_ = warmup; }
+	/// Set shortest sample in microseconds.
+	void SetSampleUSec(unsigned usec) { sampleUSec_ = Max(usec, 1U); }
+
+	/// Return results of the last run.
+	const Vector<MicroBenchmarkResult>& GetResults() const { return results_; }
+
+private:
+	/// Measure a prepared case.
+	MicroBenchmarkResult Measure(MicroBenchmark* benchmark) const;
+
+	/// Cases.
+	Vector<SharedPtr<MicroBenchmark> > benchmarks_;
+	/// Results.
+	Vector<MicroBenchmarkResult> results_;
+	/// Timed samples per case.
+	unsigned samples_;
+	/// Warm-up samples per case.
+	unsigned warmup_;
+	/// Shortest sample in microseconds.
+	unsigned sampleUSec_;
+};
@@ -0,0 +1,219 @@
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+
+#include "BroadcastLoadTest.h"
+#include "BroadcastSession.h"
+#include "MetricsExport.h"
+
+/// Largest run packet read by a subscriber.
+static const unsigned MAX_PACKET_SIZE = 1024;
+/// File handles left for the engine when raising the open file limit.
+static const unsigned RESERVED_HANDLES = 64;
+/// Subscription requests sent before the server reads them.
+static const unsigned RENEW_BATCH_SIZE = 200;
+
+/// Raise the open file limit as far as allowed and return the number of sockets that can be opened.
+static unsigned GetSocketLimit(unsigned wanted)
+{
+#ifndef _WIN32
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+	{
+		rlim_t needed = (rlim_t)wanted + RESERVED_HANDLES;
+		if (limit.rlim_cur < needed)
+		{
+			limit.rlim_cur = limit.rlim_max == RLIM_INFINITY ? needed : Min(needed, limit.rlim_max);
+			setrlimit(RLIMIT_NOFILE, &limit);
+			getrlimit(RLIMIT_NOFILE, &limit);
+		}
+		return limit.rlim_cur > RESERVED_HANDLES ? Min(wanted, (unsigned)(limit.rlim_cur - RESERVED_HANDLES)) : 0;
+	}
+#endif
+	return wanted;
+}
+
+BroadcastLoadTest::BroadcastLoadTest(Context* context) :
+	Object(context),
+	renewTime_(0),
+	accumulator_(0.0f),
+	packetTimer_(0.0f),
+	packets_(0),
+	packetSteps_(0),
+	packetChecksum_(0),
+	sendUSec_(0),
+	maxSendUSec_(0),
+	receiveUSec_(0)
+{
+	runner_.Reset();
+}
+
+BroadcastLoadTest::~BroadcastLoadTest()
+{
+	for (unsigned i = 0; i < subscribers_.Size(); ++i)
+		delete subscribers_[i];
+}
+
+bool BroadcastLoadTest::Start(unsigned numSubscribers, unsigned seed)
+{
+	if (!server_.Start(0))
+		return false;
+	// All simulated subscribers share the loopback address
+	server_.SetMaxSubscribers(Max(numSubscribers, DEFAULT_MAX_SUBSCRIBERS), numSubscribers);
+	UdpSocket::Resolve("127.0.0.1", server_.GetPort(), serverAddress_);
+
+	unsigned limit = GetSocketLimit(numSubscribers);
+	if (limit < numSubscribers)
+		URHO3D_LOGWARNING(ToString("Open file limit allows only %u of %u simulated subscribers", limit, numSubscribers));
+
+	for (unsigned i = 0; i < limit; ++i)
+	{
+		Subscriber* subscriber = new Subscriber();
+		subscriber->cookie_ = 0;
+		if (!subscriber->socket_.Open(0))
+		{
+			delete subscriber;
+			URHO3D_LOGWARNING(ToString("Could open only %u subscriber sockets", i));
+			break;
+		}
+		subscribers_.Push(subscriber);
+	}
+
+	track_.Generate(seed);
+	encoder_.Begin(seed);
+	RenewSubscriptions();
+	URHO3D_LOGINFO(ToString("Broadcast load test with %u subscribers on port %u", subscribers_.Size(), server_.GetPort()));
+
+	SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(BroadcastLoadTest, HandleUpdate));
+	SubscribeToEvent(E_COLLECTMETRICS, URHO3D_HANDLER(BroadcastLoadTest, HandleCollectMetrics));
+	return true;
+}
+
+void BroadcastLoadTest::RenewSubscriptions()
+{
+	// Real spectators renew spread over the interval. Sent all at once they would overflow the server's receive buffer, so
+	// the server reads them in between
+	for (unsigned i = 0; i < subscribers_.Size(); ++i)
+	{
+		SendSubscribe(subscribers_[i]);
+		if (i % RENEW_BATCH_SIZE == RENEW_BATCH_SIZE - 1)
+			server_.Update();
+	}
+	renewTime_ = Time::GetSystemTime();
+}
+
+void BroadcastLoadTest::SendSubscribe(Subscriber* subscriber)
+{
+	unsigned char request[BROADCAST_REQUEST_SIZE];
+	WriteBroadcastRequest(request, BROADCAST_SUBSCRIBE, subscriber->cookie_);
+	subscriber->socket_.Send(serverAddress_, request, BROADCAST_REQUEST_SIZE);
+}
+
+void BroadcastLoadTest::ReceivePackets()
+{
+	unsigned char data[MAX_PACKET_SIZE];
+	UdpAddress from;
+	int size;
+	for (unsigned i = 0; i < subscribers_.Size(); ++i)
+	{
+		Subscriber* subscriber = subscribers_[i];
+		while ((size = subscriber->socket_.Receive(from, data, MAX_PACKET_SIZE)) > 0)
+		{
+			if (data[0] == BROADCAST_COOKIE && size == (int)BROADCAST_REQUEST_SIZE)
+			{
+				subscriber->cookie_ = ReadBroadcastCookie(data);
+				SendSubscribe(subscriber);
+				continue;
+			}
+			MemoryBuffer packet(data, (unsigned)size);
+			subscriber->decoder_.ReadPacket(packet);
+		}
+	}
+}
+
+void BroadcastLoadTest::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+	using namespace Update;
+
+	float timeStep = eventData[P_TIMESTEP].GetFloat();
+	accumulator_ = Min(accumulator_ + timeStep, 5 * SIM_TIMESTEP);
+	while (accumulator_ >= SIM_TIMESTEP)
+	{
+		unsigned char buttons = (unsigned char)RunnerSim::GetBotButtons(encoder_.GetNumSteps(), 0);
+		encoder_.AddStep(runner_, buttons);
+		RunnerSim::Step(runner_, buttons, track_);
+		accumulator_ -= SIM_TIMESTEP;
+	}
+
+	if (Time::GetSystemTime() - renewTime_ >= BROADCAST_RENEW_INTERVAL)
+		RenewSubscriptions();
+
+	packetTimer_ -= timeStep;
+	if (packetTimer_ <= 0.0f)
+	{
+		packetTimer_ = Max(packetTimer_ + 1.0f / BROADCAST_PACKET_RATE, 0.0f);
+
+		HiresTimer timer;
+		server_.Update();
+		encoder_.WritePacket(packet_);
+		server_.Broadcast(packet_);
+		long long elapsed = timer.GetUSec(false);
+		sendUSec_ += elapsed;
+		maxSendUSec_ = Max(maxSendUSec_, elapsed);
+		packetSteps_ = encoder_.GetNumSteps();
+		packetChecksum_ = runner_.GetChecksum();
+		++packets_;
+	}
+
+	HiresTimer timer;
+	ReceivePackets();
+	receiveUSec_ += timer.GetUSec(false);
+}
+
+void BroadcastLoadTest::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	unsigned inSync = 0;
+	unsigned long long received = 0;
+	unsigned resyncs = 0;
+	unsigned desyncs = 0;
+	for (unsigned i = 0; i < subscribers_.Size(); ++i)
+	{
+		const BroadcastDecoder& decoder = subscribers_[i]->decoder_;
+		if (decoder.GetStep() == packetSteps_ && decoder.GetState().GetChecksum() == packetChecksum_)
+			++inSync;
+		received += decoder.GetNumPackets();
+		resyncs += decoder.GetNumResyncs();
+		desyncs += decoder.GetNumDesyncs();
+	}
+
+	float packets = (float)Max(packets_, 1U);
+	float sent = (float)Max(server_.GetNumSent(), 1ULL);
+	JSONValue& test = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["broadcastLoadTest"];
+	test["subscribers"] = subscribers_.Size();
+	test["registered"] = server_.GetNumSubscribers();
+	test["refused"] = server_.GetNumRefused();
+	test["packets"] = packets_;
+	test["packetBytes"] = packet_.GetSize();
+	test["datagramsSent"] = (double)server_.GetNumSent();
+	test["datagramsDropped"] = (double)server_.GetNumDropped();
+	test["datagramsReceived"] = (double)received;
+	test["sendUsPerPacket"] = sendUSec_ / packets;
+	test["maxSendUs"] = (double)maxSendUSec_;
+	test["sendUsPerDatagram"] = sendUSec_ / sent;
+	test["subscriberUsPerPacket"] = receiveUSec_ / packets;
+	test["subscribersInSync"] = inSync;
+	test["resyncs"] = resyncs;
+	test["desyncs"] = desyncs;
+
+	URHO3D_LOGINFO(ToString("Broadcast load test: %u subscribers, %u packets, fan-out %.1f us per packet (%.2f us per datagram), "
+		"%u dropped, %u in sync, %u desyncs", subscribers_.Size(), packets_, sendUSec_ / packets, sendUSec_ / sent,
+		(unsigned)server_.GetNumDropped(), inSync, desyncs));
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "BroadcastServer.h"
+#include "BroadcastStream.h"
+
+using namespace Urho3D;
+
+/// Local load test of the broadcast fan-out: one bot run broadcast over loopback to many simulated subscribers in the same process,
+/// each with its own socket and decoder. Fan-out and subscriber time are measured separately, so the server cost per subscriber
+/// can be read directly from the "broadcastLoadTest" metrics section.
+class BroadcastLoadTest : public Object
+{
+	URHO3D_OBJECT(BroadcastLoadTest, Object);
+
+public:
+	/// Construct.
+	BroadcastLoadTest(Context* context);
+	/// Destruct.
+	~BroadcastLoadTest();
+
+	/// Start the server and open the subscriber sockets. Return true on success.
+	bool Start(unsigned numSubscribers, unsigned seed);
+
+private:
+	/// Simulated spectator.
+	struct Subscriber
+	{
+		/// Socket.
+		UdpSocket socket_;
+		/// Decoder.
+		BroadcastDecoder decoder_;
+		/// Subscription cookie from the server, 0 before one has been received.
+		unsigned cookie_;
+	};
+
+	/// Send subscription requests from all subscribers.
+	void RenewSubscriptions();
+	/// Send a subscription request from one subscriber.
+	void SendSubscribe(Subscriber* subscriber);
+	/// Read and decode waiting packets on all subscribers, echoing subscription cookies.
+	void ReceivePackets();
+
+	/// Handle frame update.
+	void HandleUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Track.
+	TrackLayout track_;
+	/// Broadcast run state.
+	RunnerState runner_;
+	/// Encoder.
+	BroadcastEncoder encoder_;
+	/// Fan-out server.
+	BroadcastServer server_;
+	/// Packet buffer.
+	VectorBuffer packet_;
+	/// Simulated subscribers.
+	PODVector<Subscriber*> subscribers_;
+	/// Server address as seen by the subscribers.
+	UdpAddress serverAddress_;
+	/// Last subscription renewal time.
+	unsigned renewTime_;
+	/// Unsimulated time.
+	float accumulator_;
+	/// Time until the next packet.
+	float packetTimer_;
+	/// Packets produced.
+	unsigned packets_;
+	/// Steps covered by the latest packet.
+	unsigned packetSteps_;
+	/// Runner state checksum at the latest packet.
+	unsigned packetChecksum_;
+	/// Fan-out time in total.
+	long long sendUSec_;
+	/// Longest fan-out of one packet.
+	long long maxSendUSec_;
+	/// Subscriber receive and decode time in total.
+	long long receiveUSec_;
+};
@@ -0,0 +1,460 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstring>
+
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/Log.h>
+
+#include "BroadcastServer.h"
+#include "BroadcastStream.h"
+
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+static const size_t NO_SOCKET = (size_t)INVALID_SOCKET;
+#define WOULD_BLOCK (WSAGetLastError() == WSAEWOULDBLOCK)
+#define CloseSocket closesocket
+#else
+typedef int SocketHandle;
+static const size_t NO_SOCKET = (size_t)-1;
+#define WOULD_BLOCK (errno == EAGAIN || errno == EWOULDBLOCK)
+#define CloseSocket close
+#endif
+
+/// Datagrams per batched send call.
+static const unsigned SEND_BATCH_SIZE = 64;
+/// Largest datagram read from subscribers.
+static const unsigned MAX_REQUEST_SIZE = 16;
+/// Consecutive sends refused for a full buffer after which the rest of a fan-out is given up.
+static const unsigned MAX_BLOCKED_SENDS = 8;
+
+static inline unsigned long long RotateLeft(unsigned long long value, unsigned bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static inline void SipRound(unsigned long long& v0, unsigned long long& v1, unsigned long long& v2, unsigned long long& v3)
+{
+	v0 += v1;
+	v1 = RotateLeft(v1, 13) ^ v0;
+	v0 = RotateLeft(v0, 32);
+	v2 += v3;
+	v3 = RotateLeft(v3, 16) ^ v2;
+	v0 += v3;
+	v3 = RotateLeft(v3, 21) ^ v0;
+	v2 += v1;
+	v1 = RotateLeft(v1, 17) ^ v2;
+	v2 = RotateLeft(v2, 32);
+}
+
+/// SipHash-2-4 of a 16 byte message. Keyed, so a subscriber's own cookies tell nothing about the cookies of other addresses.
+static unsigned long long SipHash(const unsigned long long* key, unsigned long long m0, unsigned long long m1)
+{
+	unsigned long long v0 = key[0] ^ 0x736f6d6570736575ULL;
+	unsigned long long v1 = key[1] ^ 0x646f72616e646f6dULL;
+	unsigned long long v2 = key[0] ^ 0x6c7967656e657261ULL;
+	unsigned long long v3 = key[1] ^ 0x7465646279746573ULL;
+	unsigned long long blocks[3] = { m0, m1, 16ULL << 56 };
+	for (unsigned i = 0; i < 3; ++i)
+	{
+		v3 ^= blocks[i];
+		SipRound(v0, v1, v2, v3);
+		SipRound(v0, v1, v2, v3);
+		v0 ^= blocks[i];
+	}
+	v2 ^= 0xff;
+	for (unsigned i = 0; i < 4; ++i)
+		SipRound(v0, v1, v2, v3);
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/// Fill a cookie key from the system random source, mixing in the clock where there is none.
+static void GenerateSecret(unsigned long long* secret)
+{
+	secret[0] = secret[1] = 0;
+#ifndef _WIN32
+	FILE* file = fopen("/dev/urandom", "rb");
+	if (file)
+	{
+		if (fread(secret, sizeof(unsigned long long), 2, file) != 2)
+			secret[0] = secret[1] = 0;
+		fclose(file);
+	}
+#endif
+	secret[0] ^= (unsigned long long)Time::GetTimeSinceEpoch() * 0x9E3779B97F4A7C15ULL;
+	secret[1] ^= ((unsigned long long)Time::GetSystemTime() << 32) ^ (unsigned long long)(size_t)secret;
+}
+
+void WriteBroadcastRequest(unsigned char* dest, unsigned char type, unsigned cookie)
+{
+	dest[0] = type;
+	dest[1] = (unsigned char)cookie;
+	dest[2] = (unsigned char)(cookie >> 8);
+	dest[3] = (unsigned char)(cookie >> 16);
+	dest[4] = (unsigned char)(cookie >> 24);
+}
+
+unsigned ReadBroadcastCookie(const unsigned char* source)
+{
+	return source[1] | (source[2] << 8) | (source[3] << 16) | ((unsigned)source[4] << 24);
+}
+
+static sockaddr_in ToSockAddr(const UdpAddress& address)
+{
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(address.ip_);
+	addr.sin_port = htons(address.port_);
+	return addr;
+}
+
+UdpSocket::UdpSocket() :
+	handle_(NO_SOCKET),
+	port_(0)
+{
+}
+
+UdpSocket::~UdpSocket()
+{
+	Close();
+}
+
+bool UdpSocket::Open(unsigned short port)
+{
+	Close();
+
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+	SocketHandle handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if ((size_t)handle == NO_SOCKET)
+		return false;
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof addr);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(handle, (sockaddr*)&addr, sizeof addr) != 0)
+	{
+		CloseSocket(handle);
+		return false;
+	}
+
+#ifdef _WIN32
+	u_long nonBlocking = 1;
+	ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+	fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	socklen_t length = sizeof addr;
+	getsockname(handle, (sockaddr*)&addr, &length);
+	port_ = ntohs(addr.sin_port);
+	handle_ = (size_t)handle;
+	return true;
+}
+
+void UdpSocket::Close()
+{
+	if (handle_ != NO_SOCKET)
+	{
+		CloseSocket((SocketHandle)handle_);
+		handle_ = NO_SOCKET;
+		port_ = 0;
+	}
+}
+
+void UdpSocket::SetBufferSizes(unsigned sendSize, unsigned receiveSize)
+{
+	if (handle_ == NO_SOCKET)
+		return;
+
+	int size = (int)sendSize;
+	setsockopt((SocketHandle)handle_, SOL_SOCKET, SO_SNDBUF, (const char*)&size, sizeof size);
+	size = (int)receiveSize;
+	setsockopt((SocketHandle)handle_, SOL_SOCKET, SO_RCVBUF, (const char*)&size, sizeof size);
+}
+
+bool UdpSocket::Send(const UdpAddress& to, const void* data, unsigned size)
+{
+	if (handle_ == NO_SOCKET)
+		return false;
+
+	sockaddr_in addr = ToSockAddr(to);
+	return sendto((SocketHandle)handle_, (const char*)data, size, 0, (sockaddr*)&addr, sizeof addr) == (int)size;
+}
+
+unsigned UdpSocket::SendToAll(const UdpAddress* to, unsigned count, const void* data, unsigned size)
+{
+	if (handle_ == NO_SOCKET)
+		return 0;
+
+	// A failed datagram, e.g. to an unreachable address or while the buffer is momentarily full, is skipped and the next
+	// ones are still tried, as the kernel drains the buffer meanwhile. Only a run of full buffer failures gives up the rest
+	unsigned sent = 0;
+	unsigned next = 0;
+	unsigned blocked = 0;
+#ifdef __linux__
+	// One system call per batch, all messages share the same payload
+	sockaddr_in addrs[SEND_BATCH_SIZE];
+	mmsghdr messages[SEND_BATCH_SIZE];
+	iovec payload;
+	payload.iov_base = const_cast<void*>(data);
+	payload.iov_len = size;
+
+	while (next < count && blocked < MAX_BLOCKED_SENDS)
+	{
+		unsigned batch = Min(count - next, SEND_BATCH_SIZE);
+		memset(messages, 0, batch * sizeof(mmsghdr));
+		for (unsigned i = 0; i < batch; ++i)
+		{
+			addrs[i] = ToSockAddr(to[next + i]);
+			messages[i].msg_hdr.msg_name = &addrs[i];
+			messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+			messages[i].msg_hdr.msg_iov = &payload;
+			messages[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		// A partial result means the datagram after the sent ones failed, and a negative one that the first did
+		int result = sendmmsg((SocketHandle)handle_, messages, batch, MSG_DONTWAIT);
+		if (result > 0)
+		{
+			sent += result;
+			next += result;
+			blocked = 0;
+		}
+		if ((unsigned)Max(result, 0) < batch)
+		{
+			if (result < 0 && WOULD_BLOCK)
+				++blocked;
+			++next;
+		}
+	}
+#else
+	for (; next < count && blocked < MAX_BLOCKED_SENDS; ++next)
+	{
+		sockaddr_in addr = ToSockAddr(to[next]);
+		if (sendto((SocketHandle)handle_, (const char*)data, size, 0, (sockaddr*)&addr, sizeof addr) == (int)size)
+		{
+			++sent;
+			blocked = 0;
+		}
+		else if (WOULD_BLOCK)
+			++blocked;
+	}
+#endif
+	return sent;
+}
+
+int UdpSocket::Receive(UdpAddress& from, void* data, unsigned maxSize)
+{
+	if (handle_ == NO_SOCKET)
+		return -1;
+
+	sockaddr_in addr;
+	socklen_t length = sizeof addr;
+	int result = recvfrom((SocketHandle)handle_, (char*)data, maxSize, 0, (sockaddr*)&addr, &length);
+	if (result < 0)
+	{
+		if (!WOULD_BLOCK)
+			URHO3D_LOGDEBUG("UDP receive failed");
+		return -1;
+	}
+
+	from.ip_ = ntohl(addr.sin_addr.s_addr);
+	from.port_ = ntohs(addr.sin_port);
+	return result;
+}
+
+bool UdpSocket::IsOpen() const
+{
+	return handle_ != NO_SOCKET;
+}
+
+bool UdpSocket::Resolve(const String& host, unsigned short port, UdpAddress& dest)
+{
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof hints);
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* result = 0;
+	if (getaddrinfo(host.CString(), 0, &hints, &result) != 0 || !result)
+		return false;
+
+	dest.ip_ = ntohl(((sockaddr_in*)result->ai_addr)->sin_addr.s_addr);
+	dest.port_ = port;
+	freeaddrinfo(result);
+	return true;
+}
+
+BroadcastServer::BroadcastServer() :
+	maxSubscribers_(DEFAULT_MAX_SUBSCRIBERS),
+	maxSubscribersPerAddress_(DEFAULT_MAX_SUBSCRIBERS_PER_ADDRESS),
+	refused_(0),
+	sent_(0),
+	dropped_(0),
+	bytes_(0)
+{
+	secret_[0] = secret_[1] = 0;
+}
+
+bool BroadcastServer::Start(unsigned short port)
+{
+	Stop();
+	if (!socket_.Open(port))
+	{
+		URHO3D_LOGERROR(ToString("Could not open broadcast port %u", port));
+		return false;
+	}
+
+	// Room for a full fan-out of a packet without hitting the non-blocking limit
+	socket_.SetBufferSizes(8 * 1024 * 1024, 256 * 1024);
+	GenerateSecret(secret_);
+	URHO3D_LOGINFO(ToString("Broadcasting on UDP port %u", socket_.GetPort()));
+	return true;
+}
+
+void BroadcastServer::Stop()
+{
+	socket_.Close();
+	subscribers_.Clear();
+	renewTimes_.Clear();
+	subscriberIndices_.Clear();
+	addressCounts_.Clear();
+}
+
+void BroadcastServer::Update()
+{
+	unsigned now = Time::GetSystemTime();
+	unsigned char request[MAX_REQUEST_SIZE];
+	UdpAddress from;
+	int size;
+	while ((size = socket_.Receive(from, request, MAX_REQUEST_SIZE)) > 0)
+	{
+		// Shorter requests are not answered, as the reply would be larger
+		if (size < (int)BROADCAST_REQUEST_SIZE)
+			continue;
+
+		bool valid = IsValidCookie(from, ReadBroadcastCookie(request), now);
+		if (request[0] == BROADCAST_SUBSCRIBE)
+		{
+			if (valid)
+				Subscribe(from, now);
+			else
+			{
+				unsigned char reply[BROADCAST_REQUEST_SIZE];
+				WriteBroadcastRequest(reply, BROADCAST_COOKIE, GetCookie(from, now / BROADCAST_COOKIE_LIFETIME));
+				socket_.Send(from, reply, BROADCAST_REQUEST_SIZE);
+			}
+		}
+		else if (request[0] == BROADCAST_UNSUBSCRIBE && valid)
+		{
+			HashMap<UdpAddress, unsigned>::Iterator i = subscriberIndices_.Find(from);
+			if (i != subscriberIndices_.End())
+				Unsubscribe(i->second_);
+		}
+	}
+
+	for (unsigned i = 0; i < subscribers_.Size();)
+	{
+		if (now - renewTimes_[i] > BROADCAST_SUBSCRIBER_TIMEOUT)
+			Unsubscribe(i);
+		else
+			++i;
+	}
+}
+
+unsigned BroadcastServer::Broadcast(const VectorBuffer& packet)
+{
+	if (subscribers_.Empty())
+		return 0;
+
+	// A subscriber that misses a packet recovers from the next one, so never wait for buffer space
+	unsigned sent = socket_.SendToAll(&subscribers_[0], subscribers_.Size(), packet.GetData(), packet.GetSize());
+	sent_ += sent;
+	dropped_ += subscribers_.Size() - sent;
+	bytes_ += (unsigned long long)sent * packet.GetSize();
+	return sent;
+}
+
+void BroadcastServer::SetMaxSubscribers(unsigned total, unsigned perAddress)
+{
+	maxSubscribers_ = total;
+	maxSubscribersPerAddress_ = perAddress;
+}
+
+unsigned BroadcastServer::GetCookie(const UdpAddress& address, unsigned window) const
+{
+	return (unsigned)SipHash(secret_, ((unsigned long long)address.ip_ << 16) | address.port_, window);
+}
+
+bool BroadcastServer::IsValidCookie(const UdpAddress& address, unsigned cookie, unsigned now) const
+{
+	// A cookie handed out just before the window changed is still echoed in the next one
+	unsigned window = now / BROADCAST_COOKIE_LIFETIME;
+	return cookie == GetCookie(address, window) || cookie == GetCookie(address, window - 1);
+}
+
+void BroadcastServer::Subscribe(const UdpAddress& address, unsigned now)
+{
+	HashMap<UdpAddress, unsigned>::Iterator i = subscriberIndices_.Find(address);
+	if (i != subscriberIndices_.End())
+	{
+		renewTimes_[i->second_] = now;
+		return;
+	}
+
+	unsigned& addressCount = addressCounts_[address.ip_];
+	if (subscribers_.Size() >= maxSubscribers_ || addressCount >= maxSubscribersPerAddress_)
+	{
+		if (!addressCount)
+			addressCounts_.Erase(address.ip_);
+		++refused_;
+		return;
+	}
+
+	++addressCount;
+	subscriberIndices_[address] = subscribers_.Size();
+	subscribers_.Push(address);
+	renewTimes_.Push(now);
+}
+
+void BroadcastServer::Unsubscribe(unsigned index)
+{
+	HashMap<unsigned, unsigned>::Iterator count = addressCounts_.Find(subscribers_[index].ip_);
+	if (count != addressCounts_.End() && --count->second_ == 0)
+		addressCounts_.Erase(count);
+
+	// Swap with the last one to keep the address array contiguous
+	subscriberIndices_.Erase(subscribers_[index]);
+	unsigned last = subscribers_.Size() - 1;
+	if (index != last)
+	{
+		subscribers_[index] = subscribers_[last];
+		renewTimes_[index] = renewTimes_[last];
+		subscriberIndices_[subscribers_[index]] = index;
+	}
+	subscribers_.Pop();
+	renewTimes_.Pop();
+}
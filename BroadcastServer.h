@@ -0,0 +1,160 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+using namespace Urho3D;
+
+/// Interval in milliseconds at which spectators renew their subscription.
+const unsigned BROADCAST_RENEW_INTERVAL = 1000;
+/// Time in milliseconds after which a subscriber that has not renewed is dropped.
+const unsigned BROADCAST_SUBSCRIBER_TIMEOUT = 5000;
+/// Time in milliseconds a subscription cookie stays valid, at least. Must be longer than the renew interval.
+const unsigned BROADCAST_COOKIE_LIFETIME = 10000;
+/// Size of subscription requests and cookie replies: datagram type and cookie. Requests are padded to the reply size, so
+/// answering a spoofed request never sends more than was received.
+const unsigned BROADCAST_REQUEST_SIZE = 5;
+/// Default most subscribers.
+const unsigned DEFAULT_MAX_SUBSCRIBERS = 10000;
+/// Default most subscribers from one IP address.
+const unsigned DEFAULT_MAX_SUBSCRIBERS_PER_ADDRESS = 8;
+
+/// Write a subscription request or cookie reply. The cookie is 0 before the broadcaster has sent one.
+void WriteBroadcastRequest(unsigned char* dest, unsigned char type, unsigned cookie);
+/// Read the cookie of a subscription request or cookie reply.
+unsigned ReadBroadcastCookie(const unsigned char* source);
+
+/// IPv4 address and port, in host byte order.
+struct UdpAddress
+{
+	/// Construct undefined.
+	UdpAddress() : ip_(0), port_(0) {}
+
+	/// Test for equality.
+	bool operator ==(const UdpAddress& rhs) const { return ip_ == rhs.ip_ && port_ == rhs.port_; }
+	/// Test for inequality.
+	bool operator !=(const UdpAddress& rhs) const { return !(*this == rhs); }
+	/// Return hash value for HashMap.
+	unsigned ToHash() const { return ip_ * 31 + port_; }
+
+	/// IP address.
+	unsigned ip_;
+	/// Port.
+	unsigned short port_;
+};
+
+/// Non-blocking UDP socket.
+class UdpSocket
+{
+public:
+	/// Construct.
+	UdpSocket();
+	/// Destruct. Close the socket.
+	~UdpSocket();
+
+	/// Open and bind to a port, 0 for any free port. Return true on success.
+	bool Open(unsigned short port);
+	/// Close.
+	void Close();
+	/// Set kernel send and receive buffer sizes.
+	void SetBufferSizes(unsigned sendSize, unsigned receiveSize);
+	/// Send a datagram. Return false if it could not be sent without blocking.
+	bool Send(const UdpAddress& to, const void* data, unsigned size);
+	/// Send the same datagram to many addresses, batching system calls where the platform allows. A datagram that fails is
+	/// skipped and the rest are still sent; only when the send buffer stays full is the remainder given up. Return number sent.
+	unsigned SendToAll(const UdpAddress* to, unsigned count, const void* data, unsigned size);
+	/// Receive a datagram. Return its size, or -1 if none is waiting.
+	int Receive(UdpAddress& from, void* data, unsigned maxSize);
+
+	/// Return whether open.
+	bool IsOpen() const;
+	/// Return the bound port.
+	unsigned short GetPort() const { return port_; }
+
+	/// Resolve a host name or dotted address. Return true on success.
+	static bool Resolve(const String& host, unsigned short port, UdpAddress& dest);
+
+private:
+	/// Prevent copy construction.
+	UdpSocket(const UdpSocket& rhs);
+	/// Prevent assignment.
+	UdpSocket& operator =(const UdpSocket& rhs);
+
+	/// Platform socket handle.
+	size_t handle_;
+	/// Bound port.
+	unsigned short port_;
+};
+
+/// Fans a broadcast out to subscribed spectators over UDP. Runs on the calling thread: subscription requests are read and
+/// packets sent with non-blocking, batched calls, so one core serves thousands of subscribers and a full send buffer never stalls the game.
+/// Subscribing takes a cookie round trip: a request without a valid cookie is only answered with one, the same size as the
+/// request, and the stream starts once the cookie is echoed. A spoofed source address never receives the cookie, so it cannot
+/// be subscribed to the stream. The cookie is a keyed hash of the address and a time window, so nothing is stored per request.
+class BroadcastServer
+{
+public:
+	/// Construct.
+	BroadcastServer();
+
+	/// Start listening for subscribers. Return true on success.
+	bool Start(unsigned short port);
+	/// Stop and forget all subscribers.
+	void Stop();
+	/// Read subscription requests and drop subscribers that have not renewed in time.
+	void Update();
+	/// Send a packet to all subscribers. Return number of datagrams sent.
+	unsigned Broadcast(const VectorBuffer& packet);
+	/// Set most subscribers in total and from one IP address. Requests beyond either are ignored.
+	void SetMaxSubscribers(unsigned total, unsigned perAddress);
+
+	/// Return whether started.
+	bool IsStarted() const { return socket_.IsOpen(); }
+	/// Return the listening port.
+	unsigned short GetPort() const { return socket_.GetPort(); }
+	/// Return number of subscribers.
+	unsigned GetNumSubscribers() const { return subscribers_.Size(); }
+	/// Return number of datagrams sent.
+	unsigned long long GetNumSent() const { return sent_; }
+	/// Return number of datagrams dropped because the send buffer was full.
+	unsigned long long GetNumDropped() const { return dropped_; }
+	/// Return number of bytes sent.
+	unsigned long long GetNumBytes() const { return bytes_; }
+	/// Return number of subscription requests refused by the subscriber limits.
+	unsigned GetNumRefused() const { return refused_; }
+
+private:
+	/// Return the cookie of an address for a time window.
+	unsigned GetCookie(const UdpAddress& address, unsigned window) const;
+	/// Return whether a cookie is valid for an address now. Cookies of the previous time window are still accepted.
+	bool IsValidCookie(const UdpAddress& address, unsigned cookie, unsigned now) const;
+	/// Add or renew a subscriber, unless a limit is reached.
+	void Subscribe(const UdpAddress& address, unsigned now);
+	/// Remove a subscriber by index.
+	void Unsubscribe(unsigned index);
+
+	/// Socket.
+	UdpSocket socket_;
+	/// Subscriber addresses, contiguous for batched sends.
+	PODVector<UdpAddress> subscribers_;
+	/// Last subscription request time of each subscriber in system milliseconds.
+	PODVector<unsigned> renewTimes_;
+	/// Subscriber index by address.
+	HashMap<UdpAddress, unsigned> subscriberIndices_;
+	/// Number of subscribers by IP address.
+	HashMap<unsigned, unsigned> addressCounts_;
+	/// Cookie key, chosen at start.
+	unsigned long long secret_[2];
+	/// Most subscribers.
+	unsigned maxSubscribers_;
+	/// Most subscribers from one IP address.
+	unsigned maxSubscribersPerAddress_;
+	/// Subscription requests refused.
+	unsigned refused_;
+	/// Datagrams sent.
+	unsigned long long sent_;
+	/// Datagrams dropped.
+	unsigned long long dropped_;
+	/// Bytes sent.
+	unsigned long long bytes_;
+};
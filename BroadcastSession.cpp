@@ -0,0 +1,210 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "BroadcastSession.h"
+#include "Character.h"
+#include "MetricsExport.h"
+
+/// Largest run packet read by a spectator.
+static const unsigned MAX_PACKET_SIZE = 1024;
+/// Rate at which the spectator runner node follows the decoded position.
+static const float FOLLOW_RATE = 15.0f;
+
+BroadcastSettings::BroadcastSettings() :
+	mode_(BROADCAST_NONE),
+	address_("127.0.0.1"),
+	port_(2346),
+	bot_(false)
+{
+}
+
+bool BroadcastSettings::Parse(const Vector<String>& arguments, BroadcastSettings& settings)
+{
+	for (unsigned i = 0; i < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		if (argument == "-broadcast")
+			settings.mode_ = BROADCAST_SEND;
+		else if (argument == "-spectate" && i + 1 < arguments.Size())
+		{
+			settings.mode_ = BROADCAST_WATCH;
+			settings.address_ = arguments[++i];
+		}
+		else if (argument == "-port" && i + 1 < arguments.Size())
+			settings.port_ = (unsigned short)ToUInt(arguments[++i]);
+		else if (argument == "-bot" || argument == "-headless")
+			settings.bot_ = true;
+	}
+	return settings.mode_ != BROADCAST_NONE;
+}
+
+BroadcastSession::BroadcastSession(Context* context, const BroadcastSettings& settings) :
+	Object(context),
+	settings_(settings),
+	track_(0),
+	shownPosition_(Vector3::ZERO),
+	renewTime_(0),
+	cookie_(0),
+	localButtons_(CTRL_FORWARD),
+	accumulator_(0.0f),
+	packetTimer_(0.0f),
+	seedWarned_(false),
+	sendUSec_(0),
+	packets_(0)
+{
+	runner_.Reset();
+}
+
+BroadcastSession::~BroadcastSession()
+{
+	if (socket_.IsOpen())
+	{
+		unsigned char request[BROADCAST_REQUEST_SIZE];
+		WriteBroadcastRequest(request, BROADCAST_UNSUBSCRIBE, cookie_);
+		socket_.Send(serverAddress_, request, BROADCAST_REQUEST_SIZE);
+	}
+}
+
+bool BroadcastSession::Start(Scene* scene, const TrackLayout* track)
+{
+	track_ = track;
+	runnerNode_ = RunnerSim::CreateNode(scene, "Runner");
+
+	if (settings_.mode_ == BROADCAST_SEND)
+	{
+		if (!server_.Start(settings_.port_))
+			return false;
+		encoder_.Begin(track_->GetSeed());
+	}
+	else
+	{
+		if (!UdpSocket::Resolve(settings_.address_, settings_.port_, serverAddress_) || !socket_.Open(0))
+		{
+			URHO3D_LOGERROR("Could not spectate broadcast at " + settings_.address_);
+			return false;
+		}
+		URHO3D_LOGINFO(ToString("Spectating broadcast at %s:%u", settings_.address_.CString(), settings_.port_));
+	}
+
+	SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(BroadcastSession, HandleUpdate));
+	SubscribeToEvent(E_COLLECTMETRICS, URHO3D_HANDLER(BroadcastSession, HandleCollectMetrics));
+	return true;
+}
+
+void BroadcastSession::UpdateBroadcaster(float timeStep)
+{
+	accumulator_ = Min(accumulator_ + timeStep, 5 * SIM_TIMESTEP);
+	while (accumulator_ >= SIM_TIMESTEP)
+	{
+		unsigned step = encoder_.GetNumSteps();
+		unsigned char buttons = (unsigned char)(settings_.bot_ ? RunnerSim::GetBotButtons(step, 0) : localButtons_);
+		encoder_.AddStep(runner_, buttons);
+		RunnerSim::Step(runner_, buttons, *track_);
+		accumulator_ -= SIM_TIMESTEP;
+	}
+
+	if (runnerNode_)
+		RunnerSim::PlaceNode(runnerNode_, runner_.position_, track_->GetSpline());
+
+	packetTimer_ -= timeStep;
+	if (packetTimer_ > 0.0f)
+		return;
+	packetTimer_ += 1.0f / BROADCAST_PACKET_RATE;
+	packetTimer_ = Max(packetTimer_, 0.0f);
+
+	// Encode once, fan out the same bytes to everyone
+	HiresTimer timer;
+	server_.Update();
+	encoder_.WritePacket(packet_);
+	server_.Broadcast(packet_);
+	sendUSec_ += timer.GetUSec(false);
+	++packets_;
+}
+
+void BroadcastSession::UpdateSpectator(float timeStep)
+{
+	unsigned now = Time::GetSystemTime();
+	unsigned char request[BROADCAST_REQUEST_SIZE];
+	if (!renewTime_ || now - renewTime_ >= BROADCAST_RENEW_INTERVAL)
+	{
+		WriteBroadcastRequest(request, BROADCAST_SUBSCRIBE, cookie_);
+		socket_.Send(serverAddress_, request, BROADCAST_REQUEST_SIZE);
+		renewTime_ = now;
+	}
+
+	unsigned char data[MAX_PACKET_SIZE];
+	UdpAddress from;
+	int size;
+	while ((size = socket_.Receive(from, data, MAX_PACKET_SIZE)) > 0)
+	{
+		if (from != serverAddress_)
+			continue;
+		if (data[0] == BROADCAST_COOKIE && size == (int)BROADCAST_REQUEST_SIZE)
+		{
+			// Echo it right away, the stream starts once the broadcaster has it back
+			cookie_ = ReadBroadcastCookie(data);
+			WriteBroadcastRequest(request, BROADCAST_SUBSCRIBE, cookie_);
+			socket_.Send(serverAddress_, request, BROADCAST_REQUEST_SIZE);
+			continue;
+		}
+		MemoryBuffer packet(data, (unsigned)size);
+		decoder_.ReadPacket(packet);
+	}
+
+	if (!decoder_.HasRun())
+		return;
+
+	if (!seedWarned_ && decoder_.GetTrack().GetSeed() != track_->GetSeed())
+	{
+		URHO3D_LOGERROR(ToString("Broadcast seed %u differs from the local track %u. Start the spectator with -seed %u",
+			decoder_.GetTrack().GetSeed(), track_->GetSeed(), decoder_.GetTrack().GetSeed()));
+		seedWarned_ = true;
+	}
+
+	// Packets arrive in bursts of several steps, so follow the decoded position smoothly
+	shownPosition_ = shownPosition_.Lerp(decoder_.GetState().position_, Min(timeStep * FOLLOW_RATE, 1.0f));
+	if (runnerNode_)
+		RunnerSim::PlaceNode(runnerNode_, shownPosition_, track_->GetSpline());
+}
+
+void BroadcastSession::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+	using namespace Update;
+
+	float timeStep = eventData[P_TIMESTEP].GetFloat();
+	if (settings_.mode_ == BROADCAST_SEND)
+		UpdateBroadcaster(timeStep);
+	else
+		UpdateSpectator(timeStep);
+}
+
+void BroadcastSession::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& broadcast = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["broadcast"];
+	if (settings_.mode_ == BROADCAST_SEND)
+	{
+		broadcast["mode"] = "broadcast";
+		broadcast["steps"] = encoder_.GetNumSteps();
+		broadcast["packets"] = packets_;
+		broadcast["subscribers"] = server_.GetNumSubscribers();
+		broadcast["refusedSubscriptions"] = server_.GetNumRefused();
+		broadcast["datagramsSent"] = (double)server_.GetNumSent();
+		broadcast["datagramsDropped"] = (double)server_.GetNumDropped();
+		broadcast["bytesSent"] = (double)server_.GetNumBytes();
+		broadcast["sendUsPerPacket"] = packets_ ? (float)sendUSec_ / packets_ : 0.0f;
+	}
+	else
+	{
+		broadcast["mode"] = "spectate";
+		broadcast["steps"] = decoder_.GetStep();
+		broadcast["packets"] = decoder_.GetNumPackets();
+		broadcast["resyncs"] = decoder_.GetNumResyncs();
+		broadcast["desyncs"] = decoder_.GetNumDesyncs();
+	}
+}
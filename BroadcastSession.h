@@ -0,0 +1,117 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "BroadcastServer.h"
+#include "BroadcastStream.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Node;
+	class Scene;
+}
+
+/// Broadcast mode.
+enum BroadcastMode
+{
+	BROADCAST_NONE = 0,
+	BROADCAST_SEND,
+	BROADCAST_WATCH
+};
+
+/// Packets sent per second.
+const unsigned BROADCAST_PACKET_RATE = 20;
+
+/// Broadcast settings from the command line.
+struct BroadcastSettings
+{
+	/// Construct with defaults.
+	BroadcastSettings();
+
+	/// Parse -broadcast, -spectate <address> and -port. Return true if a broadcast mode was requested.
+	static bool Parse(const Vector<String>& arguments, BroadcastSettings& settings);
+
+	/// Mode.
+	BroadcastMode mode_;
+	/// Broadcaster address when spectating.
+	String address_;
+	/// UDP port.
+	unsigned short port_;
+	/// Drive the runner with a deterministic bot instead of the keyboard.
+	bool bot_;
+};
+
+/// Live run broadcast. The broadcaster runs the deterministic runner simulation and streams the seed, the inputs and periodic keyframes
+/// to any number of spectators; spectators decode the stream and simulate the run locally instead of receiving scene replication.
+class BroadcastSession : public Object
+{
+	URHO3D_OBJECT(BroadcastSession, Object);
+
+public:
+	/// Construct.
+	BroadcastSession(Context* context, const BroadcastSettings& settings);
+	/// Destruct.
+	~BroadcastSession();
+
+	/// Create the runner node and start broadcasting or spectating. Return true on success.
+	bool Start(Scene* scene, const TrackLayout* track);
+	/// Set local control buttons for the following steps.
+	void SetLocalButtons(unsigned buttons) { localButtons_ = buttons; }
+
+	/// Return the runner node.
+	Node* GetRunner() const { return runnerNode_; }
+	/// Return the latest runner state.
+	const RunnerState& GetRunnerState() const { return settings_.mode_ == BROADCAST_WATCH ? decoder_.GetState() : runner_; }
+
+private:
+	/// Advance the run and send packets.
+	void UpdateBroadcaster(float timeStep);
+	/// Renew the subscription and read packets.
+	void UpdateSpectator(float timeStep);
+
+	/// Handle frame update.
+	void HandleUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Settings.
+	BroadcastSettings settings_;
+	/// Track.
+	const TrackLayout* track_;
+	/// Runner node.
+	WeakPtr<Node> runnerNode_;
+	/// Runner state on the broadcaster.
+	RunnerState runner_;
+	/// Encoder on the broadcaster.
+	BroadcastEncoder encoder_;
+	/// Fan-out server on the broadcaster.
+	BroadcastServer server_;
+	/// Packet buffer.
+	VectorBuffer packet_;
+	/// Decoder on a spectator.
+	BroadcastDecoder decoder_;
+	/// Socket on a spectator.
+	UdpSocket socket_;
+	/// Broadcaster address on a spectator.
+	UdpAddress serverAddress_;
+	/// Displayed track space position on a spectator.
+	Vector3 shownPosition_;
+	/// Last subscription renewal time on a spectator.
+	unsigned renewTime_;
+	/// Subscription cookie from the broadcaster on a spectator, 0 before one has been received.
+	unsigned cookie_;
+	/// Local control buttons.
+	unsigned localButtons_;
+	/// Unsimulated time.
+	float accumulator_;
+	/// Time until the next packet.
+	float packetTimer_;
+	/// Seed mismatch has been reported.
+	bool seedWarned_;
+	/// Time spent in fan-out.
+	long long sendUSec_;
+	/// Packets produced.
+	unsigned packets_;
+};
@@ -0,0 +1,159 @@
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+
+#include "BroadcastStream.h"
+
+void WriteRunnerState(Serializer& dest, const RunnerState& state)
+{
+	dest.WriteVector3(state.position_);
+	dest.WriteVector3(state.velocity_);
+	dest.WriteFloat(state.inAirTimer_);
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		dest.WriteUInt(state.collected_[i]);
+	dest.WriteVLE(state.score_);
+	dest.WriteVLE(state.crashes_);
+	dest.WriteUByte((unsigned char)((state.onGround_ ? 1 : 0) | (state.okToJump_ ? 2 : 0)));
+}
+
+RunnerState ReadRunnerState(Deserializer& source)
+{
+	RunnerState state;
+	state.position_ = source.ReadVector3();
+	state.velocity_ = source.ReadVector3();
+	state.inAirTimer_ = source.ReadFloat();
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		state.collected_[i] = source.ReadUInt();
+	state.score_ = source.ReadVLE();
+	state.crashes_ = source.ReadVLE();
+	unsigned char flags = source.ReadUByte();
+	state.onGround_ = (flags & 1) != 0;
+	state.okToJump_ = (flags & 2) != 0;
+	return state;
+}
+
+BroadcastEncoder::BroadcastEncoder() :
+	seed_(0),
+	step_(0),
+	keyframeStep_(0)
+{
+	keyframe_.Reset();
+}
+
+void BroadcastEncoder::Begin(unsigned seed)
+{
+	seed_ = seed;
+	step_ = 0;
+	keyframeStep_ = 0;
+	keyframe_.Reset();
+	inputs_.Clear();
+}
+
+void BroadcastEncoder::AddStep(const RunnerState& state, unsigned char buttons)
+{
+	if (step_ % BROADCAST_KEYFRAME_INTERVAL == 0)
+	{
+		keyframeStep_ = step_;
+		keyframe_ = state;
+		inputs_.Clear();
+	}
+
+	inputs_.Push(buttons);
+	++step_;
+}
+
+void BroadcastEncoder::WritePacket(VectorBuffer& dest) const
+{
+	dest.Clear();
+	dest.WriteUByte(BROADCAST_RUN);
+	dest.WriteUInt(seed_);
+	dest.WriteUInt(keyframeStep_);
+	WriteRunnerState(dest, keyframe_);
+	dest.WriteVLE(inputs_.Size());
+	if (inputs_.Size())
+		dest.Write(&inputs_[0], inputs_.Size());
+}
+
+BroadcastDecoder::BroadcastDecoder() :
+	step_(0),
+	checkStep_(0),
+	checkChecksum_(0),
+	started_(false),
+	packets_(0),
+	resyncs_(0),
+	desyncs_(0)
+{
+	state_.Reset();
+}
+
+bool BroadcastDecoder::ReadPacket(Deserializer& source)
+{
+	if (source.ReadUByte() != BROADCAST_RUN)
+		return false;
+
+	unsigned seed = source.ReadUInt();
+	unsigned keyframeStep = source.ReadUInt();
+	RunnerState keyframe = ReadRunnerState(source);
+	unsigned count = source.ReadVLE();
+	// One byte per step, and a broadcaster sends a keyframe at least every interval
+	if (count > source.GetSize() - source.GetPosition() || count > BROADCAST_KEYFRAME_INTERVAL)
+		return false;
+	++packets_;
+
+	bool resync = false;
+	if (!started_ || seed != track_.GetSeed())
+	{
+		if (seed != track_.GetSeed() || !track_.GetItems().Size())
+		{
+			// The runner simulation works in track space, the center line is only needed for display
+			track_.Generate(seed, 30, 30, false);
+		}
+		resync = true;
+	}
+	else if (keyframeStep + count + BROADCAST_KEYFRAME_INTERVAL < step_)
+	{
+		// The broadcaster started a new run on the same track
+		resync = true;
+	}
+	else if (keyframeStep + count <= step_)
+	{
+		// Late or duplicate packet, nothing new in it
+		return true;
+	}
+	else if (keyframeStep > step_)
+	{
+		// Inputs between the local step and the keyframe were lost
+		++resyncs_;
+		resync = true;
+	}
+	else if (checkStep_ == keyframeStep && checkChecksum_ != keyframe.GetChecksum())
+	{
+		++desyncs_;
+		resync = true;
+	}
+
+	if (resync)
+	{
+		state_ = keyframe;
+		step_ = keyframeStep;
+		checkStep_ = keyframeStep;
+		checkChecksum_ = keyframe.GetChecksum();
+		started_ = true;
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned char buttons = source.ReadUByte();
+		if (keyframeStep + i < step_)
+			continue;
+
+		// Remember the local state at keyframe steps so that the broadcast keyframe can verify it
+		if (step_ % BROADCAST_KEYFRAME_INTERVAL == 0)
+		{
+			checkStep_ = step_;
+			checkChecksum_ = state_.GetChecksum();
+		}
+		RunnerSim::Step(state_, buttons, track_);
+		++step_;
+	}
+	return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Urho3D/IO/VectorBuffer.h>
+
+#include "RunnerSim.h"
+
+using namespace Urho3D;
+
+/// Datagram type: run packet from the broadcaster.
+const unsigned char BROADCAST_RUN = 'R';
+/// Datagram type: subscribe or keep alive, from a spectator.
+const unsigned char BROADCAST_SUBSCRIBE = 'S';
+/// Datagram type: unsubscribe, from a spectator.
+const unsigned char BROADCAST_UNSUBSCRIBE = 'U';
+/// Datagram type: subscription cookie to echo, from the broadcaster.
+const unsigned char BROADCAST_COOKIE = 'C';
+/// Steps between keyframes.
+const unsigned BROADCAST_KEYFRAME_INTERVAL = 60;
+
+/// Write a runner state.
+void WriteRunnerState(Serializer& dest, const RunnerState& state);
+/// Read a runner state.
+RunnerState ReadRunnerState(Deserializer& source);
+
+/// Encodes a run as the track seed, the input of every step and periodic keyframes of the runner state.
+/// Every packet carries the latest keyframe and all inputs since, so any single packet is enough to join or to recover from loss.
+class BroadcastEncoder
+{
+public:
+	/// Construct.
+	BroadcastEncoder();
+
+	/// Begin a run.
+	void Begin(unsigned seed);
+	/// Record the input of the next step. The state is the runner state before the step.
+	void AddStep(const RunnerState& state, unsigned char buttons);
+	/// Write a packet with the latest keyframe and the inputs since it.
+	void WritePacket(VectorBuffer& dest) const;
+
+	/// Return number of recorded steps.
+	unsigned GetNumSteps() const { return step_; }
+
+private:
+	/// Track seed.
+	unsigned seed_;
+	/// Number of recorded steps.
+	unsigned step_;
+	/// Step of the latest keyframe.
+	unsigned keyframeStep_;
+	/// Runner state before the keyframe step.
+	RunnerState keyframe_;
+	/// Inputs from the keyframe step on.
+	PODVector<unsigned char> inputs_;
+};
+
+/// Decodes run packets and simulates the run locally.
+class BroadcastDecoder
+{
+public:
+	/// Construct.
+	BroadcastDecoder();
+
+	/// Read a run packet and simulate up to its last step. Return false if the packet is not a run packet.
+	bool ReadPacket(Deserializer& source);
+
+	/// Return whether a run has been received.
+	bool HasRun() const { return started_; }
+	/// Return the track generated from the broadcast seed.
+	const TrackLayout& GetTrack() const { return track_; }
+	/// Return the simulated runner state.
+	const RunnerState& GetState() const { return state_; }
+	/// Return number of simulated steps.
+	unsigned GetStep() const { return step_; }
+	/// Return number of packets read.
+	unsigned GetNumPackets() const { return packets_; }
+	/// Return number of times the simulation jumped to a keyframe after missing inputs.
+	unsigned GetNumResyncs() const { return resyncs_; }
+	/// Return number of keyframes that did not match the local simulation.
+	unsigned GetNumDesyncs() const { return desyncs_; }
+
+private:
+	/// Track.
+	TrackLayout track_;
+	/// Runner state.
+	RunnerState state_;
+	/// Number of simulated steps.
+	unsigned step_;
+	/// Latest keyframe step reached by the local simulation.
+	unsigned checkStep_;
+	/// Checksum of the local state at checkStep_.
+	unsigned checkChecksum_;
+	/// Run received flag.
+	bool started_;
+	/// Packets read.
+	unsigned packets_;
+	/// Resyncs.
+	unsigned resyncs_;
+	/// Desyncs.
+	unsigned desyncs_;
+};
@@ -0,0 +1,68 @@
+#ifdef LOOKUP_STATS
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Engine/EngineEvents.h>
+#include <Urho3D/IO/Log.h>
+
+#include "CachedHandle.h"
+#include "EventStats.h"
+#include "MetricsExport.h"
+
+unsigned HandleStats::accesses = 0;
+unsigned HandleStats::resolves = 0;
+
+HandleStats::HandleStats(Context* context) :
+	Object(context),
+	frameAccesses_(0),
+	frameResolves_(0),
+	totalAccesses_(0),
+	totalResolves_(0),
+	frames_(0)
+{
+	SubscribeToEvent(E_ENDFRAME, GAME_HANDLER(HandleStats, HandleEndFrame));
+	SubscribeToEvent(E_CONSOLECOMMAND, GAME_HANDLER(HandleStats, HandleConsoleCommand));
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(HandleStats, HandleCollectMetrics));
+}
+
+void HandleStats::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	frameAccesses_ = accesses;
+	frameResolves_ = resolves;
+	totalAccesses_ += accesses;
+	totalResolves_ += resolves;
+	accesses = 0;
+	resolves = 0;
+	++frames_;
+}
+
+void HandleStats::HandleConsoleCommand(StringHash eventType, VariantMap& eventData)
+{
+	using namespace ConsoleCommand;
+
+	if (eventData[P_ID].GetString() != GetTypeName())
+		return;
+
+	// handles
+	if (eventData[P_COMMAND].GetString().Trimmed() != "handles")
+	{
+		URHO3D_LOGINFO("Usage: handles");
+		return;
+	}
+	float frames = (float)Max(frames_, 1U);
+	URHO3D_LOGINFO(ToString("Lookups per frame: %u uncached, %u cached (average %.2f uncached, %.4f cached over %u frames)",
+		frameAccesses_, frameResolves_, totalAccesses_ / frames, totalResolves_ / frames, frames_));
+}
+
+void HandleStats::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& handles = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["handles"];
+	float frames = (float)Max(frames_, 1U);
+	handles["frames"] = frames_;
+	handles["uncachedLookupsPerFrame"] = totalAccesses_ / frames;
+	handles["cachedLookupsPerFrame"] = totalResolves_ / frames;
+	handles["cachedLookups"] = (double)totalResolves_;
+}
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Scene/Component.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+
+#ifdef LOOKUP_STATS
+
+/// Counts handle accesses and the lookups they actually perform. Every access stands for a lookup the code did before it was
+/// cached, so the two per-frame counts are the lookup cost before and after.
+class HandleStats : public Object
+{
+	URHO3D_OBJECT(HandleStats, Object);
+
+public:
+	/// Construct.
+	HandleStats(Context* context);
+
+	/// Return accesses in the last frame.
+	unsigned GetFrameAccesses() const { return frameAccesses_; }
+	/// Return lookups in the last frame.
+	unsigned GetFrameResolves() const { return frameResolves_; }
+
+	/// Accesses in the frame in progress.
+	static unsigned accesses;
+	/// Lookups in the frame in progress.
+	static unsigned resolves;
+
+private:
+	/// Handle end of frame.
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle console command.
+	void HandleConsoleCommand(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Accesses in the last frame.
+	unsigned frameAccesses_;
+	/// Lookups in the last frame.
+	unsigned frameResolves_;
+	/// Accesses in all frames.
+	unsigned long long totalAccesses_;
+	/// Lookups in all frames.
+	unsigned long long totalResolves_;
+	/// Frames counted.
+	unsigned frames_;
+};
+
+#define HANDLE_ACCESS() ++HandleStats::accesses
+#define HANDLE_RESOLVE() ++HandleStats::resolves
+
+#else
+
+#define HANDLE_ACCESS()
+#define HANDLE_RESOLVE()
+
+#endif
+
+/// Subsystem looked up on first use. Access is a weak pointer check, and a removed subsystem is looked up again.
+template <class T> class SubsystemHandle
+{
+public:
+	/// Construct for the owner's context.
+	explicit SubsystemHandle(Context* context) :
+		context_(context)
+	{
+	}
+
+	/// Return the subsystem, or null if it does not exist.
+	T* Get()
+	{
+		HANDLE_ACCESS();
+		if (ptr_.Expired())
+		{
+			HANDLE_RESOLVE();
+			ptr_ = static_cast<T*>(context_->GetSubsystem(T::GetTypeStatic()));
+		}
+		return ptr_.Get();
+	}
+	/// Return the subsystem.
+	T* operator ->() { return Get(); }
+	/// Convert to a raw pointer.
+	operator T*() { return Get(); }
+
+private:
+	/// Context.
+	Context* context_;
+	/// Cached subsystem.
+	WeakPtr<T> ptr_;
+};
+
+/// Component of a node looked up on first use. The cached component is dropped when it is destroyed or removed from the node, or
+/// when asked for with a different node, as after a scene load or a scene swap, and then looked up again.
+template <class T> class ComponentHandle
+{
+public:
+	/// Return the component of a node, or null if it has none.
+	T* Get(Node* node)
+	{
+		HANDLE_ACCESS();
+		T* component = ptr_.Get();
+		if (!component || component->GetNode() != node)
+		{
+			HANDLE_RESOLVE();
+			component = node ? node->GetComponent<T>() : 0;
+			ptr_ = component;
+		}
+		return component;
+	}
+	/// Forget the cached component.
+	void Reset() { ptr_.Reset(); }
+
+private:
+	/// Cached component.
+	WeakPtr<T> ptr_;
+};
@@ -14,17 +14,28 @@
 #include <Urho3D/UI/Window.h>
 
 #include "Character.h"
+#include "EventStats.h"
+#include "ResourceProfiler.h"
 
 Character::Character(Context* context) :
 	LogicComponent(context),
 	onGround_(false),
 	okToJump_(true),
-	inAirTimer_(0.0f)
+	inAirTimer_(0.0f),
+	ui_(context),
+	profiler_(context)
 {
 	// Only the physics update event is needed: unsubscribe from the rest for optimization
 	SetUpdateEventMask(USE_FIXEDUPDATE);
 }
 
+Character::~Character()
+{
+	// The text lives in the UI root, so it has to go with the character, as on a scene load
+	if (positionText_)
+		positionText_->Remove();
+}
+
 void Character::RegisterObject(Context* context)
 {
 	context->RegisterFactory<Character>();
@@ -44,39 +55,50 @@ void Character::RegisterObject(Context* context)
 void Character::Start()
 {
 	// Component has been inserted into its scene node. Subscribe to events now
-	SubscribeToEvent(GetNode(), E_NODECOLLISION, URHO3D_HANDLER(Character, HandleNodeCollision));
+	SubscribeToEvent(GetNode(), E_NODECOLLISION, GAME_HANDLER(Character, HandleNodeCollision));
+}
+
+void Character::SetGroundState(bool onGround, bool okToJump, float inAirTimer)
+{
+	onGround_ = onGround;
+	okToJump_ = okToJump;
+	inAirTimer_ = inAirTimer;
 }
 
 void Character::FixedUpdate(float timeStep)
 {
-	RigidBody* body = GetComponent<RigidBody>();
+	RigidBody* body = body_.Get(node_);
+	AnimationController* animCtrl = animCtrl_.Get(node_);
+	if (!body || !animCtrl)
+		return;
 
 	/////////////////////////////
-	ResourceCache* cache = GetSubsystem<ResourceCache>();
-	UI* ui = GetSubsystem<UI>();
+	ResourceProfiler* profiler = profiler_;
+	// Attribute animations loaded by the animation controller to this function
+	ResourceCallSite callSite(profiler, "Character::FixedUpdate");
+	UI* ui = ui_;
+
+	// Construct the position text once, set string to display and font to use
+	Text* instructionText = positionText_;
+	if (!instructionText)
+	{
+		instructionText = ui->GetRoot()->CreateChild<Text>();
+		instructionText->SetFont(profiler->GetResource<Font>("Fonts/Anonymous Pro.ttf", __FUNCTION__), 15);
+		// The text has multiple rows. Center them in relation to each other
+		instructionText->SetTextAlignment(HA_CENTER);
 
-	// Construct new Text object, set string to display and font to use
-	Text* instructionText = ui->GetRoot()->CreateChild<Text>();
+		// Position the text relative to the screen center
+		instructionText->SetHorizontalAlignment(HA_CENTER);
+		instructionText->SetVerticalAlignment(VA_CENTER);
+		positionText_ = instructionText;
+	}
 	
 	instructionText->SetText(
 		body->GetPosition().ToString()
 	);
-
-	
-	instructionText->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 15);
-	// The text has multiple rows. Center them in relation to each other
-	instructionText->SetTextAlignment(HA_CENTER);
-
-	// Position the text relative to the screen center
-	instructionText->SetHorizontalAlignment(HA_CENTER);
-	instructionText->SetVerticalAlignment(VA_CENTER);
 	instructionText->SetPosition(0, ui->GetRoot()->GetHeight() / 4);
 	////////////////////////////////
 
-	/// \todo Could cache the components for faster access instead of finding them each frame
-	
-	AnimationController* animCtrl = GetComponent<AnimationController>();
-
 	// Update the in air timer. Reset if grounded
 	if (!onGround_)
 		inAirTimer_ += timeStep;
@@ -224,6 +246,10 @@ void Character::HandleNodeCollision(StringHash eventType, VariantMap& eventData)
 	// Check collision contacts and see if character is standing on ground (look for a contact that has near vertical normal)
 	using namespace NodeCollision;
 
+	// Pickups are triggers, standing in one is not standing on ground
+	if (eventData[P_TRIGGER].GetBool())
+		return;
+
 	MemoryBuffer contacts(eventData[P_CONTACTS].GetBuffer());
 
 	while (!contacts.IsEof())
@@ -3,8 +3,20 @@
 #include <Urho3D/Input/Controls.h>
 #include <Urho3D/Scene/LogicComponent.h>
 
+#include "CachedHandle.h"
+
 using namespace Urho3D;
 
+namespace Urho3D
+{
+	class AnimationController;
+	class RigidBody;
+	class Text;
+	class UI;
+}
+
+class ResourceProfiler;
+
 const int CTRL_FORWARD = 1;
 const int CTRL_BACK = 2;
 const int CTRL_LEFT = 4;
@@ -28,6 +40,8 @@ class Character : public LogicComponent
 public:
 	/// Construct.
 	Character(Context* context);
+	/// Destruct.
+	~Character();
 
 	/// Register object factory and attributes.
 	static void RegisterObject(Context* context);
@@ -37,6 +51,16 @@ public:
 	/// Handle physics world update. Called by LogicComponent base class.
 	virtual void FixedUpdate(float timeStep);
 
+	/// Restore the grounding state, e.g. from a run save.
+	void SetGroundState(bool onGround, bool okToJump, float inAirTimer);
+
+	/// Return whether grounded on the last physics step.
+	bool IsOnGround() const { return onGround_; }
+	/// Return whether a jump is allowed.
+	bool IsOkToJump() const { return okToJump_; }
+	/// Return time off the ground.
+	float GetInAirTimer() const { return inAirTimer_; }
+
 	/// Movement controls. Assigned by the main program each frame.
 	Controls controls_;
 
@@ -55,4 +79,15 @@ private:
 	bool onMiddleLane_;
 	bool onRightLane_;
 
+	/// Rigid body.
+	ComponentHandle<RigidBody> body_;
+	/// Animation controller.
+	ComponentHandle<AnimationController> animCtrl_;
+	/// UI subsystem.
+	SubsystemHandle<UI> ui_;
+	/// Resource profiler subsystem.
+	SubsystemHandle<ResourceProfiler> profiler_;
+	/// Position text, created on the first update.
+	WeakPtr<Text> positionText_;
+
 };
@@ -0,0 +1,66 @@
+#include <Urho3D/Physics/RigidBody.h>
+
+#include "CollisionMatrix.h"
+
+/// Collision layer description.
+struct CollisionLayerDesc
+{
+	/// Query layers bodies on this layer also belong to.
+	unsigned alsoIn_;
+	/// Reports overlaps without contact response.
+	bool trigger_;
+};
+
+/// Layer descriptions. Walls and the floor keep the camera out; obstacles do not, so that the camera does not jump forward
+/// whenever the runner passes one.
+static const CollisionLayerDesc collisionLayers[MAX_COLLISION_LAYERS] =
+{
+	{ 0, false },							// Runner
+	{ 0, false },							// Obstacle
+	{ 0, true },							// Pickup
+	{ COLLISION_CAMERA_BLOCKER, false },	// Wall
+	{ COLLISION_CAMERA_BLOCKER, false },	// Floor
+	{ 0, false }							// Camera blocker
+};
+
+/// Layer pairs that collide. Everything else passes through; static track content only ever meets the runner, and the camera
+/// blocker layer is only raycast against.
+static const CollisionLayer collisionPairs[][2] =
+{
+	{ LAYER_RUNNER, LAYER_OBSTACLE },
+	{ LAYER_RUNNER, LAYER_PICKUP },
+	{ LAYER_RUNNER, LAYER_WALL },
+	{ LAYER_RUNNER, LAYER_FLOOR }
+};
+
+unsigned GetCollisionLayerBits(CollisionLayer layer)
+{
+	return layer < MAX_COLLISION_LAYERS ? (1u << layer) | collisionLayers[layer].alsoIn_ : 0;
+}
+
+unsigned GetCollisionMask(CollisionLayer layer)
+{
+	unsigned mask = 0;
+	for (unsigned i = 0; i < sizeof collisionPairs / sizeof collisionPairs[0]; ++i)
+	{
+		if (collisionPairs[i][0] == layer)
+			mask |= 1u << collisionPairs[i][1];
+		if (collisionPairs[i][1] == layer)
+			mask |= 1u << collisionPairs[i][0];
+	}
+	return mask;
+}
+
+bool IsTriggerLayer(CollisionLayer layer)
+{
+	return layer < MAX_COLLISION_LAYERS && collisionLayers[layer].trigger_;
+}
+
+void ApplyCollisionLayer(RigidBody* body, CollisionLayer layer)
+{
+	if (!body)
+		return;
+
+	body->SetCollisionLayerAndMask(GetCollisionLayerBits(layer), GetCollisionMask(layer));
+	body->SetTrigger(IsTriggerLayer(layer));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+namespace Urho3D
+{
+	class RigidBody;
+}
+
+using namespace Urho3D;
+
+/// Named collision layer. Each has its own bit in the collision layer and mask of a rigid body.
+enum CollisionLayer
+{
+	LAYER_RUNNER = 0,
+	LAYER_OBSTACLE,
+	LAYER_PICKUP,
+	LAYER_WALL,
+	LAYER_FLOOR,
+	LAYER_CAMERA_BLOCKER,
+	MAX_COLLISION_LAYERS
+};
+
+/// Runner layer bit.
+const unsigned COLLISION_RUNNER = 1 << LAYER_RUNNER;
+/// Solid obstacle layer bit.
+const unsigned COLLISION_OBSTACLE = 1 << LAYER_OBSTACLE;
+/// Pickup layer bit.
+const unsigned COLLISION_PICKUP = 1 << LAYER_PICKUP;
+/// Wall layer bit.
+const unsigned COLLISION_WALL = 1 << LAYER_WALL;
+/// Floor layer bit.
+const unsigned COLLISION_FLOOR = 1 << LAYER_FLOOR;
+/// Camera blocker layer bit, for the camera raycast.
+const unsigned COLLISION_CAMERA_BLOCKER = 1 << LAYER_CAMERA_BLOCKER;
+
+/// Return the collision layer bits a body on the layer gets, including query layers it also belongs to.
+unsigned GetCollisionLayerBits(CollisionLayer layer);
+/// Return the collision mask of a body on the layer.
+unsigned GetCollisionMask(CollisionLayer layer);
+/// Return whether bodies on the layer are triggers.
+bool IsTriggerLayer(CollisionLayer layer);
+/// Set collision layer, mask and trigger mode of a body from the collision matrix.
+void ApplyCollisionLayer(RigidBody* body, CollisionLayer layer);
@@ -0,0 +1,231 @@
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Graphics/Drawable.h>
+#include <Urho3D/Math/Frustum.h>
+
+#include "CorridorIndex.h"
+
+static inline bool CompareRayQueryResults(const RayQueryResult& lhs, const RayQueryResult& rhs)
+{
+	return lhs.distance_ < rhs.distance_;
+}
+
+CorridorIndex::CorridorIndex(float bucketLength, unsigned numBuckets) :
+	bucketLength_(Max(bucketLength, 1.0f)),
+	origin_(0),
+	ringStart_(0)
+{
+	buckets_.Resize(Max(numBuckets, 1U));
+}
+
+void CorridorIndex::Clear()
+{
+	for (unsigned i = 0; i < buckets_.Size(); ++i)
+		ClearBucket(buckets_[i]);
+	locations_.Clear();
+	pending_.Clear();
+	pendingLocations_.Clear();
+	origin_ = 0;
+	ringStart_ = 0;
+}
+
+bool CorridorIndex::Insert(Drawable* drawable, float distance)
+{
+	if (!drawable)
+		return false;
+
+	int segment = GetSegment(distance);
+	if (segment < origin_)
+		return false;
+
+	if (segment < origin_ + (int)buckets_.Size())
+		AddToBucket(drawable, segment);
+	else
+		AddPending(drawable, segment);
+	return true;
+}
+
+void CorridorIndex::Remove(Drawable* drawable)
+{
+	RemoveDrawable(drawable);
+}
+
+bool CorridorIndex::Move(Drawable* drawable, float distance)
+{
+	RemoveDrawable(drawable);
+	return Insert(drawable, distance);
+}
+
+void CorridorIndex::SetOrigin(float distance)
+{
+	int segment = GetSegment(distance);
+	if (segment <= origin_)
+		return;
+
+	// Buckets the runner has passed become the buckets at the far end of the ring
+	int oldEnd = origin_ + (int)buckets_.Size();
+	unsigned steps = (unsigned)(segment - origin_);
+	if (steps >= buckets_.Size())
+	{
+		for (unsigned i = 0; i < buckets_.Size(); ++i)
+			ClearBucket(buckets_[i]);
+		ringStart_ = 0;
+	}
+	else
+	{
+		for (unsigned i = 0; i < steps; ++i)
+		{
+			ClearBucket(buckets_[ringStart_]);
+			ringStart_ = (ringStart_ + 1) % buckets_.Size();
+		}
+	}
+	origin_ = segment;
+	TakePending(oldEnd);
+}
+
+void CorridorIndex::GetDrawables(PODVector<Drawable*>& result, const Frustum& frustum, unsigned char drawableFlags,
+	unsigned viewMask) const
+{
+	for (unsigned i = 0; i < buckets_.Size(); ++i)
+	{
+		const Bucket& bucket = buckets_[i];
+		if (bucket.drawables_.Empty())
+			continue;
+		Intersection bucketResult = frustum.IsInsideFast(bucket.box_);
+		if (bucketResult == OUTSIDE)
+			continue;
+
+		for (unsigned j = 0; j < bucket.drawables_.Size(); ++j)
+		{
+			Drawable* drawable = bucket.drawables_[j];
+			if (!(drawable->GetDrawableFlags() & drawableFlags) || !(drawable->GetViewMask() & viewMask))
+				continue;
+			if (bucketResult == INSIDE || frustum.IsInsideFast(drawable->GetWorldBoundingBox()) != OUTSIDE)
+				result.Push(drawable);
+		}
+	}
+}
+
+void CorridorIndex::Raycast(PODVector<RayQueryResult>& result, const Ray& ray, RayQueryLevel level, float maxDistance,
+	unsigned char drawableFlags, unsigned viewMask) const
+{
+	RayOctreeQuery query(result, ray, level, maxDistance, drawableFlags, viewMask);
+	for (unsigned i = 0; i < buckets_.Size(); ++i)
+	{
+		const Bucket& bucket = buckets_[i];
+		if (bucket.drawables_.Empty() || ray.HitDistance(bucket.box_) >= maxDistance)
+			continue;
+
+		for (unsigned j = 0; j < bucket.drawables_.Size(); ++j)
+		{
+			Drawable* drawable = bucket.drawables_[j];
+			if ((drawable->GetDrawableFlags() & drawableFlags) && (drawable->GetViewMask() & viewMask))
+				drawable->ProcessRayQuery(query, result);
+		}
+	}
+
+	Sort(result.Begin(), result.End(), CompareRayQueryResults);
+}
+
+void CorridorIndex::AddToBucket(Drawable* drawable, int segment)
+{
+	unsigned index = (unsigned)(segment - origin_ + ringStart_) % buckets_.Size();
+	Bucket& bucket = buckets_[index];
+	locations_[drawable] = MakePair(index, bucket.drawables_.Size());
+	bucket.drawables_.Push(drawable);
+	bucket.box_.Merge(drawable->GetWorldBoundingBox());
+}
+
+void CorridorIndex::AddPending(Drawable* drawable, int segment)
+{
+	PODVector<Drawable*>& drawables = pending_[segment];
+	pendingLocations_[drawable] = MakePair(segment, drawables.Size());
+	drawables.Push(drawable);
+}
+
+void CorridorIndex::TakePending(int fromSegment)
+{
+	if (pending_.Empty())
+		return;
+
+	// Segments from the old end of the ring to the new end are either inside the ring now or were jumped over. After a long
+	// jump there are fewer pending segments than segments passed, so those are visited instead
+	int end = origin_ + (int)buckets_.Size();
+	if ((unsigned)(end - fromSegment) <= pending_.Size())
+	{
+		for (int segment = fromSegment; segment < end; ++segment)
+		{
+			HashMap<int, PODVector<Drawable*> >::Iterator i = pending_.Find(segment);
+			if (i == pending_.End())
+				continue;
+			for (unsigned j = 0; j < i->second_.Size(); ++j)
+			{
+				pendingLocations_.Erase(i->second_[j]);
+				if (segment >= origin_)
+					AddToBucket(i->second_[j], segment);
+			}
+			pending_.Erase(i);
+		}
+	}
+	else
+	{
+		for (HashMap<int, PODVector<Drawable*> >::Iterator i = pending_.Begin(); i != pending_.End();)
+		{
+			int segment = i->first_;
+			if (segment >= end)
+			{
+				++i;
+				continue;
+			}
+			for (unsigned j = 0; j < i->second_.Size(); ++j)
+			{
+				pendingLocations_.Erase(i->second_[j]);
+				if (segment >= origin_)
+					AddToBucket(i->second_[j], segment);
+			}
+			i = pending_.Erase(i);
+		}
+	}
+}
+
+bool CorridorIndex::RemoveDrawable(Drawable* drawable)
+{
+	HashMap<Drawable*, Pair<unsigned, unsigned> >::Iterator i = locations_.Find(drawable);
+	if (i != locations_.End())
+	{
+		// The bucket box is not shrunk, it is reset when the bucket empties or is reused
+		Bucket& bucket = buckets_[i->second_.first_];
+		unsigned slot = i->second_.second_;
+		Drawable* last = bucket.drawables_.Back();
+		bucket.drawables_[slot] = last;
+		locations_[last].second_ = slot;
+		bucket.drawables_.Pop();
+		if (bucket.drawables_.Empty())
+			bucket.box_.Clear();
+		locations_.Erase(drawable);
+		return true;
+	}
+
+	HashMap<Drawable*, Pair<int, unsigned> >::Iterator j = pendingLocations_.Find(drawable);
+	if (j == pendingLocations_.End())
+		return false;
+
+	HashMap<int, PODVector<Drawable*> >::Iterator k = pending_.Find(j->second_.first_);
+	PODVector<Drawable*>& drawables = k->second_;
+	unsigned slot = j->second_.second_;
+	Drawable* last = drawables.Back();
+	drawables[slot] = last;
+	pendingLocations_[last].second_ = slot;
+	drawables.Pop();
+	if (drawables.Empty())
+		pending_.Erase(k);
+	pendingLocations_.Erase(drawable);
+	return true;
+}
+
+void CorridorIndex::ClearBucket(Bucket& bucket)
+{
+	for (unsigned i = 0; i < bucket.drawables_.Size(); ++i)
+		locations_.Erase(bucket.drawables_[i]);
+	bucket.drawables_.Clear();
+	bucket.box_.Clear();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Drawable;
+	class Frustum;
+}
+
+/// Default length of a corridor bucket along the track.
+const float CORRIDOR_BUCKET_LENGTH = 10.0f;
+/// Default number of corridor buckets.
+const unsigned CORRIDOR_NUM_BUCKETS = 64;
+
+/// Drawable index for long, narrow content such as the track. A ring of buckets, each covering a fixed length along the track,
+/// moves with the runner: inserting, removing and finding the bucket of a distance are constant time, and frustum and ray
+/// queries test only a bucket box before looking at its drawables. Content ahead of the ring waits until the ring reaches it,
+/// content the ring has passed is dropped.
+class CorridorIndex
+{
+public:
+	/// Construct with bucket length and count.
+	CorridorIndex(float bucketLength = CORRIDOR_BUCKET_LENGTH, unsigned numBuckets = CORRIDOR_NUM_BUCKETS);
+
+	/// Remove all drawables and move the ring back to distance 0.
+	void Clear();
+	/// Add a drawable at a track distance. Return false if the ring has already passed the distance.
+	bool Insert(Drawable* drawable, float distance);
+	/// Remove a drawable.
+	void Remove(Drawable* drawable);
+	/// Move a drawable to another track distance, for example after its node moved.
+	bool Move(Drawable* drawable, float distance);
+	/// Move the start of the ring to a track distance. Buckets left behind are emptied and reused for the distances ahead, and
+	/// only the pending drawables of the segments entering the ring are visited.
+	void SetOrigin(float distance);
+
+	/// Return drawables inside or intersecting a frustum.
+	void GetDrawables(PODVector<Drawable*>& result, const Frustum& frustum, unsigned char drawableFlags = DRAWABLE_ANY,
+		unsigned viewMask = DEFAULT_VIEWMASK) const;
+	/// Return drawables hit by a ray, sorted by distance.
+	void Raycast(PODVector<RayQueryResult>& result, const Ray& ray, RayQueryLevel level, float maxDistance,
+		unsigned char drawableFlags = DRAWABLE_ANY, unsigned viewMask = DEFAULT_VIEWMASK) const;
+
+	/// Return start distance of the ring.
+	float GetOrigin() const { return origin_ * bucketLength_; }
+	/// Return end distance of the ring.
+	float GetEnd() const { return (origin_ + buckets_.Size()) * bucketLength_; }
+	/// Return number of drawables in the ring.
+	unsigned GetNumDrawables() const { return locations_.Size(); }
+	/// Return number of drawables waiting ahead of the ring.
+	unsigned GetNumPending() const { return pendingLocations_.Size(); }
+
+private:
+	/// Drawables of one bucket.
+	struct Bucket
+	{
+		/// Drawables.
+		PODVector<Drawable*> drawables_;
+		/// Merged world bounding box of the drawables.
+		BoundingBox box_;
+	};
+
+	/// Return absolute bucket number of a distance.
+	int GetSegment(float distance) const { return (int)floorf(distance / bucketLength_); }
+	/// Add a drawable to the bucket of a segment inside the ring.
+	void AddToBucket(Drawable* drawable, int segment);
+	/// Add a drawable to the pending drawables of a segment ahead of the ring.
+	void AddPending(Drawable* drawable, int segment);
+	/// Move the pending drawables of the segments before the end of the ring into their buckets, or drop them if the ring has
+	/// already passed their segment.
+	void TakePending(int fromSegment);
+	/// Remove a drawable from the ring or the pending drawables. Return true if found.
+	bool RemoveDrawable(Drawable* drawable);
+	/// Empty a bucket.
+	void ClearBucket(Bucket& bucket);
+
+	/// Buckets.
+	Vector<Bucket> buckets_;
+	/// Bucket slot of each drawable in the ring, as bucket index and position in it.
+	HashMap<Drawable*, Pair<unsigned, unsigned> > locations_;
+	/// Drawables ahead of the ring by absolute bucket number.
+	HashMap<int, PODVector<Drawable*> > pending_;
+	/// Pending slot of each drawable ahead of the ring, as absolute bucket number and position in it.
+	HashMap<Drawable*, Pair<int, unsigned> > pendingLocations_;
+	/// Bucket length.
+	float bucketLength_;
+	/// Absolute bucket number of the first bucket.
+	int origin_;
+	/// Index of the first bucket in the ring.
+	unsigned ringStart_;
+};
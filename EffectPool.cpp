@@ -0,0 +1,193 @@
+#include <Urho3D/Graphics/ParticleEffect.h>
+#include <Urho3D/Graphics/ParticleEmitter.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Scene/Scene.h>
+#include <Urho3D/Scene/SceneEvents.h>
+
+#include "EffectPool.h"
+#include "EventStats.h"
+#include "MetricsExport.h"
+
+EffectPool::EffectPool(Context* context) :
+	Object(context),
+	maxPlaying_(DEFAULT_MAX_PLAYING_EFFECTS),
+	peakPlaying_(0),
+	numPlayed_(0),
+	numStolen_(0),
+	numGrown_(0)
+{
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(EffectPool, HandleCollectMetrics));
+}
+
+EffectPool::~EffectPool()
+{
+	if (root_)
+		root_->Remove();
+}
+
+unsigned EffectPool::AddEffect(const String& name, unsigned prewarm)
+{
+	// Loading the effect also loads its material and textures, so nothing is left to load on first play
+	ParticleEffect* resource = GetSubsystem<ResourceCache>()->GetResource<ParticleEffect>(name);
+	if (!resource)
+		return M_MAX_UNSIGNED;
+
+	Effect effect;
+	effect.name_ = name;
+	effect.effect_ = resource;
+	effect.prewarm_ = prewarm;
+	effect.burstTime_ = resource->GetActiveTime() > 0.0f ? resource->GetActiveTime() : DEFAULT_EFFECT_BURST_TIME;
+	effect.lifeTime_ = effect.burstTime_ + resource->GetMaxTimeToLive();
+	effects_.Push(effect);
+
+	unsigned index = effects_.Size() - 1;
+	if (root_)
+	{
+		for (unsigned i = 0; i < prewarm; ++i)
+			CreateSlot(index);
+	}
+	return index;
+}
+
+void EffectPool::SetScene(Scene* scene)
+{
+	UnsubscribeFromEvent(E_SCENEUPDATE);
+	if (root_)
+		root_->Remove();
+	slots_.Clear();
+	playing_.Clear();
+	for (unsigned i = 0; i < effects_.Size(); ++i)
+		effects_[i].free_.Clear();
+
+	scene_ = scene;
+	if (!scene)
+		return;
+
+	// Temporary, so that the emitters are not saved with the scene
+	root_ = scene->CreateChild("Effects", LOCAL);
+	root_->SetTemporary(true);
+	for (unsigned i = 0; i < effects_.Size(); ++i)
+	{
+		for (unsigned j = 0; j < effects_[i].prewarm_; ++j)
+			CreateSlot(i);
+	}
+	SubscribeToEvent(scene, E_SCENEUPDATE, GAME_HANDLER(EffectPool, HandleSceneUpdate));
+}
+
+bool EffectPool::Play(unsigned effect, const Vector3& position)
+{
+	if (effect >= effects_.Size() || !root_)
+		return false;
+
+	if (playing_.Size() >= maxPlaying_)
+	{
+		Stop(playing_.Front());
+		playing_.Erase(0);
+		++numStolen_;
+	}
+
+	Effect& data = effects_[effect];
+	if (data.free_.Empty())
+	{
+		CreateSlot(effect);
+		++numGrown_;
+	}
+	unsigned index = data.free_.Back();
+	data.free_.Pop();
+
+	Slot& slot = slots_[index];
+	if (!slot.node_ || !slot.emitter_)
+		return false;
+	slot.node_->SetPosition(position);
+	slot.emitter_->Reset();
+	slot.emitter_->SetEmitting(true);
+	slot.node_->SetEnabled(true);
+	slot.age_ = 0.0f;
+	slot.emitting_ = true;
+	playing_.Push(index);
+
+	++numPlayed_;
+	peakPlaying_ = Max(peakPlaying_, playing_.Size());
+	return true;
+}
+
+void EffectPool::StopAll()
+{
+	for (unsigned i = 0; i < playing_.Size(); ++i)
+		Stop(playing_[i]);
+	playing_.Clear();
+}
+
+void EffectPool::CreateSlot(unsigned effect)
+{
+	Node* node = root_->CreateChild(String::EMPTY, LOCAL);
+	ParticleEmitter* emitter = node->CreateComponent<ParticleEmitter>(LOCAL);
+	emitter->SetEffect(effects_[effect].effect_);
+	emitter->SetEmitting(false);
+	node->SetEnabled(false);
+
+	Slot slot;
+	slot.node_ = node;
+	slot.emitter_ = emitter;
+	slot.effect_ = effect;
+	slot.age_ = 0.0f;
+	slot.emitting_ = false;
+	slots_.Push(slot);
+	effects_[effect].free_.Push(slots_.Size() - 1);
+}
+
+void EffectPool::Stop(unsigned index)
+{
+	Slot& slot = slots_[index];
+	if (slot.emitter_)
+	{
+		slot.emitter_->SetEmitting(false);
+		slot.emitter_->RemoveAllParticles();
+	}
+	if (slot.node_)
+		slot.node_->SetEnabled(false);
+	slot.emitting_ = false;
+	effects_[slot.effect_].free_.Push(index);
+}
+
+void EffectPool::HandleSceneUpdate(StringHash eventType, VariantMap& eventData)
+{
+	using namespace SceneUpdate;
+
+	// Emitters finish in the order they were played only within one effect, so finished ones are taken out from anywhere,
+	// keeping the rest oldest first
+	float timeStep = eventData[P_TIMESTEP].GetFloat();
+	unsigned kept = 0;
+	for (unsigned i = 0; i < playing_.Size(); ++i)
+	{
+		unsigned index = playing_[i];
+		Slot& slot = slots_[index];
+		const Effect& effect = effects_[slot.effect_];
+		slot.age_ += timeStep;
+		if (slot.emitting_ && slot.age_ >= effect.burstTime_)
+		{
+			if (slot.emitter_)
+				slot.emitter_->SetEmitting(false);
+			slot.emitting_ = false;
+		}
+		if (slot.age_ >= effect.lifeTime_)
+			Stop(index);
+		else
+			playing_[kept++] = index;
+	}
+	playing_.Resize(kept);
+}
+
+void EffectPool::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& pool = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["effectPool"];
+	pool["effects"] = effects_.Size();
+	pool["emitters"] = slots_.Size();
+	pool["maxPlaying"] = maxPlaying_;
+	pool["peakPlaying"] = peakPlaying_;
+	pool["played"] = numPlayed_;
+	pool["stolen"] = numStolen_;
+	pool["grown"] = numGrown_;
+}
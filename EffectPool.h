@@ -0,0 +1,129 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Node;
+	class ParticleEffect;
+	class ParticleEmitter;
+	class Scene;
+}
+
+/// Default emitters created per effect with the scene.
+const unsigned DEFAULT_EFFECT_PREWARM = 8;
+/// Default most emitters playing at once, over all effects.
+const unsigned DEFAULT_MAX_PLAYING_EFFECTS = 64;
+/// Emission time of effects that would otherwise emit forever, in seconds.
+const float DEFAULT_EFFECT_BURST_TIME = 0.1f;
+/// Effect played where a pickup is collected.
+const char* const PICKUP_EFFECT = "Particle/Burst.xml";
+/// Effect played where the character hits an obstacle.
+const char* const IMPACT_EFFECT = "Particle/SnowExplosion.xml";
+
+/// Pooled one-shot particle effects, e.g. pickup and impact feedback. Effects are loaded when added, and each gets a few
+/// disabled emitter nodes in the scene up front, so that playing one only moves and enables an idle emitter. Emitters go back
+/// to their effect's pool once the emission time and the longest particle life have passed. At the cap on playing emitters
+/// the oldest playing one is stopped to make room; an effect with no idle emitter gets another one, which is kept for reuse.
+class EffectPool : public Object
+{
+	URHO3D_OBJECT(EffectPool, Object);
+
+public:
+	/// Construct.
+	EffectPool(Context* context);
+	/// Destruct. Removes the emitter nodes.
+	~EffectPool();
+
+	/// Load an effect with its material and keep a number of emitters ready for it. Return the effect index to play it with,
+	/// or M_MAX_UNSIGNED if it could not be loaded.
+	unsigned AddEffect(const String& name, unsigned prewarm = DEFAULT_EFFECT_PREWARM);
+	/// Set the scene the emitters live in and create the prewarmed emitters. Also to be called after the scene is reloaded,
+	/// which removes them.
+	void SetScene(Scene* scene);
+	/// Play an effect at a world position. Return false if it could not play.
+	bool Play(unsigned effect, const Vector3& position);
+	/// Stop all playing emitters.
+	void StopAll();
+	/// Set most emitters playing at once.
+	void SetMaxPlaying(unsigned count) { maxPlaying_ = Max(count, 1U); }
+
+	/// Return most emitters playing at once.
+	unsigned GetMaxPlaying() const { return maxPlaying_; }
+	/// Return number of playing emitters.
+	unsigned GetNumPlaying() const { return playing_.Size(); }
+	/// Return number of emitters, playing or idle.
+	unsigned GetNumEmitters() const { return slots_.Size(); }
+	/// Return number of effects played.
+	unsigned GetNumPlayed() const { return numPlayed_; }
+	/// Return number of playing emitters stopped early to make room.
+	unsigned GetNumStolen() const { return numStolen_; }
+	/// Return number of emitters created beyond the prewarmed ones.
+	unsigned GetNumGrown() const { return numGrown_; }
+
+private:
+	/// Effect and its idle emitters.
+	struct Effect
+	{
+		/// Resource name.
+		String name_;
+		/// Effect resource.
+		SharedPtr<ParticleEffect> effect_;
+		/// Emitters created with the scene.
+		unsigned prewarm_;
+		/// Emission time.
+		float burstTime_;
+		/// Time until the last particle is gone.
+		float lifeTime_;
+		/// Idle emitter slots.
+		PODVector<unsigned> free_;
+	};
+
+	/// Emitter node.
+	struct Slot
+	{
+		/// Node.
+		WeakPtr<Node> node_;
+		/// Emitter.
+		WeakPtr<ParticleEmitter> emitter_;
+		/// Effect index.
+		unsigned effect_;
+		/// Time since played.
+		float age_;
+		/// Still emitting.
+		bool emitting_;
+	};
+
+	/// Create an idle emitter for an effect.
+	void CreateSlot(unsigned effect);
+	/// Stop an emitter and return it to its effect's idle emitters. Does not remove it from the playing list.
+	void Stop(unsigned slot);
+	/// Handle scene update. End emission and return finished emitters.
+	void HandleSceneUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Effects.
+	Vector<Effect> effects_;
+	/// Emitters.
+	Vector<Slot> slots_;
+	/// Playing emitter slots, oldest first.
+	PODVector<unsigned> playing_;
+	/// Scene.
+	WeakPtr<Scene> scene_;
+	/// Parent of the emitter nodes.
+	WeakPtr<Node> root_;
+	/// Most emitters playing at once.
+	unsigned maxPlaying_;
+	/// Most emitters seen playing at once.
+	unsigned peakPlaying_;
+	/// Effects played.
+	unsigned numPlayed_;
+	/// Emitters stopped early to make room.
+	unsigned numStolen_;
+	/// Emitters created beyond the prewarmed ones.
+	unsigned numGrown_;
+};
@@ -0,0 +1,232 @@
+#ifdef EVENT_PROFILING
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/EventProfiler.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Engine/EngineEvents.h>
+#include <Urho3D/IO/Log.h>
+
+#include "EventStats.h"
+#include "MetricsExport.h"
+
+EventStats* EventStats::instance = 0;
+
+/// Event type and its stats, for ranking.
+struct RankedEventType
+{
+	StringHash eventType_;
+	EventTypeStats stats_;
+};
+
+static bool CompareRankedEventTypes(const RankedEventType& lhs, const RankedEventType& rhs)
+{
+	if (lhs.stats_.handlerUSec_ != rhs.stats_.handlerUSec_)
+		return lhs.stats_.handlerUSec_ > rhs.stats_.handlerUSec_;
+	return lhs.stats_.sends_ > rhs.stats_.sends_;
+}
+
+static String GetEventTypeName(StringHash eventType)
+{
+	const String& name = EventNameRegistrar::GetEventName(eventType);
+	return name.Empty() ? eventType.ToString() : name;
+}
+
+void EventTypeStats::Accumulate(const EventTypeStats& rhs)
+{
+	sends_ += rhs.sends_;
+	receivers_ += rhs.receivers_;
+	handlerUSec_ += rhs.handlerUSec_;
+	gameHandlers_ += rhs.gameHandlers_;
+	gameHandlerUSec_ += rhs.gameHandlerUSec_;
+	if (rhs.payloadEntries_)
+		payloadEntries_ = rhs.payloadEntries_;
+}
+
+EventStats::EventStats(Context* context) :
+	Object(context),
+	entryCostNs_(0.0f),
+	frames_(0)
+{
+	instance = this;
+	CalibrateEntryCost();
+
+	SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(EventStats, HandleEndFrame));
+	SubscribeToEvent(E_CONSOLECOMMAND, URHO3D_HANDLER(EventStats, HandleConsoleCommand));
+	SubscribeToEvent(E_COLLECTMETRICS, URHO3D_HANDLER(EventStats, HandleCollectMetrics));
+}
+
+EventStats::~EventStats()
+{
+	if (instance == this)
+		instance = 0;
+}
+
+void EventStats::BeginHandler()
+{
+	handlerStarts_.Push(timer_.GetUSec(false));
+	nestedUSec_.Push(0);
+}
+
+void EventStats::EndHandler(StringHash eventType, bool specificSender, unsigned payloadEntries)
+{
+	long long elapsed = timer_.GetUSec(false) - handlerStarts_.Back();
+	long long nested = nestedUSec_.Back();
+	handlerStarts_.Pop();
+	nestedUSec_.Pop();
+	// Time of this handler is nested time of the enclosing one
+	if (!nestedUSec_.Empty())
+		nestedUSec_.Back() += elapsed;
+
+	EventTypeStats& stats = currentStats_[eventType];
+	++stats.gameHandlers_;
+	stats.gameHandlerUSec_ += elapsed - nested;
+	stats.payloadEntries_ = payloadEntries;
+	// Receivers of specific senders are not in the global receiver groups, count them here
+	if (specificSender)
+		++stats.receivers_;
+}
+
+String EventStats::GetReport(bool total, unsigned maxEntries) const
+{
+	const HashMap<StringHash, EventTypeStats>& source = total ? totalStats_ : frameStats_;
+	Vector<RankedEventType> ranked;
+	for (HashMap<StringHash, EventTypeStats>::ConstIterator i = source.Begin(); i != source.End(); ++i)
+	{
+		RankedEventType entry;
+		entry.eventType_ = i->first_;
+		entry.stats_ = i->second_;
+		ranked.Push(entry);
+	}
+	Sort(ranked.Begin(), ranked.End(), CompareRankedEventTypes);
+
+	String report = ToString("Events (%s, VariantMap entry %.1f ns):\n", total ? ToString("%u frames", frames_).CString() :
+		"last frame", entryCostNs_);
+	for (unsigned i = 0; i < ranked.Size() && i < maxEntries; ++i)
+	{
+		const EventTypeStats& stats = ranked[i].stats_;
+		report.AppendWithFormat("%-24s sends %6u receivers %6u handlers %8.3f ms game %6u / %8.3f ms data %7.3f ms\n",
+			GetEventTypeName(ranked[i].eventType_).CString(), stats.sends_, stats.receivers_, stats.handlerUSec_ / 1000.0f,
+			stats.gameHandlers_, stats.gameHandlerUSec_ / 1000.0f, stats.sends_ * stats.payloadEntries_ * entryCostNs_ / 1000000.0f);
+	}
+	return report;
+}
+
+void EventStats::CalibrateEntryCost()
+{
+	// Event senders refill the reused event data map, so measure clear + assignment of typical payload sizes
+	const unsigned ITERATIONS = 1000;
+	const unsigned ENTRIES = 8;
+
+	VariantMap eventData;
+	HiresTimer timer;
+	for (unsigned i = 0; i < ITERATIONS; ++i)
+	{
+		eventData.Clear();
+		for (unsigned j = 0; j < ENTRIES; ++j)
+			eventData[StringHash(j + 1)] = (float)i;
+	}
+	entryCostNs_ = timer.GetUSec(false) * 1000.0f / (ITERATIONS * ENTRIES);
+}
+
+void EventStats::CollectEngineBlocks(const ProfilerBlock* block)
+{
+	for (unsigned i = 0; i < block->children_.Size(); ++i)
+	{
+		const EventProfilerBlock* child = static_cast<const EventProfilerBlock*>(block->children_[i]);
+		long long nested = 0;
+		for (unsigned j = 0; j < child->children_.Size(); ++j)
+			nested += child->children_[j]->time_;
+
+		EventTypeStats& stats = currentStats_[child->eventID_];
+		stats.sends_ += child->count_;
+		stats.handlerUSec_ += child->time_ - nested;
+
+		CollectEngineBlocks(child);
+	}
+}
+
+void EventStats::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	bool engineBlocks = false;
+#ifdef URHO3D_PROFILING
+	EventProfiler* eventProfiler = GetSubsystem<EventProfiler>();
+	if (eventProfiler && EventProfiler::IsActive())
+	{
+		CollectEngineBlocks(eventProfiler->GetRootBlock());
+		engineBlocks = true;
+	}
+#endif
+
+	for (HashMap<StringHash, EventTypeStats>::Iterator i = currentStats_.Begin(); i != currentStats_.End(); ++i)
+	{
+		EventTypeStats& stats = i->second_;
+		// Without the engine event profiler only the game handlers are visible
+		if (!engineBlocks)
+		{
+			stats.sends_ = stats.gameHandlers_;
+			stats.handlerUSec_ = stats.gameHandlerUSec_;
+		}
+
+		EventReceiverGroup* group = context_->GetEventReceivers(i->first_);
+		if (group)
+		{
+			unsigned numReceivers = 0;
+			for (unsigned j = 0; j < group->receivers_.Size(); ++j)
+			{
+				if (group->receivers_[j])
+					++numReceivers;
+			}
+			stats.receivers_ += numReceivers * stats.sends_;
+		}
+
+		totalStats_[i->first_].Accumulate(stats);
+	}
+
+	frameStats_ = currentStats_;
+	currentStats_.Clear();
+	++frames_;
+}
+
+void EventStats::HandleConsoleCommand(StringHash eventType, VariantMap& eventData)
+{
+	using namespace ConsoleCommand;
+
+	if (eventData[P_ID].GetString() != GetTypeName())
+		return;
+
+	// events [total]
+	Vector<String> arguments = eventData[P_COMMAND].GetString().Split(' ');
+	if (arguments.Empty() || arguments[0] != "events")
+	{
+		URHO3D_LOGINFO("Usage: events [total]");
+		return;
+	}
+	URHO3D_LOGINFO(GetReport(arguments.Size() > 1 && arguments[1] == "total"));
+}
+
+void EventStats::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& events = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["events"];
+	float frames = (float)Max(frames_, 1U);
+	events["frames"] = frames_;
+	events["variantMapEntryNs"] = entryCostNs_;
+
+	JSONValue& types = events["types"];
+	for (HashMap<StringHash, EventTypeStats>::ConstIterator i = totalStats_.Begin(); i != totalStats_.End(); ++i)
+	{
+		const EventTypeStats& stats = i->second_;
+		JSONValue& type = types[GetEventTypeName(i->first_)];
+		type["sendsPerFrame"] = stats.sends_ / frames;
+		type["receiversPerFrame"] = stats.receivers_ / frames;
+		type["handlerMsPerFrame"] = stats.handlerUSec_ / 1000.0f / frames;
+		type["gameHandlerMsPerFrame"] = stats.gameHandlerUSec_ / 1000.0f / frames;
+		type["payloadEntries"] = stats.payloadEntries_;
+		type["dataMsPerFrame"] = stats.sends_ * stats.payloadEntries_ * entryCostNs_ / 1000000.0f / frames;
+	}
+}
+
+#endif
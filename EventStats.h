@@ -0,0 +1,155 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+using namespace Urho3D;
+
+#ifdef EVENT_PROFILING
+
+namespace Urho3D
+{
+	class ProfilerBlock;
+}
+
+/// Event dispatch statistics of one event type.
+struct EventTypeStats
+{
+	/// Construct with zero values.
+	EventTypeStats() :
+		sends_(0),
+		receivers_(0),
+		handlerUSec_(0),
+		gameHandlers_(0),
+		gameHandlerUSec_(0),
+		payloadEntries_(0)
+	{
+	}
+
+	/// Add another frame.
+	void Accumulate(const EventTypeStats& rhs);
+
+	/// Number of sends.
+	unsigned sends_;
+	/// Receivers visited.
+	unsigned receivers_;
+	/// Time spent in all handlers excluding nested events, in microseconds.
+	long long handlerUSec_;
+	/// Game handler invocations.
+	unsigned gameHandlers_;
+	/// Time spent in game handlers excluding nested events, in microseconds.
+	long long gameHandlerUSec_;
+	/// Number of VariantMap entries in the event data, as seen by game handlers.
+	unsigned payloadEntries_;
+};
+
+/// Event bus profiler. Counts sends, receivers visited and handler time per event type and frame.
+/// Send counts and total handler time come from the engine event profiler; game handlers subscribed with GAME_HANDLER are timed individually.
+class EventStats : public Object
+{
+	URHO3D_OBJECT(EventStats, Object);
+
+public:
+	/// Construct.
+	EventStats(Context* context);
+	/// Destruct.
+	~EventStats();
+
+	/// Begin a game handler invocation.
+	void BeginHandler();
+	/// End a game handler invocation.
+	void EndHandler(StringHash eventType, bool specificSender, unsigned payloadEntries);
+
+	/// Return stats of the last frame.
+	const HashMap<StringHash, EventTypeStats>& GetFrameStats() const { return frameStats_; }
+	/// Return stats of all frames.
+	const HashMap<StringHash, EventTypeStats>& GetTotalStats() const { return totalStats_; }
+	/// Return estimated cost of filling one VariantMap entry in nanoseconds.
+	float GetEntryCostNs() const { return entryCostNs_; }
+	/// Return report of event types ranked by handler time.
+	String GetReport(bool total, unsigned maxEntries = 15) const;
+
+	/// Return the active instance, or null.
+	static EventStats* GetInstance() { return instance; }
+
+private:
+	/// Measure the cost of filling event data, as event senders do with the reused event data map.
+	void CalibrateEntryCost();
+	/// Add engine event profiler blocks to the current frame.
+	void CollectEngineBlocks(const ProfilerBlock* block);
+	/// Handle end of frame.
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle console command.
+	void HandleConsoleCommand(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Stats of the frame in progress.
+	HashMap<StringHash, EventTypeStats> currentStats_;
+	/// Stats of the last frame.
+	HashMap<StringHash, EventTypeStats> frameStats_;
+	/// Stats of all frames.
+	HashMap<StringHash, EventTypeStats> totalStats_;
+	/// Handler start times.
+	PODVector<long long> handlerStarts_;
+	/// Time spent in nested handlers, per nesting level.
+	PODVector<long long> nestedUSec_;
+	/// Timer.
+	HiresTimer timer_;
+	/// Cost of one VariantMap entry in nanoseconds.
+	float entryCostNs_;
+	/// Frames profiled.
+	unsigned frames_;
+
+	/// Active instance.
+	static EventStats* instance;
+};
+
+/// Event handler that times the invocation and reports it to the event stats.
+template <class T> class ProfiledEventHandlerImpl : public EventHandler
+{
+public:
+	typedef void (T::*HandlerFunctionPtr)(StringHash, VariantMap&);
+
+	/// Construct.
+	ProfiledEventHandlerImpl(T* receiver, HandlerFunctionPtr function) :
+		EventHandler(receiver),
+		function_(function)
+	{
+	}
+
+	/// Invoke the handler function.
+	virtual void Invoke(VariantMap& eventData)
+	{
+		EventStats* stats = EventStats::GetInstance();
+		if (!stats)
+		{
+			(static_cast<T*>(receiver_)->*function_)(eventType_, eventData);
+			return;
+		}
+
+		// The handler may unsubscribe and destroy this object, so copy what is needed afterwards
+		StringHash eventType = eventType_;
+		bool specificSender = sender_ != 0;
+		stats->BeginHandler();
+		(static_cast<T*>(receiver_)->*function_)(eventType, eventData);
+		stats->EndHandler(eventType, specificSender, eventData.Size());
+	}
+
+	/// Return a unique copy of the event handler.
+	virtual EventHandler* Clone() const { return new ProfiledEventHandlerImpl(static_cast<T*>(receiver_), function_); }
+
+private:
+	/// Class-specific pointer to handler function.
+	HandlerFunctionPtr function_;
+};
+
+/// Game event handler, timed by the event stats.
+#define GAME_HANDLER(className, function) (new ProfiledEventHandlerImpl<className>(this, &className::function))
+
+#else
+
+/// Game event handler. Event profiling is compiled out, so this is a plain engine handler.
+#define GAME_HANDLER(className, function) URHO3D_HANDLER(className, function)
+
+#endif
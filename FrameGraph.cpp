@@ -0,0 +1,294 @@
+#include <cstring>
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Graphics/GraphicsEvents.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/UI/Font.h>
+#include <Urho3D/UI/Text.h>
+#include <Urho3D/UI/UIBatch.h>
+
+#include "EventStats.h"
+#include "FrameGraph.h"
+#include "MetricsExport.h"
+#include "ResourceProfiler.h"
+
+/// Frame time budget at 60 fps.
+static const float BUDGET_60_MS = 1000.0f / 60.0f;
+/// Frame time budget at 30 fps.
+static const float BUDGET_30_MS = 1000.0f / 30.0f;
+/// Width of one frame bar in pixels.
+static const int BAR_WIDTH = 2;
+/// Graph height in pixels.
+static const int GRAPH_HEIGHT = 150;
+/// Graph pixels per millisecond, so that the graph shows 50 ms.
+static const float PIXELS_PER_MS = 3.0f;
+/// Caption refresh interval in seconds.
+static const float CAPTION_INTERVAL = 0.25f;
+
+/// Stage names for the caption, the dump and metrics.
+static const char* stageNames[] =
+{
+	"update",
+	"physics",
+	"postUpdate",
+	"renderUpdate",
+	"render",
+	"idle"
+};
+
+/// Stage bar colors.
+static const Color stageColors[] =
+{
+	Color(0.3f, 0.5f, 1.0f),
+	Color(1.0f, 0.6f, 0.1f),
+	Color(0.3f, 0.9f, 0.3f),
+	Color(0.8f, 0.4f, 1.0f),
+	Color(1.0f, 0.3f, 0.3f),
+	Color(0.5f, 0.5f, 0.5f, 0.6f)
+};
+
+FrameSampler::FrameSampler(Context* context) :
+	Object(context),
+	next_(0),
+	numFrames_(0),
+	numHitches_(0),
+	ringTotalMs_(0.0f),
+	physicsBegin_(0),
+	physicsUSec_(0),
+	updateEnd_(0),
+	postUpdateEnd_(0),
+	renderUpdateEnd_(0),
+	renderEnd_(-1),
+	overlayUSec_(0),
+	overlayMs_(0.0f),
+	maxFrameMs_(0.0f)
+{
+	memset(samples_, 0, sizeof samples_);
+
+	SubscribeToEvent(E_BEGINFRAME, GAME_HANDLER(FrameSampler, HandleBeginFrame));
+	SubscribeToEvent(E_PHYSICSPRESTEP, GAME_HANDLER(FrameSampler, HandlePhysicsPreStep));
+	SubscribeToEvent(E_PHYSICSPOSTSTEP, GAME_HANDLER(FrameSampler, HandlePhysicsPostStep));
+	SubscribeToEvent(E_POSTUPDATE, GAME_HANDLER(FrameSampler, HandlePostUpdate));
+	SubscribeToEvent(E_RENDERUPDATE, GAME_HANDLER(FrameSampler, HandleRenderUpdate));
+	SubscribeToEvent(E_POSTRENDERUPDATE, GAME_HANDLER(FrameSampler, HandlePostRenderUpdate));
+	SubscribeToEvent(E_ENDRENDERING, GAME_HANDLER(FrameSampler, HandleEndRendering));
+	SubscribeToEvent(E_ENDFRAME, GAME_HANDLER(FrameSampler, HandleEndFrame));
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(FrameSampler, HandleCollectMetrics));
+}
+
+String FrameSampler::GetHitchReport() const
+{
+	String report = ToString("Hitches: %u (frames over %.1f ms and twice the recent average)\n", numHitches_, BUDGET_30_MS);
+	unsigned first = numHitches_ > FRAME_GRAPH_HITCHES ? numHitches_ - FRAME_GRAPH_HITCHES : 0;
+	for (unsigned i = first; i < numHitches_; ++i)
+	{
+		const FrameHitch& hitch = hitches_[i % FRAME_GRAPH_HITCHES];
+		float totalMs = 0.0f;
+		for (unsigned j = 0; j < MAX_FRAME_STAGES; ++j)
+			totalMs += hitch.stageMs_[j];
+
+		report.AppendWithFormat("#%u frame %u: %.2f ms (", hitch.id_, hitch.frame_, totalMs);
+		for (unsigned j = 0; j < MAX_FRAME_STAGES; ++j)
+			report.AppendWithFormat("%s%s %.2f", j ? ", " : "", stageNames[j], hitch.stageMs_[j]);
+		report += ")\n";
+		report += hitch.loads_;
+	}
+	return report;
+}
+
+bool FrameSampler::SaveHitchReport(const String& fileName) const
+{
+	File file(context_, fileName, FILE_WRITE);
+	if (!file.IsOpen())
+		return false;
+	String report = GetHitchReport();
+	file.Write(report.CString(), report.Length());
+	URHO3D_LOGINFO("Hitch dump written to " + fileName);
+	return true;
+}
+
+void FrameSampler::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+	frameTimer_.Reset();
+	physicsUSec_ = 0;
+	updateEnd_ = 0;
+	postUpdateEnd_ = 0;
+	renderUpdateEnd_ = 0;
+	renderEnd_ = -1;
+	overlayUSec_ = 0;
+}
+
+void FrameSampler::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+	physicsBegin_ = Now();
+}
+
+void FrameSampler::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+	physicsUSec_ += Now() - physicsBegin_;
+}
+
+void FrameSampler::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
+{
+	updateEnd_ = Now();
+}
+
+void FrameSampler::HandleRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+	postUpdateEnd_ = Now();
+}
+
+void FrameSampler::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
+{
+	renderUpdateEnd_ = Now();
+}
+
+void FrameSampler::HandleEndRendering(StringHash eventType, VariantMap& eventData)
+{
+	renderEnd_ = Now();
+}
+
+void FrameSampler::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	long long frameEnd = Now();
+	overheadTimer_.Reset();
+
+	// Headless runs do not render, the rest of the frame counts as idle
+	long long renderEnd = renderEnd_ >= 0 ? renderEnd_ : renderUpdateEnd_;
+	FrameSample& sample = samples_[next_];
+	if (numFrames_ >= FRAME_GRAPH_FRAMES)
+	{
+		for (unsigned i = 0; i < MAX_FRAME_STAGES; ++i)
+			ringTotalMs_ -= sample.stageMs_[i];
+	}
+	sample.stageMs_[FRAME_UPDATE] = Max(updateEnd_ - physicsUSec_, 0LL) / 1000.0f;
+	sample.stageMs_[FRAME_PHYSICS] = physicsUSec_ / 1000.0f;
+	sample.stageMs_[FRAME_POSTUPDATE] = Max(postUpdateEnd_ - updateEnd_, 0LL) / 1000.0f;
+	sample.stageMs_[FRAME_RENDERUPDATE] = Max(renderUpdateEnd_ - postUpdateEnd_, 0LL) / 1000.0f;
+	sample.stageMs_[FRAME_RENDER] = Max(renderEnd - renderUpdateEnd_, 0LL) / 1000.0f;
+	sample.stageMs_[FRAME_IDLE] = Max(frameEnd - renderEnd, 0LL) / 1000.0f;
+	sample.hitch_ = 0;
+
+	float totalMs = 0.0f;
+	for (unsigned i = 0; i < MAX_FRAME_STAGES; ++i)
+		totalMs += sample.stageMs_[i];
+	unsigned numSamples = GetNumSamples();
+	float averageMs = numSamples ? ringTotalMs_ / numSamples : totalMs;
+	ringTotalMs_ += totalMs;
+	maxFrameMs_ = Max(maxFrameMs_, totalMs);
+
+	if (numSamples && totalMs > BUDGET_30_MS && totalMs > 2.0f * averageMs)
+	{
+		FrameHitch& hitch = hitches_[numHitches_ % FRAME_GRAPH_HITCHES];
+		hitch.id_ = ++numHitches_;
+		hitch.frame_ = GetSubsystem<Time>()->GetFrameNumber();
+		for (unsigned i = 0; i < MAX_FRAME_STAGES; ++i)
+			hitch.stageMs_[i] = sample.stageMs_[i];
+		ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+		hitch.loads_ = profiler ? profiler->GetFrameLoads(hitch.frame_) : String::EMPTY;
+		sample.hitch_ = hitch.id_;
+		URHO3D_LOGDEBUG(ToString("Hitch #%u at frame %u: %.2f ms", hitch.id_, hitch.frame_, totalMs));
+	}
+
+	next_ = (next_ + 1) % FRAME_GRAPH_FRAMES;
+	++numFrames_;
+	overlayMs_ = (overlayUSec_ + overheadTimer_.GetUSec(false)) / 1000.0f;
+}
+
+void FrameSampler::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& frames = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["frameGraph"];
+	unsigned numSamples = GetNumSamples();
+	for (unsigned i = 0; i < MAX_FRAME_STAGES; ++i)
+	{
+		float sum = 0.0f;
+		for (unsigned j = 0; j < numSamples; ++j)
+			sum += GetSample(j).stageMs_[i];
+		frames[String(stageNames[i]) + "Ms"] = numSamples ? sum / numSamples : 0.0f;
+	}
+	frames["frames"] = numFrames_;
+	frames["maxFrameMs"] = maxFrameMs_;
+	frames["hitches"] = numHitches_;
+}
+
+FrameGraph::FrameGraph(Context* context) :
+	UIElement(context),
+	captionTimer_(0.0f)
+{
+	SetSize(FRAME_GRAPH_FRAMES * BAR_WIDTH, GRAPH_HEIGHT);
+	SetPriority(100);
+
+	caption_ = CreateChild<Text>();
+	caption_->SetFont(GetSubsystem<ResourceCache>()->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 10);
+	caption_->SetPosition(2, 2);
+	caption_->SetColor(Color::WHITE);
+}
+
+void FrameGraph::Update(float timeStep)
+{
+	captionTimer_ -= timeStep;
+	FrameSampler* sampler = GetSubsystem<FrameSampler>();
+	if (!sampler || captionTimer_ > 0.0f)
+		return;
+	captionTimer_ = CAPTION_INTERVAL;
+
+	String text;
+	for (unsigned i = 0; i < MAX_FRAME_STAGES; ++i)
+		text.AppendWithFormat("%s%s %.1f", i ? " " : "", stageNames[i], sampler->GetSample(0).stageMs_[i]);
+	text.AppendWithFormat("\nblue/orange/green/purple/red/gray, lines 60/30 fps, overlay %.3f ms", sampler->GetOverlayMs());
+	const FrameHitch* hitch = sampler->GetLatestHitch();
+	if (hitch)
+		text.AppendWithFormat("\nlast hitch #%u at frame %u, see the hitch dump (F4)", hitch->id_, hitch->frame_);
+	caption_->SetText(text);
+}
+
+void FrameGraph::GetBatches(PODVector<UIBatch>& batches, PODVector<float>& vertexData, const IntRect& currentScissor)
+{
+	FrameSampler* sampler = GetSubsystem<FrameSampler>();
+	if (!sampler)
+		return;
+	HiresTimer timer;
+
+	// Everything is untextured, so the background, bars, budget lines and markers share one batch
+	UIBatch batch(this, BLEND_ALPHA, currentScissor, 0, &vertexData);
+	batch.SetColor(Color(0.0f, 0.0f, 0.0f, 0.5f));
+	batch.AddQuad(0, 0, GetWidth(), GetHeight(), 0, 0);
+
+	unsigned numSamples = sampler->GetNumSamples();
+	for (unsigned i = 0; i < numSamples; ++i)
+	{
+		const FrameSample& sample = sampler->GetSample(i);
+		int x = GetWidth() - (int)(i + 1) * BAR_WIDTH;
+		float bottom = (float)GetHeight();
+		for (unsigned j = 0; j < MAX_FRAME_STAGES && bottom > 0.0f; ++j)
+		{
+			float height = Min(sample.stageMs_[j] * PIXELS_PER_MS, bottom);
+			int top = (int)(bottom - height);
+			if ((int)bottom > top)
+			{
+				batch.SetColor(stageColors[j]);
+				batch.AddQuad(x, top, BAR_WIDTH, (int)bottom - top, 0, 0);
+			}
+			bottom -= height;
+		}
+		if (sample.hitch_)
+		{
+			batch.SetColor(Color::RED);
+			batch.AddQuad(x - 1, 0, BAR_WIDTH + 2, 6, 0, 0);
+		}
+	}
+
+	batch.SetColor(Color(1.0f, 1.0f, 1.0f, 0.8f));
+	batch.AddQuad(0, GetHeight() - (int)(BUDGET_60_MS * PIXELS_PER_MS), GetWidth(), 1, 0, 0);
+	batch.SetColor(Color(1.0f, 1.0f, 0.0f, 0.8f));
+	batch.AddQuad(0, GetHeight() - (int)(BUDGET_30_MS * PIXELS_PER_MS), GetWidth(), 1, 0, 0);
+
+	UIBatch::AddOrMerge(batch, batches);
+	sampler->AddOverlayTime(timer.GetUSec(false));
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/UI/UIElement.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Text;
+}
+
+/// Part of a frame shown as one segment of a frame graph bar.
+enum FrameStage
+{
+	FRAME_UPDATE = 0,
+	FRAME_PHYSICS,
+	FRAME_POSTUPDATE,
+	FRAME_RENDERUPDATE,
+	FRAME_RENDER,
+	FRAME_IDLE,
+	MAX_FRAME_STAGES
+};
+
+/// Frames kept in the frame graph ring buffer.
+const unsigned FRAME_GRAPH_FRAMES = 256;
+/// Hitches kept for the hitch dump.
+const unsigned FRAME_GRAPH_HITCHES = 64;
+
+/// Stage times of one frame.
+struct FrameSample
+{
+	/// Stage times in milliseconds.
+	float stageMs_[MAX_FRAME_STAGES];
+	/// Hitch number, or 0 when the frame was not a spike.
+	unsigned hitch_;
+};
+
+/// Frame that took longer than the 30 fps budget and at least twice the recent average.
+struct FrameHitch
+{
+	/// Hitch number, shown next to the spike marker.
+	unsigned id_;
+	/// Engine frame number.
+	unsigned frame_;
+	/// Stage times in milliseconds.
+	float stageMs_[MAX_FRAME_STAGES];
+	/// Synchronous resource loads during the frame.
+	String loads_;
+};
+
+/// Measures update, physics, post-update, render update, render and idle time of every frame from the engine's frame events
+/// into a fixed-size ring buffer, and keeps the spikes for the hitch dump. Time spent by other handlers of the same event is
+/// counted in the stage the event starts or ends, depending on the handler order.
+class FrameSampler : public Object
+{
+	URHO3D_OBJECT(FrameSampler, Object);
+
+public:
+	/// Construct.
+	FrameSampler(Context* context);
+
+	/// Return sample of a frame, 0 being the latest.
+	const FrameSample& GetSample(unsigned age) const { return samples_[(next_ + FRAME_GRAPH_FRAMES - 1 - age) % FRAME_GRAPH_FRAMES]; }
+	/// Return number of samples recorded, up to FRAME_GRAPH_FRAMES.
+	unsigned GetNumSamples() const { return Min(numFrames_, FRAME_GRAPH_FRAMES); }
+	/// Return the latest hitch, or null.
+	const FrameHitch* GetLatestHitch() const { return numHitches_ ? &hitches_[(numHitches_ - 1) % FRAME_GRAPH_HITCHES] : 0; }
+	/// Return the kept hitches as text, oldest first.
+	String GetHitchReport() const;
+	/// Save the hitch report. Return true on success.
+	bool SaveHitchReport(const String& fileName) const;
+	/// Add time spent drawing the graph, counted as overlay cost of the frame.
+	void AddOverlayTime(long long usec) { overlayUSec_ += usec; }
+	/// Return overlay cost of the last frame in milliseconds.
+	float GetOverlayMs() const { return overlayMs_; }
+
+private:
+	/// Return time since the frame began.
+	long long Now() const { return frameTimer_.GetUSec(false); }
+
+	/// Handle frame begin.
+	void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle physics pre-step.
+	void HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData);
+	/// Handle physics post-step.
+	void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+	/// Handle post-update. Ends update.
+	void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle render update. Ends post-update.
+	void HandleRenderUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle post-render update. Ends render update.
+	void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle end of rendering. Ends render.
+	void HandleEndRendering(StringHash eventType, VariantMap& eventData);
+	/// Handle frame end. Stores the sample.
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Frame samples.
+	FrameSample samples_[FRAME_GRAPH_FRAMES];
+	/// Kept hitches.
+	FrameHitch hitches_[FRAME_GRAPH_HITCHES];
+	/// Timer reset at frame begin.
+	mutable HiresTimer frameTimer_;
+	/// Measurement overhead timer.
+	HiresTimer overheadTimer_;
+	/// Ring buffer write position.
+	unsigned next_;
+	/// Frames recorded.
+	unsigned numFrames_;
+	/// Hitches recorded.
+	unsigned numHitches_;
+	/// Sum of the frame times in the ring buffer, for the spike test.
+	float ringTotalMs_;
+	/// Physics step start.
+	long long physicsBegin_;
+	/// Physics time in the frame.
+	long long physicsUSec_;
+	/// Update end.
+	long long updateEnd_;
+	/// Post-update end.
+	long long postUpdateEnd_;
+	/// Render update end.
+	long long renderUpdateEnd_;
+	/// Render end, or -1 when nothing was rendered.
+	long long renderEnd_;
+	/// Overlay cost in the frame.
+	long long overlayUSec_;
+	/// Overlay cost of the last frame.
+	float overlayMs_;
+	/// Slowest frame.
+	float maxFrameMs_;
+};
+
+/// Frame time graph drawn as stacked bars, one per frame, with 60 and 30 fps budget lines and a marker above each spike. All bars,
+/// lines and markers go into a single UI batch; the caption is a separate text element.
+class FrameGraph : public UIElement
+{
+	URHO3D_OBJECT(FrameGraph, UIElement);
+
+public:
+	/// Construct.
+	FrameGraph(Context* context);
+
+	/// Return UI rendering batches.
+	virtual void GetBatches(PODVector<UIBatch>& batches, PODVector<float>& vertexData, const IntRect& currentScissor);
+	/// Perform UI element update.
+	virtual void Update(float timeStep);
+
+private:
+	/// Caption with the legend, the overlay cost and the latest hitch.
+	SharedPtr<Text> caption_;
+	/// Time until the caption is refreshed.
+	float captionTimer_;
+};
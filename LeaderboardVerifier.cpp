@@ -0,0 +1,236 @@
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/Serializer.h>
+
+#include "EventStats.h"
+#include "LeaderboardVerifier.h"
+#include "MetricsExport.h"
+
+/// Range of runs for one work item.
+struct VerifyChunk
+{
+	/// First run.
+	const RunSubmission* runs_;
+	/// Results of the runs.
+	VerifyResult* results_;
+	/// Number of runs.
+	unsigned count_;
+};
+
+static void VerifyWork(const WorkItem* item, unsigned threadIndex)
+{
+	const VerifyChunk* chunk = static_cast<const VerifyChunk*>(item->start_);
+	for (unsigned i = 0; i < chunk->count_; ++i)
+		chunk->results_[i] = LeaderboardVerifier::VerifyRun(chunk->runs_[i]);
+}
+
+void RunSubmission::Write(Serializer& dest) const
+{
+	dest.WriteFileID(RUN_SUBMISSION_ID);
+	dest.WriteUByte(RUN_SUBMISSION_VERSION);
+	dest.WriteUInt(seed_);
+	dest.WriteUInt(contentHash_);
+	dest.WriteUByte((unsigned char)simModel_);
+	dest.WriteVLE(score_);
+	dest.WriteFloat(distance_);
+	dest.WriteVLE(inputs_.Size());
+	for (unsigned i = 0; i < inputs_.Size();)
+	{
+		unsigned end = i + 1;
+		while (end < inputs_.Size() && inputs_[end] == inputs_[i])
+			++end;
+		dest.WriteUByte(inputs_[i]);
+		dest.WriteVLE(end - i);
+		i = end;
+	}
+}
+
+bool RunSubmission::Read(Deserializer& source)
+{
+	if (source.ReadFileID() != RUN_SUBMISSION_ID || source.ReadUByte() != RUN_SUBMISSION_VERSION)
+		return false;
+
+	seed_ = source.ReadUInt();
+	contentHash_ = source.ReadUInt();
+	simModel_ = (RunSimModel)source.ReadUByte();
+	score_ = source.ReadVLE();
+	distance_ = source.ReadFloat();
+	unsigned numSteps = source.ReadVLE();
+	if (numSteps > MAX_SUBMISSION_STEPS)
+		return false;
+
+	inputs_.Resize(numSteps);
+	for (unsigned i = 0; i < numSteps;)
+	{
+		unsigned char buttons = source.ReadUByte();
+		unsigned count = source.ReadVLE();
+		if (!count || count > numSteps - i || (source.IsEof() && i + count < numSteps))
+			return false;
+		for (unsigned end = i + count; i < end; ++i)
+			inputs_[i] = buttons;
+	}
+	return true;
+}
+
+LeaderboardVerifier::LeaderboardVerifier(Context* context) :
+	Object(context),
+	numRuns_(0),
+	numRejected_(0),
+	numSteps_(0),
+	coreUSec_(0),
+	wallUSec_(0),
+	lastBatchUSec_(0)
+{
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(LeaderboardVerifier, HandleCollectMetrics));
+}
+
+void LeaderboardVerifier::Verify(const Vector<RunSubmission>& runs, PODVector<VerifyResult>& results, unsigned maxThreads)
+{
+	results.Resize(runs.Size());
+	if (runs.Empty())
+		return;
+
+	// Runs of a batch are usually of similar length, so even ranges keep the threads equally busy
+	HiresTimer timer;
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	unsigned numChunks = Min(Min(maxThreads, GetMaxThreads()), runs.Size());
+	PODVector<VerifyChunk> chunks(numChunks);
+	for (unsigned i = 0; i < numChunks; ++i)
+	{
+		unsigned begin = runs.Size() * i / numChunks;
+		chunks[i].runs_ = runs.Buffer() + begin;
+		chunks[i].results_ = results.Buffer() + begin;
+		chunks[i].count_ = runs.Size() * (i + 1) / numChunks - begin;
+	}
+
+	if (numChunks == 1 || !queue)
+	{
+		WorkItem item;
+		for (unsigned i = 0; i < numChunks; ++i)
+		{
+			item.start_ = &chunks[i];
+			VerifyWork(&item, 0);
+		}
+	}
+	else
+	{
+		for (unsigned i = 0; i < numChunks; ++i)
+		{
+			SharedPtr<WorkItem> item(new WorkItem());
+			item->workFunction_ = VerifyWork;
+			item->start_ = &chunks[i];
+			item->priority_ = M_MAX_UNSIGNED;
+			queue->AddWorkItem(item);
+		}
+		queue->Complete(M_MAX_UNSIGNED);
+	}
+
+	lastBatchUSec_ = timer.GetUSec(false);
+	wallUSec_ += lastBatchUSec_;
+	numRuns_ += runs.Size();
+	for (unsigned i = 0; i < runs.Size(); ++i)
+	{
+		numSteps_ += runs[i].inputs_.Size();
+		coreUSec_ += results[i].usec_;
+		if (results[i].status_ != VERIFY_OK)
+			++numRejected_;
+	}
+}
+
+unsigned LeaderboardVerifier::VerifyDirectory(const String& path)
+{
+	FileSystem* fileSystem = GetSubsystem<FileSystem>();
+	Vector<String> fileNames;
+	fileSystem->ScanDir(fileNames, path, "*.lrun", SCAN_FILES, false);
+
+	Vector<RunSubmission> runs;
+	Vector<String> runNames;
+	for (unsigned i = 0; i < fileNames.Size(); ++i)
+	{
+		File file(context_, AddTrailingSlash(path) + fileNames[i], FILE_READ);
+		RunSubmission run;
+		if (file.IsOpen() && run.Read(file))
+		{
+			runs.Push(run);
+			runNames.Push(fileNames[i]);
+		}
+		else
+			URHO3D_LOGWARNING("Could not read run submission " + fileNames[i]);
+	}
+
+	PODVector<VerifyResult> results;
+	Verify(runs, results);
+	unsigned rejected = 0;
+	for (unsigned i = 0; i < runs.Size(); ++i)
+	{
+		if (results[i].status_ == VERIFY_OK)
+			continue;
+		++rejected;
+		if (results[i].status_ == VERIFY_UNSUPPORTED)
+			URHO3D_LOGWARNING(ToString("Rejected run %s: played with content hash %08x and simulation %u, only the built-in "
+				"generator and RunnerSim can be verified", runNames[i].CString(), runs[i].contentHash_, (unsigned)runs[i].simModel_));
+		else
+			URHO3D_LOGWARNING(ToString("Rejected run %s: claimed score %u distance %.2f, resimulated score %u distance %.2f",
+				runNames[i].CString(), runs[i].score_, runs[i].distance_, results[i].score_, results[i].distance_));
+	}
+	URHO3D_LOGINFO(ToString("Verified %u runs from %s in %.1f ms, %u rejected", runs.Size(), path.CString(),
+		lastBatchUSec_ / 1000.0, rejected));
+	return fileNames.Size();
+}
+
+unsigned LeaderboardVerifier::GetMaxThreads() const
+{
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	return queue ? queue->GetNumThreads() + 1 : 1;
+}
+
+VerifyResult LeaderboardVerifier::VerifyRun(const RunSubmission& run)
+{
+	HiresTimer timer;
+	VerifyResult result;
+	result.status_ = VERIFY_INVALID;
+	result.score_ = 0;
+	result.distance_ = 0.0f;
+	if (run.contentHash_ || run.simModel_ != RUN_SIM_RUNNER)
+		result.status_ = VERIFY_UNSUPPORTED;
+	else if (run.inputs_.Size() <= MAX_SUBMISSION_STEPS)
+	{
+		// The simulation only needs the content, not the center line
+		TrackLayout track;
+		track.Generate(run.seed_, 30, 30, false);
+		RunnerState state;
+		state.Reset();
+		for (unsigned i = 0; i < run.inputs_.Size(); ++i)
+			RunnerSim::Step(state, run.inputs_[i], track);
+
+		result.score_ = state.score_;
+		result.distance_ = state.position_.z_;
+		if (result.score_ != run.score_)
+			result.status_ = VERIFY_SCORE_MISMATCH;
+		else if (Abs(result.distance_ - run.distance_) > VERIFY_DISTANCE_TOLERANCE)
+			result.status_ = VERIFY_DISTANCE_MISMATCH;
+		else
+			result.status_ = VERIFY_OK;
+	}
+	result.usec_ = timer.GetUSec(false);
+	return result;
+}
+
+void LeaderboardVerifier::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& verify = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["leaderboardVerify"];
+	verify["threads"] = GetMaxThreads();
+	verify["runs"] = numRuns_;
+	verify["rejected"] = numRejected_;
+	verify["steps"] = (double)numSteps_;
+	verify["coreSeconds"] = coreUSec_ / 1000000.0;
+	verify["wallSeconds"] = wallUSec_ / 1000000.0;
+	verify["runsPerCoreSecond"] = coreUSec_ ? numRuns_ * 1000000.0 / coreUSec_ : 0.0;
+	verify["runsPerSecond"] = wallUSec_ ? numRuns_ * 1000000.0 / wallUSec_ : 0.0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "RunnerSim.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Deserializer;
+	class Serializer;
+}
+
+/// Submitted run file identifier.
+const char* const RUN_SUBMISSION_ID = "LRUN";
+/// Submitted run format version.
+const unsigned char RUN_SUBMISSION_VERSION = 2;
+/// Largest number of steps in a submitted run, an hour at the simulation rate.
+const unsigned MAX_SUBMISSION_STEPS = 60 * 60 * 60;
+/// Largest difference between the submitted and the resimulated distance that still verifies. The simulation is
+/// deterministic, this only allows for floating point differences between the submitting and the verifying build.
+const float VERIFY_DISTANCE_TOLERANCE = 0.01f;
+
+/// Simulation a run was played with.
+enum RunSimModel
+{
+	/// RunnerSim, which is deterministic and what the verifier resimulates. The rollback and broadcast modes use it.
+	RUN_SIM_RUNNER = 0,
+	/// Physics character of single player, which depends on the frame rate and cannot be resimulated.
+	RUN_SIM_CHARACTER
+};
+
+/// Run submitted to the leaderboard: the track seed and content generator, the simulation, the input of every step and the
+/// claimed result.
+struct RunSubmission
+{
+	/// Construct empty.
+	RunSubmission() : seed_(1), contentHash_(0), simModel_(RUN_SIM_RUNNER), score_(0), distance_(0.0f) {}
+
+	/// Write to a stream. Inputs are run-length encoded, as the buttons change a few times a second at most.
+	void Write(Serializer& dest) const;
+	/// Read from a stream. Return false if it is not a run submission of a known version or is too long.
+	bool Read(Deserializer& source);
+
+	/// Track seed.
+	unsigned seed_;
+	/// Content generator of the track, see TrackLayout::GetContentHash(). Only the built-in generator can be verified, as
+	/// the verifier has no pattern scripts.
+	unsigned contentHash_;
+	/// Simulation the run was played with.
+	RunSimModel simModel_;
+	/// Claimed collected pickup count.
+	unsigned score_;
+	/// Claimed final distance.
+	float distance_;
+	/// Control buttons of every step.
+	PODVector<unsigned char> inputs_;
+};
+
+/// Verification outcome.
+enum VerifyStatus
+{
+	VERIFY_OK = 0,
+	VERIFY_SCORE_MISMATCH,
+	VERIFY_DISTANCE_MISMATCH,
+	VERIFY_INVALID,
+	/// Played on pattern content or with the physics character, which the verifier cannot reproduce.
+	VERIFY_UNSUPPORTED
+};
+
+/// Result of resimulating a submitted run.
+struct VerifyResult
+{
+	/// Outcome.
+	VerifyStatus status_;
+	/// Resimulated collected pickup count.
+	unsigned score_;
+	/// Resimulated final distance.
+	float distance_;
+	/// Resimulation time on its thread.
+	long long usec_;
+};
+
+/// Checks submitted runs by resimulating them headless with RunnerSim, as fast as the CPU allows. Runs are independent, so
+/// a batch is split between the worker threads and the main thread.
+class LeaderboardVerifier : public Object
+{
+	URHO3D_OBJECT(LeaderboardVerifier, Object);
+
+public:
+	/// Construct.
+	LeaderboardVerifier(Context* context);
+
+	/// Verify a batch of runs on up to a number of threads, including the main thread. Blocks until all are done.
+	void Verify(const Vector<RunSubmission>& runs, PODVector<VerifyResult>& results, unsigned maxThreads = M_MAX_UNSIGNED);
+	/// Verify the run files in a directory and log the rejected ones. Return number of files read.
+	unsigned VerifyDirectory(const String& path);
+
+	/// Return maximum number of threads, the worker threads and the main thread.
+	unsigned GetMaxThreads() const;
+	/// Return wall time of the last batch in microseconds.
+	long long GetLastBatchUSec() const { return lastBatchUSec_; }
+
+	/// Resimulate one run and compare with its claimed result. Safe to call from any thread.
+	static VerifyResult VerifyRun(const RunSubmission& run);
+
+private:
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Runs verified.
+	unsigned numRuns_;
+	/// Runs rejected.
+	unsigned numRejected_;
+	/// Steps resimulated.
+	unsigned long long numSteps_;
+	/// Resimulation time summed over all threads.
+	long long coreUSec_;
+	/// Wall time of all batches.
+	long long wallUSec_;
+	/// Wall time of the last batch.
+	long long lastBatchUSec_;
+};
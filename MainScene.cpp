@@ -1,8 +1,9 @@
-#include <iostream>
-#include <string>
+#include <cstring>
 
+#include <Urho3D/Container/HashSet.h>
 #include <Urho3D/Core/CoreEvents.h>
 #include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/Timer.h>
 #include <Urho3D/Engine/Engine.h>
 #include <Urho3D/Graphics/AnimatedModel.h>
 #include <Urho3D/Graphics/AnimationController.h>
@@ -12,14 +13,20 @@
 #include <Urho3D/Graphics/Material.h>
 #include <Urho3D/Graphics/Octree.h>
 #include <Urho3D/Graphics/Renderer.h>
+#include <Urho3D/Graphics/StaticModel.h>
 #include <Urho3D/Graphics/Zone.h>
 #include <Urho3D/Input/Controls.h>
 #include <Urho3D/Input/Input.h>
 #include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Math/Frustum.h>
 #include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
 #include <Urho3D/Physics/PhysicsWorld.h>
 #include <Urho3D/Physics/RigidBody.h>
 #include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
 #include <Urho3D/Scene/Scene.h>
 #include <Urho3D/Graphics/Skybox.h>
 #include <Urho3D/UI/Font.h>
@@ -30,17 +37,76 @@
 
 #include <Urho3D/DebugNew.h>
 
+#include "AssetPrefetcher.h"
+#include "BroadcastLoadTest.h"
+#include "BroadcastSession.h"
 #include "Character.h"
+#include "CollisionMatrix.h"
+#include "EffectPool.h"
+#include "EventStats.h"
+#include "LeaderboardVerifier.h"
 #include "MainScene.h"
+#include "MemoryTracker.h"
+#include "MetricsExport.h"
+#include "PhysicsProfiler.h"
+#include "PickupMagnet.h"
+#include "ResourceProfiler.h"
+#include "RollbackSession.h"
+#include "RunSave.h"
+#include "RunnerView.h"
+#include "SceneBenchmarks.h"
+#include "SceneryStreamer.h"
+#include "ScoreStore.h"
+#include "TrackBuilder.h"
+#include "TrackInstanceGroup.h"
+#include "TrackOcclusion.h"
+#include "TrackPatternLibrary.h"
+#include "TrackPrefab.h"
+#include "ThreadedPhysics.h"
 #include "Touch.h"
 
 URHO3D_DEFINE_APPLICATION_MAIN(MainScene)
 
+/// Scenery benchmark distance per frame, faster than the runner to stress streaming.
+static const float SCENERY_BENCHMARK_STEP = 2.0f;
+/// Default number of segments ahead of the runner whose themes are prefetched.
+static const unsigned PREFETCH_AHEAD_SEGMENTS = 6;
+/// Track content behind the character that keeps its physics body.
+static const float PROMOTE_BEHIND = 10.0f;
+/// Track content ahead of the character that gets a physics body.
+static const float PROMOTE_AHEAD = 30.0f;
+/// Track distance behind the camera from which corridor culling looks for floor and wall pieces.
+static const float CORRIDOR_CULL_BEHIND = 10.0f;
+
 MainScene::MainScene(Context* context) :
-	App(context), time_(0)
+	App(context), time_(0),
+	trackSeed_(1),
+	pickupScore_(0),
+	magnetTime_(0.0f),
+	runPending_(false),
+	pickupEffect_(M_MAX_UNSIGNED),
+	impactEffect_(M_MAX_UNSIGNED),
+	sceneryBenchmarkLength_(0.0f),
+	sceneryBenchmarkDistance_(0.0f),
+	occlusionEnabled_(true),
+	corridorCulling_(false),
+	prefetchAhead_(PREFETCH_AHEAD_SEGMENTS),
+	prefetchSegment_(-1),
+	requestedThemes_(0),
+	currentTheme_(M_MAX_UNSIGNED),
+	numThemeChanges_(0),
+	input_(context),
+	ui_(context),
+	renderer_(context)
 {
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		collected_[i] = 0;
+
 	// Register factory and attributes for the Character component so it can be created via CreateComponent, and loaded / saved
 	Character::RegisterObject(context);
+	TrackInstanceGroup::RegisterObject(context);
+	SceneryPatch::RegisterObject(context);
+	context->RegisterSubsystem(new TrackPrefabLibrary(context));
 }
 
 MainScene::~MainScene()
@@ -54,9 +120,117 @@ void MainScene::Start()
 	if (touchEnabled_)
 		touch_ = new Touch(context_, TOUCH_SENSITIVITY);
 
+	const Vector<String>& arguments = GetArguments();
+	unsigned physicsThreads = 0;
+	for (unsigned i = 0; i < arguments.Size(); ++i)
+	{
+		if (arguments[i].ToLower() == "-seed" && i + 1 < arguments.Size())
+			trackSeed_ = ToUInt(arguments[++i]);
+		else if (arguments[i].ToLower() == "-noocclusion")
+			occlusionEnabled_ = false;
+		else if (arguments[i].ToLower() == "-corridorculling")
+			corridorCulling_ = true;
+		else if (arguments[i].ToLower() == "-noprefetch")
+			prefetchAhead_ = 0;
+		else if (arguments[i].ToLower() == "-prefetchahead" && i + 1 < arguments.Size())
+			prefetchAhead_ = ToUInt(arguments[++i]);
+		else if (arguments[i].ToLower() == "-compileprefabs")
+		{
+			GetSubsystem<TrackPrefabLibrary>()->Compile(TRACK_BOX_PREFAB);
+			GetSubsystem<TrackPrefabLibrary>()->Compile(TRACK_CARROT_PREFAB);
+		}
+		else if (arguments[i].ToLower() == "-verifyruns" && i + 1 < arguments.Size())
+		{
+			SharedPtr<LeaderboardVerifier> verifier(new LeaderboardVerifier(context_));
+			context_->RegisterSubsystem(verifier);
+			verifier->VerifyDirectory(arguments[++i]);
+		}
+		else if (arguments[i].ToLower() == "-physicsthreads" && i + 1 < arguments.Size())
+			physicsThreads = ToUInt(arguments[++i]);
+	}
+
+	// Networked modes use the built-in generator, so that every peer builds the same track from the seed alone
+	RollbackSettings rollbackSettings;
+	BroadcastSettings broadcastSettings;
+	bool rollback = RollbackSettings::Parse(arguments, rollbackSettings);
+	bool broadcast = !rollback && BroadcastSettings::Parse(arguments, broadcastSettings);
+	if (!rollback && !broadcast)
+	{
+		TrackPatternLibrary* patterns = new TrackPatternLibrary(context_);
+		context_->RegisterSubsystem(patterns);
+		patterns->Load();
+		SubscribeToEvent(E_TRACKPATTERNSCHANGED, GAME_HANDLER(MainScene, HandleTrackPatternsChanged));
+	}
+	GenerateTrack();
+	if (prefetchAhead_)
+		prefetcher_ = new AssetPrefetcher(context_);
+
+	BenchmarkSettings benchmarkSettings;
+	if (BenchmarkSettings::Parse(arguments, benchmarkSettings))
+	{
+		benchmarks_ = new SceneBenchmarks(context_, trackSeed_);
+		benchmarks_->Run(benchmarkSettings, trackLayout_.GetSpline());
+		sceneryBenchmarkLength_ = benchmarkSettings.sceneryLength_;
+	}
+
+	// Feedback effects are loaded now and get their emitters with the scene, so playing one neither loads nor allocates
+	effects_ = new EffectPool(context_);
+	pickupEffect_ = effects_->AddEffect(PICKUP_EFFECT);
+	impactEffect_ = effects_->AddEffect(IMPACT_EFFECT);
+
 	CreateScene();
-	
-	CreateCharacter();
+
+	if (rollback)
+	{
+		// Wyscig dwoch graczy przez siec, biegacze sa symulowani deterministycznie zamiast przez fizyke
+		rollback_ = new RollbackSession(context_, rollbackSettings);
+		if (!rollback_->Start(scene_, &trackLayout_))
+		{
+			ErrorExit("Could not start the rollback session");
+			return;
+		}
+	}
+	else if (broadcast)
+	{
+		// Transmisja biegu dla widzow: ziarno, wejscia i klatki kluczowe zamiast replikacji sceny
+		broadcast_ = new BroadcastSession(context_, broadcastSettings);
+		if (!broadcast_->Start(scene_, &trackLayout_))
+		{
+			ErrorExit("Could not start the broadcast session");
+			return;
+		}
+	}
+	else
+	{
+		CreateCharacter();
+		localScores_ = new ScoreStore(context_);
+		if (!localScores_->Open(GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "runner") + "LocalScores.slog"))
+			localScores_.Reset();
+		if (benchmarkSettings.saveRepeats_)
+			RunSaveBenchmark(benchmarkSettings.saveRepeats_);
+	}
+
+	if (benchmarkSettings.loadTestSubscribers_)
+	{
+		SharedPtr<BroadcastLoadTest> loadTest(new BroadcastLoadTest(context_));
+		if (loadTest->Start(benchmarkSettings.loadTestSubscribers_, trackSeed_))
+			context_->RegisterSubsystem(loadTest);
+	}
+
+	// Profile physics after the character exists, so that its FixedUpdate is not counted as part of the step
+	PhysicsProfiler* physicsProfiler = new PhysicsProfiler(context_);
+	context_->RegisterSubsystem(physicsProfiler);
+	physicsProfiler->SetWorld(scene_->GetComponent<PhysicsWorld>());
+#ifdef PHYSICS_THREADING
+	// Attached after the profiler, which then times the parallel work as narrowphase and solver
+	if (physicsThreads)
+	{
+		ThreadedPhysics* threadedPhysics = new ThreadedPhysics(context_);
+		context_->RegisterSubsystem(threadedPhysics);
+		threadedPhysics->SetNumThreads(physicsThreads);
+		threadedPhysics->SetWorld(scene_->GetComponent<PhysicsWorld>());
+	}
+#endif
 	
 	SubscribeToEvents();
 	
@@ -64,12 +238,30 @@ void MainScene::Start()
 
 	UpdateText();
 
+	// Everything the game needs has been loaded, further synchronous loads are reported as hitches
+	GetSubsystem<ResourceProfiler>()->SetGameplay(true);
+}
+void MainScene::Stop()
+{
+	// Every run is its own entry, so the local board ranks runs rather than players
+	if (localScores_ && character_)
+	{
+		unsigned run = localScores_->GetNumSubmissions();
+		localScores_->Submit(run, (unsigned)(time_ * 10));
+		localScores_->Flush();
+		URHO3D_LOGINFO(ToString("Run score %u, rank %u of %u on the local leaderboard", (unsigned)(time_ * 10),
+			localScores_->GetPlayerRank(run) + 1, localScores_->GetNumEntries()));
+	}
+
+	App::Stop();
 }
+
 void MainScene::UpdateText()
 {	
+	MemoryScope memoryScope(MEMTAG_UI);
 	// CZAS
-	ResourceCache* cache = GetSubsystem<ResourceCache>();
-	GetSubsystem<UI>()->GetRoot()->SetDefaultStyle(cache->GetResource<XMLFile>("UI/DefaultStyle.xml"));
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+	GetSubsystem<UI>()->GetRoot()->SetDefaultStyle(profiler->GetResource<XMLFile>("UI/DefaultStyle.xml", __FUNCTION__));
 	// Let's create some text to display.
 	text_ = new Text(context_);
 	// Text will be updated later in the E_UPDATE handler. Keep readin'.
@@ -77,7 +269,7 @@ void MainScene::UpdateText()
 	// If the engine cannot find the font, it comes with Urho3D.
 	// Set the environment variables URHO3D_HOME, URHO3D_PREFIX_PATH or
 	// change the engine parameter "ResourcePrefixPath" in the Setup method.
-	text_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 20);
+	text_->SetFont(profiler->GetResource<Font>("Fonts/Anonymous Pro.ttf", __FUNCTION__), 20);
 	text_->SetColor(Color(0, 0, 0));
 	text_->SetHorizontalAlignment(HA_LEFT);
 	text_->SetVerticalAlignment(VA_TOP);
@@ -91,15 +283,30 @@ void MainScene::UpdateText()
 	// If the engine cannot find the font, it comes with Urho3D.
 	// Set the environment variables URHO3D_HOME, URHO3D_PREFIX_PATH or
 	// change the engine parameter "ResourcePrefixPath" in the Setup method.
-	text2_->SetFont(cache->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 20);
+	text2_->SetFont(profiler->GetResource<Font>("Fonts/Anonymous Pro.ttf", __FUNCTION__), 20);
 	text2_->SetColor(Color(1, 0, 0));
 	text2_->SetHorizontalAlignment(HA_RIGHT);
 	text2_->SetVerticalAlignment(VA_BOTTOM);
 	GetSubsystem<UI>()->GetRoot()->AddChild(text2_);
 }
+void MainScene::GenerateTrack()
+{
+	MemoryScope memoryScope(MEMTAG_TRACK_LAYOUT);
+	TrackPatternLibrary* patterns = GetSubsystem<TrackPatternLibrary>();
+	if (!patterns || patterns->GetPatterns().Empty())
+	{
+		trackLayout_.Generate(trackSeed_);
+		return;
+	}
+
+	HiresTimer timer;
+	trackLayout_.Generate(trackSeed_, patterns->GetPatterns());
+	patterns->RecordGeneration(timer.GetUSec(false), NUM_PATTERN_SEGMENTS);
+}
+
 void MainScene::CreateScene()
 {
-	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
 
 	scene_ = new Scene(context_);
 
@@ -113,7 +320,9 @@ void MainScene::CreateScene()
 	cameraNode_ = new Node(context_);
 	Camera* camera = cameraNode_->CreateComponent<Camera>();
 	camera->SetFarClip(300.0f);
-	GetSubsystem<Renderer>()->SetViewport(0, new Viewport(context_, scene_, camera));
+	Renderer* renderer = GetSubsystem<Renderer>();
+	if (renderer)
+		renderer->SetViewport(0, new Viewport(context_, scene_, camera));
 
 	// Create static scene content. First create a zone for ambient lighting and fog control
 	Node* zoneNode = scene_->CreateChild("Zone");
@@ -138,91 +347,19 @@ void MainScene::CreateScene()
 	Node* skyNode = scene_->CreateChild("Sky");
 	skyNode->SetScale(500.0f); // The scale actually does not matter
 	Skybox* skybox = skyNode->CreateComponent<Skybox>();
-	skybox->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-	skybox->SetMaterial(cache->GetResource<Material>("Materials/Skybox.xml"));
-
-	// Create the floor object
-	Node* floorNode = scene_->CreateChild("Floor");
-	floorNode->SetPosition(Vector3(0.0f, -0.5f, 100.0f));
-	floorNode->SetScale(Vector3(100.0f, 1.0f, 200.0f));
-	StaticModel* object = floorNode->CreateComponent<StaticModel>();
-	object->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-	object->SetMaterial(cache->GetResource<Material>("Materials/Terrain.xml"));
-
-	RigidBody* body = floorNode->CreateComponent<RigidBody>();
-	// Use collision layer bit 2 to mark world scenery. This is what we will raycast against to prevent camera from going
-	// inside geometry
-	body->SetCollisionLayer(2);
-	CollisionShape* shape = floorNode->CreateComponent<CollisionShape>();
-	shape->SetBox(Vector3::ONE);
-
-	Node* leftWallNode = scene_->CreateChild("LeftWall");
-	leftWallNode->SetPosition(Vector3(-4.5f, 2.0f, 100.0f));
-	leftWallNode->SetScale(Vector3(1.0f, 4.0f, 200.0f));
-	StaticModel* object2 = leftWallNode->CreateComponent<StaticModel>();
-	object2->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-	object2->SetMaterial(cache->GetResource<Material>("Materials/GreenTransparent.xml"));
-
-	RigidBody* body2 = leftWallNode->CreateComponent<RigidBody>();
-	body2->SetCollisionLayer(2);
-	CollisionShape* shape2 = leftWallNode->CreateComponent<CollisionShape>();
-	shape2->SetBox(Vector3::ONE);
-
-	Node* rightWallNode = scene_->CreateChild("RightWall");
-	rightWallNode->SetPosition(Vector3(4.5f, 2.0f, 100.0f));
-	rightWallNode->SetScale(Vector3(1.0f, 4.0f, 200.0f));
-	StaticModel* object3 = rightWallNode->CreateComponent<StaticModel>();
-	object3->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-	object3->SetMaterial(cache->GetResource<Material>("Materials/GreenTransparent.xml"));
-
-	RigidBody* body3 = rightWallNode->CreateComponent<RigidBody>();
-	body3->SetCollisionLayer(2);
-	CollisionShape* shape3 = rightWallNode->CreateComponent<CollisionShape>();
-	shape3->SetBox(Vector3::ONE);
-
-
-
-	const unsigned NUM_BOXES = 30;
-	for (unsigned i = 0; i < NUM_BOXES; ++i)
-	{
-		std::cout <<int(Random(3.0f));
-		Node* objectNode = scene_->CreateChild("Box");
-		objectNode->SetPosition(Vector3((int(Random(3.0f) - 1.0f))*3.0f - 3.0f, 0.75f, (Random(90.0f) + 5.0f)*4));
-		objectNode->SetRotation(Quaternion(0.0f, 0.0f,0.0f));
-		objectNode->SetScale(1.5f);
-		StaticModel* object5 = objectNode->CreateComponent<StaticModel>();
-		object5->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-		object5->SetMaterial(cache->GetResource<Material>("Materials/Stone.xml"));
-		object5->SetCastShadows(true);
-
-		RigidBody* body5 = objectNode->CreateComponent<RigidBody>();
-		body5->SetCollisionLayer(2);
-		// Bigger boxes will be heavier and harder to move
-		//body5->SetMass(20.0f);
-		CollisionShape* shape5 = objectNode->CreateComponent<CollisionShape>();
-		shape5->SetBox(Vector3::ONE);
-	}
-
-	const unsigned NUM_CARROTS = 30;
-	for (unsigned i = 0; i < NUM_CARROTS; ++i)
-	{
-		std::cout << int(Random(3.0f));
-		Node* carrotNode = scene_->CreateChild("Carrot");
-		carrotNode->SetPosition(Vector3((int(Random(3.0f) - 1.0f))*3.0f - 3.0f, 2.0f, (Random(90.0f) + 5.0f) * 4));
-		carrotNode->SetRotation(Quaternion(0.0f, 0.0f, 0.0f));
-		carrotNode->SetScale(1.5f);
-		StaticModel* carrot = carrotNode->CreateComponent<StaticModel>();
-		carrot->SetModel(cache->GetResource<Model>("Models/TeaPot.mdl"));
-		carrot->SetMaterial(cache->GetResource<Material>("Models/marchew/material.xml"));
-		carrot->SetCastShadows(true);
-
-		RigidBody* carrotBody = carrotNode->CreateComponent<RigidBody>();
-		carrotBody->SetCollisionLayer(2);
-		// Bigger boxes will be heavier and harder to move
-		//body5->SetMass(20.0f);
-		CollisionShape* carrotShape = carrotNode->CreateComponent<CollisionShape>();
-		carrotShape->SetBox(Vector3::ONE);
-	}
+	skybox->SetModel(profiler->GetResource<Model>("Models/Box.mdl", __FUNCTION__));
+	skybox->SetMaterial(profiler->GetResource<Material>("Materials/Skybox.xml", __FUNCTION__));
+
+	// Beyond the walls, terrain generated in the background as the runner moves on
+	if (occlusionEnabled_)
+		occlusion_ = new TrackOcclusion(context_);
+	scenery_ = new SceneryStreamer(context_);
+	if (!scenery_->Initialize("Textures/HeightMap.png", "Materials/Terrain.xml"))
+		scenery_.Reset();
+
+	CreateTrack();
+	if (effects_)
+		effects_->SetScene(scene_);
 	/*
 	RigidBody* ch = character_->GetComponent<RigidBody>();
 
@@ -233,76 +370,548 @@ void MainScene::CreateScene()
 		objectNode2->SetRotation(Quaternion(0.0f, 0.0f, 0.0f));
 		objectNode2->SetScale(2.5f);
 		StaticModel* object52 = objectNode2->CreateComponent<StaticModel>();
-		object52->SetModel(cache->GetResource<Model>("Models/Box.mdl"));
-		object52->SetMaterial(cache->GetResource<Material>("Materials/Water.xml"));
+		object52->SetModel(profiler->GetResource<Model>("Models/Box.mdl", __FUNCTION__));
+		object52->SetMaterial(profiler->GetResource<Material>("Materials/Water.xml", __FUNCTION__));
 		object52->SetCastShadows(true);
 	}
 	*/
 }
 
-void MainScene::CreateCharacter() {
-	ResourceCache* cache = GetSubsystem<ResourceCache>();
+void MainScene::CreateTrack()
+{
+	MemoryScope memoryScope(MEMTAG_TRACK);
+	const Vector<SharedPtr<Node> >& children = scene_->GetChildren();
+	for (unsigned i = children.Size(); i-- > 0;)
+	{
+		const String& name = children[i]->GetName();
+		if (name == "Floor" || name == "LeftWall" || name == "RightWall")
+			children[i]->Remove();
+	}
+	if (occlusion_)
+		occlusion_->ClearFloor();
+
+	// The floor pieces also hide track content beyond crests from the camera
+	const TrackSpline& spline = trackLayout_.GetSpline();
+	PODVector<Node*> floorPieces;
+	CreateTrackPieces(scene_, spline, &floorPieces);
+	if (occlusion_)
+	{
+		for (unsigned i = 0; i < floorPieces.Size(); ++i)
+			occlusion_->AddFloorPiece(floorPieces[i]->GetWorldTransform(), GetTrackPieceCenter(i));
+	}
+	if (scenery_)
+		scenery_->SetSpline(spline);
+	if (corridorCulling_)
+		IndexTrackPieces();
+
+	CreateTrackContent();
+}
+
+void MainScene::IndexTrackPieces()
+{
+	// Pieces are found by name, so that those of a loaded snapshot are indexed the same way. The first piece starts before the
+	// ring can reach and stays with the octree
+	corridor_.Clear();
+	corridorShown_.Clear();
+	const TrackSpline& spline = trackLayout_.GetSpline();
+	const Vector<SharedPtr<Node> >& children = scene_->GetChildren();
+	for (unsigned i = 0; i < children.Size(); ++i)
+	{
+		const String& name = children[i]->GetName();
+		if (name != "Floor" && name != "LeftWall" && name != "RightWall")
+			continue;
+		StaticModel* model = children[i]->GetComponent<StaticModel>();
+		if (model && corridor_.Insert(model, spline.ToTrack(children[i]->GetPosition()).z_))
+			model->SetEnabled(false);
+	}
+}
+
+void MainScene::UpdateCorridorCulling(float distance)
+{
+	// A restored run can put the camera behind the ring, which has dropped the pieces it passed
+	float origin = distance - CORRIDOR_CULL_BEHIND;
+	if (corridor_.GetOrigin() > 0.0f && origin < corridor_.GetOrigin())
+		IndexTrackPieces();
+	corridor_.SetOrigin(origin);
+
+	// The frustum starts behind the camera, so that pieces just behind it still cast their shadows into view
+	Camera* camera = camera_.Get(cameraNode_);
+	Matrix3x4 transform(cameraNode_->GetWorldPosition() - CORRIDOR_CULL_BEHIND * cameraNode_->GetWorldDirection(),
+		cameraNode_->GetWorldRotation(), 1.0f);
+	Frustum frustum;
+	frustum.Define(camera->GetFov(), camera->GetAspectRatio(), camera->GetZoom(), camera->GetNearClip(),
+		camera->GetFarClip() + CORRIDOR_CULL_BEHIND, transform);
+	PODVector<Drawable*> visible;
+	corridor_.GetDrawables(visible, frustum, DRAWABLE_GEOMETRY);
+
+	// Disabled drawables are out of the octree, so only pieces that come into or leave the view are inserted or removed
+	HashSet<Drawable*> visibleSet;
+	for (unsigned i = 0; i < visible.Size(); ++i)
+	{
+		visibleSet.Insert(visible[i]);
+		visible[i]->SetEnabled(true);
+	}
+	for (unsigned i = 0; i < corridorShown_.Size(); ++i)
+	{
+		if (!visibleSet.Contains(corridorShown_[i]))
+			corridorShown_[i]->SetEnabled(false);
+	}
+	corridorShown_ = visible;
+}
+
+void MainScene::CreateTrackContent()
+{
+	MemoryScope memoryScope(MEMTAG_TRACK_ENTITIES);
+
+	// The content node is temporary, so after loading a saved scene the content is created again from the seed
+	trackEntities_.Clear();
+	magnet_.Clear();
+	Node* contentNode = scene_->GetChild("TrackContent");
+	if (contentNode)
+		contentNode->Remove();
+	contentNode = scene_->CreateChild("TrackContent", LOCAL);
+	contentNode->SetTemporary(true);
+
+	// The theme at the runner is applied on the next update
+	currentTheme_ = M_MAX_UNSIGNED;
+	prefetchSegment_ = -1;
+	if (!AddTrackContent(trackEntities_, contentNode, trackLayout_, GetSubsystem<TrackPrefabLibrary>()))
+		return;
+
+	const PODVector<TrackItem>& items = trackLayout_.GetItems();
+	for (unsigned i = 0; i < items.Size(); ++i)
+	{
+		const TrackItem& item = items[i];
+		if (item.type_ == TRACK_CARROT && (collected_[item.pickupIndex_ >> 5] & (1u << (item.pickupIndex_ & 31))))
+			trackEntities_.SetVisible(ARCHETYPE_PICKUP, item.pickupIndex_, false);
+	}
+}
+
+void MainScene::CollectPickups(const Vector3& trackPosition)
+{
+	// Pickups are added to the store in item order, so the pickup index is also the entity index
+	const PODVector<TrackItem>& items = trackLayout_.GetItems();
+	for (unsigned i = trackLayout_.FindFirst(trackPosition.z_ - RUNNER_TOUCH_DISTANCE); i < items.Size() &&
+		items[i].z_ < trackPosition.z_ + RUNNER_TOUCH_DISTANCE; ++i)
+	{
+		const TrackItem& item = items[i];
+		unsigned bit = 1u << (item.pickupIndex_ & 31);
+		if (item.type_ != TRACK_CARROT || (collected_[item.pickupIndex_ >> 5] & bit) ||
+			Abs(trackPosition.x_ - TrackLayout::GetLaneX(item.lane_)) >= RUNNER_TOUCH_DISTANCE)
+			continue;
+		CollectPickup(item.pickupIndex_);
+	}
+}
+
+void MainScene::CollectPickup(unsigned pickupIndex)
+{
+	collected_[pickupIndex >> 5] |= 1u << (pickupIndex & 31);
+	++pickupScore_;
+	if (effects_)
+		effects_->Play(pickupEffect_, trackEntities_.GetTransforms(ARCHETYPE_PICKUP)[pickupIndex].Translation());
+	trackEntities_.SetVisible(ARCHETYPE_PICKUP, pickupIndex, false);
+}
+
+void MainScene::UpdateMagnet(const Vector3& trackPosition, float timeStep)
+{
+	if (magnetTime_ <= 0.0f && !magnet_.GetNumAttracted())
+		return;
+
+	// Pickups already flying when the power-up runs out still reach the runner, only new ones are no longer attracted
+	magnetTime_ = Max(magnetTime_ - timeStep, 0.0f);
+	magnetCollected_.Clear();
+	magnet_.Update(trackEntities_, trackPosition, character_->GetNode()->GetPosition(), timeStep, magnetTime_ > 0.0f,
+		magnetCollected_);
+	for (unsigned i = 0; i < magnetCollected_.Size(); ++i)
+		CollectPickup(magnetCollected_[i]);
+}
+
+void MainScene::UpdateThemes(float distance)
+{
+	MemoryScope memoryScope(MEMTAG_TRACK);
+	// The generator publishes the themes up to the prefetch distance whenever the runner enters a segment. The nearer a theme
+	// starts, the higher its priority; themes no longer in range are released
+	int segment = TrackLayout::GetSegment(distance);
+	if (prefetcher_ && segment != prefetchSegment_)
+	{
+		prefetchSegment_ = segment;
+		PODVector<unsigned> themes;
+		trackLayout_.GetUpcomingThemes(distance, prefetchAhead_, themes);
+		unsigned wantedThemes = 0;
+		for (unsigned i = 0; i < themes.Size(); ++i)
+			wantedThemes |= 1u << themes[i];
+		for (unsigned i = 0; i < NUM_TRACK_THEMES; ++i)
+		{
+			if ((requestedThemes_ & (1u << i)) && !(wantedThemes & (1u << i)))
+				ReleaseTheme(i, wantedThemes);
+		}
+		for (unsigned i = 0; i < themes.Size(); ++i)
+			RequestTheme(themes[i], themes.Size() - i);
+		requestedThemes_ = wantedThemes;
+	}
+	if (prefetcher_)
+		prefetcher_->Update();
+
+	unsigned theme = trackLayout_.GetTheme(distance);
+	if (theme != currentTheme_)
+		ApplyTheme(theme);
+}
+
+void MainScene::RequestTheme(unsigned theme, int priority)
+{
+	// Prefab references are found in the prefab XML once it has loaded
+	const TrackTheme& data = TrackLayout::GetThemeData(theme);
+	prefetcher_->Request(XMLFile::GetTypeStatic(), String(data.obstaclePrefab_) + ".xml", priority, theme);
+	prefetcher_->Request(XMLFile::GetTypeStatic(), String(data.pickupPrefab_) + ".xml", priority, theme);
+	prefetcher_->Request(Material::GetTypeStatic(), data.floorMaterial_, priority, theme);
+	prefetcher_->Request(Material::GetTypeStatic(), data.wallMaterial_, priority, theme);
+}
+
+void MainScene::ReleaseTheme(unsigned theme, unsigned wantedThemes)
+{
+	prefetcher_->ReleaseGroup(theme);
 
-	Node* objectNode = scene_->CreateChild("Jack");
-	objectNode->SetPosition(Vector3(0.0f, 1.1f, 0.0f));
-	//objectNode->SetScale(Vector3(1.0f, 1.0f, 1.0f));
-	//objectNode->SetRotation(Quaternion(90, Vector3(0, 1, 0)));
+	// The prefab library holds the models and materials of its prefabs
+	TrackPrefabLibrary* prefabs = GetSubsystem<TrackPrefabLibrary>();
+	const TrackTheme& data = TrackLayout::GetThemeData(theme);
+	const char* prefabNames[] = { data.obstaclePrefab_, data.pickupPrefab_ };
+	for (unsigned i = 0; i < sizeof(prefabNames) / sizeof(prefabNames[0]); ++i)
+	{
+		bool shared = false;
+		for (unsigned j = 0; j < NUM_TRACK_THEMES; ++j)
+		{
+			const TrackTheme& other = TrackLayout::GetThemeData(j);
+			if ((wantedThemes & (1u << j)) && (!strcmp(other.obstaclePrefab_, prefabNames[i]) ||
+				!strcmp(other.pickupPrefab_, prefabNames[i])))
+				shared = true;
+		}
+		if (!shared)
+			prefabs->ReleasePrefab(prefabNames[i]);
+	}
+}
 
-	// Create the rendering component + animation controller
-	AnimatedModel* object = objectNode->CreateComponent<AnimatedModel>();
-	object->SetModel(cache->GetResource<Model>("Models/Mutant/Mutant.mdl"));
-	object->SetMaterial(cache->GetResource<Material>("Models/Mutant/Materials/mutant_M.xml"));
-	object->SetCastShadows(true);
-	objectNode->CreateComponent<AnimationController>();
+void MainScene::ApplyTheme(unsigned theme)
+{
+	// Resources that were not prefetched load here, and are reported as synchronous gameplay loads
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+	TrackPrefabLibrary* prefabs = GetSubsystem<TrackPrefabLibrary>();
+	const TrackTheme& data = TrackLayout::GetThemeData(theme);
+	Material* floorMaterial = profiler->GetResource<Material>(data.floorMaterial_, __FUNCTION__);
+	Material* wallMaterial = profiler->GetResource<Material>(data.wallMaterial_, __FUNCTION__);
+	const Vector<SharedPtr<Node> >& children = scene_->GetChildren();
+	for (unsigned i = 0; i < children.Size(); ++i)
+	{
+		const String& name = children[i]->GetName();
+		Material* material = name == "Floor" ? floorMaterial : (name == "LeftWall" || name == "RightWall") ? wallMaterial : 0;
+		StaticModel* model = material ? children[i]->GetComponent<StaticModel>() : 0;
+		if (model)
+			model->SetMaterial(material);
+	}
+
+	const char* prefabNames[] = { data.obstaclePrefab_, data.pickupPrefab_ };
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		ResourceCallSite callSite(profiler, __FUNCTION__);
+		TrackPrefab* prefab = prefabs->GetPrefab(prefabNames[i]);
+		if (prefab)
+			trackEntities_.SetPrefab((TrackArchetype)i, prefab);
+	}
+
+	if (currentTheme_ != M_MAX_UNSIGNED)
+		++numThemeChanges_;
+	currentTheme_ = theme;
+}
 
-	// Set the head bone for manual control
-	object->GetSkeleton().GetBone("Mutant:Head")->animated_ = false;
+void MainScene::SaveSnapshot(Serializer& dest)
+{
+	scene_->SaveXML(dest);
+}
 
-	// Create rigidbody, and set non-zero mass so that the body becomes dynamic
-	RigidBody* body = objectNode->CreateComponent<RigidBody>();
-	body->SetCollisionLayer(1);
-	body->SetMass(1.0f);
+bool MainScene::LoadSnapshot(Deserializer& source)
+{
+	if (!scene_->LoadXML(source))
+		return false;
+	// After loading we have to reacquire the weak pointer to the Character component, as it has been recreated
+	// Simply find the character's scene node by name as there's only one of them
+	Node* characterNode = scene_->GetChild("Jack", true);
+	if (characterNode)
+		character_ = characterNode->GetComponent<Character>();
+	// The physics world has been recreated as well
+	AttachPhysicsWorld();
+	// Track content and effect emitters are not saved, create them again for the loaded scene
+	if (corridorCulling_)
+		IndexTrackPieces();
+	CreateTrackContent();
+	if (effects_)
+		effects_->SetScene(scene_);
+	return true;
+}
 
-	// Set zero angular factor so that physics doesn't turn the character on its own.
-	// Instead we will control the character yaw manually
-	body->SetAngularFactor(Vector3::ZERO);
+void MainScene::SaveRun(Serializer& dest)
+{
+	RunSave save;
+	save.seed_ = trackSeed_;
+	save.contentHash_ = trackLayout_.GetContentHash();
+	save.time_ = time_;
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		save.runner_.collected_[i] = collected_[i];
+	save.runner_.score_ = pickupScore_;
+	if (character_)
+	{
+		const TrackSpline& spline = trackLayout_.GetSpline();
+		Node* characterNode = character_->GetNode();
+		RunnerState& runner = save.runner_;
+		runner.position_ = spline.ToTrack(characterNode->GetPosition());
+		RigidBody* body = characterNode->GetComponent<RigidBody>();
+		if (body)
+			runner.velocity_ = spline.GetRotation(runner.position_.z_).Inverse() * body->GetLinearVelocity();
+		runner.inAirTimer_ = character_->GetInAirTimer();
+		runner.onGround_ = character_->IsOnGround();
+		runner.okToJump_ = character_->IsOkToJump();
+	}
+	// Pickups in flight are not saved, they are back in place after loading and the magnet attracts them again
+	if (magnetTime_ > 0.0f)
+	{
+		SavedPowerUp magnet;
+		magnet.type_ = POWERUP_MAGNET;
+		magnet.remaining_ = magnetTime_;
+		save.powerUps_.Push(magnet);
+	}
+	save.Write(dest);
+}
 
-	// Set the rigidbody to signal collision also when in rest, so that we get ground collisions properly
-	body->SetCollisionEventMode(COLLISION_ALWAYS);
+bool MainScene::LoadRun(Deserializer& source)
+{
+	RunSave save;
+	if (!save.Read(source))
+		return false;
+	return RestoreRun(save);
+}
 
-	// Set a capsule shape for collision
-	CollisionShape* shape = objectNode->CreateComponent<CollisionShape>();
-	shape->SetCapsule(0.7f, 1.8f, Vector3(0.0f,0.9f, 0.0f));
+bool MainScene::RestoreRun(const RunSave& save)
+{
+	// The seed only gives back the same track with the same patterns, or with the built-in generator on both sides
+	if (save.contentHash_ != trackLayout_.GetContentHash())
+	{
+		URHO3D_LOGERROR(ToString("Run save is of a track generated with other patterns (content hash %08x, current %08x)",
+			save.contentHash_, trackLayout_.GetContentHash()));
+		return false;
+	}
+
+	// Everything static comes from the seed: the same track, floor, walls and content as when the run started, with the
+	// collected pickups left out. The floor and walls are only replaced when the save is of another track
+	time_ = save.time_;
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		collected_[i] = save.runner_.collected_[i];
+	pickupScore_ = save.runner_.score_;
+	magnetTime_ = 0.0f;
+	for (unsigned i = 0; i < save.powerUps_.Size(); ++i)
+	{
+		if (save.powerUps_[i].type_ == POWERUP_MAGNET)
+			magnetTime_ = save.powerUps_[i].remaining_;
+	}
+	magnetCollected_.Clear();
+	if (effects_)
+		effects_->StopAll();
+	if (save.seed_ != trackSeed_)
+	{
+		trackSeed_ = save.seed_;
+		GenerateTrack();
+		CreateTrack();
+	}
+	else
+		CreateTrackContent();
+	if (!character_)
+		CreateCharacter();
+
+	const TrackSpline& spline = trackLayout_.GetSpline();
+	const RunnerState& runner = save.runner_;
+	Node* characterNode = character_->GetNode();
+	characterNode->SetPosition(spline.ToWorld(runner.position_));
+	characterNode->SetRotation(Quaternion(spline.GetYaw(save.GetDistance()), Vector3::UP));
+	RigidBody* body = characterNode->GetComponent<RigidBody>();
+	body->SetLinearVelocity(spline.GetRotation(save.GetDistance()) * runner.velocity_);
+	body->SetAngularVelocity(Vector3::ZERO);
+	character_->SetGroundState(runner.onGround_, runner.okToJump_, runner.inAirTimer_);
+	return true;
+}
+
+void MainScene::AttachPhysicsWorld()
+{
+	PhysicsWorld* world = physicsWorld_.Get(scene_);
+	PhysicsProfiler* physicsProfiler = GetSubsystem<PhysicsProfiler>();
+	if (physicsProfiler)
+		physicsProfiler->SetWorld(world);
+#ifdef PHYSICS_THREADING
+	ThreadedPhysics* threadedPhysics = GetSubsystem<ThreadedPhysics>();
+	if (threadedPhysics)
+		threadedPhysics->SetWorld(world);
+#endif
+}
+
+void MainScene::RunSaveBenchmark(unsigned repeats)
+{
+	// Both formats are saved to and loaded from memory, so that only serialization and scene rebuilding are timed. Both
+	// loads end with a playable scene, so the XML load includes creating the track content again
+	VectorBuffer xmlBuffer;
+	VectorBuffer runBuffer;
+	long long xmlSaveUSec = 0;
+	long long xmlLoadUSec = 0;
+	long long runSaveUSec = 0;
+	long long runLoadUSec = 0;
+	float maxPositionError = 0.0f;
+	HiresTimer timer;
+	for (unsigned i = 0; i < repeats; ++i)
+	{
+		xmlBuffer.Clear();
+		timer.Reset();
+		SaveSnapshot(xmlBuffer);
+		xmlSaveUSec += timer.GetUSec(true);
+		xmlBuffer.Seek(0);
+		LoadSnapshot(xmlBuffer);
+		xmlLoadUSec += timer.GetUSec(false);
+
+		Vector3 position = character_->GetNode()->GetPosition();
+		runBuffer.Clear();
+		timer.Reset();
+		SaveRun(runBuffer);
+		runSaveUSec += timer.GetUSec(true);
+		runBuffer.Seek(0);
+		LoadRun(runBuffer);
+		runLoadUSec += timer.GetUSec(false);
+		maxPositionError = Max(maxPositionError, (character_->GetNode()->GetPosition() - position).Length());
+	}
+
+	repeats = Max(repeats, 1U);
+	JSONValue& results = benchmarks_->GetSection("runSave");
+	results["repeats"] = repeats;
+	results["xmlBytes"] = xmlBuffer.GetSize();
+	results["compactBytes"] = runBuffer.GetSize();
+	results["xmlSaveMs"] = xmlSaveUSec / 1000.0 / repeats;
+	results["xmlLoadMs"] = xmlLoadUSec / 1000.0 / repeats;
+	results["compactSaveMs"] = runSaveUSec / 1000.0 / repeats;
+	results["compactLoadMs"] = runLoadUSec / 1000.0 / repeats;
+	results["maxPositionError"] = maxPositionError;
+	URHO3D_LOGINFO(ToString("Run save: XML %u bytes, save %.3f ms, load %.3f ms; compact %u bytes, save %.3f ms, load %.3f ms",
+		xmlBuffer.GetSize(), xmlSaveUSec / 1000.0 / repeats, xmlLoadUSec / 1000.0 / repeats, runBuffer.GetSize(),
+		runSaveUSec / 1000.0 / repeats, runLoadUSec / 1000.0 / repeats));
+}
+
+void MainScene::UpdateSceneryBenchmark()
+{
+	// Main thread time of the last complete frame, without the frame limiter's wait
+	FrameSampler* sampler = GetSubsystem<FrameSampler>();
+	if (sampler->GetNumSamples())
+	{
+		const FrameSample& sample = sampler->GetSample(0);
+		float frameMs = 0.0f;
+		for (unsigned i = 0; i < FRAME_IDLE; ++i)
+			frameMs += sample.stageMs_[i];
+		sceneryFrameMs_.Push(frameMs);
+	}
+	sceneryUpdateMs_.Push(scenery_->GetLastUpdateUSec() / 1000.0f);
 
-	// Create the character logic component, which takes care of steering the rigidbody
-	// Remember it so that we can set the controls. Use a WeakPtr because the scene hierarchy already owns it
+	sceneryBenchmarkDistance_ += SCENERY_BENCHMARK_STEP;
+	if (sceneryBenchmarkDistance_ < sceneryBenchmarkLength_)
+		return;
+
+	unsigned hitches = 0;
+	for (unsigned i = 0; i < sceneryFrameMs_.Size(); ++i)
+	{
+		if (sceneryFrameMs_[i] > 1000.0f / 30.0f)
+			++hitches;
+	}
+
+	JSONValue& scenery = benchmarks_->GetSection("sceneryRun");
+	scenery["lengthKm"] = sceneryBenchmarkLength_ / 1000.0f;
+	scenery["frames"] = sceneryUpdateMs_.Size();
+	scenery["hitches"] = hitches;
+	scenery["themeChanges"] = numThemeChanges_;
+	scenery["prefetchSegments"] = prefetchAhead_;
+	scenery["gameplayLoads"] = GetSubsystem<ResourceProfiler>()->GetNumGameplayLoads();
+	scenery["frameMs"] = GetPercentiles(sceneryFrameMs_);
+	scenery["updateMs"] = GetPercentiles(sceneryUpdateMs_);
+	URHO3D_LOGINFO(ToString("Scenery run of %.1f km: frame p50 %.2f p99 %.2f max %.2f ms, scenery update p99 %.3f max %.3f ms, "
+		"%u frames over 33 ms, %u theme changes, %u synchronous loads", sceneryBenchmarkLength_ / 1000.0f,
+		scenery["frameMs"]["p50"].GetFloat(), scenery["frameMs"]["p99"].GetFloat(), scenery["frameMs"]["max"].GetFloat(),
+		scenery["updateMs"]["p99"].GetFloat(), scenery["updateMs"]["max"].GetFloat(), hitches, numThemeChanges_,
+		GetSubsystem<ResourceProfiler>()->GetNumGameplayLoads()));
+
+	sceneryBenchmarkLength_ = 0.0f;
+	engine_->Exit();
+}
+
+void MainScene::CreateCharacter() {
+	MemoryScope memoryScope(MEMTAG_ANIMATION);
+	// Remember the character so that we can set the controls. Use a WeakPtr because the scene hierarchy already owns it
 	// and keeps it alive as long as it's not removed from the hierarchy
-	character_ = objectNode->CreateComponent<Character>();
-	//////////////////
+	character_ = CreateRunner(scene_);
 }
 
 
 void MainScene::SubscribeToEvents()
 {
+	// Subscribe to BeginFrame event for restoring a loaded run before anything of the frame has run
+	SubscribeToEvent(E_BEGINFRAME, GAME_HANDLER(MainScene, HandleBeginFrame));
 	// Subscribe to Update event for setting the character controls before physics simulation
-	SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(MainScene, HandleUpdate));
+	SubscribeToEvent(E_UPDATE, GAME_HANDLER(MainScene, HandleUpdate));
 
 	// Subscribe to PostUpdate event for updating the camera position after physics simulation
-	SubscribeToEvent(E_POSTUPDATE, URHO3D_HANDLER(MainScene, HandlePostUpdate));
-	SubscribeToEvent(E_POSTRENDERUPDATE, URHO3D_HANDLER(MainScene, HandlePostRenderUpdate));
+	SubscribeToEvent(E_POSTUPDATE, GAME_HANDLER(MainScene, HandlePostUpdate));
+	SubscribeToEvent(E_POSTRENDERUPDATE, GAME_HANDLER(MainScene, HandlePostRenderUpdate));
+	SubscribeToEvent(E_PHYSICSCOLLISIONSTART, GAME_HANDLER(MainScene, HandlePhysicsCollisionStart));
 	// Unsubscribe the SceneUpdate event from base class as the camera node is being controlled in HandlePostUpdate() in this sample
 	UnsubscribeFromEvent(E_SCENEUPDATE);
 }
 
+void MainScene::HandleBeginFrame(StringHash eventType, VariantMap& eventData)
+{
+	if (!runPending_)
+		return;
+	runPending_ = false;
+	RestoreRun(pendingRun_);
+}
+
 void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 {
 
 	using namespace Update;
 
-	Input* input = GetSubsystem<Input>();
+	Input* input = input_;
+
+	if (rollback_ || broadcast_)
+	{
+		unsigned buttons = CTRL_FORWARD;
+		UI* ui = ui_;
+		if (!ui->GetFocusElement())
+		{
+			if (input->GetKeyDown(KEY_A))
+				buttons |= CTRL_LEFT;
+			if (input->GetKeyDown(KEY_D))
+				buttons |= CTRL_RIGHT;
+			if (input->GetKeyDown(KEY_SPACE))
+				buttons |= CTRL_JUMP;
+		}
+		if (rollback_)
+			rollback_->SetLocalButtons(buttons);
+		else
+			broadcast_->SetLocalButtons(buttons);
+		return;
+	}
 
 	if (character_)
 	{
+		// Only the track content around the character needs physics bodies
+		const TrackSpline& spline = trackLayout_.GetSpline();
+		Vector3 trackPosition = spline.ToTrack(character_->GetNode()->GetPosition());
+		float distance = trackPosition.z_;
+		CollectPickups(trackPosition);
+		UpdateMagnet(trackPosition, eventData[P_TIMESTEP].GetFloat());
+		{
+			MemoryScope memoryScope(MEMTAG_TRACK_ENTITIES);
+			trackEntities_.UpdatePromotion(scene_, distance - PROMOTE_BEHIND, distance + PROMOTE_AHEAD);
+		}
+
 		// Clear previous controls
 		character_->controls_.Set(CTRL_FORWARD | CTRL_BACK | CTRL_LEFT | CTRL_RIGHT | CTRL_JUMP, false);
 
@@ -314,7 +923,7 @@ void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 	
 
 		// Update controls using keys
-		UI* ui = GetSubsystem<UI>();
+		UI* ui = ui_;
 		if (!ui->GetFocusElement())
 		{
 			if (!touch_ || !touch_->useGyroscope_)
@@ -335,7 +944,7 @@ void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 					TouchState* state = input->GetTouch(i);
 					if (!state->touchedElement_)    // Touch on empty space
 					{
-						Camera* camera = cameraNode_->GetComponent<Camera>();
+						Camera* camera = camera_.Get(cameraNode_);
 						if (!camera)
 							return;
 
@@ -356,9 +965,15 @@ void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 			// Limit pitch
 			//character_->controls_.pitch_ = Clamp(character_->controls_.pitch_, -80.0f, 80.0f);
 			// Set rotation already here so that it's updated every rendering frame instead of every physics frame
+			// Steer along the track: forward is always the track direction at the character's distance
+			character_->controls_.yaw_ = spline.GetYaw(distance);
 			character_->GetNode()->SetRotation(Quaternion(character_->controls_.yaw_, Vector3::UP));
 
 
+			// Magnet power-up on demand, as the track does not place power-ups yet
+			if (input->GetKeyPress(KEY_M))
+				magnetTime_ = MAGNET_DURATION;
+
 			// Turn on/off gyroscope on mobile platform
 			if (touch_ && input->GetKeyPress(KEY_G))
 				touch_->useGyroscope_ = !touch_->useGyroscope_;
@@ -367,17 +982,25 @@ void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 			if (input->GetKeyPress(KEY_F5))
 			{
 				File saveFile(context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/CharacterDemo.xml", FILE_WRITE);
-				scene_->SaveXML(saveFile);
+				SaveSnapshot(saveFile);
 			}
 			if (input->GetKeyPress(KEY_F7))
 			{
 				File loadFile(context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/CharacterDemo.xml", FILE_READ);
-				scene_->LoadXML(loadFile);
-				// After loading we have to reacquire the weak pointer to the Character component, as it has been recreated
-				// Simply find the character's scene node by name as there's only one of them
-				Node* characterNode = scene_->GetChild("Jack", true);
-				if (characterNode)
-					character_ = characterNode->GetComponent<Character>();
+				LoadSnapshot(loadFile);
+			}
+			// Compact run save: seed and dynamic state only, the track is regenerated on load. Reading is done here, restoring
+			// waits for the start of the next frame, so that the rest of this frame still sees the track it started with
+			if (input->GetKeyPress(KEY_F6))
+			{
+				File saveFile(context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/Run.sav", FILE_WRITE);
+				SaveRun(saveFile);
+			}
+			if (input->GetKeyPress(KEY_F8))
+			{
+				File loadFile(context_, GetSubsystem<FileSystem>()->GetProgramDir() + "Data/Scenes/Run.sav", FILE_READ);
+				if (loadFile.IsOpen() && pendingRun_.Read(loadFile))
+					runPending_ = true;
 			}
 		}
 		
@@ -387,56 +1010,93 @@ void MainScene::HandleUpdate(StringHash eventType, VariantMap& eventData)
 
 void MainScene::HandlePostUpdate(StringHash eventType, VariantMap& eventData)
 {
-	if (!character_)
+	Node* characterNode = 0;
+	float pitch = 0.0f;
+	if (character_)
+	{
+		characterNode = character_->GetNode();
+		pitch = character_->controls_.pitch_;
+	}
+	else if (rollback_)
+		characterNode = rollback_->GetLocalRunner();
+	else if (broadcast_)
+		characterNode = broadcast_->GetRunner();
+	if (!characterNode || !text_)
 		return;
 
-	Node* characterNode = character_->GetNode();
+	// Scenery and themes follow the runner, or travel on their own in a -scenerybenchmark run
+	float distance = sceneryBenchmarkLength_ > 0.0f ? sceneryBenchmarkDistance_ :
+		trackLayout_.GetSpline().ToTrack(characterNode->GetPosition()).z_;
+	UpdateThemes(distance);
+	if (scenery_)
+	{
+		scenery_->Update(scene_, distance);
+		if (sceneryBenchmarkLength_ > 0.0f)
+			UpdateSceneryBenchmark();
+	}
 
 	// update wyswietlanego score
 	time_ += 0.01;
-	std::string str;
-	str.append("Score: ");
-	str.append(std::to_string(int(time_ * 10)));
-	String s(str.c_str(), str.size());
-	text_->SetText(s);
-
-	// update wyswietlanej pozycji bohatera
-	std::string str2;
-	str2.append("posX: ");
-	str2.append(std::to_string(int(characterNode->GetPosition().x_)));
-	str2.append(" posY: ");
-	str2.append(std::to_string(int(characterNode->GetPosition().y_)));
-	str2.append(" posZ: ");
-	str2.append(std::to_string(int(characterNode->GetPosition().z_)));
-	String s2(str2.c_str(), str2.size());
-	text2_->SetText(s2);
-	
+	{
+		MemoryScope memoryScope(MEMTAG_UI);
+		text_->SetText(FormatScoreText(time_));
 
+		// update wyswietlanej pozycji bohatera
+		text2_->SetText(FormatPositionText(characterNode->GetPosition()));
+	}
 
+	// Third person camera behind the character, pulled in front of camera blockers
+	UpdateThirdPersonCamera(physicsWorld_.Get(scene_), cameraNode_, characterNode->GetPosition(), characterNode->GetRotation(), pitch,
+		touch_ ? touch_->cameraDistance_ : CAMERA_INITIAL_DIST);
 
-	// Get camera lookat dir from character yaw + pitch
-	Quaternion rot = characterNode->GetRotation();
-	Quaternion dir = rot * Quaternion(character_->controls_.pitch_, Vector3::RIGHT);
+	// Track content hidden behind the nearest boxes and the floor is left out of rendering
+	float cameraDistance = trackLayout_.GetSpline().ToTrack(cameraNode_->GetPosition()).z_;
+	if (occlusion_)
+		occlusion_->Update(camera_.Get(cameraNode_), trackEntities_, cameraDistance);
+	if (corridorCulling_)
+		UpdateCorridorCulling(cameraDistance);
+	
+	
+}
 
-		// Third person camera: position behind the character
-		Vector3 aimPoint = characterNode->GetPosition() + rot * Vector3(0.0f, 2.2f, -1.0f);
+void MainScene::HandleTrackPatternsChanged(StringHash eventType, VariantMap& eventData)
+{
+	// Designer iteration: the running track is rebuilt with the new patterns in place. Pickup indices and positions change with
+	// the track, so collected pickups, the score and the magnet start over
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		collected_[i] = 0;
+	pickupScore_ = 0;
+	magnetTime_ = 0.0f;
+	magnetCollected_.Clear();
+	GenerateTrack();
+	CreateTrackContent();
+}
 
-		// Collide camera ray with static physics objects (layer bitmask 2) to ensure we see the character properly
-		Vector3 rayDir = dir * Vector3::BACK;
-		float rayDistance = touch_ ? touch_->cameraDistance_ : CAMERA_INITIAL_DIST;
-		PhysicsRaycastResult result;
-		scene_->GetComponent<PhysicsWorld>()->RaycastSingle(result, Ray(aimPoint, rayDir), rayDistance, 2);
-		if (result.body_)
-			rayDistance = Min(rayDistance, result.distance_);
-		rayDistance = Clamp(rayDistance, CAMERA_MIN_DIST, CAMERA_MAX_DIST);
+void MainScene::HandlePhysicsCollisionStart(StringHash eventType, VariantMap& eventData)
+{
+	using namespace PhysicsCollisionStart;
 
-		cameraNode_->SetPosition(aimPoint + rayDir * rayDistance);
-		cameraNode_->SetRotation(dir);
-	
-	
+	if (!character_ || !effects_ || eventData[P_TRIGGER].GetBool())
+		return;
+
+	Node* runner = character_->GetNode();
+	RigidBody* other;
+	if (eventData[P_NODEA].GetPtr() == runner)
+		other = static_cast<RigidBody*>(eventData[P_BODYB].GetPtr());
+	else if (eventData[P_NODEB].GetPtr() == runner)
+		other = static_cast<RigidBody*>(eventData[P_BODYA].GetPtr());
+	else
+		return;
+	if (!other || !(other->GetCollisionLayer() & COLLISION_OBSTACLE))
+		return;
+
+	MemoryBuffer contacts(eventData[P_CONTACTS].GetBuffer());
+	effects_->Play(impactEffect_, contacts.IsEof() ? runner->GetPosition() : contacts.ReadVector3());
 }
 
 void MainScene::HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData)
 {
-	GetSubsystem<Renderer>()->DrawDebugGeometry(true);
+	Renderer* renderer = renderer_;
+	if (renderer)
+		renderer->DrawDebugGeometry(true);
 }
\ No newline at end of file
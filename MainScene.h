@@ -1,14 +1,36 @@
 #pragma once
 
 #include "App.h"
+#include "CachedHandle.h"
+#include "CollisionMatrix.h"
+#include "CorridorIndex.h"
+#include "PickupMagnet.h"
+#include "RunSave.h"
+#include "RunnerSim.h"
+#include "TrackEntities.h"
+#include "TrackLayout.h"
 
 namespace Urho3D
 {
+	class Camera;
+	class Deserializer;
 	class Node;
+	class PhysicsWorld;
+	class Renderer;
 	class Scene;
+	class Serializer;
+	class UI;
 }
 
+class AssetPrefetcher;
 class Character;
+class BroadcastSession;
+class EffectPool;
+class RollbackSession;
+class SceneBenchmarks;
+class SceneryStreamer;
+class ScoreStore;
+class TrackOcclusion;
 class Touch;
 
 class MainScene : public App 
@@ -26,25 +48,151 @@ public:
 	~MainScene();
 
 	virtual void Start();
+	/// Submit the run score to the local leaderboard and stop.
+	virtual void Stop();
 
 private:
+	/// Generate the track layout from the seed, with the scripted patterns when there are any.
+	void GenerateTrack();
 	// Utworzenie sceny
 	void CreateScene();
+	/// Create the floor and wall pieces along the track layout, replacing those of a previous track, and the track content.
+	void CreateTrack();
+	/// Take the floor and wall pieces out of the octree and index them by track distance for corridor culling.
+	void IndexTrackPieces();
+	/// Put only the floor and wall pieces the corridor index finds in view of the camera at a track distance into the octree.
+	void UpdateCorridorCulling(float distance);
+	/// Create obstacles and pickups from the track layout. Collected pickups are left hidden.
+	void CreateTrackContent();
+	/// Prefetch the themes coming up within the prefetch distance, release the ones left behind, and switch to the theme at
+	/// a track distance.
+	void UpdateThemes(float distance);
+	/// Request the prefabs and materials of a theme from the prefetcher.
+	void RequestTheme(unsigned theme, int priority);
+	/// Release a theme from the prefetcher and forget its prefabs, except those another wanted theme shares.
+	void ReleaseTheme(unsigned theme, unsigned wantedThemes);
+	/// Show a theme: set the floor and wall materials and the track content prefabs.
+	void ApplyTheme(unsigned theme);
+	/// Collect the pickups the character touches at a track position.
+	void CollectPickups(const Vector3& trackPosition);
+	/// Count a pickup as collected, hide it and play the pickup effect where it is.
+	void CollectPickup(unsigned pickupIndex);
+	/// Run the magnet power-up while it is active or pickups are still flying, and count the pickups it brings in.
+	void UpdateMagnet(const Vector3& trackPosition, float timeStep);
+	/// Save the whole scene as XML.
+	void SaveSnapshot(Serializer& dest);
+	/// Load the whole scene from XML and create the track content again. Return true if successful.
+	bool LoadSnapshot(Deserializer& source);
+	/// Save the run compactly: seed, run time, runner state, collected pickups and power-ups.
+	void SaveRun(Serializer& dest);
+	/// Load a compact run save and restore it. Return true if successful.
+	bool LoadRun(Deserializer& source);
+	/// Restore a run in the current scene: the track from its seed, the track content without the collected pickups, and the
+	/// runner. The scene, camera and viewport are kept. Return false if the save is of a track from other patterns.
+	bool RestoreRun(const RunSave& save);
+	/// Attach the physics profiler and threading to the physics world after the scene has been recreated.
+	void AttachPhysicsWorld();
 	// Utworzenie bohatera
 	void CreateCharacter();
+	/// Measure size and save and load time of the compact run save against the XML snapshot and log them.
+	void RunSaveBenchmark(unsigned repeats);
+	/// Record a frame of the scenery benchmark run, and log the frame time percentiles and exit at its end.
+	void UpdateSceneryBenchmark();
 	
 	void UpdateText();
 
 	void SubscribeToEvents();
 	
+	/// Handle the start of a frame. Restore a run save loaded during the previous frame.
+	void HandleBeginFrame(StringHash eventType, VariantMap& eventData);
 	/// Handle application update. Set controls to character.
 	void HandleUpdate(StringHash eventType, VariantMap& eventData);
 	/// Handle application post-update. Update camera position after character has moved.
 	void HandlePostUpdate(StringHash eventType, VariantMap& eventData);
 	void HandlePostRenderUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle track pattern script reload.
+	void HandleTrackPatternsChanged(StringHash eventType, VariantMap& eventData);
+	/// Handle a new physics contact. Play the impact effect where the character hits an obstacle.
+	void HandlePhysicsCollisionStart(StringHash eventType, VariantMap& eventData);
 
 	/// Touch utility object.
 	SharedPtr<Touch> touch_;
 	/// The controllable character component.
 	WeakPtr<Character> character_;
+	/// Obstacle and pickup layout.
+	TrackLayout trackLayout_;
+	/// Track seed, from -seed.
+	unsigned trackSeed_;
+	/// Networked race session, if started with -rollback.
+	SharedPtr<RollbackSession> rollback_;
+	/// Live run broadcast, if started with -broadcast or -spectate.
+	SharedPtr<BroadcastSession> broadcast_;
+	/// Obstacles and pickups.
+	TrackEntityStore trackEntities_;
+	/// Pickups collected by the character, by pickup index.
+	unsigned collected_[PICKUP_MASK_WORDS];
+	/// Number of pickups collected by the character.
+	unsigned pickupScore_;
+	/// Magnet power-up.
+	PickupMagnet magnet_;
+	/// Seconds left of the magnet power-up.
+	float magnetTime_;
+	/// Pickups brought in by the magnet in the last update.
+	PODVector<unsigned> magnetCollected_;
+	/// Run save to restore at the start of the next frame.
+	RunSave pendingRun_;
+	/// Whether there is a run save to restore.
+	bool runPending_;
+	/// Pooled pickup and impact effects.
+	SharedPtr<EffectPool> effects_;
+	/// Pickup effect index in the pool.
+	unsigned pickupEffect_;
+	/// Impact effect index in the pool.
+	unsigned impactEffect_;
+	/// Local leaderboard, ranking the runs made on this machine.
+	SharedPtr<ScoreStore> localScores_;
+	/// Roadside terrain.
+	SharedPtr<SceneryStreamer> scenery_;
+	/// Scenery benchmark run length, from -scenerybenchmark, or 0 when not running.
+	float sceneryBenchmarkLength_;
+	/// Scenery benchmark distance travelled.
+	float sceneryBenchmarkDistance_;
+	/// Main thread frame times during the scenery benchmark.
+	PODVector<float> sceneryFrameMs_;
+	/// Scenery update times during the scenery benchmark.
+	PODVector<float> sceneryUpdateMs_;
+	/// Occlusion culling of track content, unless started with -noocclusion.
+	SharedPtr<TrackOcclusion> occlusion_;
+	/// Occlusion culling enabled.
+	bool occlusionEnabled_;
+	/// Floor and wall pieces by track distance, when started with -corridorculling.
+	CorridorIndex corridor_;
+	/// Pieces put into the octree by corridor culling in the last update.
+	PODVector<Drawable*> corridorShown_;
+	/// Corridor culling enabled.
+	bool corridorCulling_;
+	/// Background loading of upcoming themes, unless started with -noprefetch.
+	SharedPtr<AssetPrefetcher> prefetcher_;
+	/// Segments ahead of the runner whose themes are prefetched, from -prefetchahead.
+	unsigned prefetchAhead_;
+	/// Segment the theme requests were last published for, or -1 to publish them again.
+	int prefetchSegment_;
+	/// Themes requested from the prefetcher, one bit each.
+	unsigned requestedThemes_;
+	/// Theme shown, or M_MAX_UNSIGNED when the content has been created again and needs it applied.
+	unsigned currentTheme_;
+	/// Theme switches during the run.
+	unsigned numThemeChanges_;
+	/// Input subsystem.
+	SubsystemHandle<Input> input_;
+	/// UI subsystem.
+	SubsystemHandle<UI> ui_;
+	/// Renderer subsystem, null when headless.
+	SubsystemHandle<Renderer> renderer_;
+	/// Physics world of the scene, looked up again after a scene load.
+	ComponentHandle<PhysicsWorld> physicsWorld_;
+	/// Camera component of the camera node.
+	ComponentHandle<Camera> camera_;
+	/// Startup benchmarks, if any were requested on the command line.
+	SharedPtr<SceneBenchmarks> benchmarks_;
 };
\ No newline at end of file
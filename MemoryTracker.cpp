@@ -0,0 +1,442 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <Bullet/LinearMath/btAlignedAllocator.h>
+
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/UI/Font.h>
+#include <Urho3D/UI/Text.h>
+
+#include "EventStats.h"
+#include "MemoryTracker.h"
+#include "MetricsExport.h"
+
+/// Category names, for the HUD and metrics.
+static const char* tagNames[] =
+{
+	"engine",
+	"track",
+	"layout",
+	"obstaclesAndPickups",
+	"scenery",
+	"physics",
+	"ui",
+	"animation",
+	"scripting",
+	"leaderboard"
+};
+
+/// Category parents.
+static const MemoryTag tagParents[] =
+{
+	MAX_MEMORY_TAGS,
+	MAX_MEMORY_TAGS,
+	MEMTAG_TRACK,
+	MEMTAG_TRACK,
+	MEMTAG_TRACK,
+	MAX_MEMORY_TAGS,
+	MAX_MEMORY_TAGS,
+	MAX_MEMORY_TAGS,
+	MAX_MEMORY_TAGS,
+	MAX_MEMORY_TAGS
+};
+
+const char* GetMemoryTagName(MemoryTag tag)
+{
+	return tag < MAX_MEMORY_TAGS ? tagNames[tag] : "";
+}
+
+MemoryTag GetMemoryTagParent(MemoryTag tag)
+{
+	return tag < MAX_MEMORY_TAGS ? tagParents[tag] : MAX_MEMORY_TAGS;
+}
+
+#ifdef MEMORY_TAGS
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEMORY_THREAD_LOCAL __declspec(thread)
+#define MEMORY_ATOMIC_ADD(value, delta) _InterlockedExchangeAdd64(&(value), (delta))
+#else
+#define MEMORY_THREAD_LOCAL __thread
+#define MEMORY_ATOMIC_ADD(value, delta) __sync_fetch_and_add(&(value), (delta))
+#endif
+
+/// Bytes in front of every tagged allocation, keeping the allocator's alignment.
+static const size_t HEADER_SIZE = 16;
+/// Allocation and free pairs timed by the calibration, per round.
+static const unsigned CALIBRATION_BLOCKS = 1024;
+/// Calibration rounds.
+static const unsigned CALIBRATION_ROUNDS = 64;
+/// Allocation size used by the calibration.
+static const size_t CALIBRATION_SIZE = 64;
+/// HUD refresh interval in seconds.
+static const float VIEW_INTERVAL = 0.5f;
+/// Width of the category column of the HUD view.
+static const unsigned VIEW_NAME_WIDTH = 22;
+
+/// Header in front of a tagged allocation.
+struct AllocationHeader
+{
+	/// Requested size.
+	size_t size_;
+	/// Category.
+	unsigned tag_;
+};
+
+/// Counters of one category, updated from any thread.
+struct TagCounters
+{
+	/// Bytes allocated and not yet freed.
+	volatile long long liveBytes_;
+	/// Allocations not yet freed.
+	volatile long long liveAllocations_;
+	/// Allocations made.
+	volatile long long allocations_;
+};
+
+/// Counters of all categories. Zero-initialized before any allocation, including those of static constructors.
+static TagCounters counters[MAX_MEMORY_TAGS];
+/// Category of the calling thread's allocations.
+static MEMORY_THREAD_LOCAL unsigned currentTag = MEMTAG_ENGINE;
+
+MemoryTag GetMemoryTag()
+{
+	return (MemoryTag)currentTag;
+}
+
+MemoryTag SetMemoryTag(MemoryTag tag)
+{
+	MemoryTag previous = (MemoryTag)currentTag;
+	currentTag = tag;
+	return previous;
+}
+
+MemoryTagStats GetMemoryTagStats(MemoryTag tag)
+{
+	MemoryTagStats stats;
+	stats.liveBytes_ = counters[tag].liveBytes_;
+	stats.liveAllocations_ = counters[tag].liveAllocations_;
+	stats.allocations_ = counters[tag].allocations_;
+	return stats;
+}
+
+void* TaggedAlloc(size_t size, MemoryTag tag)
+{
+	unsigned char* block = static_cast<unsigned char*>(malloc(size + HEADER_SIZE));
+	if (!block)
+		return 0;
+
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(block);
+	header->size_ = size;
+	header->tag_ = tag;
+	MEMORY_ATOMIC_ADD(counters[tag].liveBytes_, (long long)size);
+	MEMORY_ATOMIC_ADD(counters[tag].liveAllocations_, 1LL);
+	MEMORY_ATOMIC_ADD(counters[tag].allocations_, 1LL);
+	return block + HEADER_SIZE;
+}
+
+void TaggedFree(void* ptr)
+{
+	if (!ptr)
+		return;
+
+	unsigned char* block = static_cast<unsigned char*>(ptr) - HEADER_SIZE;
+	AllocationHeader* header = reinterpret_cast<AllocationHeader*>(block);
+	MEMORY_ATOMIC_ADD(counters[header->tag_].liveBytes_, -(long long)header->size_);
+	MEMORY_ATOMIC_ADD(counters[header->tag_].liveAllocations_, -1LL);
+	free(block);
+}
+
+void* TaggedRealloc(void* ptr, size_t size, MemoryTag tag)
+{
+	if (!ptr)
+		return TaggedAlloc(size, tag);
+
+	void* newPtr = TaggedAlloc(size, tag);
+	if (!newPtr)
+		return 0;
+	const AllocationHeader* header = reinterpret_cast<const AllocationHeader*>(static_cast<unsigned char*>(ptr) - HEADER_SIZE);
+	memcpy(newPtr, ptr, header->size_ < size ? header->size_ : size);
+	TaggedFree(ptr);
+	return newPtr;
+}
+
+static void* AllocPhysics(size_t size)
+{
+	return TaggedAlloc(size, MEMTAG_PHYSICS);
+}
+
+void InstallPhysicsAllocator()
+{
+	// The physics library aligns within the block itself, so only the plain allocation functions are replaced
+	btAlignedAllocSetCustom(AllocPhysics, TaggedFree);
+}
+
+// Every allocation of the game and the statically linked engine goes through the tagged allocator, in the calling thread's
+// category. Engine code allocating in a scope of the game is counted in the game's category.
+void* operator new(size_t size)
+{
+	void* ptr = TaggedAlloc(size, (MemoryTag)currentTag);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	void* ptr = TaggedAlloc(size, (MemoryTag)currentTag);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) throw()
+{
+	return TaggedAlloc(size, (MemoryTag)currentTag);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) throw()
+{
+	return TaggedAlloc(size, (MemoryTag)currentTag);
+}
+
+void operator delete(void* ptr) throw()
+{
+	TaggedFree(ptr);
+}
+
+void operator delete[](void* ptr) throw()
+{
+	TaggedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) throw()
+{
+	TaggedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) throw()
+{
+	TaggedFree(ptr);
+}
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+// DebugNew.h maps new to the CRT debug allocator, whose blocks would otherwise be freed by the tagged delete above
+void* operator new(size_t size, int, const char*, int)
+{
+	return operator new(size);
+}
+
+void* operator new[](size_t size, int, const char*, int)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr, int, const char*, int)
+{
+	TaggedFree(ptr);
+}
+
+void operator delete[](void* ptr, int, const char*, int)
+{
+	TaggedFree(ptr);
+}
+#endif
+
+MemoryTracker::MemoryTracker(Context* context) :
+	Object(context),
+	nextSnapshotMs_(0),
+	firstAllocations_(-1),
+	frames_(0),
+	overheadNs_(0.0f)
+{
+	Calibrate();
+	SubscribeToEvent(E_ENDFRAME, GAME_HANDLER(MemoryTracker, HandleEndFrame));
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(MemoryTracker, HandleCollectMetrics));
+}
+
+MemoryTagStats MemoryTracker::GetTreeStats(MemoryTag tag) const
+{
+	MemoryTagStats stats = GetMemoryTagStats(tag);
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+	{
+		if (GetMemoryTagParent((MemoryTag)i) != tag)
+			continue;
+		MemoryTagStats child = GetTreeStats((MemoryTag)i);
+		stats.liveBytes_ += child.liveBytes_;
+		stats.liveAllocations_ += child.liveAllocations_;
+		stats.allocations_ += child.allocations_;
+	}
+	return stats;
+}
+
+String MemoryTracker::GetTreeText() const
+{
+	String text("category               live KB, blocks\n");
+	long long totalBytes = 0;
+	long long totalAllocations = 0;
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+	{
+		MemoryTag tag = (MemoryTag)i;
+		MemoryTag parent = GetMemoryTagParent(tag);
+		MemoryTagStats stats = GetTreeStats(tag);
+		// Children follow their parent in the enum, so the tree prints in order
+		String name = parent == MAX_MEMORY_TAGS ? String(GetMemoryTagName(tag)) : "  " + String(GetMemoryTagName(tag));
+		while (name.Length() < VIEW_NAME_WIDTH)
+			name += ' ';
+		text.AppendWithFormat("%s %.1f, %u\n", name.CString(), stats.liveBytes_ / 1024.0, (unsigned)stats.liveAllocations_);
+		if (parent == MAX_MEMORY_TAGS)
+		{
+			totalBytes += stats.liveBytes_;
+			totalAllocations += stats.liveAllocations_;
+		}
+	}
+	String name("total");
+	while (name.Length() < VIEW_NAME_WIDTH)
+		name += ' ';
+	text.AppendWithFormat("%s %.1f, %u\n%.0f allocations per frame, %.1f ns tagging each", name.CString(), totalBytes / 1024.0,
+		(unsigned)totalAllocations, GetAllocationsPerFrame(), overheadNs_);
+	return text;
+}
+
+float MemoryTracker::GetAllocationsPerFrame() const
+{
+	if (frames_ < 2)
+		return 0.0f;
+	long long allocations = 0;
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+		allocations += counters[i].allocations_;
+	return (float)(allocations - firstAllocations_) / (frames_ - 1);
+}
+
+void MemoryTracker::Calibrate()
+{
+	// The same allocation pattern through malloc alone and through the tagged allocator; the difference is the tagging cost
+	PODVector<void*> blocks(CALIBRATION_BLOCKS);
+	HiresTimer timer;
+	long long plainUSec = 0;
+	long long taggedUSec = 0;
+	for (unsigned round = 0; round < CALIBRATION_ROUNDS; ++round)
+	{
+		timer.Reset();
+		for (unsigned i = 0; i < CALIBRATION_BLOCKS; ++i)
+			blocks[i] = malloc(CALIBRATION_SIZE);
+		for (unsigned i = 0; i < CALIBRATION_BLOCKS; ++i)
+			free(blocks[i]);
+		plainUSec += timer.GetUSec(true);
+
+		for (unsigned i = 0; i < CALIBRATION_BLOCKS; ++i)
+			blocks[i] = operator new(CALIBRATION_SIZE);
+		for (unsigned i = 0; i < CALIBRATION_BLOCKS; ++i)
+			operator delete(blocks[i]);
+		taggedUSec += timer.GetUSec(false);
+	}
+	overheadNs_ = Max((taggedUSec - plainUSec) * 1000.0f / (CALIBRATION_ROUNDS * CALIBRATION_BLOCKS), 0.0f);
+}
+
+void MemoryTracker::TakeSnapshot()
+{
+	if (snapshots_.Size() == MEMORY_SNAPSHOTS)
+		snapshots_.Erase(0);
+	Snapshot snapshot;
+	snapshot.time_ = timer_.GetMSec(false) / 1000.0f;
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+		snapshot.liveBytes_[i] = counters[i].liveBytes_;
+	snapshots_.Push(snapshot);
+}
+
+void MemoryTracker::WriteTree(JSONValue& dest, MemoryTag tag) const
+{
+	MemoryTagStats own = GetMemoryTagStats(tag);
+	MemoryTagStats tree = GetTreeStats(tag);
+	JSONValue& node = dest[GetMemoryTagName(tag)];
+	node["liveBytes"] = (double)tree.liveBytes_;
+	node["liveAllocations"] = (double)tree.liveAllocations_;
+	node["allocations"] = (double)tree.allocations_;
+	if (tree.allocations_ == own.allocations_)
+		return;
+	node["ownBytes"] = (double)own.liveBytes_;
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+	{
+		if (GetMemoryTagParent((MemoryTag)i) == tag)
+			WriteTree(node["children"], (MemoryTag)i);
+	}
+}
+
+void MemoryTracker::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	if (firstAllocations_ < 0)
+	{
+		firstAllocations_ = 0;
+		for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+			firstAllocations_ += counters[i].allocations_;
+	}
+	++frames_;
+
+	if (timer_.GetMSec(false) >= nextSnapshotMs_)
+	{
+		TakeSnapshot();
+		nextSnapshotMs_ += (unsigned)(MEMORY_SNAPSHOT_INTERVAL * 1000.0f);
+	}
+}
+
+void MemoryTracker::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& memory = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["memory"];
+	JSONValue& tags = memory["tags"];
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+	{
+		if (GetMemoryTagParent((MemoryTag)i) == MAX_MEMORY_TAGS)
+			WriteTree(tags, (MemoryTag)i);
+	}
+
+	JSONValue snapshots;
+	for (unsigned i = 0; i < snapshots_.Size(); ++i)
+	{
+		JSONValue snapshot;
+		snapshot["time"] = snapshots_[i].time_;
+		for (unsigned j = 0; j < MAX_MEMORY_TAGS; ++j)
+			snapshot[GetMemoryTagName((MemoryTag)j)] = (double)snapshots_[i].liveBytes_[j];
+		snapshots.Push(snapshot);
+	}
+	memory["snapshotInterval"] = MEMORY_SNAPSHOT_INTERVAL;
+	memory["snapshots"] = snapshots;
+
+	// The frame cost is the calibrated cost per allocation times the allocations counted, not a measured frame time, which
+	// would need the same run built with and without MEMORY_TAGS
+	float allocationsPerFrame = GetAllocationsPerFrame();
+	JSONValue& overhead = memory["overhead"];
+	overhead["nsPerAllocation"] = overheadNs_;
+	overhead["allocationsPerFrame"] = allocationsPerFrame;
+	overhead["estimatedMsPerFrame"] = allocationsPerFrame * overheadNs_ / 1000000.0f;
+}
+
+MemoryView::MemoryView(Context* context) :
+	UIElement(context),
+	refreshTimer_(0.0f)
+{
+	SetPriority(100);
+
+	text_ = CreateChild<Text>();
+	text_->SetFont(GetSubsystem<ResourceCache>()->GetResource<Font>("Fonts/Anonymous Pro.ttf"), 10);
+	text_->SetColor(Color::WHITE);
+}
+
+void MemoryView::Update(float timeStep)
+{
+	refreshTimer_ -= timeStep;
+	MemoryTracker* tracker = GetSubsystem<MemoryTracker>();
+	if (!tracker || refreshTimer_ > 0.0f)
+		return;
+	refreshTimer_ = VIEW_INTERVAL;
+
+	text_->SetText(tracker->GetTreeText());
+	SetSize(text_->GetSize());
+}
+
+#endif
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/UI/UIElement.h>
+
+#include <cstddef>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Text;
+}
+
+/// Memory category. The categories form a tree, see GetMemoryTagParent().
+enum MemoryTag
+{
+	MEMTAG_ENGINE = 0,
+	MEMTAG_TRACK,
+	MEMTAG_TRACK_LAYOUT,
+	MEMTAG_TRACK_ENTITIES,
+	MEMTAG_TRACK_SCENERY,
+	MEMTAG_PHYSICS,
+	MEMTAG_UI,
+	MEMTAG_ANIMATION,
+	MEMTAG_SCRIPTING,
+	MEMTAG_LEADERBOARD,
+	MAX_MEMORY_TAGS
+};
+
+/// Seconds between memory snapshots in the metrics export.
+const float MEMORY_SNAPSHOT_INTERVAL = 5.0f;
+/// Memory snapshots kept, the oldest are dropped.
+const unsigned MEMORY_SNAPSHOTS = 120;
+
+/// Live allocations of one category.
+struct MemoryTagStats
+{
+	/// Bytes allocated and not yet freed.
+	long long liveBytes_;
+	/// Allocations not yet freed.
+	long long liveAllocations_;
+	/// Allocations made.
+	long long allocations_;
+};
+
+/// Return name of a category.
+const char* GetMemoryTagName(MemoryTag tag);
+/// Return parent of a category, or MAX_MEMORY_TAGS for a top-level category.
+MemoryTag GetMemoryTagParent(MemoryTag tag);
+
+#ifdef MEMORY_TAGS
+
+/// Return category the calling thread allocates under.
+MemoryTag GetMemoryTag();
+/// Set category the calling thread allocates under. Return the previous one.
+MemoryTag SetMemoryTag(MemoryTag tag);
+/// Return live allocations of a category, not including its children.
+MemoryTagStats GetMemoryTagStats(MemoryTag tag);
+/// Allocate memory attributed to a category. Freed with TaggedFree() or operator delete.
+void* TaggedAlloc(size_t size, MemoryTag tag);
+/// Free memory allocated by TaggedAlloc() or operator new.
+void TaggedFree(void* ptr);
+/// Resize memory allocated by TaggedAlloc() or operator new, attributing it to a category. Allocate when null. Return null,
+/// leaving the memory as it was, if the new size could not be allocated.
+void* TaggedRealloc(void* ptr, size_t size, MemoryTag tag);
+/// Route the physics library's allocations through TaggedAlloc() as physics. Must be called before the physics world exists.
+void InstallPhysicsAllocator();
+
+/// Attributes the calling thread's allocations to a category for the duration of a scope.
+class MemoryScope
+{
+public:
+	/// Construct and set the category.
+	explicit MemoryScope(MemoryTag tag) :
+		previous_(SetMemoryTag(tag))
+	{
+	}
+
+	/// Destruct and restore the previous category.
+	~MemoryScope()
+	{
+		SetMemoryTag(previous_);
+	}
+
+private:
+	/// Category to restore.
+	MemoryTag previous_;
+};
+
+/// Base class attributing every instance of a class to a category, wherever it is created.
+template <MemoryTag Tag> class MemoryTagged
+{
+public:
+	/// Allocate an instance.
+	static void* operator new(size_t size) { return TaggedAlloc(size, Tag); }
+#if defined(_MSC_VER) && defined(_DEBUG)
+	/// Allocate an instance with the CRT debug allocator's arguments, as DebugNew.h does.
+	static void* operator new(size_t size, int, const char*, int) { return TaggedAlloc(size, Tag); }
+	/// Free an instance whose constructor threw.
+	static void operator delete(void* ptr, int, const char*, int) { TaggedFree(ptr); }
+#endif
+	/// Free an instance.
+	static void operator delete(void* ptr) { TaggedFree(ptr); }
+};
+
+/// Keeps the per-category totals for the HUD and the metrics export: a tree view of live memory, a snapshot every few seconds,
+/// allocations per frame and the calibrated cost of tagging one allocation.
+class MemoryTracker : public Object
+{
+	URHO3D_OBJECT(MemoryTracker, Object);
+
+public:
+	/// Construct. Measures the tagging overhead.
+	MemoryTracker(Context* context);
+
+	/// Return live allocations of a category including its children.
+	MemoryTagStats GetTreeStats(MemoryTag tag) const;
+	/// Return the category tree as text, one category per line.
+	String GetTreeText() const;
+	/// Return time added to an allocation and free pair by tagging, in nanoseconds.
+	float GetOverheadNs() const { return overheadNs_; }
+	/// Return average allocations per frame.
+	float GetAllocationsPerFrame() const;
+
+private:
+	/// Snapshot of live bytes per category.
+	struct Snapshot
+	{
+		/// Time since start in seconds.
+		float time_;
+		/// Live bytes of each category, not including its children.
+		long long liveBytes_[MAX_MEMORY_TAGS];
+	};
+
+	/// Measure the tagging overhead against the plain allocator.
+	void Calibrate();
+	/// Record a snapshot.
+	void TakeSnapshot();
+	/// Write a category and its children into a JSON object.
+	void WriteTree(JSONValue& dest, MemoryTag tag) const;
+	/// Handle end of frame.
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Snapshots, oldest first.
+	Vector<Snapshot> snapshots_;
+	/// Time since start.
+	Timer timer_;
+	/// Time of the next snapshot in milliseconds since start.
+	unsigned nextSnapshotMs_;
+	/// Allocations of all categories at the first counted frame.
+	long long firstAllocations_;
+	/// Frames counted.
+	unsigned frames_;
+	/// Time added to an allocation and free pair by tagging, in nanoseconds.
+	float overheadNs_;
+};
+
+/// HUD view of the memory category tree, refreshed a few times per second.
+class MemoryView : public UIElement
+{
+	URHO3D_OBJECT(MemoryView, UIElement);
+
+public:
+	/// Construct.
+	MemoryView(Context* context);
+
+	/// Perform UI element update.
+	virtual void Update(float timeStep);
+
+private:
+	/// Tree text.
+	SharedPtr<Text> text_;
+	/// Time until the text is refreshed.
+	float refreshTimer_;
+};
+
+#else
+
+/// Allocation scope. Memory tagging is compiled out, so this does nothing.
+class MemoryScope
+{
+public:
+	/// Construct.
+	explicit MemoryScope(MemoryTag tag)
+	{
+	}
+};
+
+/// Base class for tagged classes. Memory tagging is compiled out, so this does nothing.
+template <MemoryTag Tag> class MemoryTagged
+{
+};
+
+#endif
@@ -0,0 +1,40 @@
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/JSONFile.h>
+
+#include "MetricsExport.h"
+
+MetricsExport::MetricsExport(Context* context) :
+	Object(context)
+{
+}
+
+void MetricsExport::Collect(JSONValue& root)
+{
+	Time* time = GetSubsystem<Time>();
+	root["frames"] = time->GetFrameNumber();
+	root["elapsedTime"] = time->GetElapsedTime();
+
+	using namespace CollectMetrics;
+
+	VariantMap& eventData = GetEventDataMap();
+	eventData[P_METRICS] = &root;
+	SendEvent(E_COLLECTMETRICS, eventData);
+}
+
+bool MetricsExport::Save(const String& fileName)
+{
+	SharedPtr<JSONFile> json(new JSONFile(context_));
+	Collect(json->GetRoot());
+
+	File file(context_, fileName, FILE_WRITE);
+	if (!file.IsOpen() || !json->Save(file, "\t"))
+	{
+		URHO3D_LOGERROR("Could not write metrics to " + fileName);
+		return false;
+	}
+
+	URHO3D_LOGINFO("Metrics written to " + fileName);
+	return true;
+}
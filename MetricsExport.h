@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Resource/JSONValue.h>
+
+using namespace Urho3D;
+
+/// Metrics are being collected. Providers write their own section into the JSON object.
+URHO3D_EVENT(E_COLLECTMETRICS, CollectMetrics)
+{
+	URHO3D_PARAM(P_METRICS, Metrics);              // JSONValue pointer
+}
+
+/// Gathers metrics from the game systems and writes them as JSON, e.g. at the end of a headless run.
+class MetricsExport : public Object
+{
+	URHO3D_OBJECT(MetricsExport, Object);
+
+public:
+	/// Construct.
+	MetricsExport(Context* context);
+
+	/// Collect metrics from all providers into a JSON object.
+	void Collect(JSONValue& root);
+	/// Collect metrics and save them to a file. Return true on success.
+	bool Save(const String& fileName);
+};
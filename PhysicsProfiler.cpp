@@ -0,0 +1,261 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Engine/DebugHud.h>
+#include <Urho3D/Physics/PhysicsEvents.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionDispatcher.h>
+#include <Bullet/BulletDynamics/ConstraintSolver/btConstraintSolver.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "MetricsExport.h"
+#include "PhysicsProfiler.h"
+
+/// Profiler receiving near callbacks. Bullet near callbacks are plain functions without user data.
+static PhysicsProfiler* nearCallbackProfiler = 0;
+
+static void ProfiledNearCallback(btBroadphasePair& collisionPair, btCollisionDispatcher& dispatcher, const btDispatcherInfo& dispatchInfo)
+{
+	if (nearCallbackProfiler)
+		nearCallbackProfiler->OnNarrowphasePair();
+	btCollisionDispatcher::defaultNearCallback(collisionPair, dispatcher, dispatchInfo);
+}
+
+/// Constraint solver wrapper that timestamps the solve and forwards everything to the world's own solver.
+class ProfiledConstraintSolver : public btConstraintSolver
+{
+public:
+	ProfiledConstraintSolver(btConstraintSolver* solver, PhysicsProfiler* profiler) :
+		solver_(solver),
+		profiler_(profiler)
+	{
+	}
+
+	virtual void prepareSolve(int numBodies, int numManifolds)
+	{
+		profiler_->OnSolveBegin();
+		solver_->prepareSolve(numBodies, numManifolds);
+	}
+
+	virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies, btPersistentManifold** manifolds, int numManifolds,
+		btTypedConstraint** constraints, int numConstraints, const btContactSolverInfo& info, btIDebugDraw* debugDrawer,
+		btDispatcher* dispatcher)
+	{
+		return solver_->solveGroup(bodies, numBodies, manifolds, numManifolds, constraints, numConstraints, info, debugDrawer,
+			dispatcher);
+	}
+
+	virtual void allSolved(const btContactSolverInfo& info, btIDebugDraw* debugDrawer)
+	{
+		solver_->allSolved(info, debugDrawer);
+		profiler_->OnSolveEnd();
+	}
+
+	virtual void reset() { solver_->reset(); }
+
+	virtual btConstraintSolverType getSolverType() const { return solver_->getSolverType(); }
+
+	/// Wrapped solver, owned by the physics world.
+	btConstraintSolver* solver_;
+	/// Profiler to notify.
+	PhysicsProfiler* profiler_;
+};
+
+void PhysicsStepStats::Reset()
+{
+	broadphaseUSec_ = 0;
+	narrowphaseUSec_ = 0;
+	solverUSec_ = 0;
+	integrationUSec_ = 0;
+	dispatchUSec_ = 0;
+	steps_ = 0;
+	pairs_ = 0;
+	manifolds_ = 0;
+	contacts_ = 0;
+	solverContacts_ = 0;
+	activeBodies_ = 0;
+	collisionEvents_ = 0;
+}
+
+void PhysicsStepStats::Accumulate(const PhysicsStepStats& rhs)
+{
+	broadphaseUSec_ += rhs.broadphaseUSec_;
+	narrowphaseUSec_ += rhs.narrowphaseUSec_;
+	solverUSec_ += rhs.solverUSec_;
+	integrationUSec_ += rhs.integrationUSec_;
+	dispatchUSec_ += rhs.dispatchUSec_;
+	steps_ += rhs.steps_;
+	collisionEvents_ += rhs.collisionEvents_;
+	solverContacts_ += rhs.solverContacts_;
+	pairs_ = rhs.pairs_;
+	manifolds_ = rhs.manifolds_;
+	contacts_ = rhs.contacts_;
+	activeBodies_ = rhs.activeBodies_;
+}
+
+PhysicsProfiler::PhysicsProfiler(Context* context) :
+	Object(context),
+	solver_(0),
+	maxFrameUSec_(0),
+	frames_(0),
+	stepBegin_(0),
+	narrowphaseStart_(0),
+	solveBegin_(0),
+	solveEnd_(0),
+	dispatchBegin_(0),
+	stepCollisionEvents_(0),
+	narrowphaseStarted_(false)
+{
+	SubscribeToEvent(E_ENDFRAME, URHO3D_HANDLER(PhysicsProfiler, HandleEndFrame));
+	SubscribeToEvent(E_COLLECTMETRICS, URHO3D_HANDLER(PhysicsProfiler, HandleCollectMetrics));
+}
+
+PhysicsProfiler::~PhysicsProfiler()
+{
+	Detach();
+}
+
+void PhysicsProfiler::SetWorld(PhysicsWorld* world)
+{
+	if (world == world_)
+		return;
+
+	Detach();
+	world_ = world;
+	if (!world_)
+		return;
+
+	btDiscreteDynamicsWorld* btWorld = world_->GetWorld();
+	solver_ = new ProfiledConstraintSolver(btWorld->getConstraintSolver(), this);
+	btWorld->setConstraintSolver(solver_);
+	static_cast<btCollisionDispatcher*>(btWorld->getDispatcher())->setNearCallback(ProfiledNearCallback);
+	nearCallbackProfiler = this;
+
+	// Subscribe after the logic components so that FixedUpdate is not counted as broadphase
+	SubscribeToEvent(world_, E_PHYSICSPRESTEP, URHO3D_HANDLER(PhysicsProfiler, HandlePhysicsPreStep));
+	SubscribeToEvent(world_, E_PHYSICSCOLLISION, URHO3D_HANDLER(PhysicsProfiler, HandlePhysicsCollision));
+	SubscribeToEvent(world_, E_PHYSICSPOSTSTEP, URHO3D_HANDLER(PhysicsProfiler, HandlePhysicsPostStep));
+}
+
+void PhysicsProfiler::Detach()
+{
+	if (world_)
+	{
+		btDiscreteDynamicsWorld* btWorld = world_->GetWorld();
+		btWorld->setConstraintSolver(solver_->solver_);
+		static_cast<btCollisionDispatcher*>(btWorld->getDispatcher())->setNearCallback(btCollisionDispatcher::defaultNearCallback);
+		UnsubscribeFromEvent(world_, E_PHYSICSPRESTEP);
+		UnsubscribeFromEvent(world_, E_PHYSICSCOLLISION);
+		UnsubscribeFromEvent(world_, E_PHYSICSPOSTSTEP);
+	}
+
+	// The old world may already be destroyed along with its scene, in which case the wrapper is no longer referenced
+	delete solver_;
+	solver_ = 0;
+	world_.Reset();
+	if (nearCallbackProfiler == this)
+		nearCallbackProfiler = 0;
+}
+
+void PhysicsProfiler::HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData)
+{
+	stepBegin_ = timer_.GetUSec(false);
+	solveBegin_ = solveEnd_ = stepBegin_;
+	dispatchBegin_ = 0;
+	stepCollisionEvents_ = 0;
+	narrowphaseStarted_ = false;
+}
+
+void PhysicsProfiler::HandlePhysicsCollision(StringHash eventType, VariantMap& eventData)
+{
+	if (!stepCollisionEvents_)
+		dispatchBegin_ = timer_.GetUSec(false);
+	++stepCollisionEvents_;
+}
+
+void PhysicsProfiler::HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData)
+{
+	long long stepEnd = timer_.GetUSec(false);
+	long long narrowphaseStart = narrowphaseStarted_ ? narrowphaseStart_ : solveBegin_;
+	long long dispatchBegin = stepCollisionEvents_ ? dispatchBegin_ : stepEnd;
+
+	PhysicsStepStats step;
+	step.broadphaseUSec_ = narrowphaseStart - stepBegin_;
+	step.narrowphaseUSec_ = solveBegin_ - narrowphaseStart;
+	step.solverUSec_ = solveEnd_ - solveBegin_;
+	step.integrationUSec_ = dispatchBegin - solveEnd_;
+	step.dispatchUSec_ = stepEnd - dispatchBegin;
+	step.steps_ = 1;
+	step.collisionEvents_ = stepCollisionEvents_;
+
+	btDiscreteDynamicsWorld* btWorld = world_->GetWorld();
+	btDispatcher* dispatcher = btWorld->getDispatcher();
+	step.pairs_ = (unsigned)btWorld->getBroadphase()->getOverlappingPairCache()->getNumOverlappingPairs();
+	step.manifolds_ = (unsigned)dispatcher->getNumManifolds();
+	for (int i = 0; i < dispatcher->getNumManifolds(); ++i)
+	{
+		// Trigger contacts are reported as collisions but never solved
+		btPersistentManifold* manifold = dispatcher->getManifoldByIndexInternal(i);
+		unsigned contacts = (unsigned)manifold->getNumContacts();
+		step.contacts_ += contacts;
+		if (manifold->getBody0()->hasContactResponse() && manifold->getBody1()->hasContactResponse())
+			step.solverContacts_ += contacts;
+	}
+
+	const btCollisionObjectArray& objects = btWorld->getCollisionObjectArray();
+	for (int i = 0; i < objects.size(); ++i)
+	{
+		if (!objects[i]->isStaticOrKinematicObject() && objects[i]->isActive())
+			++step.activeBodies_;
+	}
+
+	currentStats_.Accumulate(step);
+}
+
+void PhysicsProfiler::HandleEndFrame(StringHash eventType, VariantMap& eventData)
+{
+	frameStats_ = currentStats_;
+	currentStats_.Reset();
+
+	if (frameStats_.steps_)
+	{
+		++frames_;
+		totalStats_.Accumulate(frameStats_);
+		maxFrameUSec_ = Max(maxFrameUSec_, frameStats_.GetTotalUSec());
+	}
+
+	DebugHud* debugHud = GetSubsystem<DebugHud>();
+	if (debugHud)
+	{
+		debugHud->SetAppStats("Physics ms", ToString("bp %.2f np %.2f solve %.2f integ %.2f events %.2f (%u steps)",
+			frameStats_.broadphaseUSec_ / 1000.0f, frameStats_.narrowphaseUSec_ / 1000.0f, frameStats_.solverUSec_ / 1000.0f,
+			frameStats_.integrationUSec_ / 1000.0f, frameStats_.dispatchUSec_ / 1000.0f, frameStats_.steps_));
+		debugHud->SetAppStats("Physics counts", ToString("pairs %u manifolds %u contacts %u solved %.1f active %u events %u",
+			frameStats_.pairs_, frameStats_.manifolds_, frameStats_.contacts_,
+			frameStats_.steps_ ? (float)frameStats_.solverContacts_ / frameStats_.steps_ : 0.0f, frameStats_.activeBodies_,
+			frameStats_.collisionEvents_));
+	}
+}
+
+void PhysicsProfiler::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& physics = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["physics"];
+	float frames = (float)Max(frames_, 1U);
+	physics["frames"] = frames_;
+	physics["steps"] = totalStats_.steps_;
+	physics["broadphaseMsPerFrame"] = totalStats_.broadphaseUSec_ / 1000.0f / frames;
+	physics["narrowphaseMsPerFrame"] = totalStats_.narrowphaseUSec_ / 1000.0f / frames;
+	physics["solverMsPerFrame"] = totalStats_.solverUSec_ / 1000.0f / frames;
+	physics["integrationMsPerFrame"] = totalStats_.integrationUSec_ / 1000.0f / frames;
+	physics["dispatchMsPerFrame"] = totalStats_.dispatchUSec_ / 1000.0f / frames;
+	physics["totalMsPerFrame"] = totalStats_.GetTotalUSec() / 1000.0f / frames;
+	physics["maxFrameMs"] = maxFrameUSec_ / 1000.0f;
+	physics["collisionEvents"] = totalStats_.collisionEvents_;
+	physics["pairs"] = totalStats_.pairs_;
+	physics["manifolds"] = totalStats_.manifolds_;
+	physics["contacts"] = totalStats_.contacts_;
+	physics["solverContactsPerStep"] = totalStats_.steps_ ? (float)totalStats_.solverContacts_ / totalStats_.steps_ : 0.0f;
+	physics["activeBodies"] = totalStats_.activeBodies_;
+}
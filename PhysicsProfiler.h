@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class PhysicsWorld;
+}
+
+class ProfiledConstraintSolver;
+
+/// Physics step time breakdown in microseconds and world counters.
+struct PhysicsStepStats
+{
+	/// Construct with zero values.
+	PhysicsStepStats() { Reset(); }
+
+	/// Reset to zero.
+	void Reset();
+	/// Add times and event counts of another step. Counters describing world state are taken from the latest step.
+	void Accumulate(const PhysicsStepStats& rhs);
+	/// Return total step time.
+	long long GetTotalUSec() const { return broadphaseUSec_ + narrowphaseUSec_ + solverUSec_ + integrationUSec_ + dispatchUSec_; }
+
+	/// Motion prediction, AABB update and broadphase pair update.
+	long long broadphaseUSec_;
+	/// Contact generation for overlapping pairs and island building.
+	long long narrowphaseUSec_;
+	/// Constraint solve.
+	long long solverUSec_;
+	/// Integration, actions and activation state update.
+	long long integrationUSec_;
+	/// Collision event dispatch, including E_NODECOLLISION handlers.
+	long long dispatchUSec_;
+	/// Number of steps.
+	unsigned steps_;
+	/// Broadphase overlapping pairs.
+	unsigned pairs_;
+	/// Contact manifolds.
+	unsigned manifolds_;
+	/// Contact points in all manifolds.
+	unsigned contacts_;
+	/// Contact points between bodies with contact response, which go to the solver, summed over steps.
+	unsigned solverContacts_;
+	/// Active dynamic bodies.
+	unsigned activeBodies_;
+	/// Collision events sent.
+	unsigned collisionEvents_;
+};
+
+/// Splits the physics step into broadphase, narrowphase, solver, integration and collision event dispatch.
+class PhysicsProfiler : public Object
+{
+	URHO3D_OBJECT(PhysicsProfiler, Object);
+
+public:
+	/// Construct.
+	PhysicsProfiler(Context* context);
+	/// Destruct. Restores the original constraint solver.
+	~PhysicsProfiler();
+
+	/// Attach to a physics world. Must be called again when the world is recreated, e.g. after scene load.
+	void SetWorld(PhysicsWorld* world);
+
+	/// Return the physics world profiled.
+	PhysicsWorld* GetWorld() const { return world_; }
+	/// Return stats of the last frame.
+	const PhysicsStepStats& GetFrameStats() const { return frameStats_; }
+	/// Return stats accumulated over all frames.
+	const PhysicsStepStats& GetTotalStats() const { return totalStats_; }
+
+	/// Called by the near callback for every pair. Marks the start of narrowphase.
+	void OnNarrowphasePair()
+	{
+		if (!narrowphaseStarted_)
+		{
+			narrowphaseStart_ = timer_.GetUSec(false);
+			narrowphaseStarted_ = true;
+		}
+	}
+	/// Called by the constraint solver before solving.
+	void OnSolveBegin() { solveBegin_ = timer_.GetUSec(false); }
+	/// Called by the constraint solver after solving.
+	void OnSolveEnd() { solveEnd_ = timer_.GetUSec(false); }
+
+private:
+	/// Detach from the current world.
+	void Detach();
+	/// Handle physics pre-step. Marks the start of the step.
+	void HandlePhysicsPreStep(StringHash eventType, VariantMap& eventData);
+	/// Handle world collision event. Marks the start of collision event dispatch.
+	void HandlePhysicsCollision(StringHash eventType, VariantMap& eventData);
+	/// Handle physics post-step. Closes the step and reads world counters.
+	void HandlePhysicsPostStep(StringHash eventType, VariantMap& eventData);
+	/// Handle end of frame. Publishes frame stats to the debug HUD.
+	void HandleEndFrame(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Physics world.
+	WeakPtr<PhysicsWorld> world_;
+	/// Constraint solver wrapper installed into the world.
+	ProfiledConstraintSolver* solver_;
+	/// Timer for step timestamps.
+	HiresTimer timer_;
+	/// Stats of the frame in progress.
+	PhysicsStepStats currentStats_;
+	/// Stats of the last frame.
+	PhysicsStepStats frameStats_;
+	/// Stats of all frames.
+	PhysicsStepStats totalStats_;
+	/// Slowest frame physics time.
+	long long maxFrameUSec_;
+	/// Frames with physics steps.
+	unsigned frames_;
+	/// Step start timestamp.
+	long long stepBegin_;
+	/// Narrowphase start timestamp.
+	long long narrowphaseStart_;
+	/// Solver start timestamp.
+	long long solveBegin_;
+	/// Solver end timestamp.
+	long long solveEnd_;
+	/// Collision event dispatch start timestamp.
+	long long dispatchBegin_;
+	/// Collision events sent during the step.
+	unsigned stepCollisionEvents_;
+	/// Narrowphase started flag.
+	bool narrowphaseStarted_;
+};
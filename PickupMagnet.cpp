@@ -0,0 +1,163 @@
+#include <cmath>
+
+#include <Urho3D/Math/Matrix3x4.h>
+
+#include "PickupMagnet.h"
+#include "RunnerSim.h"
+
+#ifdef URHO3D_SSE
+#include <xmmintrin.h>
+#endif
+
+PickupMagnet::PickupMagnet(float radius, float pullSpeed) :
+	radius_(radius),
+	pullSpeed_(pullSpeed)
+{
+}
+
+void PickupMagnet::Clear()
+{
+	entities_.Clear();
+	offsetX_.Clear();
+	offsetY_.Clear();
+	offsetZ_.Clear();
+	remaining_.Clear();
+	attracted_.Clear();
+}
+
+void PickupMagnet::Query(PODVector<unsigned>& result, const TrackEntityStore& store, TrackArchetype archetype,
+	const Vector3& trackPosition) const
+{
+	// Entities are sorted by distance, so only the ones within the radius along the track are looked at
+	result.Clear();
+	const PODVector<float>& distances = store.GetDistances(archetype);
+	const PODVector<signed char>& lanes = store.GetLanes(archetype);
+	float radiusSquared = radius_ * radius_;
+	for (unsigned i = store.FindFirst(archetype, trackPosition.z_ - radius_); i < distances.Size() &&
+		distances[i] < trackPosition.z_ + radius_; ++i)
+	{
+		float dx = TrackLayout::GetLaneX(lanes[i]) - trackPosition.x_;
+		float dz = distances[i] - trackPosition.z_;
+		if (dx * dx + dz * dz < radiusSquared && store.IsVisible(archetype, i))
+			result.Push(i);
+	}
+}
+
+void PickupMagnet::Update(TrackEntityStore& store, const Vector3& trackPosition, const Vector3& worldPosition, float timeStep,
+	bool capture, PODVector<unsigned>& collected)
+{
+	Vector3 target = worldPosition + Vector3(0.0f, MAGNET_TARGET_HEIGHT, 0.0f);
+
+	// Pickups collected or hidden some other way are no longer pulled
+	for (unsigned i = entities_.Size(); i-- > 0;)
+	{
+		if (!store.IsVisible(ARCHETYPE_PICKUP, entities_[i]))
+			Release(i);
+	}
+
+	if (capture)
+	{
+		unsigned numEntities = store.GetNumEntities(ARCHETYPE_PICKUP);
+		if (attracted_.Size() < numEntities)
+		{
+			unsigned oldSize = attracted_.Size();
+			attracted_.Resize(numEntities);
+			for (unsigned i = oldSize; i < numEntities; ++i)
+				attracted_[i] = 0;
+		}
+
+		const PODVector<Matrix3x4>& transforms = store.GetTransforms(ARCHETYPE_PICKUP);
+		Query(candidates_, store, ARCHETYPE_PICKUP, trackPosition);
+		for (unsigned i = 0; i < candidates_.Size(); ++i)
+		{
+			if (!attracted_[candidates_[i]])
+				Attract(candidates_[i], transforms[candidates_[i]].Translation(), target);
+		}
+	}
+
+	unsigned count = entities_.Size();
+	if (!count)
+		return;
+
+	// Shorten every offset by the pull distance, stopping at the target, and record how far each pickup still is from the
+	// touch distance. The same arithmetic for every pickup, four at a time where SSE is available
+	float step = pullSpeed_ * timeStep;
+	float* x = &offsetX_[0];
+	float* y = &offsetY_[0];
+	float* z = &offsetZ_[0];
+	float* remaining = &remaining_[0];
+	unsigned i = 0;
+#ifdef URHO3D_SSE
+	__m128 step4 = _mm_set1_ps(step);
+	__m128 touch4 = _mm_set1_ps(RUNNER_TOUCH_DISTANCE);
+	__m128 zero4 = _mm_setzero_ps();
+	__m128 epsilon4 = _mm_set1_ps(M_EPSILON);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x4 = _mm_loadu_ps(x + i);
+		__m128 y4 = _mm_loadu_ps(y + i);
+		__m128 z4 = _mm_loadu_ps(z + i);
+		__m128 length4 = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x4, x4), _mm_mul_ps(y4, y4)), _mm_mul_ps(z4, z4)));
+		__m128 left4 = _mm_sub_ps(length4, step4);
+		__m128 scale4 = _mm_div_ps(_mm_max_ps(left4, zero4), _mm_max_ps(length4, epsilon4));
+		_mm_storeu_ps(x + i, _mm_mul_ps(x4, scale4));
+		_mm_storeu_ps(y + i, _mm_mul_ps(y4, scale4));
+		_mm_storeu_ps(z + i, _mm_mul_ps(z4, scale4));
+		_mm_storeu_ps(remaining + i, _mm_sub_ps(left4, touch4));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		float length = sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+		float left = length - step;
+		float scale = Max(left, 0.0f) / Max(length, M_EPSILON);
+		x[i] *= scale;
+		y[i] *= scale;
+		z[i] *= scale;
+		remaining[i] = left - RUNNER_TOUCH_DISTANCE;
+	}
+
+	// Collected when the pull has brought the pickup within the touch distance
+	for (unsigned j = count; j-- > 0;)
+	{
+		if (remaining[j] <= 0.0f)
+		{
+			collected.Push(entities_[j]);
+			Release(j);
+		}
+	}
+
+	count = entities_.Size();
+	positions_.Resize(count);
+	for (unsigned j = 0; j < count; ++j)
+		positions_[j] = Vector3(target.x_ + offsetX_[j], target.y_ + offsetY_[j], target.z_ + offsetZ_[j]);
+	store.SetPositions(ARCHETYPE_PICKUP, entities_.Buffer(), positions_.Buffer(), count);
+}
+
+void PickupMagnet::Attract(unsigned entity, const Vector3& position, const Vector3& target)
+{
+	Vector3 offset = position - target;
+	entities_.Push(entity);
+	offsetX_.Push(offset.x_);
+	offsetY_.Push(offset.y_);
+	offsetZ_.Push(offset.z_);
+	remaining_.Push(0.0f);
+	attracted_[entity] = 1;
+}
+
+void PickupMagnet::Release(unsigned slot)
+{
+	if (entities_[slot] < attracted_.Size())
+		attracted_[entities_[slot]] = 0;
+	unsigned last = entities_.Size() - 1;
+	entities_[slot] = entities_[last];
+	offsetX_[slot] = offsetX_[last];
+	offsetY_[slot] = offsetY_[last];
+	offsetZ_[slot] = offsetZ_[last];
+	remaining_[slot] = remaining_[last];
+	entities_.Pop();
+	offsetX_.Pop();
+	offsetY_.Pop();
+	offsetZ_.Pop();
+	remaining_.Pop();
+}
@@ -0,0 +1,220 @@
+#include <sys/stat.h>
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Thread.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/PackageFile.h>
+
+#include "ResourceProfiler.h"
+
+static const char* UNTRACKED_CALL_SITE = "(untracked)";
+static const char* BACKGROUND_CALL_SITE = "(background)";
+
+static bool CompareLoadRecords(const ResourceLoadRecord& lhs, const ResourceLoadRecord& rhs)
+{
+	if (lhs.usec_ != rhs.usec_)
+		return lhs.usec_ > rhs.usec_;
+	return lhs.bytes_ > rhs.bytes_;
+}
+
+static const PackageEntry* FindPackageEntry(ResourceCache* cache, const String& name)
+{
+	const Vector<SharedPtr<PackageFile> >& packages = cache->GetPackageFiles();
+	for (unsigned i = 0; i < packages.Size(); ++i)
+	{
+		const PackageEntry* entry = packages[i]->GetEntry(name);
+		if (entry)
+			return entry;
+	}
+	return 0;
+}
+
+static unsigned GetDirectoryEntrySize(const String& fileName)
+{
+#ifdef _WIN32
+	struct _stat st;
+	if (_wstat(WString(GetNativePath(fileName)).CString(), &st) != 0)
+		return 0;
+#else
+	struct stat st;
+	if (stat(GetNativePath(fileName).CString(), &st) != 0)
+		return 0;
+#endif
+	return (unsigned)st.st_size;
+}
+
+ResourceLoadObserver::ResourceLoadObserver(Context* context, ResourceProfiler* profiler) :
+	ResourceRouter(context),
+	profiler_(profiler)
+{
+}
+
+void ResourceLoadObserver::Route(String& name, ResourceRequest requestType)
+{
+	// Existence checks do not read anything
+	if (requestType == RESOURCE_GETFILE)
+		profiler_->OnFileOpened(name);
+}
+
+ResourceProfiler::ResourceProfiler(Context* context) :
+	Object(context),
+	cache_(GetSubsystem<ResourceCache>()),
+	callSite_(UNTRACKED_CALL_SITE),
+	numGameplayLoads_(0),
+	loading_(false),
+	gameplay_(false)
+{
+	observer_ = new ResourceLoadObserver(context_, this);
+	if (cache_)
+		cache_->AddResourceRouter(observer_);
+}
+
+ResourceProfiler::~ResourceProfiler()
+{
+	if (cache_)
+		cache_->RemoveResourceRouter(observer_);
+}
+
+const char* ResourceProfiler::SetCallSite(const char* callSite)
+{
+	const char* previous = callSite_;
+	callSite_ = callSite ? callSite : UNTRACKED_CALL_SITE;
+	return previous;
+}
+
+void ResourceProfiler::OnFileOpened(const String& name)
+{
+	unsigned bytes = GetFileSize(name);
+	bool mainThread = Thread::IsMainThread();
+
+	// Dependencies opened while a timed load is in progress belong to that load
+	if (mainThread && loading_)
+	{
+		activeLoad_.bytes_ += bytes;
+		++activeLoad_.files_;
+		return;
+	}
+
+	ResourceLoadRecord record;
+	record.name_ = name;
+	record.callSite_ = mainThread ? callSite_ : BACKGROUND_CALL_SITE;
+	record.bytes_ = bytes;
+	record.files_ = 1;
+	record.usec_ = 0;
+	record.frame_ = mainThread ? GetSubsystem<Time>()->GetFrameNumber() : 0;
+	record.mainThread_ = mainThread;
+	record.gameplay_ = gameplay_;
+
+	if (mainThread && gameplay_)
+	{
+		++numGameplayLoads_;
+		URHO3D_LOGWARNING("Synchronous resource load during gameplay: " + name + " from " + record.callSite_);
+	}
+
+	MutexLock lock(recordsMutex_);
+	records_.Push(record);
+}
+
+Vector<ResourceLoadRecord> ResourceProfiler::GetRecords() const
+{
+	MutexLock lock(recordsMutex_);
+	return records_;
+}
+
+String ResourceProfiler::GetReport(unsigned maxEntries) const
+{
+	Vector<ResourceLoadRecord> ranked;
+	{
+		MutexLock lock(recordsMutex_);
+		ranked = records_;
+	}
+	Sort(ranked.Begin(), ranked.End(), CompareLoadRecords);
+
+	unsigned long long totalBytes = 0;
+	long long totalUsec = 0;
+	for (unsigned i = 0; i < ranked.Size(); ++i)
+	{
+		totalBytes += ranked[i].bytes_;
+		totalUsec += ranked[i].usec_;
+	}
+
+	String report = ToString("Resource loads: %u, %.2f ms, %u KB, %u during gameplay\n", ranked.Size(), totalUsec / 1000.0f,
+		(unsigned)(totalBytes / 1024), numGameplayLoads_);
+	for (unsigned i = 0; i < ranked.Size() && i < maxEntries; ++i)
+	{
+		const ResourceLoadRecord& record = ranked[i];
+		report.AppendWithFormat("%8.2f ms %8u KB %3u files %-10s %-7s %-8s frame %-6u %s <- %s\n", record.usec_ / 1000.0f,
+			record.bytes_ / 1024, record.files_, record.type_.Empty() ? "-" : record.type_.CString(),
+			record.mainThread_ ? "main" : "worker", record.gameplay_ ? "gameplay" : "startup", record.frame_,
+			record.name_.CString(), record.callSite_.CString());
+	}
+	return report;
+}
+
+String ResourceProfiler::GetFrameLoads(unsigned frame) const
+{
+	String loads;
+	MutexLock lock(recordsMutex_);
+	// Records are in load order, so only the tail can belong to a recent frame
+	for (unsigned i = records_.Size() - 1; i < records_.Size(); --i)
+	{
+		const ResourceLoadRecord& record = records_[i];
+		if (record.mainThread_ && record.frame_ < frame)
+			break;
+		if (record.mainThread_ && record.frame_ == frame)
+			loads.AppendWithFormat("%8.2f ms %8u KB %s <- %s\n", record.usec_ / 1000.0f, record.bytes_ / 1024, record.name_.CString(),
+				record.callSite_.CString());
+	}
+	return loads;
+}
+
+void ResourceProfiler::BeginLoad(const String& name, const String& type, const char* callSite)
+{
+	activeLoad_.name_ = name;
+	activeLoad_.type_ = type;
+	activeLoad_.callSite_ = callSite;
+	activeLoad_.bytes_ = 0;
+	activeLoad_.files_ = 0;
+	activeLoad_.frame_ = GetSubsystem<Time>()->GetFrameNumber();
+	activeLoad_.mainThread_ = true;
+	activeLoad_.gameplay_ = gameplay_;
+	loading_ = true;
+	loadTimer_.Reset();
+}
+
+void ResourceProfiler::EndLoad()
+{
+	activeLoad_.usec_ = loadTimer_.GetUSec(false);
+	loading_ = false;
+
+	if (gameplay_)
+	{
+		++numGameplayLoads_;
+		URHO3D_LOGWARNING(ToString("Synchronous resource load during gameplay: %s (%.2f ms) from %s", activeLoad_.name_.CString(),
+			activeLoad_.usec_ / 1000.0f, activeLoad_.callSite_.CString()));
+	}
+
+	MutexLock lock(recordsMutex_);
+	records_.Push(activeLoad_);
+}
+
+unsigned ResourceProfiler::GetFileSize(const String& name) const
+{
+	if (!cache_)
+		return 0;
+
+	// The router runs just before the cache opens the file, so the size is read from metadata instead of opening the file a
+	// second time. Same search order as the cache
+	const PackageEntry* entry = FindPackageEntry(cache_, name);
+	if (entry && cache_->GetSearchPackagesFirst())
+		return entry->size_;
+
+	String fileName = cache_->GetResourceFileName(name);
+	if (!fileName.Empty())
+		return GetDirectoryEntrySize(fileName);
+	return entry ? entry->size_ : 0;
+}
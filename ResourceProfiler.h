@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Urho3D/Core/Mutex.h>
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+using namespace Urho3D;
+
+class ResourceProfiler;
+
+/// Single file load observed by the resource profiler.
+struct ResourceLoadRecord
+{
+	/// Resource name.
+	String name_;
+	/// Resource type name, empty when the load was not requested through the profiler.
+	String type_;
+	/// Function that requested the load.
+	String callSite_;
+	/// Bytes read, including dependencies opened while the resource was loading.
+	unsigned bytes_;
+	/// Number of files opened by the load.
+	unsigned files_;
+	/// Time spent inside ResourceCache::GetResource in microseconds. Zero when not measured.
+	long long usec_;
+	/// Frame number at the time of the load.
+	unsigned frame_;
+	/// Loaded on the main thread.
+	bool mainThread_;
+	/// Loaded after startup, during gameplay frames.
+	bool gameplay_;
+};
+
+/// Resource router that reports every file opened by the resource cache to the profiler.
+class ResourceLoadObserver : public ResourceRouter
+{
+	URHO3D_OBJECT(ResourceLoadObserver, ResourceRouter);
+
+public:
+	/// Construct.
+	ResourceLoadObserver(Context* context, ResourceProfiler* profiler);
+
+	/// Observe a resource request. Does not modify the name.
+	virtual void Route(String& name, ResourceRequest requestType);
+
+private:
+	/// Owning profiler.
+	ResourceProfiler* profiler_;
+};
+
+/// Records resource loads: name, type, bytes read, load time, thread, requesting call site and whether it happened during gameplay.
+class ResourceProfiler : public Object
+{
+	URHO3D_OBJECT(ResourceProfiler, Object);
+
+public:
+	/// Construct. Installs the load observer into the resource cache.
+	ResourceProfiler(Context* context);
+	/// Destruct.
+	~ResourceProfiler();
+
+	/// Get a resource, timing the load and attributing it to the call site if it is not cached yet.
+	template <class T> T* GetResource(const String& name, const char* callSite)
+	{
+		T* resource = cache_->GetExistingResource<T>(name);
+		if (resource)
+			return resource;
+
+		BeginLoad(name, T::GetTypeNameStatic(), callSite);
+		resource = cache_->GetResource<T>(name);
+		EndLoad();
+		return resource;
+	}
+
+	/// Mark the end of startup. Synchronous main thread loads after this are reported as warnings.
+	void SetGameplay(bool enable) { gameplay_ = enable; }
+	/// Set call site for loads the engine performs internally, e.g. animations requested by AnimationController. Returns the previous one.
+	const char* SetCallSite(const char* callSite);
+	/// Called by the observer when the cache opens a file.
+	void OnFileOpened(const String& name);
+
+	/// Return whether startup has finished.
+	bool IsGameplay() const { return gameplay_; }
+	/// Return a copy of all recorded loads.
+	Vector<ResourceLoadRecord> GetRecords() const;
+	/// Return number of synchronous main thread loads during gameplay.
+	unsigned GetNumGameplayLoads() const { return numGameplayLoads_; }
+	/// Return report of the slowest loads, ranked by load time and then bytes read.
+	String GetReport(unsigned maxEntries = 20) const;
+	/// Return the main thread loads of a frame, one per line.
+	String GetFrameLoads(unsigned frame) const;
+
+private:
+	/// Start a timed load.
+	void BeginLoad(const String& name, const String& type, const char* callSite);
+	/// Finish the timed load and store its record.
+	void EndLoad();
+	/// Return size of a resource file from the package index or the directory entry, without opening it. Zero if not found.
+	unsigned GetFileSize(const String& name) const;
+
+	/// Resource cache.
+	WeakPtr<ResourceCache> cache_;
+	/// Observer installed into the resource cache.
+	SharedPtr<ResourceLoadObserver> observer_;
+	/// Recorded loads.
+	Vector<ResourceLoadRecord> records_;
+	/// Load in progress on the main thread.
+	ResourceLoadRecord activeLoad_;
+	/// Timer of the load in progress.
+	HiresTimer loadTimer_;
+	/// Mutex for records, as background loading opens files from worker threads.
+	mutable Mutex recordsMutex_;
+	/// Call site of engine internal loads.
+	const char* callSite_;
+	/// Number of synchronous main thread loads during gameplay.
+	unsigned numGameplayLoads_;
+	/// Timed load in progress flag.
+	bool loading_;
+	/// Gameplay flag.
+	bool gameplay_;
+};
+
+/// Sets the resource profiler call site for the duration of a scope.
+class ResourceCallSite
+{
+public:
+	/// Construct and set the call site.
+	ResourceCallSite(ResourceProfiler* profiler, const char* callSite) :
+		profiler_(profiler),
+		previous_(profiler ? profiler->SetCallSite(callSite) : 0)
+	{
+	}
+
+	/// Destruct and restore the previous call site.
+	~ResourceCallSite()
+	{
+		if (profiler_)
+			profiler_->SetCallSite(previous_);
+	}
+
+private:
+	/// Profiler.
+	ResourceProfiler* profiler_;
+	/// Call site to restore.
+	const char* previous_;
+};
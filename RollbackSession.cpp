@@ -0,0 +1,422 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Network/Connection.h>
+#include <Urho3D/Network/Network.h>
+#include <Urho3D/Network/NetworkEvents.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "Character.h"
+#include "MetricsExport.h"
+#include "RollbackSession.h"
+
+/// Steps between logged checksums of confirmed states.
+static const unsigned CHECKSUM_INTERVAL = 600;
+/// Remote input predicted before anything has been received.
+static const unsigned char DEFAULT_INPUT = CTRL_FORWARD;
+
+RollbackSettings::RollbackSettings() :
+	host_(true),
+	address_("127.0.0.1"),
+	port_(2345),
+	latencyMs_(0),
+	jitterMs_(0),
+	bot_(false)
+{
+}
+
+bool RollbackSettings::Parse(const Vector<String>& arguments, RollbackSettings& settings)
+{
+	bool requested = false;
+	for (unsigned i = 0; i + 1 < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		if (argument == "-rollback")
+		{
+			requested = true;
+			settings.host_ = arguments[++i].ToLower() != "join";
+		}
+		else if (argument == "-address")
+			settings.address_ = arguments[++i];
+		else if (argument == "-port")
+			settings.port_ = (unsigned short)ToUInt(arguments[++i]);
+		else if (argument == "-latency")
+			settings.latencyMs_ = ToUInt(arguments[++i]);
+		else if (argument == "-jitter")
+			settings.jitterMs_ = ToUInt(arguments[++i]);
+	}
+	for (unsigned i = 0; i < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		if (argument == "-bot" || argument == "-headless")
+			settings.bot_ = true;
+	}
+	return requested;
+}
+
+RollbackSession::RollbackSession(Context* context, const RollbackSettings& settings) :
+	Object(context),
+	settings_(settings),
+	track_(0),
+	jitterRandom_(Time::GetSystemTime()),
+	localButtons_(CTRL_FORWARD),
+	localPlayer_(0),
+	currentStep_(0),
+	remoteConfirmed_(0),
+	remoteAck_(0),
+	rollbackFrom_(M_MAX_UNSIGNED),
+	nextChecksumStep_(CHECKSUM_INTERVAL),
+	accumulator_(0.0f),
+	running_(false),
+	frames_(0),
+	rollbacks_(0),
+	stalls_(0),
+	resimSteps_(0),
+	maxResimSteps_(0),
+	resimUSec_(0),
+	maxResimUSec_(0)
+{
+}
+
+RollbackSession::~RollbackSession()
+{
+	Network* network = GetSubsystem<Network>();
+	if (network)
+	{
+		if (settings_.host_)
+			network->StopServer();
+		else
+			network->Disconnect();
+	}
+}
+
+bool RollbackSession::Start(Scene* scene, const TrackLayout* track)
+{
+	track_ = track;
+	runnerNodes_[0] = RunnerSim::CreateNode(scene, "Runner0");
+	runnerNodes_[1] = RunnerSim::CreateNode(scene, "Runner1");
+
+	Network* network = GetSubsystem<Network>();
+	if (settings_.host_)
+	{
+		localPlayer_ = 0;
+		if (!network->StartServer(settings_.port_))
+		{
+			URHO3D_LOGERROR(ToString("Could not host rollback race on port %u", settings_.port_));
+			return false;
+		}
+		SubscribeToEvent(E_CLIENTCONNECTED, URHO3D_HANDLER(RollbackSession, HandleClientConnected));
+	}
+	else
+	{
+		localPlayer_ = 1;
+		if (!network->Connect(settings_.address_, settings_.port_, 0))
+		{
+			URHO3D_LOGERROR("Could not connect to rollback race at " + settings_.address_);
+			return false;
+		}
+		SubscribeToEvent(E_SERVERCONNECTED, URHO3D_HANDLER(RollbackSession, HandleServerConnected));
+	}
+
+	SubscribeToEvent(E_NETWORKMESSAGE, URHO3D_HANDLER(RollbackSession, HandleNetworkMessage));
+	SubscribeToEvent(E_UPDATE, URHO3D_HANDLER(RollbackSession, HandleUpdate));
+	SubscribeToEvent(E_COLLECTMETRICS, URHO3D_HANDLER(RollbackSession, HandleCollectMetrics));
+	return true;
+}
+
+void RollbackSession::BeginRace()
+{
+	runners_[0].Reset();
+	runners_[1].Reset();
+	running_ = true;
+	URHO3D_LOGINFO(ToString("Rollback race started as player %u, seed %u, injected latency %u ms jitter %u ms", localPlayer_,
+		track_->GetSeed(), settings_.latencyMs_, settings_.jitterMs_));
+}
+
+unsigned char RollbackSession::GetInput(unsigned player, unsigned step) const
+{
+	const PODVector<unsigned char>& history = inputs_[player];
+	if (player == localPlayer_)
+		return history[step];
+
+	if (step < remoteReceived_.Size() && remoteReceived_[step])
+		return history[step];
+
+	// Predict by repeating the latest received input. Everything before remoteConfirmed_ has been received
+	unsigned i = Min(step, remoteReceived_.Size());
+	while (i > remoteConfirmed_)
+	{
+		--i;
+		if (remoteReceived_[i])
+			return history[i];
+	}
+	return remoteConfirmed_ ? history[remoteConfirmed_ - 1] : DEFAULT_INPUT;
+}
+
+void RollbackSession::SimulateStep(unsigned step)
+{
+	unsigned slot = step % ROLLBACK_STATES;
+	savedStates_[slot][0] = runners_[0];
+	savedStates_[slot][1] = runners_[1];
+
+	unsigned remotePlayer = 1 - localPlayer_;
+	unsigned char remoteButtons = GetInput(remotePlayer, step);
+	usedRemoteInputs_[slot] = remoteButtons;
+
+	RunnerSim::Step(runners_[localPlayer_], inputs_[localPlayer_][step], *track_);
+	RunnerSim::Step(runners_[remotePlayer], remoteButtons, *track_);
+}
+
+void RollbackSession::Rollback()
+{
+	if (rollbackFrom_ >= currentStep_)
+	{
+		rollbackFrom_ = M_MAX_UNSIGNED;
+		return;
+	}
+
+	HiresTimer timer;
+	unsigned slot = rollbackFrom_ % ROLLBACK_STATES;
+	runners_[0] = savedStates_[slot][0];
+	runners_[1] = savedStates_[slot][1];
+	for (unsigned step = rollbackFrom_; step < currentStep_; ++step)
+		SimulateStep(step);
+
+	long long elapsed = timer.GetUSec(false);
+	unsigned steps = currentStep_ - rollbackFrom_;
+	++rollbacks_;
+	resimSteps_ += steps;
+	resimUSec_ += elapsed;
+	maxResimSteps_ = Max(maxResimSteps_, steps);
+	maxResimUSec_ = Max(maxResimUSec_, elapsed);
+	rollbackFrom_ = M_MAX_UNSIGNED;
+}
+
+void RollbackSession::SendInputs()
+{
+	if (!connection_)
+		return;
+
+	const PODVector<unsigned char>& history = inputs_[localPlayer_];
+	unsigned first = remoteAck_;
+	unsigned count = Min(currentStep_ - first, MAX_INPUTS_PER_MESSAGE);
+
+	// Always send, the message also acknowledges the remote inputs
+	VectorBuffer message;
+	message.WriteUInt(remoteConfirmed_);
+	message.WriteUInt(first);
+	message.WriteUByte((unsigned char)count);
+	for (unsigned i = 0; i < count; ++i)
+		message.WriteUByte(history[first + i]);
+	QueueMessage(MSG_ROLLBACK_INPUT, false, message);
+}
+
+void RollbackSession::QueueMessage(int msgID, bool reliable, const VectorBuffer& message)
+{
+	DelayedMessage delayed;
+	delayed.msgID_ = msgID;
+	delayed.reliable_ = reliable;
+	delayed.sendTime_ = Time::GetSystemTime() + settings_.latencyMs_ + (settings_.jitterMs_ ? jitterRandom_.Int(settings_.jitterMs_ + 1) : 0);
+	delayed.data_ = message;
+	outgoing_.Push(delayed);
+}
+
+void RollbackSession::FlushMessages()
+{
+	if (!connection_)
+		return;
+
+	// Jitter may let a later message overtake an earlier one, just like on a real network
+	unsigned now = Time::GetSystemTime();
+	for (unsigned i = 0; i < outgoing_.Size();)
+	{
+		if (outgoing_[i].sendTime_ <= now)
+		{
+			connection_->SendMessage(outgoing_[i].msgID_, outgoing_[i].reliable_, outgoing_[i].reliable_, outgoing_[i].data_);
+			outgoing_.Erase(i);
+		}
+		else
+			++i;
+	}
+}
+
+void RollbackSession::ReadInputs(MemoryBuffer& message)
+{
+	unsigned ack = message.ReadUInt();
+	unsigned first = message.ReadUInt();
+	unsigned count = message.ReadUByte();
+
+	// The range comes off the network, so it is checked before the history grows. The peer stalls MAX_PREDICTION steps past
+	// its last confirmed input, which is never ahead of this side, so nothing valid ends beyond that. Subtracting first keeps
+	// the check from wrapping
+	unsigned limit = currentStep_ + MAX_PREDICTION;
+	if (count > MAX_INPUTS_PER_MESSAGE || count > message.GetSize() - message.GetPosition() || first > limit ||
+		count > limit - first)
+	{
+		URHO3D_LOGWARNING(ToString("Dropped rollback input message for steps %u+%u at step %u", first, count, currentStep_));
+		return;
+	}
+	remoteAck_ = Max(remoteAck_, Min(ack, currentStep_));
+
+	PODVector<unsigned char>& history = inputs_[1 - localPlayer_];
+	if (first + count > history.Size())
+	{
+		unsigned oldSize = history.Size();
+		history.Resize(first + count);
+		remoteReceived_.Resize(first + count);
+		for (unsigned i = oldSize; i < history.Size(); ++i)
+		{
+			history[i] = 0;
+			remoteReceived_[i] = 0;
+		}
+	}
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned step = first + i;
+		unsigned char buttons = message.ReadUByte();
+		if (remoteReceived_[step])
+			continue;
+
+		history[step] = buttons;
+		remoteReceived_[step] = 1;
+		// Later predicted steps are resimulated as well, so only the earliest misprediction matters
+		if (step < currentStep_ && usedRemoteInputs_[step % ROLLBACK_STATES] != buttons)
+			rollbackFrom_ = Min(rollbackFrom_, step);
+	}
+
+	while (remoteConfirmed_ < remoteReceived_.Size() && remoteReceived_[remoteConfirmed_])
+		++remoteConfirmed_;
+}
+
+void RollbackSession::CheckConfirmedStates()
+{
+	// Player indices are the same on both peers, so the logs can be compared line by line
+	while (nextChecksumStep_ < currentStep_ && nextChecksumStep_ <= remoteConfirmed_)
+	{
+		if (currentStep_ - nextChecksumStep_ < ROLLBACK_STATES)
+		{
+			unsigned slot = nextChecksumStep_ % ROLLBACK_STATES;
+			URHO3D_LOGINFO(ToString("Rollback checksum at step %u: %08X %08X", nextChecksumStep_, savedStates_[slot][0].GetChecksum(),
+				savedStates_[slot][1].GetChecksum()));
+		}
+		nextChecksumStep_ += CHECKSUM_INTERVAL;
+	}
+}
+
+void RollbackSession::UpdateNodes()
+{
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		if (runnerNodes_[i])
+			RunnerSim::PlaceNode(runnerNodes_[i], runners_[i].position_, track_->GetSpline());
+	}
+}
+
+void RollbackSession::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+	using namespace Update;
+
+	if (!running_)
+	{
+		FlushMessages();
+		return;
+	}
+
+	++frames_;
+	accumulator_ = Min(accumulator_ + eventData[P_TIMESTEP].GetFloat(), MAX_STEPS_PER_FRAME * SIM_TIMESTEP);
+
+	// Inputs that arrived since the last frame have been read in the begin frame network update; correct the past first
+	Rollback();
+
+	while (accumulator_ >= SIM_TIMESTEP)
+	{
+		if (currentStep_ >= remoteConfirmed_ + MAX_PREDICTION)
+		{
+			++stalls_;
+			break;
+		}
+
+		inputs_[localPlayer_].Push((unsigned char)(settings_.bot_ ? RunnerSim::GetBotButtons(currentStep_, localPlayer_) : localButtons_));
+		SimulateStep(currentStep_);
+		++currentStep_;
+		accumulator_ -= SIM_TIMESTEP;
+	}
+
+	CheckConfirmedStates();
+	SendInputs();
+	FlushMessages();
+	UpdateNodes();
+}
+
+void RollbackSession::HandleClientConnected(StringHash eventType, VariantMap& eventData)
+{
+	using namespace ClientConnected;
+
+	if (connection_)
+		return;
+
+	connection_ = static_cast<Connection*>(eventData[P_CONNECTION].GetPtr());
+	VectorBuffer message;
+	message.WriteUInt(track_->GetSeed());
+	QueueMessage(MSG_ROLLBACK_START, true, message);
+	BeginRace();
+}
+
+void RollbackSession::HandleServerConnected(StringHash eventType, VariantMap& eventData)
+{
+	connection_ = GetSubsystem<Network>()->GetServerConnection();
+}
+
+void RollbackSession::HandleNetworkMessage(StringHash eventType, VariantMap& eventData)
+{
+	using namespace NetworkMessage;
+
+	int msgID = eventData[P_MESSAGEID].GetInt();
+	if (msgID != MSG_ROLLBACK_START && msgID != MSG_ROLLBACK_INPUT)
+		return;
+	// The race is between two peers, a third connection must not inject inputs or restart it
+	if (connection_ && eventData[P_CONNECTION].GetPtr() != connection_.Get())
+		return;
+
+	const PODVector<unsigned char>& data = eventData[P_DATA].GetBuffer();
+	MemoryBuffer message(data);
+
+	if (msgID == MSG_ROLLBACK_INPUT)
+	{
+		if (running_)
+			ReadInputs(message);
+		return;
+	}
+
+	unsigned seed = message.ReadUInt();
+	if (seed != track_->GetSeed())
+	{
+		URHO3D_LOGERROR(ToString("Rollback race seed mismatch: host %u, local %u. Start both with the same -seed", seed,
+			track_->GetSeed()));
+		return;
+	}
+	BeginRace();
+}
+
+void RollbackSession::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& rollback = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["rollback"];
+	float frames = (float)Max(frames_, 1U);
+	rollback["player"] = localPlayer_;
+	rollback["injectedRttMs"] = 2 * settings_.latencyMs_ + settings_.jitterMs_;
+	rollback["frames"] = frames_;
+	rollback["steps"] = currentStep_;
+	rollback["confirmedSteps"] = remoteConfirmed_;
+	rollback["rollbacks"] = rollbacks_;
+	rollback["stalls"] = stalls_;
+	rollback["resimStepsPerFrame"] = resimSteps_ / frames;
+	rollback["maxResimSteps"] = maxResimSteps_;
+	rollback["resimMsPerFrame"] = resimUSec_ / 1000.0f / frames;
+	rollback["maxResimMs"] = maxResimUSec_ / 1000.0f;
+	rollback["resimUsPerStep"] = resimSteps_ ? (float)resimUSec_ / resimSteps_ : 0.0f;
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/IO/VectorBuffer.h>
+
+#include "RunnerSim.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Connection;
+	class MemoryBuffer;
+	class Node;
+	class Scene;
+}
+
+/// Network message: race start, sent by the host. Contains the track seed.
+const int MSG_ROLLBACK_START = 40;
+/// Network message: input history of a peer.
+const int MSG_ROLLBACK_INPUT = 41;
+
+/// Number of saved states. Must be larger than the maximum prediction.
+const unsigned ROLLBACK_STATES = 64;
+/// Steps the simulation may run ahead of the last confirmed remote input before it stalls.
+const unsigned MAX_PREDICTION = 30;
+/// Maximum number of inputs in one message.
+const unsigned MAX_INPUTS_PER_MESSAGE = 64;
+/// Maximum steps simulated per frame when catching up.
+const unsigned MAX_STEPS_PER_FRAME = 5;
+
+/// Rollback mode settings from the command line.
+struct RollbackSettings
+{
+	/// Construct with defaults.
+	RollbackSettings();
+
+	/// Parse -rollback host|join, -address, -port, -latency and -jitter. Return true if rollback mode was requested.
+	static bool Parse(const Vector<String>& arguments, RollbackSettings& settings);
+
+	/// Host the race, otherwise join one.
+	bool host_;
+	/// Host address when joining.
+	String address_;
+	/// UDP port.
+	unsigned short port_;
+	/// Injected one-way latency for outgoing messages.
+	unsigned latencyMs_;
+	/// Injected random jitter on top of the latency.
+	unsigned jitterMs_;
+	/// Drive the local runner with a deterministic bot instead of the keyboard.
+	bool bot_;
+};
+
+/// Head-to-head race with rollback networking. Both peers run the deterministic runner simulation at a fixed step,
+/// predict the remote inputs by repeating the last confirmed one and, when a late input differs from the prediction,
+/// restore the saved state of that step and resimulate up to the present within the same frame.
+class RollbackSession : public Object
+{
+	URHO3D_OBJECT(RollbackSession, Object);
+
+public:
+	/// Construct.
+	RollbackSession(Context* context, const RollbackSettings& settings);
+	/// Destruct.
+	~RollbackSession();
+
+	/// Create the runner nodes and start hosting or connecting. Return true on success.
+	bool Start(Scene* scene, const TrackLayout* track);
+	/// Set local control buttons for the following steps.
+	void SetLocalButtons(unsigned buttons) { localButtons_ = buttons; }
+
+	/// Return whether the race is running.
+	bool IsRunning() const { return running_; }
+	/// Return whether the local runner is bot controlled.
+	bool IsBot() const { return settings_.bot_; }
+	/// Return the local runner node.
+	Node* GetLocalRunner() const { return runnerNodes_[localPlayer_]; }
+	/// Return the latest simulated state of a player.
+	const RunnerState& GetRunnerState(unsigned player) const { return runners_[player]; }
+	/// Return the local player index.
+	unsigned GetLocalPlayer() const { return localPlayer_; }
+	/// Return next step to simulate.
+	unsigned GetCurrentStep() const { return currentStep_; }
+
+private:
+	/// Begin the race.
+	void BeginRace();
+	/// Return input of a player for a step: confirmed if received, otherwise predicted from the latest earlier one.
+	unsigned char GetInput(unsigned player, unsigned step) const;
+	/// Simulate one step from the current state, saving the state before it.
+	void SimulateStep(unsigned step);
+	/// Restore the state of the earliest mispredicted step and resimulate to the present.
+	void Rollback();
+	/// Send unacknowledged local inputs.
+	void SendInputs();
+	/// Queue a message with the injected latency and jitter.
+	void QueueMessage(int msgID, bool reliable, const VectorBuffer& message);
+	/// Send queued messages that are due.
+	void FlushMessages();
+	/// Read an input message.
+	void ReadInputs(MemoryBuffer& message);
+	/// Log checksums of fully confirmed states, for comparing the two peers.
+	void CheckConfirmedStates();
+	/// Move runner nodes to the simulated state.
+	void UpdateNodes();
+
+	/// Handle frame update.
+	void HandleUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle a client connecting to the host.
+	void HandleClientConnected(StringHash eventType, VariantMap& eventData);
+	/// Handle connection to the host.
+	void HandleServerConnected(StringHash eventType, VariantMap& eventData);
+	/// Handle a network message.
+	void HandleNetworkMessage(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Message waiting for its simulated delivery time.
+	struct DelayedMessage
+	{
+		/// Message ID.
+		int msgID_;
+		/// Reliable flag.
+		bool reliable_;
+		/// Send time in system milliseconds.
+		unsigned sendTime_;
+		/// Message data.
+		VectorBuffer data_;
+	};
+
+	/// Settings.
+	RollbackSettings settings_;
+	/// Track.
+	const TrackLayout* track_;
+	/// Runner nodes by player.
+	WeakPtr<Node> runnerNodes_[2];
+	/// Connection to the other peer.
+	WeakPtr<Connection> connection_;
+	/// Current runner states by player.
+	RunnerState runners_[2];
+	/// Saved states before each step, by step modulo ROLLBACK_STATES.
+	RunnerState savedStates_[ROLLBACK_STATES][2];
+	/// Remote input used when each step was simulated, by step modulo ROLLBACK_STATES.
+	unsigned char usedRemoteInputs_[ROLLBACK_STATES];
+	/// Input history by player.
+	PODVector<unsigned char> inputs_[2];
+	/// Received flags of the remote input history.
+	PODVector<unsigned char> remoteReceived_;
+	/// Outgoing messages.
+	Vector<DelayedMessage> outgoing_;
+	/// Random generator for jitter.
+	TrackRandom jitterRandom_;
+	/// Local control buttons.
+	unsigned localButtons_;
+	/// Local player index, host is player 0.
+	unsigned localPlayer_;
+	/// Next step to simulate.
+	unsigned currentStep_;
+	/// All remote inputs before this step have been received.
+	unsigned remoteConfirmed_;
+	/// The remote peer has all local inputs before this step.
+	unsigned remoteAck_;
+	/// Earliest mispredicted step, M_MAX_UNSIGNED if none.
+	unsigned rollbackFrom_;
+	/// Next step whose checksum is logged.
+	unsigned nextChecksumStep_;
+	/// Unsimulated time.
+	float accumulator_;
+	/// Race running flag.
+	bool running_;
+
+	/// Frames with the race running.
+	unsigned frames_;
+	/// Number of rollbacks.
+	unsigned rollbacks_;
+	/// Frames where the simulation waited for remote inputs.
+	unsigned stalls_;
+	/// Resimulated steps in total.
+	unsigned resimSteps_;
+	/// Most resimulated steps in one frame.
+	unsigned maxResimSteps_;
+	/// Resimulation time in total.
+	long long resimUSec_;
+	/// Longest resimulation in one frame.
+	long long maxResimUSec_;
+};
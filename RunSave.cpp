@@ -0,0 +1,51 @@
+#include <Urho3D/IO/Deserializer.h>
+#include <Urho3D/IO/Serializer.h>
+
+#include "BroadcastStream.h"
+#include "RunSave.h"
+
+RunSave::RunSave() :
+	seed_(1),
+	contentHash_(0),
+	time_(0.0f)
+{
+	runner_.Reset();
+}
+
+void RunSave::Write(Serializer& dest) const
+{
+	dest.WriteFileID(RUN_SAVE_ID);
+	dest.WriteUByte(RUN_SAVE_VERSION);
+	dest.WriteUInt(seed_);
+	dest.WriteUInt(contentHash_);
+	dest.WriteFloat(time_);
+	WriteRunnerState(dest, runner_);
+	dest.WriteVLE(powerUps_.Size());
+	for (unsigned i = 0; i < powerUps_.Size(); ++i)
+	{
+		dest.WriteUByte(powerUps_[i].type_);
+		dest.WriteFloat(powerUps_[i].remaining_);
+	}
+}
+
+bool RunSave::Read(Deserializer& source)
+{
+	if (source.ReadFileID() != RUN_SAVE_ID || source.ReadUByte() != RUN_SAVE_VERSION)
+		return false;
+
+	seed_ = source.ReadUInt();
+	contentHash_ = source.ReadUInt();
+	time_ = source.ReadFloat();
+	runner_ = ReadRunnerState(source);
+	// A truncated file must not make a huge allocation
+	unsigned numPowerUps = source.ReadVLE();
+	if (numPowerUps * 5 > source.GetSize() - source.GetPosition())
+		return false;
+	powerUps_.Resize(numPowerUps);
+	for (unsigned i = 0; i < powerUps_.Size(); ++i)
+	{
+		powerUps_[i].type_ = source.ReadUByte();
+		powerUps_[i].remaining_ = source.ReadFloat();
+	}
+	return true;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+
+#include "RunnerSim.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Deserializer;
+	class Serializer;
+}
+
+/// Run save file identifier.
+const char* const RUN_SAVE_ID = "RSAV";
+/// Run save format version.
+const unsigned char RUN_SAVE_VERSION = 2;
+
+/// Power-up active at the time of saving.
+struct SavedPowerUp
+{
+	/// Power-up type.
+	unsigned char type_;
+	/// Seconds left.
+	float remaining_;
+};
+
+/// Compact save of a single player run: the run parameters and dynamic state only. The floor, walls, zone, light, sky and
+/// track content are not saved, as loading regenerates them from the seed, so the size does not grow with the track. The
+/// content generator is identified by its hash, as the same seed gives another track with other patterns.
+struct RunSave
+{
+	/// Construct with a reset runner.
+	RunSave();
+
+	/// Write to a stream.
+	void Write(Serializer& dest) const;
+	/// Read from a stream. Return false if it is not a run save of a known version.
+	bool Read(Deserializer& source);
+
+	/// Return distance along the track.
+	float GetDistance() const { return runner_.position_.z_; }
+
+	/// Track seed.
+	unsigned seed_;
+	/// Content generator the track was generated with, see TrackLayout::GetContentHash().
+	unsigned contentHash_;
+	/// Run time, which the score is counted from.
+	float time_;
+	/// Runner state. Position is in track space and velocity in the track frame at the runner, so that both can be put back
+	/// onto the regenerated track. The collected pickup bitset and pickup count are part of it.
+	RunnerState runner_;
+	/// Active power-ups.
+	PODVector<SavedPowerUp> powerUps_;
+};
@@ -0,0 +1,221 @@
+#include <cstring>
+
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/Animation.h>
+#include <Urho3D/Graphics/AnimationController.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "Character.h"
+#include "ResourceProfiler.h"
+#include "RunnerSim.h"
+
+/// Runner X limit between the walls.
+static const float WALL_LIMIT = 4.5f - 0.5f - RUNNER_RADIUS;
+/// Gravity of the physics world.
+static const float GRAVITY = 9.81f;
+/// Height of box tops.
+static const float BOX_TOP = 2.0f * BOX_HALF_SIZE;
+
+static unsigned HashFloat(unsigned hash, float value)
+{
+	unsigned bits;
+	memcpy(&bits, &value, sizeof bits);
+	return hash * 31 + bits;
+}
+
+void RunnerState::Reset()
+{
+	position_ = Vector3::ZERO;
+	velocity_ = Vector3::ZERO;
+	inAirTimer_ = 0.0f;
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		collected_[i] = 0;
+	score_ = 0;
+	crashes_ = 0;
+	onGround_ = false;
+	okToJump_ = true;
+}
+
+unsigned RunnerState::GetChecksum() const
+{
+	unsigned hash = 0;
+	hash = HashFloat(hash, position_.x_);
+	hash = HashFloat(hash, position_.y_);
+	hash = HashFloat(hash, position_.z_);
+	hash = HashFloat(hash, velocity_.x_);
+	hash = HashFloat(hash, velocity_.y_);
+	hash = HashFloat(hash, velocity_.z_);
+	hash = HashFloat(hash, inAirTimer_);
+	for (unsigned i = 0; i < PICKUP_MASK_WORDS; ++i)
+		hash = hash * 31 + collected_[i];
+	hash = hash * 31 + score_;
+	hash = hash * 31 + crashes_;
+	hash = hash * 31 + (onGround_ ? 1 : 0) + (okToJump_ ? 2 : 0);
+	return hash;
+}
+
+void RunnerSim::Step(RunnerState& state, unsigned buttons, const TrackLayout& track)
+{
+	// Update the in air timer. Reset if grounded
+	if (!state.onGround_)
+		state.inAirTimer_ += SIM_TIMESTEP;
+	else
+		state.inAirTimer_ = 0.0f;
+	bool softGrounded = state.inAirTimer_ < INAIR_THRESHOLD_TIME;
+
+	Vector3 moveDir = Vector3::ZERO;
+	if (buttons & CTRL_FORWARD)
+		moveDir += Vector3::FORWARD;
+	if (buttons & CTRL_RIGHT)
+		moveDir += Vector3::RIGHT;
+	if (buttons & CTRL_LEFT)
+		moveDir += Vector3::LEFT;
+	if (moveDir.LengthSquared() > 0.0f)
+		moveDir.Normalize();
+
+	// Unit mass, so impulses change velocity directly
+	Vector3& velocity = state.velocity_;
+	Vector3 planeVelocity(velocity.x_, 0.0f, velocity.z_);
+	velocity += moveDir * (softGrounded ? MOVE_FORCE : INAIR_MOVE_FORCE);
+	if (softGrounded)
+	{
+		velocity -= planeVelocity * BRAKE_FORCE;
+
+		if (buttons & CTRL_JUMP)
+		{
+			if (state.okToJump_)
+			{
+				velocity.y_ += JUMP_FORCE;
+				state.okToJump_ = false;
+			}
+		}
+		else
+			state.okToJump_ = true;
+	}
+	velocity.y_ -= GRAVITY * SIM_TIMESTEP;
+
+	Vector3 previous = state.position_;
+	Vector3& position = state.position_;
+	position += velocity * SIM_TIMESTEP;
+	state.onGround_ = false;
+
+	// Floor
+	if (position.y_ <= 0.0f)
+	{
+		position.y_ = 0.0f;
+		velocity.y_ = Max(velocity.y_, 0.0f);
+		state.onGround_ = true;
+	}
+
+	// Walls
+	if (Abs(position.x_) > WALL_LIMIT)
+	{
+		position.x_ = Clamp(position.x_, -WALL_LIMIT, WALL_LIMIT);
+		velocity.x_ = 0.0f;
+	}
+
+	// Obstacles and pickups within reach
+	const PODVector<TrackItem>& items = track.GetItems();
+	for (unsigned i = track.FindFirst(position.z_ - RUNNER_TOUCH_DISTANCE); i < items.Size() &&
+		items[i].z_ < position.z_ + RUNNER_TOUCH_DISTANCE; ++i)
+	{
+		const TrackItem& item = items[i];
+		float laneX = TrackLayout::GetLaneX(item.lane_);
+		if (Abs(position.x_ - laneX) >= RUNNER_TOUCH_DISTANCE)
+			continue;
+
+		if (item.type_ == TRACK_CARROT)
+		{
+			if (!state.IsCollected(item.pickupIndex_))
+			{
+				state.collected_[item.pickupIndex_ >> 5] |= 1u << (item.pickupIndex_ & 31);
+				++state.score_;
+			}
+			continue;
+		}
+
+		if (position.y_ >= BOX_TOP)
+			continue;
+
+		if (previous.y_ >= BOX_TOP - M_EPSILON)
+		{
+			// Landed on top
+			position.y_ = BOX_TOP;
+			velocity.y_ = Max(velocity.y_, 0.0f);
+			state.onGround_ = true;
+		}
+		else if (previous.z_ <= item.z_ - RUNNER_TOUCH_DISTANCE)
+		{
+			// Ran into the front face
+			position.z_ = item.z_ - RUNNER_TOUCH_DISTANCE;
+			if (velocity.z_ > 0.0f)
+			{
+				// Count only the first contact, not every step spent pushing against the box
+				if (previous.z_ < item.z_ - RUNNER_TOUCH_DISTANCE)
+					++state.crashes_;
+				velocity.z_ = 0.0f;
+			}
+		}
+		else
+		{
+			// Side contact
+			position.x_ = laneX + (previous.x_ < laneX ? -RUNNER_TOUCH_DISTANCE : RUNNER_TOUCH_DISTANCE);
+			velocity.x_ = 0.0f;
+		}
+	}
+}
+
+unsigned RunnerSim::GetBotButtons(unsigned step, unsigned player)
+{
+	// A new decision every second: change lane for a quarter second, jump, or keep running
+	TrackRandom random((step / 60) * 2654435761u + player * 40503u + 1);
+	random.Next();
+	unsigned buttons = CTRL_FORWARD;
+	unsigned phase = step % 60;
+	switch (random.Int(4))
+	{
+	case 0:
+		if (phase < 15)
+			buttons |= CTRL_LEFT;
+		break;
+
+	case 1:
+		if (phase < 15)
+			buttons |= CTRL_RIGHT;
+		break;
+
+	case 2:
+		if (phase < 5)
+			buttons |= CTRL_JUMP;
+		break;
+
+	default:
+		break;
+	}
+	return buttons;
+}
+
+Node* RunnerSim::CreateNode(Scene* scene, const String& name)
+{
+	ResourceProfiler* profiler = scene->GetSubsystem<ResourceProfiler>();
+
+	Node* runnerNode = scene->CreateChild(name);
+	AnimatedModel* model = runnerNode->CreateComponent<AnimatedModel>();
+	model->SetModel(profiler->GetResource<Model>("Models/Mutant/Mutant.mdl", __FUNCTION__));
+	model->SetMaterial(profiler->GetResource<Material>("Models/Mutant/Materials/mutant_M.xml", __FUNCTION__));
+	model->SetCastShadows(true);
+
+	// Runners are moved by the simulation, there is no physics body
+	AnimationController* animCtrl = runnerNode->CreateComponent<AnimationController>();
+	profiler->GetResource<Animation>("Models/Mutant/Mutant_Run.ani", __FUNCTION__);
+	animCtrl->PlayExclusive("Models/Mutant/Mutant_Run.ani", 0, true, 0.2f);
+	return runnerNode;
+}
+
+void RunnerSim::PlaceNode(Node* node, const Vector3& trackPosition, const TrackSpline& spline)
+{
+	node->SetPosition(spline.ToWorld(trackPosition));
+	node->SetRotation(Quaternion(spline.GetYaw(trackPosition.z_), Vector3::UP));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <Urho3D/Math/Vector3.h>
+
+#include "TrackLayout.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Node;
+	class Scene;
+}
+
+/// Fixed simulation step, same as the default physics world rate.
+const float SIM_TIMESTEP = 1.0f / 60.0f;
+/// Runner capsule radius, as in CreateCharacter.
+const float RUNNER_RADIUS = 0.35f;
+/// Horizontal distance at which a runner touches an item.
+const float RUNNER_TOUCH_DISTANCE = BOX_HALF_SIZE + RUNNER_RADIUS;
+/// Number of words in the collected pickup bitset.
+const unsigned PICKUP_MASK_WORDS = MAX_PICKUPS / 32;
+
+/// Complete dynamic state of one runner. Plain data, copied as a whole for rollback and saving.
+struct RunnerState
+{
+	/// Reset to the start of the track.
+	void Reset();
+	/// Return whether a pickup has been collected.
+	bool IsCollected(unsigned pickupIndex) const { return (collected_[pickupIndex >> 5] & (1u << (pickupIndex & 31))) != 0; }
+	/// Return checksum of the state for desync detection.
+	unsigned GetChecksum() const;
+
+	/// Position. Y is the feet height.
+	Vector3 position_;
+	/// Velocity.
+	Vector3 velocity_;
+	/// Time off the ground.
+	float inAirTimer_;
+	/// Collected pickups.
+	unsigned collected_[PICKUP_MASK_WORDS];
+	/// Collected pickup count.
+	unsigned score_;
+	/// Number of obstacles hit.
+	unsigned crashes_;
+	/// Grounded on the last step.
+	bool onGround_;
+	/// Jump must be released in between jumps.
+	bool okToJump_;
+};
+
+/// Deterministic runner simulation against a track layout. Mirrors the Character movement rules
+/// (impulses, braking, jump, soft grounding) with analytic collision, so that the same seed and controls always give the same run.
+class RunnerSim
+{
+public:
+	/// Advance a runner by one fixed step with the given control buttons.
+	static void Step(RunnerState& state, unsigned buttons, const TrackLayout& track);
+	/// Return deterministic bot control buttons for a step. Different players get different decisions.
+	static unsigned GetBotButtons(unsigned step, unsigned player);
+	/// Create a scene node that displays a simulated runner. It has no physics body.
+	static Node* CreateNode(Scene* scene, const String& name);
+	/// Move a runner node to a track space position, upright and facing along the track.
+	static void PlaceNode(Node* node, const Vector3& trackPosition, const TrackSpline& spline);
+};
@@ -0,0 +1,51 @@
+#include <string>
+
+#include <Urho3D/Math/Ray.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "CollisionMatrix.h"
+#include "RunnerView.h"
+#include "Touch.h"
+
+String FormatScoreText(float time)
+{
+	std::string str;
+	str.append("Score: ");
+	str.append(std::to_string(int(time * 10)));
+	return String(str.c_str(), str.size());
+}
+
+String FormatPositionText(const Vector3& position)
+{
+	std::string str;
+	str.append("posX: ");
+	str.append(std::to_string(int(position.x_)));
+	str.append(" posY: ");
+	str.append(std::to_string(int(position.y_)));
+	str.append(" posZ: ");
+	str.append(std::to_string(int(position.z_)));
+	return String(str.c_str(), str.size());
+}
+
+float UpdateThirdPersonCamera(PhysicsWorld* world, Node* cameraNode, const Vector3& position, const Quaternion& rotation, float pitch,
+	float distance)
+{
+	// Get camera lookat dir from character yaw + pitch
+	Quaternion dir = rotation * Quaternion(pitch, Vector3::RIGHT);
+
+	// Third person camera: position behind the character
+	Vector3 aimPoint = position + rotation * Vector3(0.0f, 2.2f, -1.0f);
+
+	// Collide camera ray with camera blockers to ensure we see the character properly
+	Vector3 rayDir = dir * Vector3::BACK;
+	PhysicsRaycastResult result;
+	world->RaycastSingle(result, Ray(aimPoint, rayDir), distance, COLLISION_CAMERA_BLOCKER);
+	if (result.body_)
+		distance = Min(distance, result.distance_);
+	distance = Clamp(distance, CAMERA_MIN_DIST, CAMERA_MAX_DIST);
+
+	cameraNode->SetPosition(aimPoint + rayDir * distance);
+	cameraNode->SetRotation(dir);
+	return distance;
+}
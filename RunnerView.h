@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Node;
+	class PhysicsWorld;
+}
+
+/// Return the score line of the HUD for a run time.
+String FormatScoreText(float time);
+/// Return the position line of the HUD.
+String FormatPositionText(const Vector3& position);
+/// Place the third person camera behind a runner, in front of the nearest camera blocker and within the allowed distance.
+/// Return the camera distance.
+float UpdateThirdPersonCamera(PhysicsWorld* world, Node* cameraNode, const Vector3& position, const Quaternion& rotation, float pitch,
+	float distance);
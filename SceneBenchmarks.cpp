@@ -0,0 +1,1035 @@
+#include <cstdio>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Core/StringUtils.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/Octree.h>
+#include <Urho3D/Graphics/OctreeQuery.h>
+#include <Urho3D/Graphics/ParticleEffect.h>
+#include <Urho3D/Graphics/ParticleEmitter.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Urho3D/DebugNew.h>
+
+#include "CollisionMatrix.h"
+#include "CorridorIndex.h"
+#include "EffectPool.h"
+#include "EventStats.h"
+#include "LeaderboardVerifier.h"
+#include "MemoryTracker.h"
+#include "MetricsExport.h"
+#include "PickupMagnet.h"
+#include "ResourceProfiler.h"
+#include "RunnerSim.h"
+#include "SceneBenchmarks.h"
+#include "ScoreStore.h"
+#include "ThreadedPhysics.h"
+#include "TrackEntities.h"
+#include "TrackInstanceGroup.h"
+#include "TrackLayout.h"
+#include "TrackPrefab.h"
+
+/// Default queries per direction in the track spline benchmark.
+static const unsigned SPLINE_BENCHMARK_QUERIES = 10000000;
+/// Default entity count in the track entity benchmark.
+static const unsigned ENTITY_BENCHMARK_COUNT = 1000000;
+/// Default instance count in the prefab benchmark.
+static const unsigned PREFAB_BENCHMARK_COUNT = 10000;
+/// Default number of pickups animated by -pickupbenchmark.
+static const unsigned PICKUP_BENCHMARK_COUNT = 10000;
+/// Frames animated by -pickupbenchmark for each approach.
+static const unsigned PICKUP_BENCHMARK_FRAMES = 100;
+/// Default number of pickups in range in the magnet benchmark.
+static const unsigned MAGNET_BENCHMARK_COUNT = 5000;
+/// Steps simulated by the magnet benchmark for each approach.
+static const unsigned MAGNET_BENCHMARK_STEPS = 100;
+/// Default effects started per second in the effect benchmark.
+static const unsigned EFFECT_BENCHMARK_RATE = 500;
+/// Length of each effect benchmark run in seconds.
+static const unsigned EFFECT_BENCHMARK_SECONDS = 5;
+/// Default number of runners in the physics threading benchmark.
+static const unsigned PHYSICS_BENCHMARK_RUNNERS = 500;
+/// Static obstacles per runner in the physics threading benchmark.
+static const unsigned PHYSICS_BENCHMARK_OBSTACLES = 4;
+/// Physics steps simulated by the physics threading benchmark for each thread count.
+static const unsigned PHYSICS_BENCHMARK_STEPS = 300;
+/// Default number of save and load rounds in the run save benchmark.
+static const unsigned SAVE_BENCHMARK_REPEATS = 20;
+/// Default number of submitted runs in the leaderboard verification benchmark.
+static const unsigned VERIFY_BENCHMARK_RUNS = 256;
+/// Longest run in the leaderboard verification benchmark, ten minutes at the simulation rate. Runs end at the end of the
+/// track before that.
+static const unsigned VERIFY_BENCHMARK_MAX_STEPS = 10 * 60 * 60;
+/// Default number of players in the score store benchmark.
+static const unsigned SCORE_BENCHMARK_PLAYERS = 10000000;
+/// Queries of each kind in the score store benchmark.
+static const unsigned SCORE_BENCHMARK_QUERIES = 100000;
+/// Drawable counts in the corridor index benchmark.
+static const unsigned CORRIDOR_BENCHMARK_COUNTS[] = { 10000, 100000 };
+/// Default run length of the scenery benchmark in kilometres.
+static const float SCENERY_BENCHMARK_KM = 10.0f;
+
+/// Switch and default count of a benchmark whose count may follow its switch.
+struct BenchmarkSwitch
+{
+	/// Lowercase switch.
+	const char* name_;
+	/// Default count.
+	unsigned defaultCount_;
+	/// Count in the settings.
+	unsigned BenchmarkSettings::* count_;
+};
+
+static const BenchmarkSwitch BENCHMARK_SWITCHES[] =
+{
+	{ "-splinebenchmark", SPLINE_BENCHMARK_QUERIES, &BenchmarkSettings::splineQueries_ },
+	{ "-entitybenchmark", ENTITY_BENCHMARK_COUNT, &BenchmarkSettings::entities_ },
+	{ "-prefabbenchmark", PREFAB_BENCHMARK_COUNT, &BenchmarkSettings::prefabs_ },
+	{ "-pickupbenchmark", PICKUP_BENCHMARK_COUNT, &BenchmarkSettings::pickups_ },
+	{ "-magnetbenchmark", MAGNET_BENCHMARK_COUNT, &BenchmarkSettings::magnetPickups_ },
+	{ "-effectbenchmark", EFFECT_BENCHMARK_RATE, &BenchmarkSettings::effectsPerSecond_ },
+	{ "-physicsbenchmark", PHYSICS_BENCHMARK_RUNNERS, &BenchmarkSettings::physicsRunners_ },
+	{ "-savebenchmark", SAVE_BENCHMARK_REPEATS, &BenchmarkSettings::saveRepeats_ },
+	{ "-verifybenchmark", VERIFY_BENCHMARK_RUNS, &BenchmarkSettings::verifyRuns_ },
+	{ "-scorebenchmark", SCORE_BENCHMARK_PLAYERS, &BenchmarkSettings::scorePlayers_ }
+};
+
+JSONValue GetPercentiles(PODVector<float>& samples)
+{
+	JSONValue result;
+	if (samples.Empty())
+		return result;
+
+	Sort(samples.Begin(), samples.End());
+	const float percentiles[] = { 50.0f, 90.0f, 99.0f, 99.9f };
+	const char* names[] = { "p50", "p90", "p99", "p999" };
+	for (unsigned i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); ++i)
+		result[names[i]] = samples[Min((unsigned)(samples.Size() * percentiles[i] / 100.0f), samples.Size() - 1)];
+	result["max"] = samples.Back();
+	return result;
+}
+
+/// Effect started with its own node in the effect benchmark.
+struct BenchmarkEffect
+{
+	/// Node.
+	Node* node_;
+	/// Time since started.
+	float age_;
+	/// Emission time.
+	float burstTime_;
+	/// Time until the last particle is gone.
+	float lifeTime_;
+};
+
+/// Return allocations made so far over all memory categories, or 0 when memory tagging is compiled out.
+static long long GetAllocationCount()
+{
+	long long allocations = 0;
+#ifdef MEMORY_TAGS
+	for (unsigned i = 0; i < MAX_MEMORY_TAGS; ++i)
+		allocations += GetMemoryTagStats((MemoryTag)i).allocations_;
+#endif
+	return allocations;
+}
+
+BenchmarkSettings::BenchmarkSettings() :
+	splineQueries_(0),
+	entities_(0),
+	corridor_(false),
+	prefabs_(0),
+	pickups_(0),
+	magnetPickups_(0),
+	effectsPerSecond_(0),
+	physicsRunners_(0),
+	saveRepeats_(0),
+	verifyRuns_(0),
+	scorePlayers_(0),
+	sceneryLength_(0.0f),
+	loadTestSubscribers_(0)
+{
+}
+
+bool BenchmarkSettings::Parse(const Vector<String>& arguments, BenchmarkSettings& settings)
+{
+	const unsigned numSwitches = sizeof(BENCHMARK_SWITCHES) / sizeof(BENCHMARK_SWITCHES[0]);
+
+	bool requested = false;
+	for (unsigned i = 0; i < arguments.Size(); ++i)
+	{
+		String argument = arguments[i].ToLower();
+		bool hasCount = i + 1 < arguments.Size() && IsDigit(arguments[i + 1][0]);
+
+		unsigned j = 0;
+		while (j < numSwitches && argument != BENCHMARK_SWITCHES[j].name_)
+			++j;
+		if (j < numSwitches)
+			settings.*BENCHMARK_SWITCHES[j].count_ = hasCount ? ToUInt(arguments[++i]) : BENCHMARK_SWITCHES[j].defaultCount_;
+		else if (argument == "-corridorbenchmark")
+			settings.corridor_ = true;
+		else if (argument == "-scenerybenchmark")
+			settings.sceneryLength_ = (hasCount ? ToFloat(arguments[++i]) : SCENERY_BENCHMARK_KM) * 1000.0f;
+		else if (argument == "-broadcastloadtest" && hasCount)
+			settings.loadTestSubscribers_ = ToUInt(arguments[++i]);
+		else
+			continue;
+		requested = true;
+	}
+	return requested;
+}
+
+SceneBenchmarks::SceneBenchmarks(Context* context, unsigned seed) :
+	Object(context),
+	seed_(seed)
+{
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(SceneBenchmarks, HandleCollectMetrics));
+}
+
+void SceneBenchmarks::Run(const BenchmarkSettings& settings, const TrackSpline& spline)
+{
+	if (settings.splineQueries_)
+		RunSplineBenchmark(spline, settings.splineQueries_);
+	if (settings.entities_)
+		RunEntityBenchmark(settings.entities_);
+	if (settings.prefabs_)
+		RunPrefabBenchmark(settings.prefabs_);
+	if (settings.pickups_)
+		RunPickupBenchmark(settings.pickups_);
+	if (settings.magnetPickups_)
+		RunMagnetBenchmark(settings.magnetPickups_);
+	if (settings.effectsPerSecond_)
+		RunEffectBenchmark(settings.effectsPerSecond_);
+	if (settings.verifyRuns_)
+		RunVerifyBenchmark(settings.verifyRuns_);
+	if (settings.scorePlayers_)
+		RunScoreBenchmark(settings.scorePlayers_);
+#ifdef PHYSICS_THREADING
+	if (settings.physicsRunners_)
+		RunPhysicsBenchmark(settings.physicsRunners_);
+#endif
+	if (settings.corridor_)
+	{
+		for (unsigned i = 0; i < sizeof(CORRIDOR_BENCHMARK_COUNTS) / sizeof(CORRIDOR_BENCHMARK_COUNTS[0]); ++i)
+			RunCorridorBenchmark(CORRIDOR_BENCHMARK_COUNTS[i]);
+	}
+}
+
+void SceneBenchmarks::RunSplineBenchmark(const TrackSpline& spline, unsigned numQueries)
+{
+	// Query points are generated up front so that only the lookups are timed
+	const unsigned NUM_POINTS = 4096;
+	PODVector<Vector3> trackPoints(NUM_POINTS);
+	PODVector<Vector3> worldPoints(NUM_POINTS);
+	TrackRandom random(seed_);
+	for (unsigned i = 0; i < NUM_POINTS; ++i)
+	{
+		trackPoints[i] = Vector3(random.Float(9.0f) - 4.5f, random.Float(3.0f), random.Float(spline.GetLength()));
+		worldPoints[i] = spline.ToWorld(trackPoints[i]);
+	}
+
+	Vector3 sum = Vector3::ZERO;
+	HiresTimer timer;
+	for (unsigned i = 0; i < numQueries; ++i)
+		sum += spline.ToWorld(trackPoints[i & (NUM_POINTS - 1)]);
+	long long toWorldUSec = Max(timer.GetUSec(true), 1LL);
+	for (unsigned i = 0; i < numQueries; ++i)
+		sum += spline.ToTrack(worldPoints[i & (NUM_POINTS - 1)]);
+	long long toTrackUSec = Max(timer.GetUSec(false), 1LL);
+
+	float maxError = 0.0f;
+	for (unsigned i = 0; i < NUM_POINTS; ++i)
+		maxError = Max(maxError, (spline.ToTrack(worldPoints[i]) - trackPoints[i]).Length());
+
+	JSONValue& results = results_["trackSpline"];
+	results["samples"] = spline.GetNumSamples();
+	results["length"] = spline.GetLength();
+	results["toWorldPerSecond"] = numQueries * 1000000.0 / toWorldUSec;
+	results["toTrackPerSecond"] = numQueries * 1000000.0 / toTrackUSec;
+	results["maxRoundTripError"] = maxError;
+	// The sum is logged so that the loops cannot be optimized away
+	URHO3D_LOGINFO(ToString("Track spline: %.2f M ToWorld/s, %.2f M ToTrack/s, max round trip error %.4f m (%s)",
+		numQueries / (float)toWorldUSec, numQueries / (float)toTrackUSec, maxError, sum.ToString().CString()));
+}
+
+/// Return resident memory of the process in bytes, or 0 if not known on this platform.
+static unsigned long long GetResidentMemory()
+{
+#ifdef __linux__
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (!file)
+		return 0;
+	unsigned long long size = 0;
+	unsigned long long resident = 0;
+	int read = fscanf(file, "%llu %llu", &size, &resident);
+	fclose(file);
+	return read == 2 ? resident * (unsigned long long)sysconf(_SC_PAGESIZE) : 0;
+#else
+	return 0;
+#endif
+}
+
+void SceneBenchmarks::RunEntityBenchmark(unsigned count)
+{
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+	const unsigned ITERATION_PASSES = 10;
+	count = Max(count, 2U);
+
+	// Archetype store, half obstacles and half pickups along a straight track
+	TrackCollider collider;
+	collider.size_ = Vector3::ONE;
+	collider.layer_ = LAYER_OBSTACLE;
+	TrackRandom random(seed_);
+	HiresTimer timer;
+	TrackEntityStore store;
+	store.Reserve(ARCHETYPE_OBSTACLE, count / 2);
+	store.Reserve(ARCHETYPE_PICKUP, count - count / 2);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		float distance = i * 0.5f;
+		int lane = random.Int(3) - 1;
+		Matrix3x4 transform(Vector3(TrackLayout::GetLaneX(lane), BOX_HALF_SIZE, distance), Quaternion::IDENTITY, 2.0f * BOX_HALF_SIZE);
+		store.Add((i & 1) ? ARCHETYPE_PICKUP : ARCHETYPE_OBSTACLE, transform, distance, lane, collider);
+	}
+	long long storeCreateUSec = Max(timer.GetUSec(true), 1LL);
+
+	Vector3 sum = Vector3::ZERO;
+	for (unsigned pass = 0; pass < ITERATION_PASSES; ++pass)
+	{
+		for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+		{
+			const PODVector<Matrix3x4>& transforms = store.GetTransforms((TrackArchetype)i);
+			for (unsigned j = 0; j < transforms.Size(); ++j)
+				sum += transforms[j].Translation();
+		}
+	}
+	long long storeIterateUSec = Max(timer.GetUSec(false) / ITERATION_PASSES, 1LL);
+	unsigned storeBytes = store.GetMemoryUse();
+
+	// The same content as nodes, the way the track used to be built. The scene has no physics world, so no Bullet objects are
+	// created for the bodies and the node figures are on the low side
+	Model* model = profiler->GetResource<Model>("Models/Box.mdl", __FUNCTION__);
+	Material* material = profiler->GetResource<Material>("Materials/Stone.xml", __FUNCTION__);
+	random = TrackRandom(seed_);
+	unsigned long long residentBefore = GetResidentMemory();
+	SharedPtr<Scene> scene(new Scene(context_));
+	scene->CreateComponent<Octree>();
+	timer.Reset();
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Node* node = scene->CreateChild((i & 1) ? "Carrot" : "Box", LOCAL);
+		node->SetPosition(Vector3(TrackLayout::GetLaneX(random.Int(3) - 1), BOX_HALF_SIZE, i * 0.5f));
+		node->SetScale(2.0f * BOX_HALF_SIZE);
+		StaticModel* object = node->CreateComponent<StaticModel>(LOCAL);
+		object->SetModel(model);
+		object->SetMaterial(material);
+		ApplyCollisionLayer(node->CreateComponent<RigidBody>(LOCAL), LAYER_OBSTACLE);
+		node->CreateComponent<CollisionShape>(LOCAL)->SetBox(Vector3::ONE);
+	}
+	long long nodeCreateUSec = Max(timer.GetUSec(true), 1LL);
+	unsigned long long residentAfter = GetResidentMemory();
+
+	const Vector<SharedPtr<Node> >& children = scene->GetChildren();
+	for (unsigned pass = 0; pass < ITERATION_PASSES; ++pass)
+	{
+		for (unsigned i = 0; i < children.Size(); ++i)
+			sum += children[i]->GetWorldPosition();
+	}
+	long long nodeIterateUSec = Max(timer.GetUSec(false) / ITERATION_PASSES, 1LL);
+	// Without resident memory figures the node size is not known
+	double nodeBytesPerEntity = residentBefore && residentAfter > residentBefore ? (double)(residentAfter - residentBefore) / count : 0.0;
+
+	JSONValue& results = results_["trackEntities"];
+	results["entities"] = count;
+	results["storeBytesPerEntity"] = (double)storeBytes / count;
+	results["storeCreateMs"] = storeCreateUSec / 1000.0;
+	results["storeIterateMs"] = storeIterateUSec / 1000.0;
+	results["nodeBytesPerEntity"] = nodeBytesPerEntity;
+	results["nodeCreateMs"] = nodeCreateUSec / 1000.0;
+	results["nodeIterateMs"] = nodeIterateUSec / 1000.0;
+	// The sum is logged so that the loops cannot be optimized away
+	URHO3D_LOGINFO(ToString("Track entities (%u): store %.1f B/entity, iterate %.2f ms; nodes %.1f B/entity, iterate %.2f ms (%s)",
+		count, (double)storeBytes / count, storeIterateUSec / 1000.0, nodeBytesPerEntity, nodeIterateUSec / 1000.0,
+		sum.ToString().CString()));
+}
+
+void SceneBenchmarks::RunCorridorBenchmark(unsigned count)
+{
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+	const unsigned NUM_FRAMES = 1000;
+	// The corridor spans the default octree, the same as the game scene uses
+	const float CORRIDOR_START = -1000.0f;
+	const float CORRIDOR_LENGTH = 2000.0f;
+	const float VIEW_DISTANCE = 300.0f;
+
+	SharedPtr<Scene> scene(new Scene(context_));
+	Octree* octree = scene->CreateComponent<Octree>();
+	Model* model = profiler->GetResource<Model>("Models/Box.mdl", __FUNCTION__);
+	TrackRandom random(seed_ + count);
+	PODVector<StaticModel*> drawables(count);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Node* node = scene->CreateChild("Box", LOCAL);
+		node->SetPosition(Vector3(random.Float(9.0f) - 4.5f, random.Float(4.0f), CORRIDOR_START + random.Float(CORRIDOR_LENGTH)));
+		drawables[i] = node->CreateComponent<StaticModel>(LOCAL);
+		drawables[i]->SetModel(model);
+	}
+	// New drawables go to the octree root until the octree is updated
+	FrameInfo frame;
+	frame.frameNumber_ = 1;
+	frame.timeStep_ = 0.0f;
+	octree->Update(frame);
+
+	HiresTimer timer;
+	CorridorIndex index;
+	for (unsigned i = 0; i < count; ++i)
+		index.Insert(drawables[i], drawables[i]->GetNode()->GetPosition().z_ - CORRIDOR_START);
+	long long corridorInsertUSec = timer.GetUSec(true);
+
+	// The camera flies down the corridor, culling and casting a ray ahead every frame
+	PODVector<Drawable*> visible;
+	PODVector<RayQueryResult> hits;
+	Frustum frustum;
+	unsigned octreeVisible = 0;
+	unsigned octreeHits = 0;
+	long long octreeCullUSec = 0;
+	long long octreeRayUSec = 0;
+	for (unsigned i = 0; i < NUM_FRAMES; ++i)
+	{
+		Vector3 cameraPosition(0.0f, 2.0f, CORRIDOR_START + i * (CORRIDOR_LENGTH - VIEW_DISTANCE) / NUM_FRAMES);
+		frustum.Define(45.0f, 16.0f / 9.0f, 1.0f, 0.1f, VIEW_DISTANCE, Matrix3x4(cameraPosition, Quaternion::IDENTITY, 1.0f));
+		timer.Reset();
+		visible.Clear();
+		FrustumOctreeQuery frustumQuery(visible, frustum, DRAWABLE_GEOMETRY);
+		octree->GetDrawables(frustumQuery);
+		octreeCullUSec += timer.GetUSec(true);
+		hits.Clear();
+		RayOctreeQuery rayQuery(hits, Ray(cameraPosition, Vector3::FORWARD), RAY_AABB, VIEW_DISTANCE, DRAWABLE_GEOMETRY);
+		octree->Raycast(rayQuery);
+		octreeRayUSec += timer.GetUSec(false);
+		octreeVisible += visible.Size();
+		octreeHits += hits.Size();
+	}
+
+	unsigned corridorVisible = 0;
+	unsigned corridorHits = 0;
+	long long corridorCullUSec = 0;
+	long long corridorRayUSec = 0;
+	for (unsigned i = 0; i < NUM_FRAMES; ++i)
+	{
+		Vector3 cameraPosition(0.0f, 2.0f, CORRIDOR_START + i * (CORRIDOR_LENGTH - VIEW_DISTANCE) / NUM_FRAMES);
+		frustum.Define(45.0f, 16.0f / 9.0f, 1.0f, 0.1f, VIEW_DISTANCE, Matrix3x4(cameraPosition, Quaternion::IDENTITY, 1.0f));
+		timer.Reset();
+		index.SetOrigin(cameraPosition.z_ - CORRIDOR_START - CORRIDOR_BUCKET_LENGTH);
+		visible.Clear();
+		index.GetDrawables(visible, frustum, DRAWABLE_GEOMETRY);
+		corridorCullUSec += timer.GetUSec(true);
+		hits.Clear();
+		index.Raycast(hits, Ray(cameraPosition, Vector3::FORWARD), RAY_AABB, VIEW_DISTANCE, DRAWABLE_GEOMETRY);
+		corridorRayUSec += timer.GetUSec(false);
+		corridorVisible += visible.Size();
+		corridorHits += hits.Size();
+	}
+
+	// Visible and hit totals should match, otherwise the index is missing content
+	JSONValue result;
+	result["drawables"] = count;
+	result["frames"] = NUM_FRAMES;
+	result["octreeCullUs"] = (double)octreeCullUSec / NUM_FRAMES;
+	result["octreeRaycastUs"] = (double)octreeRayUSec / NUM_FRAMES;
+	result["octreeVisible"] = octreeVisible;
+	result["octreeHits"] = octreeHits;
+	result["corridorInsertMs"] = corridorInsertUSec / 1000.0;
+	result["corridorCullUs"] = (double)corridorCullUSec / NUM_FRAMES;
+	result["corridorRaycastUs"] = (double)corridorRayUSec / NUM_FRAMES;
+	result["corridorVisible"] = corridorVisible;
+	result["corridorHits"] = corridorHits;
+	results_["corridorIndex"].Push(result);
+	URHO3D_LOGINFO(ToString("Corridor index (%u drawables): cull %.1f us octree, %.1f us corridor; raycast %.1f us octree, %.1f us corridor; "
+		"visible %u / %u, hits %u / %u", count, (double)octreeCullUSec / NUM_FRAMES, (double)corridorCullUSec / NUM_FRAMES,
+		(double)octreeRayUSec / NUM_FRAMES, (double)corridorRayUSec / NUM_FRAMES, octreeVisible, corridorVisible, octreeHits,
+		corridorHits));
+}
+
+void SceneBenchmarks::RunPrefabBenchmark(unsigned count)
+{
+	TrackPrefab* prefab = GetSubsystem<TrackPrefabLibrary>()->GetPrefab(TRACK_BOX_PREFAB);
+	XMLFile* xml = GetSubsystem<ResourceProfiler>()->GetResource<XMLFile>(String(TRACK_BOX_PREFAB) + ".xml", __FUNCTION__);
+	if (!prefab || !xml)
+		return;
+
+	// Resources are already cached by the prefab, so all three paths measure node and component creation only
+	SharedPtr<Scene> scene(new Scene(context_));
+	scene->CreateComponent<Octree>();
+	HiresTimer timer;
+	for (unsigned i = 0; i < count; ++i)
+		scene->InstantiateXML(xml->GetRoot(), Vector3(0.0f, 0.0f, (float)i), Quaternion::IDENTITY, LOCAL);
+	long long xmlUSec = Max(timer.GetUSec(false), 1LL);
+	scene->RemoveAllChildren();
+
+	timer.Reset();
+	for (unsigned i = 0; i < count; ++i)
+		prefab->InstantiateBinary(scene, Vector3(0.0f, 0.0f, (float)i), Quaternion::IDENTITY);
+	long long binaryUSec = Max(timer.GetUSec(false), 1LL);
+	scene->RemoveAllChildren();
+
+	timer.Reset();
+	for (unsigned i = 0; i < count; ++i)
+		prefab->Instantiate(scene, Vector3(0.0f, 0.0f, (float)i), Quaternion::IDENTITY);
+	long long fastUSec = Max(timer.GetUSec(false), 1LL);
+
+	JSONValue& results = results_["prefabs"];
+	results["instances"] = count;
+	results["binaryBytes"] = prefab->GetBinary().GetSize();
+	results["fastPath"] = prefab->IsFast();
+	results["xmlUsPerPrefab"] = (double)xmlUSec / count;
+	results["binaryUsPerPrefab"] = (double)binaryUSec / count;
+	results["fastUsPerPrefab"] = (double)fastUSec / count;
+	URHO3D_LOGINFO(ToString("Prefab instantiation (%u): XML %.2f us, binary %.2f us, fast clone %.2f us per prefab", count,
+		(double)xmlUSec / count, (double)binaryUSec / count, (double)fastUSec / count));
+}
+
+void SceneBenchmarks::RunPickupBenchmark(unsigned count)
+{
+	TrackPrefab* prefab = GetSubsystem<TrackPrefabLibrary>()->GetPrefab(TRACK_CARROT_PREFAB);
+	if (!prefab)
+		return;
+
+	// Both approaches update the octree and prepare batches the way the renderer does each frame, without drawing
+	SharedPtr<Scene> scene(new Scene(context_));
+	Octree* octree = scene->CreateComponent<Octree>();
+	Node* cameraNode = scene->CreateChild("Camera", LOCAL);
+	cameraNode->SetPosition(Vector3(0.0f, 3.0f, -10.0f));
+	FrameInfo frame;
+	frame.frameNumber_ = 1;
+	frame.timeStep_ = 1.0f / 60.0f;
+	frame.viewSize_ = IntVector2(1280, 720);
+	frame.camera_ = cameraNode->CreateComponent<Camera>(LOCAL);
+
+	TrackRandom random(seed_);
+	PODVector<Matrix3x4> transforms(count);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Vector3 position(TrackLayout::GetLaneX(random.Int(3) - 1), CARROT_HEIGHT, random.Float(1000.0f));
+		transforms[i] = Matrix3x4(position, Quaternion::IDENTITY, prefab->GetScale());
+	}
+
+	// Node-driven: every pickup node is turned and moved each frame, which dirties its transform and reinserts its drawable.
+	// Speed, bob and phase match the carrot material
+	PODVector<Node*> nodes(count);
+	PODVector<StaticModel*> models(count);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		nodes[i] = scene->CreateChild("Pickup", LOCAL);
+		nodes[i]->SetTransform(transforms[i].Translation(), Quaternion::IDENTITY, prefab->GetScale());
+		models[i] = nodes[i]->CreateComponent<StaticModel>(LOCAL);
+		models[i]->SetModel(prefab->GetModel());
+		models[i]->SetMaterial(prefab->GetMaterial());
+	}
+	HiresTimer timer;
+	for (unsigned i = 0; i < PICKUP_BENCHMARK_FRAMES; ++i, ++frame.frameNumber_)
+	{
+		float time = i * frame.timeStep_;
+		for (unsigned j = 0; j < count; ++j)
+		{
+			Vector3 position = transforms[j].Translation();
+			float phase = 0.7f * position.x_ + 0.45f * position.z_;
+			nodes[j]->SetRotation(Quaternion((time * 2.5f + phase) * M_RADTODEG, Vector3::UP));
+			nodes[j]->SetPosition(position + Vector3(0.0f, 0.15f * Sin((time * 3.0f + phase) * M_RADTODEG), 0.0f));
+		}
+		octree->Update(frame);
+		for (unsigned j = 0; j < count; ++j)
+			models[j]->UpdateBatches(frame);
+	}
+	long long nodeUSec = Max(timer.GetUSec(false), 1LL);
+	for (unsigned i = 0; i < count; ++i)
+		nodes[i]->Remove();
+
+	// Shader-driven: the pickups are instances that never move, animated by the material from the elapsed time
+	TrackInstanceGroup* group = scene->CreateChild("Pickups", LOCAL)->CreateComponent<TrackInstanceGroup>(LOCAL);
+	group->SetModel(prefab->GetModel());
+	group->SetMaterial(prefab->GetMaterial());
+	group->SetInstances(&transforms);
+	timer.Reset();
+	for (unsigned i = 0; i < PICKUP_BENCHMARK_FRAMES; ++i, ++frame.frameNumber_)
+	{
+		octree->Update(frame);
+		group->UpdateBatches(frame);
+	}
+	long long shaderUSec = Max(timer.GetUSec(false), 1LL);
+
+	JSONValue& results = results_["pickupAnimation"];
+	results["pickups"] = count;
+	results["frames"] = PICKUP_BENCHMARK_FRAMES;
+	results["nodeDrivenMsPerFrame"] = nodeUSec / 1000.0 / PICKUP_BENCHMARK_FRAMES;
+	results["shaderDrivenMsPerFrame"] = shaderUSec / 1000.0 / PICKUP_BENCHMARK_FRAMES;
+	results["speedup"] = (double)nodeUSec / shaderUSec;
+	URHO3D_LOGINFO(ToString("Pickup animation (%u): node-driven %.3f ms, shader-driven %.3f ms per frame", count,
+		nodeUSec / 1000.0 / PICKUP_BENCHMARK_FRAMES, shaderUSec / 1000.0 / PICKUP_BENCHMARK_FRAMES));
+}
+
+void SceneBenchmarks::RunMagnetBenchmark(unsigned count)
+{
+	TrackPrefab* prefab = GetSubsystem<TrackPrefabLibrary>()->GetPrefab(TRACK_CARROT_PREFAB);
+	if (!prefab)
+		return;
+
+	// Both approaches update the octree each step, which reinserts moved drawables or merges the instance bounding box
+	SharedPtr<Scene> scene(new Scene(context_));
+	Octree* octree = scene->CreateComponent<Octree>();
+	FrameInfo frame;
+	frame.frameNumber_ = 1;
+	frame.timeStep_ = SIM_TIMESTEP;
+
+	// The runner stands at the origin of a straight track, with every pickup within the magnet radius on its three lanes.
+	// The pull is slow enough that none reaches the runner, so each step moves all of them
+	PickupMagnet magnet(MAGNET_RADIUS, 0.05f);
+	Vector3 runnerPosition = Vector3::ZERO;
+	Vector3 target = runnerPosition + Vector3(0.0f, MAGNET_TARGET_HEIGHT, 0.0f);
+	float span = 2.0f * 0.95f * MAGNET_RADIUS;
+	PODVector<Vector3> positions(count);
+	for (unsigned i = 0; i < count; ++i)
+		positions[i] = Vector3(TrackLayout::GetLaneX(i % 3 - 1), CARROT_HEIGHT, -0.5f * span + span * i / count);
+
+	// Node-driven: walk the pickup nodes, and move the ones in range toward the runner
+	Node* pickupRoot = scene->CreateChild("Pickups", LOCAL);
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Node* node = pickupRoot->CreateChild("Carrot", LOCAL);
+		node->SetTransform(positions[i], Quaternion::IDENTITY, prefab->GetScale());
+		StaticModel* model = node->CreateComponent<StaticModel>(LOCAL);
+		model->SetModel(prefab->GetModel());
+		model->SetMaterial(prefab->GetMaterial());
+	}
+	float step = magnet.GetPullSpeed() * SIM_TIMESTEP;
+	float radiusSquared = MAGNET_RADIUS * MAGNET_RADIUS;
+	unsigned nodeCollected = 0;
+	HiresTimer timer;
+	for (unsigned i = 0; i < MAGNET_BENCHMARK_STEPS; ++i, ++frame.frameNumber_)
+	{
+		const Vector<SharedPtr<Node> >& children = pickupRoot->GetChildren();
+		for (unsigned j = 0; j < children.Size(); ++j)
+		{
+			Node* node = children[j];
+			if (node->GetName() != "Carrot")
+				continue;
+			Vector3 position = node->GetPosition();
+			Vector3 offset = position - target;
+			if (offset.x_ * offset.x_ + offset.z_ * offset.z_ >= radiusSquared)
+				continue;
+			float length = offset.Length();
+			if (length - step <= RUNNER_TOUCH_DISTANCE)
+				++nodeCollected;
+			else
+				node->SetPosition(position - offset * (step / length));
+		}
+		octree->Update(frame);
+	}
+	long long nodeUSec = Max(timer.GetUSec(false), 1LL);
+	pickupRoot->Remove();
+
+	// Magnet: radius query through the distance index, one pass over the offsets, instance transforms written in a batch
+	TrackEntityStore store;
+	store.SetRenderNode(scene->CreateChild("Pickups", LOCAL));
+	store.SetPrefab(ARCHETYPE_PICKUP, prefab);
+	store.Reserve(ARCHETYPE_PICKUP, count);
+	TrackCollider collider;
+	collider.size_ = Vector3::ONE;
+	collider.layer_ = LAYER_PICKUP;
+	for (unsigned i = 0; i < count; ++i)
+		store.Add(ARCHETYPE_PICKUP, Matrix3x4(positions[i], Quaternion::IDENTITY, prefab->GetScale()), positions[i].z_, i % 3 - 1,
+			collider);
+	PODVector<unsigned> collected;
+	timer.Reset();
+	for (unsigned i = 0; i < MAGNET_BENCHMARK_STEPS; ++i, ++frame.frameNumber_)
+	{
+		magnet.Update(store, runnerPosition, runnerPosition, SIM_TIMESTEP, true, collected);
+		octree->Update(frame);
+	}
+	long long magnetUSec = Max(timer.GetUSec(false), 1LL);
+
+	JSONValue& results = results_["pickupMagnet"];
+	results["pickups"] = count;
+	results["steps"] = MAGNET_BENCHMARK_STEPS;
+	results["attracted"] = magnet.GetNumAttracted();
+	results["collected"] = nodeCollected + collected.Size();
+	results["nodeMsPerStep"] = nodeUSec / 1000.0 / MAGNET_BENCHMARK_STEPS;
+	results["magnetMsPerStep"] = magnetUSec / 1000.0 / MAGNET_BENCHMARK_STEPS;
+	results["speedup"] = (double)nodeUSec / magnetUSec;
+	URHO3D_LOGINFO(ToString("Pickup magnet (%u in range): node walk %.3f ms, magnet %.3f ms per step", count,
+		nodeUSec / 1000.0 / MAGNET_BENCHMARK_STEPS, magnetUSec / 1000.0 / MAGNET_BENCHMARK_STEPS));
+}
+
+void SceneBenchmarks::RunEffectBenchmark(unsigned effectsPerSecond)
+{
+	const char* effectNames[] = { PICKUP_EFFECT, IMPACT_EFFECT };
+	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	unsigned numFrames = (unsigned)(EFFECT_BENCHMARK_SECONDS / SIM_TIMESTEP + 0.5f);
+
+	// Frames simulate the particles and update the octree, as the scene update and culling do, without drawing
+	SharedPtr<Scene> scene(new Scene(context_));
+	Octree* octree = scene->CreateComponent<Octree>();
+	FrameInfo frame;
+	frame.frameNumber_ = 1;
+	frame.timeStep_ = SIM_TIMESTEP;
+
+	// Per effect: a node and an emitter each time, the effect taken from the cache and loaded on first use, and the node
+	// removed once the last particle is gone. Emission ends and the node goes at the same times as in the pool
+	PODVector<BenchmarkEffect> live;
+	PODVector<float> nodeFrameMs;
+	TrackRandom random(seed_);
+	float debt = 0.0f;
+	unsigned started = 0;
+	unsigned peakLive = 0;
+	long long nodeAllocations = GetAllocationCount();
+	HiresTimer timer;
+	for (unsigned i = 0; i < numFrames; ++i, ++frame.frameNumber_)
+	{
+		timer.Reset();
+		for (debt += effectsPerSecond * SIM_TIMESTEP; debt >= 1.0f; debt -= 1.0f, ++started)
+		{
+			ParticleEffect* effect = cache->GetResource<ParticleEffect>(effectNames[started & 1]);
+			if (!effect)
+				continue;
+			BenchmarkEffect entry;
+			entry.node_ = scene->CreateChild("Effect", LOCAL);
+			entry.node_->SetPosition(Vector3(random.Float(10.0f) - 5.0f, random.Float(3.0f), random.Float(30.0f)));
+			entry.node_->CreateComponent<ParticleEmitter>(LOCAL)->SetEffect(effect);
+			entry.age_ = 0.0f;
+			entry.burstTime_ = effect->GetActiveTime() > 0.0f ? effect->GetActiveTime() : DEFAULT_EFFECT_BURST_TIME;
+			entry.lifeTime_ = entry.burstTime_ + effect->GetMaxTimeToLive();
+			live.Push(entry);
+		}
+		unsigned kept = 0;
+		for (unsigned j = 0; j < live.Size(); ++j)
+		{
+			BenchmarkEffect& entry = live[j];
+			entry.age_ += SIM_TIMESTEP;
+			if (entry.age_ >= entry.burstTime_)
+				entry.node_->GetComponent<ParticleEmitter>()->SetEmitting(false);
+			if (entry.age_ >= entry.lifeTime_)
+				entry.node_->Remove();
+			else
+				live[kept++] = entry;
+		}
+		live.Resize(kept);
+		peakLive = Max(peakLive, live.Size());
+		scene->Update(SIM_TIMESTEP);
+		octree->Update(frame);
+		nodeFrameMs.Push(timer.GetUSec(false) / 1000.0f);
+	}
+	nodeAllocations = GetAllocationCount() - nodeAllocations;
+	for (unsigned i = 0; i < live.Size(); ++i)
+		live[i].node_->Remove();
+
+	// Pooled: effects loaded and emitters created up front, each effect only moves and enables an idle emitter. The cap
+	// allows as many playing as the node path peaked at, so that no effect is cut short and both paths do the same work
+	timer.Reset();
+	SharedPtr<EffectPool> pool(new EffectPool(context_));
+	pool->SetMaxPlaying(Max(peakLive, DEFAULT_MAX_PLAYING_EFFECTS));
+	unsigned effects[] = { pool->AddEffect(PICKUP_EFFECT), pool->AddEffect(IMPACT_EFFECT) };
+	pool->SetScene(scene);
+	float poolSetupMs = timer.GetUSec(false) / 1000.0f;
+	PODVector<float> poolFrameMs;
+	random = TrackRandom(seed_);
+	debt = 0.0f;
+	started = 0;
+	long long poolAllocations = GetAllocationCount();
+	for (unsigned i = 0; i < numFrames; ++i, ++frame.frameNumber_)
+	{
+		timer.Reset();
+		for (debt += effectsPerSecond * SIM_TIMESTEP; debt >= 1.0f; debt -= 1.0f, ++started)
+			pool->Play(effects[started & 1], Vector3(random.Float(10.0f) - 5.0f, random.Float(3.0f), random.Float(30.0f)));
+		scene->Update(SIM_TIMESTEP);
+		octree->Update(frame);
+		poolFrameMs.Push(timer.GetUSec(false) / 1000.0f);
+	}
+	poolAllocations = GetAllocationCount() - poolAllocations;
+
+	JSONValue nodePercentiles = GetPercentiles(nodeFrameMs);
+	JSONValue poolPercentiles = GetPercentiles(poolFrameMs);
+	JSONValue& results = results_["effectBurst"];
+	results["effectsPerSecond"] = effectsPerSecond;
+	results["frames"] = numFrames;
+	results["nodePeakLive"] = peakLive;
+	results["nodeFrameMs"] = nodePercentiles;
+	results["poolSetupMs"] = poolSetupMs;
+	results["poolMaxPlaying"] = pool->GetMaxPlaying();
+	results["poolEmitters"] = pool->GetNumEmitters();
+	results["poolStolen"] = pool->GetNumStolen();
+	results["poolGrown"] = pool->GetNumGrown();
+	results["poolFrameMs"] = poolPercentiles;
+#ifdef MEMORY_TAGS
+	results["allocationsCounted"] = true;
+	results["nodeAllocationsPerFrame"] = (double)nodeAllocations / numFrames;
+	results["poolAllocationsPerFrame"] = (double)poolAllocations / numFrames;
+	URHO3D_LOGINFO(ToString("Effect burst (%u per second): node per effect p99 %.3f ms, %.1f allocations, pool p99 %.3f ms, "
+		"%.1f allocations per frame", effectsPerSecond, nodePercentiles["p99"].GetFloat(), (double)nodeAllocations / numFrames,
+		poolPercentiles["p99"].GetFloat(), (double)poolAllocations / numFrames));
+#else
+	// Allocations are only seen through the tagged allocator
+	results["allocationsCounted"] = false;
+	results["allocationsNote"] = "Build with MEMORY_TAGS to count allocations";
+	URHO3D_LOGINFO(ToString("Effect burst (%u per second): node per effect p99 %.3f ms, pool p99 %.3f ms per frame. "
+		"Build with MEMORY_TAGS to count allocations", effectsPerSecond, nodePercentiles["p99"].GetFloat(),
+		poolPercentiles["p99"].GetFloat()));
+#endif
+}
+
+#ifdef PHYSICS_THREADING
+void SceneBenchmarks::RunPhysicsBenchmark(unsigned numRunners)
+{
+	const float TRACK_LENGTH = 1000.0f;
+	const float RUNNER_SPEED = 8.0f;
+
+	SharedPtr<ThreadedPhysics> threadedPhysics(new ThreadedPhysics(context_));
+	unsigned maxThreads = threadedPhysics->GetMaxThreads();
+	JSONValue& results = results_["physicsBenchmark"];
+	results["runners"] = numRunners;
+	results["obstacles"] = numRunners * PHYSICS_BENCHMARK_OBSTACLES;
+	results["steps"] = PHYSICS_BENCHMARK_STEPS;
+
+	// The same scene is built for every thread count. Runners are the character's capsule, running into each other and the
+	// boxes on the lanes
+	double singleMs = 0.0;
+	unsigned singleHash = 0;
+	bool deterministic = true;
+	for (unsigned threads = 1; threads <= maxThreads; ++threads)
+	{
+		SharedPtr<Scene> scene(new Scene(context_));
+		PhysicsWorld* world = scene->CreateComponent<PhysicsWorld>();
+		Node* floorNode = scene->CreateChild("Floor", LOCAL);
+		floorNode->SetPosition(Vector3(0.0f, -0.5f, TRACK_LENGTH * 0.5f));
+		floorNode->CreateComponent<RigidBody>(LOCAL);
+		floorNode->CreateComponent<CollisionShape>(LOCAL)->SetBox(Vector3(20.0f, 1.0f, TRACK_LENGTH + 100.0f));
+
+		TrackRandom random(seed_ + numRunners);
+		for (unsigned i = 0; i < numRunners * PHYSICS_BENCHMARK_OBSTACLES; ++i)
+		{
+			Node* node = scene->CreateChild("Box", LOCAL);
+			node->SetPosition(Vector3(TrackLayout::GetLaneX(random.Int(3) - 1), 0.5f, 20.0f + random.Float(TRACK_LENGTH)));
+			node->CreateComponent<RigidBody>(LOCAL);
+			node->CreateComponent<CollisionShape>(LOCAL)->SetBox(Vector3::ONE);
+		}
+		PODVector<Node*> runners(numRunners);
+		for (unsigned i = 0; i < numRunners; ++i)
+		{
+			runners[i] = scene->CreateChild("Runner", LOCAL);
+			runners[i]->SetPosition(Vector3(random.Float(8.0f) - 4.0f, 0.0f, random.Float(TRACK_LENGTH)));
+			RigidBody* body = runners[i]->CreateComponent<RigidBody>(LOCAL);
+			body->SetMass(1.0f);
+			body->SetAngularFactor(Vector3::ZERO);
+			body->SetLinearVelocity(Vector3(random.Float(2.0f) - 1.0f, 0.0f, RUNNER_SPEED));
+			runners[i]->CreateComponent<CollisionShape>(LOCAL)->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
+		}
+
+		threadedPhysics->SetNumThreads(threads);
+		threadedPhysics->SetWorld(world);
+		HiresTimer timer;
+		for (unsigned i = 0; i < PHYSICS_BENCHMARK_STEPS; ++i)
+			world->Update(1.0f / world->GetFps());
+		long long stepUSec = Max(timer.GetUSec(false), 1LL);
+		threadedPhysics->SetWorld(0);
+
+		// FNV-1a over the final runner positions; any difference in contacts or solving shows up here
+		unsigned hash = 2166136261u;
+		for (unsigned i = 0; i < numRunners; ++i)
+		{
+			const Vector3& position = runners[i]->GetWorldPosition();
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(position.Data());
+			for (unsigned j = 0; j < sizeof(Vector3); ++j)
+				hash = (hash ^ bytes[j]) * 16777619u;
+		}
+
+		double ms = stepUSec / 1000.0 / PHYSICS_BENCHMARK_STEPS;
+		if (threads == 1)
+		{
+			singleMs = ms;
+			singleHash = hash;
+		}
+		deterministic &= hash == singleHash;
+		JSONValue result;
+		result["threads"] = threads;
+		result["msPerStep"] = ms;
+		result["speedup"] = singleMs / ms;
+		result["positionHash"] = hash;
+		results["threadCounts"].Push(result);
+		URHO3D_LOGINFO(ToString("Physics threading (%u runners, %u threads): %.3f ms per step, speedup %.2f, hash %08x", numRunners,
+			threads, ms, singleMs / ms, hash));
+	}
+	results["deterministic"] = deterministic;
+}
+#endif
+
+void SceneBenchmarks::RunVerifyBenchmark(unsigned numRuns)
+{
+	// Bot runs on a few seeds, each from the start to the end of the track, as there is no content past it to verify
+	// against. The claimed results come from simulating the runs once; every tenth run then claims a pickup more than it
+	// collected, and must be rejected
+	Vector<RunSubmission> runs(numRuns);
+	unsigned tampered = 0;
+	unsigned submissionBytes = 0;
+	unsigned long long totalSteps = 0;
+	VectorBuffer buffer;
+	TrackLayout track;
+	for (unsigned i = 0; i < numRuns; ++i)
+	{
+		RunSubmission& run = runs[i];
+		run.seed_ = seed_ + i % 8;
+		track.Generate(run.seed_, 30, 30, false);
+		RunnerState state;
+		state.Reset();
+		while (state.position_.z_ < TRACK_LENGTH && run.inputs_.Size() < VERIFY_BENCHMARK_MAX_STEPS)
+		{
+			unsigned char buttons = (unsigned char)RunnerSim::GetBotButtons(run.inputs_.Size(), i);
+			RunnerSim::Step(state, buttons, track);
+			run.inputs_.Push(buttons);
+		}
+		totalSteps += run.inputs_.Size();
+		VerifyResult claimed = LeaderboardVerifier::VerifyRun(run);
+		run.score_ = claimed.score_;
+		run.distance_ = claimed.distance_;
+		if (i % 10 == 9)
+		{
+			++run.score_;
+			++tampered;
+		}
+
+		// Runs are verified as read back from the submission format
+		buffer.Clear();
+		run.Write(buffer);
+		submissionBytes += buffer.GetSize();
+		buffer.Seek(0);
+		run.Read(buffer);
+	}
+
+	SharedPtr<LeaderboardVerifier> verifier(new LeaderboardVerifier(context_));
+	JSONValue& results = results_["leaderboardVerifyBenchmark"];
+	results["runs"] = numRuns;
+	float runSeconds = numRuns ? (float)(totalSteps * SIM_TIMESTEP / numRuns) : 0.0f;
+	results["runSeconds"] = runSeconds;
+	results["tampered"] = tampered;
+	results["submissionBytes"] = numRuns ? submissionBytes / numRuns : 0;
+	unsigned threadCounts[] = { 1, verifier->GetMaxThreads() };
+	for (unsigned i = 0; i < (threadCounts[1] > 1 ? 2U : 1U); ++i)
+	{
+		PODVector<VerifyResult> verified;
+		verifier->Verify(runs, verified, threadCounts[i]);
+		long long coreUSec = 0;
+		unsigned rejected = 0;
+		for (unsigned j = 0; j < verified.Size(); ++j)
+		{
+			coreUSec += verified[j].usec_;
+			if (verified[j].status_ != VERIFY_OK)
+				++rejected;
+		}
+		coreUSec = Max(coreUSec, 1LL);
+		long long wallUSec = Max(verifier->GetLastBatchUSec(), 1LL);
+
+		JSONValue result;
+		result["threads"] = threadCounts[i];
+		result["rejected"] = rejected;
+		result["wallSeconds"] = wallUSec / 1000000.0;
+		result["runsPerSecond"] = numRuns * 1000000.0 / wallUSec;
+		result["runsPerCoreSecond"] = numRuns * 1000000.0 / coreUSec;
+		result["speedupOverRealTime"] = (double)totalSteps * SIM_TIMESTEP * 1000000.0 / wallUSec;
+		results["threadCounts"].Push(result);
+		URHO3D_LOGINFO(ToString("Leaderboard verification (%u runs of %.1f s, %u threads): %.1f runs/s, %.1f runs per core-second, "
+			"%u of %u tampered runs rejected", numRuns, runSeconds, threadCounts[i], numRuns * 1000000.0 / wallUSec,
+			numRuns * 1000000.0 / coreUSec, rejected, tampered));
+	}
+}
+
+void SceneBenchmarks::RunScoreBenchmark(unsigned numPlayers)
+{
+	// A board of distinct players with random scores, written to a log in the preferences directory that is removed after
+	FileSystem* fileSystem = GetSubsystem<FileSystem>();
+	String fileName = fileSystem->GetAppPreferencesDir("urho3d", "runner") + "ScoreBenchmark.slog";
+	if (fileSystem->FileExists(fileName))
+		fileSystem->Delete(fileName);
+	SharedPtr<ScoreStore> store(new ScoreStore(context_));
+	if (!store->Open(fileName))
+		return;
+
+	TrackRandom random(seed_);
+	HiresTimer timer;
+	for (unsigned i = 0; i < numPlayers; ++i)
+		store->Submit(i, random.Next() % 1000000);
+	store->Flush();
+	long long insertUSec = Max(timer.GetUSec(true), 1LL);
+
+	PODVector<ScoreEntry> entries;
+	for (unsigned i = 0; i < SCORE_BENCHMARK_QUERIES; ++i)
+		store->GetTop(entries, 100);
+	long long topUSec = timer.GetUSec(true);
+	unsigned rankSum = 0;
+	for (unsigned i = 0; i < SCORE_BENCHMARK_QUERIES; ++i)
+		rankSum += store->GetRank(random.Next() % 1000000);
+	long long rankUSec = timer.GetUSec(true);
+	for (unsigned i = 0; i < SCORE_BENCHMARK_QUERIES; ++i)
+		store->GetNeighbours(entries, random.Int(numPlayers), 5);
+	long long neighbourUSec = timer.GetUSec(true);
+
+	// A tenth of the players submit again, about half of them improving, which leaves superseded records in the log
+	unsigned numResubmits = numPlayers / 10;
+	unsigned improved = 0;
+	for (unsigned i = 0; i < numResubmits; ++i)
+	{
+		if (store->Submit(random.Int(numPlayers), random.Next() % 1000000))
+			++improved;
+	}
+	store->Flush();
+	long long resubmitUSec = Max(timer.GetUSec(true), 1LL);
+
+	unsigned numRecords = store->GetNumLogRecords();
+	unsigned numEntries = store->GetNumEntries();
+	store->Close();
+	bool recovered = store->Open(fileName) && store->GetNumEntries() == numEntries;
+	long long recoveryUSec = store->GetRecoveryUSec();
+	timer.Reset();
+	store->Compact();
+	long long compactUSec = timer.GetUSec(false);
+	store->Close();
+	fileSystem->Delete(fileName);
+
+	JSONValue& results = results_["scoreStore"];
+	results["players"] = numPlayers;
+	results["insertsPerSecond"] = numPlayers * 1000000.0 / insertUSec;
+	results["resubmitsPerSecond"] = numResubmits * 1000000.0 / resubmitUSec;
+	results["improved"] = improved;
+	results["top100Us"] = (double)topUSec / SCORE_BENCHMARK_QUERIES;
+	results["rankUs"] = (double)rankUSec / SCORE_BENCHMARK_QUERIES;
+	results["neighboursUs"] = (double)neighbourUSec / SCORE_BENCHMARK_QUERIES;
+	results["logRecords"] = numRecords;
+	results["recovered"] = recovered;
+	results["recoveryMs"] = recoveryUSec / 1000.0;
+	results["compactMs"] = compactUSec / 1000.0;
+	URHO3D_LOGINFO(ToString("Score store (%u players): %.0f inserts/s, top 100 %.2f us, rank %.2f us, neighbours %.2f us, "
+		"recovery of %u records %.1f ms, compaction %.1f ms (rank checksum %u)", numPlayers, numPlayers * 1000000.0 / insertUSec,
+		(double)topUSec / SCORE_BENCHMARK_QUERIES, (double)rankUSec / SCORE_BENCHMARK_QUERIES,
+		(double)neighbourUSec / SCORE_BENCHMARK_QUERIES, numRecords, recoveryUSec / 1000.0, compactUSec / 1000.0, rankSum));
+}
+
+void SceneBenchmarks::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& metrics = *static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr());
+	for (ConstJSONObjectIterator i = results_.Begin(); i != results_.End(); ++i)
+		metrics[i->first_] = i->second_;
+}
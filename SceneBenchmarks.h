@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Resource/JSONValue.h>
+
+using namespace Urho3D;
+
+class TrackSpline;
+
+/// Benchmark runs from the command line. A zero count or length means the benchmark is not run.
+struct BenchmarkSettings
+{
+	/// Construct with nothing to run.
+	BenchmarkSettings();
+
+	/// Parse the -xxxbenchmark switches, each optionally followed by its count, and -broadcastloadtest <subscribers>. Return
+	/// true if anything was requested.
+	static bool Parse(const Vector<String>& arguments, BenchmarkSettings& settings);
+
+	/// Track spline queries, from -splinebenchmark.
+	unsigned splineQueries_;
+	/// Track entities, from -entitybenchmark.
+	unsigned entities_;
+	/// Run the corridor index benchmark, from -corridorbenchmark.
+	bool corridor_;
+	/// Prefab instances, from -prefabbenchmark.
+	unsigned prefabs_;
+	/// Animated pickups, from -pickupbenchmark.
+	unsigned pickups_;
+	/// Pickups in magnet range, from -magnetbenchmark.
+	unsigned magnetPickups_;
+	/// Effects started per second, from -effectbenchmark.
+	unsigned effectsPerSecond_;
+	/// Physics runners, from -physicsbenchmark.
+	unsigned physicsRunners_;
+	/// Run save rounds, from -savebenchmark.
+	unsigned saveRepeats_;
+	/// Leaderboard runs, from -verifybenchmark.
+	unsigned verifyRuns_;
+	/// Score store players, from -scorebenchmark.
+	unsigned scorePlayers_;
+	/// Scenery run length in metres, from -scenerybenchmark in kilometres.
+	float sceneryLength_;
+	/// Simulated broadcast subscribers, from -broadcastloadtest.
+	unsigned loadTestSubscribers_;
+};
+
+/// Return median, 90th, 99th and 99.9th percentile and maximum of samples. Sorts the samples.
+JSONValue GetPercentiles(PODVector<float>& samples);
+
+/// Startup benchmarks of the game's systems. Each builds its own scene or data from the track seed, logs its figures and
+/// keeps them for the metrics export, one section per benchmark. The run save and scenery benchmarks drive the game scene
+/// itself and add their sections through GetSection.
+class SceneBenchmarks : public Object
+{
+	URHO3D_OBJECT(SceneBenchmarks, Object);
+
+public:
+	/// Construct with the track seed.
+	SceneBenchmarks(Context* context, unsigned seed);
+
+	/// Run the requested benchmarks that do not need the game scene.
+	void Run(const BenchmarkSettings& settings, const TrackSpline& spline);
+	/// Measure track spline queries per second and log them.
+	void RunSplineBenchmark(const TrackSpline& spline, unsigned numQueries);
+	/// Measure memory per entity and iteration time of the entity store against nodes and log them.
+	void RunEntityBenchmark(unsigned count);
+	/// Measure frustum culling and raycast time of the corridor index against the octree and log them.
+	void RunCorridorBenchmark(unsigned count);
+	/// Measure instantiation time per prefab from XML, binary and the fast clone path and log them.
+	void RunPrefabBenchmark(unsigned count);
+	/// Measure CPU time per frame of pickup idle animation driven by nodes against the instanced material and log them.
+	void RunPickupBenchmark(unsigned count);
+	/// Measure CPU time per step of the magnet power-up with all pickups in range, walking pickup nodes against the magnet
+	/// over the entity store, and log them.
+	void RunMagnetBenchmark(unsigned count);
+	/// Measure frame time and allocations of a steady stream of pickup and impact effects, creating a node and emitter per
+	/// effect against the effect pool, and log them.
+	void RunEffectBenchmark(unsigned effectsPerSecond);
+#ifdef PHYSICS_THREADING
+	/// Measure physics step time of a many-runner scene from one thread to all worker threads, check that the results match,
+	/// and log them.
+	void RunPhysicsBenchmark(unsigned numRunners);
+#endif
+	/// Measure leaderboard verification throughput of ten minute runs on one thread and on all threads and log it.
+	void RunVerifyBenchmark(unsigned numRuns);
+	/// Measure insert, query, recovery and compaction time of the score store with many players and log them.
+	void RunScoreBenchmark(unsigned numPlayers);
+
+	/// Return a metrics section to write results into.
+	JSONValue& GetSection(const String& name) { return results_[name]; }
+
+private:
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Results by metrics section.
+	JSONValue results_;
+	/// Track seed.
+	unsigned seed_;
+};
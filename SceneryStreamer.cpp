@@ -0,0 +1,524 @@
+#include <cstring>
+
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Geometry.h>
+#include <Urho3D/Graphics/IndexBuffer.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/VertexBuffer.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/Image.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "EventStats.h"
+#include "MetricsExport.h"
+#include "ResourceProfiler.h"
+#include "SceneryStreamer.h"
+
+/// Floats per vertex: position, normal, texture coordinate.
+static const unsigned VERTEX_FLOATS = 8;
+/// Patch distance from the runner up to which each level of detail is used. Farther patches use the last level.
+static const float LOD_DISTANCES[SCENERY_LOD_LEVELS - 1] = { 80.0f, 180.0f };
+/// Height of the tallest hills.
+static const float MAX_HEIGHT = 35.0f;
+/// Distance from the walls over which the hills rise to full height.
+static const float RAMP_WIDTH = 40.0f;
+/// Height map pixels per metre. The height map repeats beyond its edges.
+static const float HEIGHT_MAP_SCALE = 0.5f;
+/// Texture coordinates per metre. The detail textures repeat DetailTiling times per coordinate unit.
+static const float UV_SCALE = 1.0f / 256.0f;
+/// Depth of the skirts along the patch ends.
+static const float SKIRT_DEPTH = 4.0f;
+
+/// Return number of vertices of a patch.
+static unsigned GetNumVertices(unsigned lod)
+{
+	unsigned row = (SCENERY_QUADS_X >> lod) + 1;
+	return row * ((SCENERY_QUADS_Z >> lod) + 1) + 2 * row;
+}
+
+/// Return position of a vertex.
+static Vector3 GetVertexPosition(const float* vertices, unsigned index)
+{
+	const float* vertex = vertices + index * VERTEX_FLOATS;
+	return Vector3(vertex[0], vertex[1], vertex[2]);
+}
+
+/// Build patch indices: the grid, then skirts along both ends that hide cracks against a neighbour at another level of detail.
+static void BuildIndices(unsigned lod, PODVector<unsigned short>& indices)
+{
+	unsigned qx = SCENERY_QUADS_X >> lod;
+	unsigned qz = SCENERY_QUADS_Z >> lod;
+	unsigned row = qx + 1;
+
+	for (unsigned z = 0; z < qz; ++z)
+	{
+		for (unsigned x = 0; x < qx; ++x)
+		{
+			unsigned short i = (unsigned short)(z * row + x);
+			indices.Push(i);
+			indices.Push(i + row);
+			indices.Push(i + 1);
+			indices.Push(i + row);
+			indices.Push(i + row + 1);
+			indices.Push(i + 1);
+		}
+	}
+
+	unsigned short backSkirt = (unsigned short)(row * (qz + 1));
+	unsigned short frontSkirt = backSkirt + row;
+	unsigned short frontEdge = (unsigned short)(row * qz);
+	for (unsigned short x = 0; x < qx; ++x)
+	{
+		// The back skirt faces backwards, the front skirt forwards
+		indices.Push(x);
+		indices.Push(x + 1);
+		indices.Push(backSkirt + x + 1);
+		indices.Push(x);
+		indices.Push(backSkirt + x + 1);
+		indices.Push(backSkirt + x);
+
+		indices.Push(frontEdge + x);
+		indices.Push(frontSkirt + x + 1);
+		indices.Push(frontEdge + x + 1);
+		indices.Push(frontEdge + x);
+		indices.Push(frontSkirt + x);
+		indices.Push(frontSkirt + x + 1);
+	}
+}
+
+SceneryPatch::SceneryPatch(Context* context) :
+	StaticModel(context)
+{
+}
+
+void SceneryPatch::RegisterObject(Context* context)
+{
+	context->RegisterFactory<SceneryPatch>();
+}
+
+SceneryStreamer::Slot::Slot() :
+	segment_(0),
+	side_(0),
+	lod_(M_MAX_UNSIGNED),
+	used_(false),
+	ready_(false)
+{
+}
+
+SceneryStreamer::SceneryStreamer(Context* context) :
+	Object(context),
+	heightWidth_(0),
+	heightHeight_(0),
+	splineChanged_(false),
+	lastUpdateUSec_(0),
+	maxUpdateUSec_(0),
+	totalUpdateUSec_(0),
+	numUpdates_(0),
+	numGenerated_(0),
+	generateUSec_(0),
+	numUploads_(0)
+{
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(SceneryStreamer, HandleCollectMetrics));
+}
+
+SceneryStreamer::~SceneryStreamer()
+{
+	// Workers write into the slots, so generation in progress is taken off the queue or waited for
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		SharedPtr<WorkItem> item = slots_[i].item_;
+		if (item && !(queue && queue->RemoveWorkItem(item)))
+		{
+			while (!item->completed_)
+				Time::Sleep(0);
+		}
+	}
+}
+
+bool SceneryStreamer::Initialize(const String& heightMapName, const String& materialName)
+{
+	ResourceProfiler* profiler = GetSubsystem<ResourceProfiler>();
+	Image* image = profiler->GetResource<Image>(heightMapName, __FUNCTION__);
+	material_ = profiler->GetResource<Material>(materialName, __FUNCTION__);
+	if (!image || image->IsCompressed() || !material_)
+	{
+		URHO3D_LOGERROR("Could not load scenery height map " + heightMapName + " or material " + materialName);
+		material_.Reset();
+		return false;
+	}
+
+	// Workers read their own copy, so that a reload of the image cannot change the data under them
+	heightWidth_ = image->GetWidth();
+	heightHeight_ = image->GetHeight();
+	unsigned components = image->GetComponents();
+	const unsigned char* data = image->GetData();
+	heights_.Resize((unsigned)(heightWidth_ * heightHeight_));
+	for (unsigned i = 0; i < heights_.Size(); ++i)
+		heights_[i] = data[i * components];
+
+	for (unsigned i = 0; i < SCENERY_LOD_LEVELS; ++i)
+	{
+		PODVector<unsigned short> indices;
+		BuildIndices(i, indices);
+		indexBuffers_[i] = new IndexBuffer(context_);
+		indexBuffers_[i]->SetShadowed(true);
+		indexBuffers_[i]->SetSize(indices.Size(), false);
+		indexBuffers_[i]->SetData(&indices[0]);
+	}
+
+	unsigned maxVertices = GetNumVertices(0);
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		Slot& slot = slots_[i];
+		slot.job_.vertices_.Resize(maxVertices * VERTEX_FLOATS);
+		slot.vertexBuffer_ = new VertexBuffer(context_);
+		slot.vertexBuffer_->SetSize(maxVertices, MASK_POSITION | MASK_NORMAL | MASK_TEXCOORD1, true);
+		slot.geometry_ = new Geometry(context_);
+		slot.geometry_->SetVertexBuffer(0, slot.vertexBuffer_);
+		slot.geometry_->SetIndexBuffer(indexBuffers_[0]);
+		slot.model_ = new Model(context_);
+		slot.model_->SetNumGeometries(1);
+		slot.model_->SetNumGeometryLodLevels(0, 1);
+		slot.model_->SetGeometry(0, 0, slot.geometry_);
+	}
+	return true;
+}
+
+void SceneryStreamer::SetSpline(const TrackSpline& spline)
+{
+	MemoryScope memoryScope(MEMTAG_TRACK_SCENERY);
+	pendingSpline_ = spline;
+	splineChanged_ = true;
+}
+
+void SceneryStreamer::Update(Scene* scene, float distance)
+{
+	MemoryScope memoryScope(MEMTAG_TRACK_SCENERY);
+	if (!material_ || !scene)
+		return;
+
+	HiresTimer timer;
+	if (!root_ || root_->GetScene() != scene)
+		CreateNodes(scene);
+
+	unsigned inFlight = 0;
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		Slot& slot = slots_[i];
+		if (!slot.item_)
+			continue;
+		if (slot.item_->completed_)
+		{
+			slot.item_.Reset();
+			slot.ready_ = true;
+			generateUSec_ += slot.job_.usec_;
+			++numGenerated_;
+		}
+		else
+			++inFlight;
+	}
+
+	// Workers read the spline, so a new track is switched to only once they are done, and then everything is regenerated
+	if (splineChanged_ && !inFlight)
+	{
+		spline_ = pendingSpline_;
+		pendingSpline_ = TrackSpline();
+		splineChanged_ = false;
+		for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+		{
+			slots_[i].used_ = false;
+			slots_[i].ready_ = false;
+		}
+	}
+
+	int first = (int)Floor((distance - SCENERY_BEHIND) / SCENERY_PATCH_LENGTH);
+	int last = (int)Floor((distance + SCENERY_AHEAD) / SCENERY_PATCH_LENGTH);
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		Slot& slot = slots_[i];
+		if (slot.used_ && !slot.item_ && (slot.segment_ < first || slot.segment_ > last))
+		{
+			slot.used_ = false;
+			slot.ready_ = false;
+		}
+		if (!slot.used_ && slot.lod_ != M_MAX_UNSIGNED)
+		{
+			if (slot.drawable_)
+				slot.drawable_->SetEnabled(false);
+			slot.lod_ = M_MAX_UNSIGNED;
+		}
+	}
+
+	// Nearest results first, a bounded number per frame
+	for (unsigned upload = 0; upload < SCENERY_UPLOADS_PER_FRAME; ++upload)
+	{
+		Slot* nearest = 0;
+		float nearestDistance = M_INFINITY;
+		for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+		{
+			Slot& slot = slots_[i];
+			float patchDistance = Abs((slot.segment_ + 0.5f) * SCENERY_PATCH_LENGTH - distance);
+			if (slot.used_ && slot.ready_ && patchDistance < nearestDistance)
+			{
+				nearest = &slot;
+				nearestDistance = patchDistance;
+			}
+		}
+		if (!nearest)
+			break;
+		Upload(*nearest);
+	}
+
+	// Request missing patches and detail changes, ahead of the runner first
+	if (!splineChanged_ && spline_.GetNumSamples())
+	{
+		int current = (int)Floor(distance / SCENERY_PATCH_LENGTH);
+		for (int j = 0; j <= last - first; ++j)
+		{
+			int segment = current + j <= last ? current + j : current - (current + j - last);
+			unsigned lod = GetLod(segment, distance);
+			for (int side = -1; side <= 1; side += 2)
+			{
+				Slot* slot = FindSlot(segment, side);
+				if (!slot)
+				{
+					for (unsigned i = 0; i < MAX_SCENERY_PATCHES && !slot; ++i)
+					{
+						if (!slots_[i].used_ && !slots_[i].item_)
+							slot = &slots_[i];
+					}
+					if (!slot)
+						break;
+					slot->used_ = true;
+					QueueJob(*slot, segment, side, lod);
+				}
+				else if (!slot->item_ && !slot->ready_ && slot->lod_ != lod)
+					QueueJob(*slot, segment, side, lod);
+			}
+		}
+	}
+
+	lastUpdateUSec_ = timer.GetUSec(false);
+	maxUpdateUSec_ = Max(maxUpdateUSec_, lastUpdateUSec_);
+	totalUpdateUSec_ += lastUpdateUSec_;
+	++numUpdates_;
+}
+
+unsigned SceneryStreamer::GetNumVisible() const
+{
+	unsigned count = 0;
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		if (slots_[i].lod_ != M_MAX_UNSIGNED)
+			++count;
+	}
+	return count;
+}
+
+unsigned SceneryStreamer::GetNumInFlight() const
+{
+	unsigned count = 0;
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		if (slots_[i].item_)
+			++count;
+	}
+	return count;
+}
+
+void SceneryStreamer::GeneratePatchWork(const WorkItem* item, unsigned threadIndex)
+{
+	MemoryScope memoryScope(MEMTAG_TRACK_SCENERY);
+	static_cast<const SceneryStreamer*>(item->aux_)->GeneratePatch(*static_cast<SceneryJob*>(item->start_));
+}
+
+void SceneryStreamer::GeneratePatch(SceneryJob& job) const
+{
+	HiresTimer timer;
+	unsigned qx = SCENERY_QUADS_X >> job.lod_;
+	unsigned qz = SCENERY_QUADS_Z >> job.lod_;
+	unsigned row = qx + 1;
+	float x0 = job.side_ < 0 ? -(SCENERY_INNER_OFFSET + SCENERY_PATCH_WIDTH) : SCENERY_INNER_OFFSET;
+	float z0 = job.segment_ * SCENERY_PATCH_LENGTH;
+	float stepX = SCENERY_PATCH_WIDTH / qx;
+	float stepZ = SCENERY_PATCH_LENGTH / qz;
+	float* vertices = &job.vertices_[0];
+	job.boundingBox_.Clear();
+
+	// The grid is laid out in track space, so that the patches bend with the track
+	for (unsigned z = 0; z <= qz; ++z)
+	{
+		for (unsigned x = 0; x <= qx; ++x)
+		{
+			Vector3 trackPosition(x0 + x * stepX, 0.0f, z0 + z * stepZ);
+			trackPosition.y_ = GetHeight(trackPosition.x_, trackPosition.z_);
+			Vector3 position = spline_.ToWorld(trackPosition);
+			float* vertex = vertices + (z * row + x) * VERTEX_FLOATS;
+			vertex[0] = position.x_;
+			vertex[1] = position.y_;
+			vertex[2] = position.z_;
+			vertex[6] = trackPosition.x_ * UV_SCALE;
+			vertex[7] = trackPosition.z_ * UV_SCALE;
+			job.boundingBox_.Merge(position);
+		}
+	}
+
+	for (unsigned z = 0; z <= qz; ++z)
+	{
+		for (unsigned x = 0; x <= qx; ++x)
+		{
+			Vector3 dx = GetVertexPosition(vertices, z * row + (x < qx ? x + 1 : x)) -
+				GetVertexPosition(vertices, z * row + (x ? x - 1 : x));
+			Vector3 dz = GetVertexPosition(vertices, (z < qz ? z + 1 : z) * row + x) -
+				GetVertexPosition(vertices, (z ? z - 1 : z) * row + x);
+			Vector3 normal = dz.CrossProduct(dx).Normalized();
+			float* vertex = vertices + (z * row + x) * VERTEX_FLOATS;
+			vertex[3] = normal.x_;
+			vertex[4] = normal.y_;
+			vertex[5] = normal.z_;
+		}
+	}
+
+	// Skirt vertices copy the end rows, lowered
+	float* backSkirt = vertices + row * (qz + 1) * VERTEX_FLOATS;
+	float* frontSkirt = backSkirt + row * VERTEX_FLOATS;
+	for (unsigned x = 0; x < row; ++x)
+	{
+		memcpy(backSkirt + x * VERTEX_FLOATS, vertices + x * VERTEX_FLOATS, VERTEX_FLOATS * sizeof(float));
+		memcpy(frontSkirt + x * VERTEX_FLOATS, vertices + (qz * row + x) * VERTEX_FLOATS, VERTEX_FLOATS * sizeof(float));
+		backSkirt[x * VERTEX_FLOATS + 1] -= SKIRT_DEPTH;
+		frontSkirt[x * VERTEX_FLOATS + 1] -= SKIRT_DEPTH;
+	}
+	job.boundingBox_.min_.y_ -= SKIRT_DEPTH;
+
+	job.numVertices_ = GetNumVertices(job.lod_);
+	job.usec_ = timer.GetUSec(false);
+}
+
+float SceneryStreamer::GetHeight(float x, float z) const
+{
+	float px = x * HEIGHT_MAP_SCALE;
+	float pz = z * HEIGHT_MAP_SCALE;
+	int ix = (int)Floor(px);
+	int iz = (int)Floor(pz);
+	float fx = px - ix;
+	float fz = pz - iz;
+	int x0 = (ix % heightWidth_ + heightWidth_) % heightWidth_;
+	int z0 = (iz % heightHeight_ + heightHeight_) % heightHeight_;
+	int x1 = (x0 + 1) % heightWidth_;
+	int z1 = (z0 + 1) % heightHeight_;
+
+	float h0 = Lerp((float)heights_[z0 * heightWidth_ + x0], (float)heights_[z0 * heightWidth_ + x1], fx);
+	float h1 = Lerp((float)heights_[z1 * heightWidth_ + x0], (float)heights_[z1 * heightWidth_ + x1], fx);
+	float height = Lerp(h0, h1, fz) / 255.0f;
+
+	// Level with the floor at the walls, rising into hills away from the track
+	float ramp = SmoothStep(0.0f, RAMP_WIDTH, Abs(x) - SCENERY_INNER_OFFSET);
+	return height * MAX_HEIGHT * ramp;
+}
+
+unsigned SceneryStreamer::GetLod(int segment, float distance) const
+{
+	float patchDistance = Abs((segment + 0.5f) * SCENERY_PATCH_LENGTH - distance);
+	unsigned lod = 0;
+	while (lod < SCENERY_LOD_LEVELS - 1 && patchDistance > LOD_DISTANCES[lod])
+		++lod;
+	return lod;
+}
+
+SceneryStreamer::Slot* SceneryStreamer::FindSlot(int segment, int side)
+{
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		Slot& slot = slots_[i];
+		if (slot.used_ && slot.segment_ == segment && slot.side_ == side)
+			return &slot;
+	}
+	return 0;
+}
+
+void SceneryStreamer::QueueJob(Slot& slot, int segment, int side, unsigned lod)
+{
+	slot.segment_ = segment;
+	slot.side_ = side;
+	slot.job_.segment_ = segment;
+	slot.job_.side_ = side;
+	slot.job_.lod_ = lod;
+
+	// A new item each time: a finished item stays in the queue's list until the queue purges it, so it can not be added again
+	// right away. Without worker threads the queue runs low priority items on the main thread within a time budget
+	SharedPtr<WorkItem> item(new WorkItem());
+	item->workFunction_ = GeneratePatchWork;
+	item->start_ = &slot.job_;
+	item->aux_ = this;
+	item->priority_ = 0;
+	GetSubsystem<WorkQueue>()->AddWorkItem(item);
+	slot.item_ = item;
+}
+
+void SceneryStreamer::Upload(Slot& slot)
+{
+	const SceneryJob& job = slot.job_;
+	IndexBuffer* indexBuffer = indexBuffers_[job.lod_];
+	slot.vertexBuffer_->SetDataRange(&job.vertices_[0], 0, job.numVertices_);
+	slot.geometry_->SetIndexBuffer(indexBuffer);
+	slot.geometry_->SetDrawRange(TRIANGLE_LIST, 0, indexBuffer->GetIndexCount(), 0, job.numVertices_);
+	slot.model_->SetBoundingBox(job.boundingBox_);
+	if (slot.drawable_)
+	{
+		slot.drawable_->SetPatchBoundingBox(job.boundingBox_);
+		slot.drawable_->SetEnabled(true);
+	}
+	slot.lod_ = job.lod_;
+	slot.ready_ = false;
+	++numUploads_;
+}
+
+void SceneryStreamer::CreateNodes(Scene* scene)
+{
+	// Patches are world space geometry under an identity root, not saved with the scene
+	if (root_)
+		root_->Remove();
+	Node* root = scene->CreateChild("Scenery", LOCAL);
+	root->SetTemporary(true);
+	root_ = root;
+
+	for (unsigned i = 0; i < MAX_SCENERY_PATCHES; ++i)
+	{
+		Slot& slot = slots_[i];
+		slot.node_ = root->CreateChild("SceneryPatch", LOCAL);
+		SceneryPatch* drawable = slot.node_->CreateComponent<SceneryPatch>(LOCAL);
+		drawable->SetModel(slot.model_);
+		drawable->SetMaterial(material_);
+		drawable->SetEnabled(false);
+		slot.drawable_ = drawable;
+
+		// Shown patches went with the previous scene; patches being generated are shown once done
+		if (!slot.item_)
+		{
+			slot.used_ = false;
+			slot.ready_ = false;
+		}
+		slot.lod_ = M_MAX_UNSIGNED;
+	}
+}
+
+void SceneryStreamer::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& scenery = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["scenery"];
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	scenery["workerThreads"] = queue ? queue->GetNumThreads() : 0;
+	scenery["slots"] = MAX_SCENERY_PATCHES;
+	scenery["visible"] = GetNumVisible();
+	scenery["generated"] = numGenerated_;
+	scenery["generateMsPerPatch"] = numGenerated_ ? generateUSec_ / 1000.0f / numGenerated_ : 0.0f;
+	scenery["uploads"] = numUploads_;
+	scenery["updateMsPerFrame"] = numUpdates_ ? totalUpdateUSec_ / 1000.0f / numUpdates_ : 0.0f;
+	scenery["maxUpdateMs"] = maxUpdateUSec_ / 1000.0f;
+}
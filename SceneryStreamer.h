@@ -0,0 +1,194 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Math/BoundingBox.h>
+
+#include "MemoryTracker.h"
+#include "TrackSpline.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Geometry;
+	class IndexBuffer;
+	class Material;
+	class Model;
+	class Node;
+	class Scene;
+	class VertexBuffer;
+	struct WorkItem;
+}
+
+/// Length of a scenery patch along the track.
+const float SCENERY_PATCH_LENGTH = 40.0f;
+/// Width of a scenery patch away from the track.
+const float SCENERY_PATCH_WIDTH = 120.0f;
+/// Lateral offset of the inner patch edge, the outer face of the walls.
+const float SCENERY_INNER_OFFSET = 5.0f;
+/// Scenery kept behind the runner.
+const float SCENERY_BEHIND = 40.0f;
+/// Scenery streamed in ahead of the runner, up to the fog end.
+const float SCENERY_AHEAD = 300.0f;
+/// Number of patch level of detail steps.
+const unsigned SCENERY_LOD_LEVELS = 3;
+/// Patch quads across the width at full detail. Each level halves the resolution in both directions.
+const unsigned SCENERY_QUADS_X = 32;
+/// Patch quads along the length at full detail.
+const unsigned SCENERY_QUADS_Z = 16;
+/// Patch slots, which bound the number of patches and vertex buffers.
+const unsigned MAX_SCENERY_PATCHES = 28;
+/// Patch vertex buffer uploads per frame.
+const unsigned SCENERY_UPLOADS_PER_FRAME = 2;
+
+/// Drawable of a scenery patch. The patch model is regenerated in place, so the bounding box is set along with the new data.
+class SceneryPatch : public StaticModel
+{
+	URHO3D_OBJECT(SceneryPatch, StaticModel);
+
+public:
+	/// Construct.
+	SceneryPatch(Context* context);
+
+	/// Register object factory.
+	static void RegisterObject(Context* context);
+
+	/// Set bounding box after the model's vertex data has changed.
+	void SetPatchBoundingBox(const BoundingBox& box) { SetBoundingBox(box); }
+};
+
+/// Patch generation input and output, written by one worker thread at a time.
+struct SceneryJob
+{
+	/// Patch index along the track.
+	int segment_;
+	/// Side of the track, -1 left or 1 right.
+	int side_;
+	/// Level of detail.
+	unsigned lod_;
+	/// Vertex data, sized for full detail.
+	PODVector<float> vertices_;
+	/// Number of vertices written.
+	unsigned numVertices_;
+	/// World bounding box of the vertices.
+	BoundingBox boundingBox_;
+	/// Generation time in microseconds.
+	long long usec_;
+};
+
+/// Generates terrain patches along both sides of the track from the height map on worker threads, and shows the ones around
+/// the runner at a detail level by distance. The main thread only decides what is needed and uploads finished vertex data, a
+/// bounded number of buffers per frame. Patches live in a fixed set of slots whose vertex buffers, sized for full detail, are
+/// reused for whatever patch the slot holds next; index buffers are shared per detail level.
+class SceneryStreamer : public Object, public MemoryTagged<MEMTAG_TRACK_SCENERY>
+{
+	URHO3D_OBJECT(SceneryStreamer, Object);
+
+public:
+	/// Construct.
+	SceneryStreamer(Context* context);
+	/// Destruct. Waits for generation in progress.
+	~SceneryStreamer();
+
+	/// Load the height map and material, and create buffers. Return true on success.
+	bool Initialize(const String& heightMapName, const String& materialName);
+	/// Set the track to follow. Takes effect once generation in progress has finished; the patches are then regenerated.
+	void SetSpline(const TrackSpline& spline);
+	/// Update patches around a track distance. Patch nodes are created in the scene as temporary, and again after a scene load.
+	void Update(Scene* scene, float distance);
+
+	/// Return time spent in the last update in microseconds.
+	long long GetLastUpdateUSec() const { return lastUpdateUSec_; }
+	/// Return number of visible patches.
+	unsigned GetNumVisible() const;
+	/// Return number of patches being generated.
+	unsigned GetNumInFlight() const;
+
+private:
+	/// Patch slot.
+	struct Slot
+	{
+		/// Construct.
+		Slot();
+
+		/// Patch index along the track, valid when in use.
+		int segment_;
+		/// Side of the track.
+		int side_;
+		/// Level of detail shown, or M_MAX_UNSIGNED when nothing is shown.
+		unsigned lod_;
+		/// Slot holds a patch.
+		bool used_;
+		/// Generation result waiting for upload.
+		bool ready_;
+		/// Generation in progress.
+		SharedPtr<WorkItem> item_;
+		/// Generation input and output.
+		SceneryJob job_;
+		/// Vertex buffer.
+		SharedPtr<VertexBuffer> vertexBuffer_;
+		/// Geometry.
+		SharedPtr<Geometry> geometry_;
+		/// Model.
+		SharedPtr<Model> model_;
+		/// Scene node.
+		WeakPtr<Node> node_;
+		/// Drawable.
+		WeakPtr<SceneryPatch> drawable_;
+	};
+
+	/// Worker thread entry point.
+	static void GeneratePatchWork(const WorkItem* item, unsigned threadIndex);
+	/// Generate patch vertices. Reads only the spline and the height map.
+	void GeneratePatch(SceneryJob& job) const;
+	/// Return terrain height above the track surface at a track space position.
+	float GetHeight(float x, float z) const;
+	/// Return level of detail for a patch.
+	unsigned GetLod(int segment, float distance) const;
+	/// Return slot holding a patch, or null.
+	Slot* FindSlot(int segment, int side);
+	/// Queue generation for a slot.
+	void QueueJob(Slot& slot, int segment, int side, unsigned lod);
+	/// Upload finished vertex data and show the patch.
+	void Upload(Slot& slot);
+	/// Create the scenery root and patch nodes.
+	void CreateNodes(Scene* scene);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Track followed by the patches, read by worker threads.
+	TrackSpline spline_;
+	/// Track to switch to when no generation is in progress.
+	TrackSpline pendingSpline_;
+	/// Height map samples, read by worker threads.
+	PODVector<unsigned char> heights_;
+	/// Height map width.
+	int heightWidth_;
+	/// Height map height.
+	int heightHeight_;
+	/// Patch slots.
+	Slot slots_[MAX_SCENERY_PATCHES];
+	/// Index buffers per level of detail.
+	SharedPtr<IndexBuffer> indexBuffers_[SCENERY_LOD_LEVELS];
+	/// Patch material.
+	SharedPtr<Material> material_;
+	/// Scenery root node.
+	WeakPtr<Node> root_;
+	/// Pending track change.
+	bool splineChanged_;
+	/// Time spent in the last update.
+	long long lastUpdateUSec_;
+	/// Slowest update.
+	long long maxUpdateUSec_;
+	/// Time spent in all updates.
+	long long totalUpdateUSec_;
+	/// Updates.
+	unsigned numUpdates_;
+	/// Patches generated.
+	unsigned numGenerated_;
+	/// Worker time spent generating.
+	long long generateUSec_;
+	/// Vertex buffer uploads.
+	unsigned numUploads_;
+};
@@ -0,0 +1,608 @@
+#include <cstring>
+
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+
+#include "ScoreStore.h"
+
+/// Sequence number marking an empty player hash table slot.
+static const unsigned EMPTY_SEQUENCE = M_MAX_UNSIGNED;
+/// Log records written at a time when compacting.
+static const unsigned SCORE_LOG_BLOCK = 4096;
+
+static unsigned HashPlayer(unsigned player)
+{
+	player ^= player >> 16;
+	player *= 0x45d9f3bu;
+	player ^= player >> 16;
+	return player;
+}
+
+ScoreStore::ScoreStore(Context* context) :
+	Object(context)
+{
+	Close();
+}
+
+ScoreStore::~ScoreStore()
+{
+	Close();
+}
+
+bool ScoreStore::Open(const String& fileName)
+{
+	MemoryScope memoryScope(MEMTAG_LEADERBOARD);
+	Close();
+	HiresTimer timer;
+	fileName_ = fileName;
+
+	// Compaction deletes the log before renaming the new one over it. If it stopped in between, the new log is complete
+	FileSystem* fileSystem = GetSubsystem<FileSystem>();
+	String tempName = fileName + ".tmp";
+	if (!fileSystem->FileExists(fileName) && fileSystem->FileExists(tempName))
+	{
+		URHO3D_LOGWARNING("Recovering score log " + fileName + " from an interrupted compaction");
+		fileSystem->Rename(tempName, fileName);
+	}
+
+	bool rewrite = true;
+	if (fileSystem->FileExists(fileName))
+	{
+		File file(context_, fileName, FILE_READ);
+		if (!file.IsOpen() || file.GetSize() < 4 || file.ReadFileID() != SCORE_LOG_ID)
+		{
+			URHO3D_LOGERROR("Could not read score log " + fileName);
+			fileName_.Clear();
+			return false;
+		}
+
+		// A partial record at the end, from a crash while appending, is dropped and the log rewritten
+		numLogRecords_ = (file.GetSize() - 4) / sizeof(ScoreEntry);
+		rewrite = 4 + numLogRecords_ * sizeof(ScoreEntry) != file.GetSize();
+		PODVector<ScoreEntry> records(numLogRecords_);
+		file.Read(records.Buffer(), records.Size() * sizeof(ScoreEntry));
+
+		// Keep the best record of each player
+		ReservePlayers(records.Size());
+		for (unsigned i = 0; i < records.Size(); ++i)
+		{
+			const ScoreEntry& record = records[i];
+			nextSequence_ = Max(nextSequence_, record.sequence_ + 1);
+			ScoreEntry& slot = players_[FindSlot(record.player_)];
+			if (slot.sequence_ == EMPTY_SEQUENCE || IsBefore(record, slot))
+				slot = record;
+		}
+
+		// The live records stay in log order. Compaction writes them in rank order, so unless there were improvements
+		// since, they need no sorting
+		unsigned numLive = 0;
+		bool sorted = true;
+		for (unsigned i = 0; i < records.Size(); ++i)
+		{
+			if (players_[FindSlot(records[i].player_)].sequence_ != records[i].sequence_)
+				continue;
+			if (numLive && IsBefore(records[i], records[numLive - 1]))
+				sorted = false;
+			records[numLive++] = records[i];
+		}
+		records.Resize(numLive);
+		if (!sorted)
+			Sort(records.Begin(), records.End(), IsBefore);
+		BuildIndex(records);
+		if (NeedsCompact())
+			rewrite = true;
+	}
+
+	if (rewrite)
+	{
+		if (!Compact())
+		{
+			URHO3D_LOGERROR("Could not write score log " + fileName);
+			Close();
+			return false;
+		}
+	}
+	else
+	{
+		file_ = new File(context_, fileName_, FILE_READWRITE);
+		file_->Seek(file_->GetSize());
+	}
+
+	recoveryUSec_ = timer.GetUSec(false);
+	return true;
+}
+
+void ScoreStore::Close()
+{
+	file_.Reset();
+	fileName_.Clear();
+	ClearIndex();
+	players_.Clear();
+	ReservePlayers(0);
+	numLogRecords_ = 0;
+	nextSequence_ = 0;
+	recoveryUSec_ = 0;
+}
+
+bool ScoreStore::Submit(unsigned player, unsigned score)
+{
+	MemoryScope memoryScope(MEMTAG_LEADERBOARD);
+	ScoreEntry entry;
+	entry.player_ = player;
+	entry.score_ = score;
+	entry.sequence_ = nextSequence_++;
+	AppendRecord(entry);
+
+	bool improved = false;
+	ReservePlayers(numEntries_ + 1);
+	ScoreEntry& slot = players_[FindSlot(player)];
+	if (slot.sequence_ == EMPTY_SEQUENCE || IsBefore(entry, slot))
+	{
+		if (slot.sequence_ != EMPTY_SEQUENCE)
+			Remove(slot);
+		slot = entry;
+		Insert(entry);
+		improved = true;
+	}
+
+	if (NeedsCompact())
+		Compact();
+	return improved;
+}
+
+bool ScoreStore::Compact()
+{
+	MemoryScope memoryScope(MEMTAG_LEADERBOARD);
+	if (fileName_.Empty())
+		return false;
+
+	// The live entries are written in rank order to a new file, which then replaces the log
+	String tempName = fileName_ + ".tmp";
+	{
+		File file(context_, tempName, FILE_WRITE);
+		if (!file.IsOpen())
+			return false;
+		file.WriteFileID(SCORE_LOG_ID);
+		PODVector<ScoreEntry> block;
+		for (unsigned i = 0; i < numEntries_; i += SCORE_LOG_BLOCK)
+		{
+			GetRange(block, i, SCORE_LOG_BLOCK);
+			file.Write(block.Buffer(), block.Size() * sizeof(ScoreEntry));
+		}
+	}
+
+	file_.Reset();
+	FileSystem* fileSystem = GetSubsystem<FileSystem>();
+	if (fileSystem->FileExists(fileName_))
+		fileSystem->Delete(fileName_);
+	if (!fileSystem->Rename(tempName, fileName_))
+		return false;
+	file_ = new File(context_, fileName_, FILE_READWRITE);
+	file_->Seek(file_->GetSize());
+	numLogRecords_ = numEntries_;
+	return file_->IsOpen();
+}
+
+bool ScoreStore::NeedsCompact() const
+{
+	return numLogRecords_ >= SCORE_COMPACT_MIN_RECORDS && numLogRecords_ >= SCORE_COMPACT_RATIO * numEntries_;
+}
+
+void ScoreStore::Flush()
+{
+	if (file_)
+		file_->Flush();
+}
+
+void ScoreStore::GetTop(PODVector<ScoreEntry>& dest, unsigned count) const
+{
+	GetRange(dest, 0, count);
+}
+
+void ScoreStore::GetRange(PODVector<ScoreEntry>& dest, unsigned begin, unsigned count) const
+{
+	dest.Clear();
+	if (begin < numEntries_)
+		dest.Reserve(Min(count, numEntries_ - begin));
+
+	// Descend by the entry counts to the leaf holding the next rank, then copy from it
+	while (dest.Size() < count && begin < numEntries_)
+	{
+		unsigned node = root_;
+		unsigned position = begin;
+		for (unsigned level = height_; level; --level)
+		{
+			const Branch& branch = branches_[node];
+			unsigned i = 0;
+			while (position >= branch.sizes_[i])
+				position -= branch.sizes_[i++];
+			node = branch.children_[i];
+		}
+
+		const Leaf& leaf = leaves_[node];
+		for (; position < leaf.count_ && dest.Size() < count; ++position, ++begin)
+			dest.Push(leaf.entries_[position]);
+	}
+}
+
+unsigned ScoreStore::GetRank(unsigned score) const
+{
+	// Sequence 0 ranks before every other entry of the same score
+	ScoreEntry entry;
+	entry.player_ = 0;
+	entry.score_ = score;
+	entry.sequence_ = 0;
+	return GetEntryRank(entry);
+}
+
+unsigned ScoreStore::GetPlayerRank(unsigned player) const
+{
+	const ScoreEntry* entry = GetPlayerEntry(player);
+	return entry ? GetEntryRank(*entry) : M_MAX_UNSIGNED;
+}
+
+void ScoreStore::GetNeighbours(PODVector<ScoreEntry>& dest, unsigned player, unsigned count) const
+{
+	unsigned rank = GetPlayerRank(player);
+	if (rank == M_MAX_UNSIGNED)
+	{
+		dest.Clear();
+		return;
+	}
+	unsigned begin = rank > count ? rank - count : 0;
+	GetRange(dest, begin, rank - begin + count + 1);
+}
+
+const ScoreEntry* ScoreStore::GetPlayerEntry(unsigned player) const
+{
+	const ScoreEntry& slot = players_[FindSlot(player)];
+	return slot.sequence_ != EMPTY_SEQUENCE ? &slot : 0;
+}
+
+unsigned ScoreStore::FindChild(const Branch& branch, const ScoreEntry& entry)
+{
+	// Last child whose key the entry does not rank before
+	unsigned low = 1;
+	unsigned high = branch.count_;
+	while (low < high)
+	{
+		unsigned middle = (low + high) / 2;
+		if (IsBefore(entry, branch.keys_[middle]))
+			high = middle;
+		else
+			low = middle + 1;
+	}
+	return low - 1;
+}
+
+unsigned ScoreStore::FindPosition(const Leaf& leaf, const ScoreEntry& entry)
+{
+	unsigned low = 0;
+	unsigned high = leaf.count_;
+	while (low < high)
+	{
+		unsigned middle = (low + high) / 2;
+		if (IsBefore(leaf.entries_[middle], entry))
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+void ScoreStore::ClearIndex()
+{
+	leaves_.Clear();
+	branches_.Clear();
+	freeLeaves_.Clear();
+	freeBranches_.Clear();
+	root_ = AllocateLeaf();
+	height_ = 0;
+	numEntries_ = 0;
+}
+
+void ScoreStore::BuildIndex(const PODVector<ScoreEntry>& entries)
+{
+	ClearIndex();
+	if (entries.Empty())
+		return;
+	leaves_.Clear();
+	leaves_.Reserve((entries.Size() + SCORE_LEAF_CAPACITY - 1) / SCORE_LEAF_CAPACITY);
+
+	// Full leaves, then full branches over them level by level until one node is left
+	PODVector<unsigned> nodes;
+	PODVector<unsigned> sizes;
+	PODVector<ScoreEntry> keys;
+	for (unsigned i = 0; i < entries.Size(); i += SCORE_LEAF_CAPACITY)
+	{
+		unsigned index = AllocateLeaf();
+		Leaf& leaf = leaves_[index];
+		leaf.count_ = Min(entries.Size() - i, SCORE_LEAF_CAPACITY);
+		memcpy(leaf.entries_, &entries[i], leaf.count_ * sizeof(ScoreEntry));
+		nodes.Push(index);
+		sizes.Push(leaf.count_);
+		keys.Push(entries[i]);
+	}
+
+	while (nodes.Size() > 1)
+	{
+		// Each level is written over the start of the one below, which has been read by then
+		unsigned numChildren = nodes.Size();
+		unsigned numBranches = 0;
+		for (unsigned i = 0; i < numChildren; i += SCORE_BRANCH_CAPACITY)
+		{
+			unsigned index = AllocateBranch();
+			Branch& branch = branches_[index];
+			branch.count_ = Min(numChildren - i, SCORE_BRANCH_CAPACITY);
+			unsigned size = 0;
+			for (unsigned j = 0; j < branch.count_; ++j)
+			{
+				branch.keys_[j] = keys[i + j];
+				branch.children_[j] = nodes[i + j];
+				branch.sizes_[j] = sizes[i + j];
+				size += sizes[i + j];
+			}
+			nodes[numBranches] = index;
+			sizes[numBranches] = size;
+			keys[numBranches] = branch.keys_[0];
+			++numBranches;
+		}
+		nodes.Resize(numBranches);
+		sizes.Resize(numBranches);
+		keys.Resize(numBranches);
+		++height_;
+	}
+
+	root_ = nodes[0];
+	numEntries_ = entries.Size();
+}
+
+unsigned ScoreStore::AllocateLeaf()
+{
+	unsigned index;
+	if (freeLeaves_.Size())
+	{
+		index = freeLeaves_.Back();
+		freeLeaves_.Pop();
+	}
+	else
+	{
+		index = leaves_.Size();
+		leaves_.Resize(index + 1);
+	}
+	leaves_[index].count_ = 0;
+	return index;
+}
+
+unsigned ScoreStore::AllocateBranch()
+{
+	unsigned index;
+	if (freeBranches_.Size())
+	{
+		index = freeBranches_.Back();
+		freeBranches_.Pop();
+	}
+	else
+	{
+		index = branches_.Size();
+		branches_.Resize(index + 1);
+	}
+	branches_[index].count_ = 0;
+	return index;
+}
+
+void ScoreStore::Insert(const ScoreEntry& entry)
+{
+	ScoreEntry splitKey;
+	unsigned splitNode;
+	unsigned splitSize;
+	if (InsertUnder(root_, height_, entry, splitKey, splitNode, splitSize))
+	{
+		// The root split: grow a level
+		unsigned index = AllocateBranch();
+		Branch& branch = branches_[index];
+		branch.count_ = 2;
+		branch.children_[0] = root_;
+		branch.sizes_[0] = numEntries_ + 1 - splitSize;
+		branch.keys_[1] = splitKey;
+		branch.children_[1] = splitNode;
+		branch.sizes_[1] = splitSize;
+		root_ = index;
+		++height_;
+	}
+	++numEntries_;
+}
+
+bool ScoreStore::InsertUnder(unsigned node, unsigned level, const ScoreEntry& entry, ScoreEntry& splitKey,
+	unsigned& splitNode, unsigned& splitSize)
+{
+	// Nodes are referred to by index, as allocating a split node may move them
+	if (!level)
+	{
+		bool split = leaves_[node].count_ == SCORE_LEAF_CAPACITY;
+		unsigned target = node;
+		if (split)
+		{
+			unsigned right = AllocateLeaf();
+			Leaf& leaf = leaves_[node];
+			Leaf& rightLeaf = leaves_[right];
+			unsigned half = SCORE_LEAF_CAPACITY / 2;
+			rightLeaf.count_ = leaf.count_ - half;
+			memcpy(rightLeaf.entries_, leaf.entries_ + half, rightLeaf.count_ * sizeof(ScoreEntry));
+			leaf.count_ = half;
+			if (!IsBefore(entry, rightLeaf.entries_[0]))
+				target = right;
+			splitNode = right;
+		}
+
+		Leaf& leaf = leaves_[target];
+		unsigned position = FindPosition(leaf, entry);
+		memmove(leaf.entries_ + position + 1, leaf.entries_ + position, (leaf.count_ - position) * sizeof(ScoreEntry));
+		leaf.entries_[position] = entry;
+		++leaf.count_;
+
+		if (split)
+		{
+			splitKey = leaves_[splitNode].entries_[0];
+			splitSize = leaves_[splitNode].count_;
+		}
+		return split;
+	}
+
+	unsigned child = FindChild(branches_[node], entry);
+	++branches_[node].sizes_[child];
+	ScoreEntry childKey;
+	unsigned childNode;
+	unsigned childSize;
+	if (!InsertUnder(branches_[node].children_[child], level - 1, entry, childKey, childNode, childSize))
+		return false;
+
+	// The child split: the new node follows it, splitting this branch first if full
+	bool split = branches_[node].count_ == SCORE_BRANCH_CAPACITY;
+	unsigned target = node;
+	if (split)
+	{
+		unsigned right = AllocateBranch();
+		Branch& branch = branches_[node];
+		Branch& rightBranch = branches_[right];
+		unsigned half = SCORE_BRANCH_CAPACITY / 2;
+		rightBranch.count_ = branch.count_ - half;
+		memcpy(rightBranch.keys_, branch.keys_ + half, rightBranch.count_ * sizeof(ScoreEntry));
+		memcpy(rightBranch.children_, branch.children_ + half, rightBranch.count_ * sizeof(unsigned));
+		memcpy(rightBranch.sizes_, branch.sizes_ + half, rightBranch.count_ * sizeof(unsigned));
+		branch.count_ = half;
+		if (child >= half)
+		{
+			target = right;
+			child -= half;
+		}
+		splitNode = right;
+	}
+
+	Branch& branch = branches_[target];
+	branch.sizes_[child] -= childSize;
+	unsigned position = child + 1;
+	unsigned numMoved = branch.count_ - position;
+	memmove(branch.keys_ + position + 1, branch.keys_ + position, numMoved * sizeof(ScoreEntry));
+	memmove(branch.children_ + position + 1, branch.children_ + position, numMoved * sizeof(unsigned));
+	memmove(branch.sizes_ + position + 1, branch.sizes_ + position, numMoved * sizeof(unsigned));
+	branch.keys_[position] = childKey;
+	branch.children_[position] = childNode;
+	branch.sizes_[position] = childSize;
+	++branch.count_;
+
+	if (split)
+	{
+		const Branch& rightBranch = branches_[splitNode];
+		splitKey = rightBranch.keys_[0];
+		splitSize = 0;
+		for (unsigned i = 0; i < rightBranch.count_; ++i)
+			splitSize += rightBranch.sizes_[i];
+	}
+	return split;
+}
+
+void ScoreStore::Remove(const ScoreEntry& entry)
+{
+	// Nodes are not merged when they run low, only freed when empty. Improvements replace an entry with one ranking
+	// higher, so the index keeps its shape, and is built full again whenever the log is read
+	if (RemoveUnder(root_, height_, entry) && height_)
+	{
+		freeBranches_.Push(root_);
+		root_ = AllocateLeaf();
+		height_ = 0;
+	}
+	--numEntries_;
+
+	while (height_ && branches_[root_].count_ == 1)
+	{
+		freeBranches_.Push(root_);
+		root_ = branches_[root_].children_[0];
+		--height_;
+	}
+}
+
+bool ScoreStore::RemoveUnder(unsigned node, unsigned level, const ScoreEntry& entry)
+{
+	if (!level)
+	{
+		Leaf& leaf = leaves_[node];
+		unsigned position = FindPosition(leaf, entry);
+		--leaf.count_;
+		memmove(leaf.entries_ + position, leaf.entries_ + position + 1, (leaf.count_ - position) * sizeof(ScoreEntry));
+		return !leaf.count_;
+	}
+
+	Branch& branch = branches_[node];
+	unsigned child = FindChild(branch, entry);
+	--branch.sizes_[child];
+	if (!RemoveUnder(branch.children_[child], level - 1, entry))
+		return false;
+
+	if (level == 1)
+		freeLeaves_.Push(branch.children_[child]);
+	else
+		freeBranches_.Push(branch.children_[child]);
+	--branch.count_;
+	unsigned numMoved = branch.count_ - child;
+	memmove(branch.keys_ + child, branch.keys_ + child + 1, numMoved * sizeof(ScoreEntry));
+	memmove(branch.children_ + child, branch.children_ + child + 1, numMoved * sizeof(unsigned));
+	memmove(branch.sizes_ + child, branch.sizes_ + child + 1, numMoved * sizeof(unsigned));
+	return !branch.count_;
+}
+
+unsigned ScoreStore::GetEntryRank(const ScoreEntry& entry) const
+{
+	unsigned rank = 0;
+	unsigned node = root_;
+	for (unsigned level = height_; level; --level)
+	{
+		const Branch& branch = branches_[node];
+		unsigned child = FindChild(branch, entry);
+		for (unsigned i = 0; i < child; ++i)
+			rank += branch.sizes_[i];
+		node = branch.children_[child];
+	}
+	return rank + FindPosition(leaves_[node], entry);
+}
+
+unsigned ScoreStore::FindSlot(unsigned player) const
+{
+	unsigned mask = players_.Size() - 1;
+	unsigned slot = HashPlayer(player) & mask;
+	while (players_[slot].sequence_ != EMPTY_SEQUENCE && players_[slot].player_ != player)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+void ScoreStore::ReservePlayers(unsigned numPlayers)
+{
+	// Keep the table at most three quarters full
+	unsigned size = 16;
+	while (size * 3 < numPlayers * 4)
+		size <<= 1;
+	if (size <= players_.Size())
+		return;
+
+	PODVector<ScoreEntry> old;
+	old.Swap(players_);
+	players_.Resize(size);
+	for (unsigned i = 0; i < size; ++i)
+		players_[i].sequence_ = EMPTY_SEQUENCE;
+	for (unsigned i = 0; i < old.Size(); ++i)
+	{
+		if (old[i].sequence_ != EMPTY_SEQUENCE)
+			players_[FindSlot(old[i].player_)] = old[i];
+	}
+}
+
+void ScoreStore::AppendRecord(const ScoreEntry& entry)
+{
+	if (!file_)
+		return;
+	file_->Write(&entry, sizeof entry);
+	++numLogRecords_;
+}
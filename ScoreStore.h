@@ -0,0 +1,171 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "MemoryTracker.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class File;
+}
+
+/// Score log file identifier.
+const char* const SCORE_LOG_ID = "SLOG";
+/// Log records per live entry above which the log is compacted.
+const unsigned SCORE_COMPACT_RATIO = 2;
+/// Log records below which the log is never compacted.
+const unsigned SCORE_COMPACT_MIN_RECORDS = 4096;
+/// Entries in a leaf of the score index.
+const unsigned SCORE_LEAF_CAPACITY = 64;
+/// Children of a branch of the score index.
+const unsigned SCORE_BRANCH_CAPACITY = 64;
+
+/// Leaderboard entry.
+struct ScoreEntry
+{
+	/// Player.
+	unsigned player_;
+	/// Score.
+	unsigned score_;
+	/// Submission sequence number. Of equal scores the earlier ranks higher.
+	unsigned sequence_;
+};
+
+/// Embedded leaderboard with the best score of each player. Submissions are appended to a log file, and an in-memory
+/// order-statistic index (a B+ tree counting the entries below each child) answers top-K, rank and neighbour queries in
+/// logarithmic time with a few cache misses each. Opening replays the log; when it holds mostly superseded submissions it
+/// is rewritten with the live entries only. Local and regional boards are separate stores in their own files.
+class ScoreStore : public Object, public MemoryTagged<MEMTAG_LEADERBOARD>
+{
+	URHO3D_OBJECT(ScoreStore, Object);
+
+public:
+	/// Construct.
+	ScoreStore(Context* context);
+	/// Destruct. Flushes the log.
+	~ScoreStore();
+
+	/// Open a log file and recover its entries, creating it if it does not exist. A log left as the temporary file of an
+	/// interrupted compaction is recovered. Return true if successful.
+	bool Open(const String& fileName);
+	/// Close the log file and remove all entries.
+	void Close();
+	/// Submit a score. It is logged, and replaces the player's entry if better. Return true if it did.
+	bool Submit(unsigned player, unsigned score);
+	/// Rewrite the log with the live entries only.
+	bool Compact();
+	/// Write buffered log records to disk.
+	void Flush();
+
+	/// Return number of entries.
+	unsigned GetNumEntries() const { return numEntries_; }
+	/// Return number of records in the log.
+	unsigned GetNumLogRecords() const { return numLogRecords_; }
+	/// Return number of submissions ever made, including those compacted away.
+	unsigned GetNumSubmissions() const { return nextSequence_; }
+	/// Return the best entries, at most count.
+	void GetTop(PODVector<ScoreEntry>& dest, unsigned count) const;
+	/// Return entries by rank, starting from a 0-based rank.
+	void GetRange(PODVector<ScoreEntry>& dest, unsigned begin, unsigned count) const;
+	/// Return 0-based rank a score would get, the number of entries with a higher score.
+	unsigned GetRank(unsigned score) const;
+	/// Return 0-based rank of a player, or M_MAX_UNSIGNED if the player has no entry.
+	unsigned GetPlayerRank(unsigned player) const;
+	/// Return the entries around a player, up to count on each side and the player's own.
+	void GetNeighbours(PODVector<ScoreEntry>& dest, unsigned player, unsigned count) const;
+	/// Return the entry of a player, or null.
+	const ScoreEntry* GetPlayerEntry(unsigned player) const;
+	/// Return time spent recovering the log in the last open in microseconds.
+	long long GetRecoveryUSec() const { return recoveryUSec_; }
+
+private:
+	/// Index leaf, entries in rank order.
+	struct Leaf
+	{
+		/// Number of entries.
+		unsigned count_;
+		/// Entries.
+		ScoreEntry entries_[SCORE_LEAF_CAPACITY];
+	};
+
+	/// Index branch. Its children are leaves on the level above the leaves, otherwise branches.
+	struct Branch
+	{
+		/// Number of children.
+		unsigned count_;
+		/// Keys separating the children: entries ranking before a child's key are under the earlier children. The first is unused.
+		ScoreEntry keys_[SCORE_BRANCH_CAPACITY];
+		/// Children.
+		unsigned children_[SCORE_BRANCH_CAPACITY];
+		/// Number of entries under each child.
+		unsigned sizes_[SCORE_BRANCH_CAPACITY];
+	};
+
+	/// Return whether an entry ranks before another.
+	static bool IsBefore(const ScoreEntry& lhs, const ScoreEntry& rhs)
+	{
+		return lhs.score_ > rhs.score_ || (lhs.score_ == rhs.score_ && lhs.sequence_ < rhs.sequence_);
+	}
+	/// Return the child of a branch that an entry belongs under.
+	static unsigned FindChild(const Branch& branch, const ScoreEntry& entry);
+	/// Return number of entries of a leaf that rank before an entry.
+	static unsigned FindPosition(const Leaf& leaf, const ScoreEntry& entry);
+
+	/// Remove all entries from the index.
+	void ClearIndex();
+	/// Build the index from entries in rank order.
+	void BuildIndex(const PODVector<ScoreEntry>& entries);
+	/// Allocate an empty leaf.
+	unsigned AllocateLeaf();
+	/// Allocate an empty branch.
+	unsigned AllocateBranch();
+	/// Insert an entry into the index.
+	void Insert(const ScoreEntry& entry);
+	/// Insert an entry under a node on a level, 0 being the leaves. Return true if the node was split, with the new node
+	/// following it, its lowest key and its number of entries.
+	bool InsertUnder(unsigned node, unsigned level, const ScoreEntry& entry, ScoreEntry& splitKey, unsigned& splitNode,
+		unsigned& splitSize);
+	/// Remove an entry from the index.
+	void Remove(const ScoreEntry& entry);
+	/// Remove an entry under a node on a level. Return true if the node was left empty.
+	bool RemoveUnder(unsigned node, unsigned level, const ScoreEntry& entry);
+	/// Return number of entries in the index ranking before an entry.
+	unsigned GetEntryRank(const ScoreEntry& entry) const;
+	/// Return the slot of a player in the hash table, empty if the player has no entry.
+	unsigned FindSlot(unsigned player) const;
+	/// Grow the hash table if needed to hold a number of players.
+	void ReservePlayers(unsigned numPlayers);
+	/// Append a record to the log.
+	void AppendRecord(const ScoreEntry& entry);
+	/// Return whether the log holds enough superseded records to be compacted.
+	bool NeedsCompact() const;
+
+	/// Log file name.
+	String fileName_;
+	/// Log file open for appending.
+	SharedPtr<File> file_;
+	/// Index leaves.
+	PODVector<Leaf> leaves_;
+	/// Index branches.
+	PODVector<Branch> branches_;
+	/// Freed leaves.
+	PODVector<unsigned> freeLeaves_;
+	/// Freed branches.
+	PODVector<unsigned> freeBranches_;
+	/// Best entry of each player, hashed by player with open addressing. A power of two in size.
+	PODVector<ScoreEntry> players_;
+	/// Root node of the index.
+	unsigned root_;
+	/// Number of branch levels above the leaves.
+	unsigned height_;
+	/// Number of entries.
+	unsigned numEntries_;
+	/// Number of records in the log.
+	unsigned numLogRecords_;
+	/// Next submission sequence number.
+	unsigned nextSequence_;
+	/// Time spent recovering the log in the last open.
+	long long recoveryUSec_;
+};
@@ -0,0 +1,43 @@
+#include <Urho3D/IO/Log.h>
+
+#include "GameTest.h"
+
+bool GameTest::Check(bool condition, const String& description)
+{
+	if (!condition)
+	{
+		URHO3D_LOGERROR(name_ + ": " + description);
+		++failures_;
+	}
+	return condition;
+}
+
+GameTestRunner::GameTestRunner(Context* context) :
+	Object(context)
+{
+}
+
+unsigned GameTestRunner::Run(const String& filter)
+{
+	unsigned failed = 0;
+	unsigned run = 0;
+	for (unsigned i = 0; i < tests_.Size(); ++i)
+	{
+		GameTest* test = tests_[i];
+		if (!filter.Empty() && !test->GetName().Contains(filter, false))
+			continue;
+
+		test->Run(context_);
+		++run;
+		if (test->GetFailures())
+		{
+			URHO3D_LOGERROR("FAILED " + test->GetName());
+			++failed;
+		}
+		else
+			URHO3D_LOGINFO("passed " + test->GetName());
+	}
+
+	URHO3D_LOGINFO(ToString("%u of %u tests passed", run - failed, run));
+	return failed;
+}
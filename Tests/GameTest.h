@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+using namespace Urho3D;
+
+/// Test case. Failed checks are logged and counted, and the case fails when any check did.
+class GameTest : public RefCounted
+{
+public:
+	/// Construct with a name.
+	GameTest(const String& name) :
+		name_(name),
+		failures_(0)
+	{
+	}
+
+	/// Run the checks.
+	virtual void Run(Context* context) = 0;
+
+	/// Return name.
+	const String& GetName() const { return name_; }
+	/// Return number of failed checks.
+	unsigned GetFailures() const { return failures_; }
+
+protected:
+	/// Check a condition, logging the description when it does not hold. Return the condition.
+	bool Check(bool condition, const String& description);
+
+private:
+	/// Name.
+	String name_;
+	/// Failed checks.
+	unsigned failures_;
+};
+
+/// Runs test cases and logs the outcome of each.
+class GameTestRunner : public Object
+{
+	URHO3D_OBJECT(GameTestRunner, Object);
+
+public:
+	/// Construct.
+	GameTestRunner(Context* context);
+
+	/// Add a case.
+	void Add(GameTest* test) { tests_.Push(SharedPtr<GameTest>(test)); }
+	/// Run the cases whose name contains the filter, or all with an empty filter. Return the number of failed cases.
+	unsigned Run(const String& filter = String::EMPTY);
+
+private:
+	/// Cases.
+	Vector<SharedPtr<GameTest> > tests_;
+};
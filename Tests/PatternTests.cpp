@@ -0,0 +1,72 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#include "PatternTests.h"
+#include "TrackPatternLibrary.h"
+
+#if defined(URHO3D_LUA) && defined(URHO3D_FILEWATCHER)
+
+/// Resource name of the script written by the test.
+static const char* const PATTERN_TEST_SCRIPT = "TrackPatternsTest.lua";
+/// Longest wait for the file watcher to report the fixed script, in milliseconds.
+static const unsigned PATTERN_RELOAD_TIMEOUT_MSEC = 10000;
+
+/// The pattern script has a syntax error when the library loads it, and is fixed afterwards. The failed load must still
+/// watch the script, so that the fixed one is compiled on a later update.
+class PatternReloadAfterErrorTest : public GameTest
+{
+public:
+	PatternReloadAfterErrorTest() :
+		GameTest("PatternReloadAfterError")
+	{
+	}
+
+	virtual void Run(Context* context)
+	{
+		FileSystem* fileSystem = context->GetSubsystem<FileSystem>();
+		ResourceCache* cache = context->GetSubsystem<ResourceCache>();
+		String path = fileSystem->GetAppPreferencesDir("urho3d", "tests") + "Patterns/";
+		fileSystem->CreateDir(path);
+		cache->AddResourceDir(path);
+
+		Check(WriteScript(context, path, "TrackPatterns = {"), "could not write the broken script");
+		SharedPtr<TrackPatternLibrary> library(new TrackPatternLibrary(context));
+		Check(!library->Load(PATTERN_TEST_SCRIPT), "broken script compiled");
+		Check(library->GetPatterns().Empty(), "patterns from the broken script");
+
+		Check(WriteScript(context, path, "TrackPatterns = { { name = \"Fixed\", items = { { type = \"box\", lane = 0 } } } }"),
+			"could not write the fixed script");
+		Timer timer;
+		while (library->GetPatterns().Empty() && timer.GetMSec(false) < PATTERN_RELOAD_TIMEOUT_MSEC)
+		{
+			Time::Sleep(50);
+			library->SendEvent(E_UPDATE);
+		}
+		if (Check(library->GetPatterns().Size() == 1, "fixed script was not reloaded"))
+			Check(library->GetPatterns()[0].name_ == "Fixed", "wrong pattern reloaded");
+
+		library.Reset();
+		cache->RemoveResourceDir(path);
+		fileSystem->Delete(path + PATTERN_TEST_SCRIPT);
+	}
+
+private:
+	/// Write the test script. Return true on success.
+	static bool WriteScript(Context* context, const String& path, const String& source)
+	{
+		File file(context, path + PATTERN_TEST_SCRIPT, FILE_WRITE);
+		return file.IsOpen() && file.Write(source.CString(), source.Length()) == source.Length();
+	}
+};
+
+#endif
+
+void AddPatternTests(GameTestRunner* runner)
+{
+#if defined(URHO3D_LUA) && defined(URHO3D_FILEWATCHER)
+	runner->Add(new PatternReloadAfterErrorTest());
+#endif
+}
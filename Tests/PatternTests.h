@@ -0,0 +1,6 @@
+#pragma once
+
+#include "GameTest.h"
+
+/// Add the track pattern test cases to a runner: hot reload of the pattern script.
+void AddPatternTests(GameTestRunner* runner);
@@ -0,0 +1,80 @@
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionDispatcher.h>
+#include <Bullet/BulletCollision/NarrowPhaseCollision/btPersistentManifold.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+
+#include "PhysicsTests.h"
+#include "ThreadedPhysics.h"
+
+#ifdef PHYSICS_THREADING
+
+/// Gap between the cylinders after separating. Wider than the contact breaking threshold, narrower than the two AABB
+/// expansions by the same threshold, so that the pair stays in the broadphase.
+static const float SEPARATION_GAP = 0.03f;
+
+/// Two cylinders touch and then move apart while their AABBs still overlap. The threaded convex algorithm is handed the
+/// manifold of the pair, so the contact it generated must be dropped by the narrowphase and not linger in the manifold.
+class ThreadedManifoldSeparationTest : public GameTest
+{
+public:
+	ThreadedManifoldSeparationTest() :
+		GameTest("ThreadedManifoldSeparation")
+	{
+	}
+
+	virtual void Run(Context* context)
+	{
+		SharedPtr<Scene> scene(new Scene(context));
+		PhysicsWorld* world = scene->CreateComponent<PhysicsWorld>();
+		world->SetGravity(Vector3::ZERO);
+		world->SetInterpolation(false);
+		SharedPtr<ThreadedPhysics> threaded(new ThreadedPhysics(context));
+		threaded->SetWorld(world);
+
+		// Cylinders go through the convex algorithm, unlike box and sphere pairs
+		Node* staticNode = scene->CreateChild("Static");
+		staticNode->CreateComponent<RigidBody>();
+		staticNode->CreateComponent<CollisionShape>()->SetCylinder(1.0f, 1.0f);
+		Node* movingNode = scene->CreateChild("Moving");
+		movingNode->SetPosition(Vector3(0.99f, 0.0f, 0.0f));
+		RigidBody* moving = movingNode->CreateComponent<RigidBody>();
+		moving->SetMass(1.0f);
+		moving->SetAngularFactor(Vector3::ZERO);
+		movingNode->CreateComponent<CollisionShape>()->SetCylinder(1.0f, 1.0f);
+
+		world->Update(1.0f / world->GetFps());
+		Check(GetNumContacts(world) > 0, "no contact between the overlapping cylinders");
+
+		moving->SetPosition(Vector3(1.0f + SEPARATION_GAP, 0.0f, 0.0f));
+		moving->SetLinearVelocity(Vector3::ZERO);
+		world->Update(1.0f / world->GetFps());
+		Check(world->GetWorld()->getDispatcher()->getNumManifolds() > 0, "pair left the broadphase, the gap is too wide");
+		Check(GetNumContacts(world) == 0, "contact left in the manifold after the cylinders separated");
+
+		threaded->SetWorld(0);
+	}
+
+private:
+	/// Return number of contact points in the manifolds of a world.
+	static int GetNumContacts(PhysicsWorld* world)
+	{
+		btDispatcher* dispatcher = world->GetWorld()->getDispatcher();
+		int contacts = 0;
+		for (int i = 0; i < dispatcher->getNumManifolds(); ++i)
+			contacts += dispatcher->getManifoldByIndexInternal(i)->getNumContacts();
+		return contacts;
+	}
+};
+
+#endif
+
+void AddPhysicsTests(GameTestRunner* runner)
+{
+#ifdef PHYSICS_THREADING
+	runner->Add(new ThreadedManifoldSeparationTest());
+#endif
+}
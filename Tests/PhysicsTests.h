@@ -0,0 +1,6 @@
+#pragma once
+
+#include "GameTest.h"
+
+/// Add the physics test cases to a runner: contact manifolds of the threaded narrowphase.
+void AddPhysicsTests(GameTestRunner* runner);
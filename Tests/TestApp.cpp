@@ -0,0 +1,45 @@
+#include <cstdlib>
+
+#include <Urho3D/Core/ProcessUtils.h>
+#include <Urho3D/Engine/Engine.h>
+#include <Urho3D/IO/FileSystem.h>
+
+#include "GameTest.h"
+#include "PatternTests.h"
+#include "PhysicsTests.h"
+#include "TestApp.h"
+
+URHO3D_DEFINE_APPLICATION_MAIN(TestApp)
+
+TestApp::TestApp(Context* context) :
+	Application(context)
+{
+}
+
+void TestApp::Setup()
+{
+	engineParameters_["Headless"] = true;
+	engineParameters_["Sound"] = false;
+	engineParameters_["LogName"] = GetSubsystem<FileSystem>()->GetAppPreferencesDir("urho3d", "logs") + GetTypeName() + ".log";
+	if (!engineParameters_.Contains("ResourcePrefixPaths"))
+		engineParameters_["ResourcePrefixPaths"] = ";../share/Resources;../share/Urho3D/Resources";
+}
+
+void TestApp::Start()
+{
+	SharedPtr<GameTestRunner> runner(new GameTestRunner(context_));
+	AddPatternTests(runner);
+	AddPhysicsTests(runner);
+
+	String filter;
+	const Vector<String>& arguments = GetArguments();
+	for (unsigned i = 0; i + 1 < arguments.Size(); ++i)
+	{
+		if (arguments[i].ToLower() == "-filter")
+			filter = arguments[++i];
+	}
+
+	if (runner->Run(filter))
+		exitCode_ = EXIT_FAILURE;
+	engine_->Exit();
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Urho3D/Engine/Application.h>
+
+using namespace Urho3D;
+
+/// Headless application running the game's tests and exiting with a failure code when any failed. Options: -filter <text>
+/// runs the cases whose name contains the text.
+class TestApp : public Application
+{
+	URHO3D_OBJECT(TestApp, Application);
+
+public:
+	/// Construct.
+	TestApp(Context* context);
+
+	/// Setup before engine initialization.
+	virtual void Setup();
+	/// Run the tests after engine initialization.
+	virtual void Start();
+};
@@ -0,0 +1,551 @@
+#ifdef PHYSICS_THREADING
+
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Physics/PhysicsWorld.h>
+
+#include <Bullet/BulletCollision/BroadphaseCollision/btBroadphaseProxy.h>
+#include <Bullet/BulletCollision/BroadphaseCollision/btOverlappingPairCache.h>
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionConfiguration.h>
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionDispatcher.h>
+#include <Bullet/BulletCollision/CollisionDispatch/btCollisionObjectWrapper.h>
+#include <Bullet/BulletCollision/CollisionDispatch/btConvexConvexAlgorithm.h>
+#include <Bullet/BulletCollision/CollisionDispatch/btManifoldResult.h>
+#include <Bullet/BulletCollision/NarrowPhaseCollision/btGjkEpaPenetrationDepthSolver.h>
+#include <Bullet/BulletCollision/NarrowPhaseCollision/btPersistentManifold.h>
+#include <Bullet/BulletCollision/NarrowPhaseCollision/btVoronoiSimplexSolver.h>
+#include <Bullet/BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolver.h>
+#include <Bullet/BulletDynamics/ConstraintSolver/btTypedConstraint.h>
+#include <Bullet/BulletDynamics/Dynamics/btDiscreteDynamicsWorld.h>
+#include <Bullet/BulletDynamics/Dynamics/btRigidBody.h>
+
+#include "EventStats.h"
+#include "MetricsExport.h"
+#include "PhysicsProfiler.h"
+#include "ThreadedPhysics.h"
+
+/// Penetration depth solver of the convex algorithms. It keeps no state, so one is shared by all threads.
+static btGjkEpaPenetrationDepthSolver convexPenetrationSolver;
+
+/// Convex pair algorithm with a simplex solver of its own. Bullet's algorithm shares one simplex solver between all pairs, and
+/// creates its manifold on first use; this one gets its manifold when created, so that contact generation touches nothing
+/// but its own pair and can run on any thread.
+class ThreadedConvexAlgorithm : public btConvexConvexAlgorithm
+{
+public:
+	ThreadedConvexAlgorithm(btPersistentManifold* manifold, bool ownManifold, const btCollisionAlgorithmConstructionInfo& ci,
+		const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap) :
+		btConvexConvexAlgorithm(manifold, ci, body0Wrap, body1Wrap, &simplexSolver_, &convexPenetrationSolver, 0, 3),
+		manifold_(manifold),
+		ownManifold_(ownManifold)
+	{
+	}
+
+	virtual ~ThreadedConvexAlgorithm()
+	{
+		if (ownManifold_)
+			m_dispatcher->releaseManifold(manifold_);
+	}
+
+	virtual void getAllContactManifolds(btManifoldArray& manifoldArray)
+	{
+		if (ownManifold_)
+			manifoldArray.push_back(manifold_);
+	}
+
+	/// Simplex solver.
+	btVoronoiSimplexSolver simplexSolver_;
+	/// Contact manifold.
+	btPersistentManifold* manifold_;
+	/// Manifold is released with the algorithm.
+	bool ownManifold_;
+};
+
+/// Creates the convex pair algorithms.
+struct ThreadedConvexCreateFunc : public btCollisionAlgorithmCreateFunc
+{
+	virtual btCollisionAlgorithm* CreateCollisionAlgorithm(btCollisionAlgorithmConstructionInfo& ci,
+		const btCollisionObjectWrapper* body0Wrap, const btCollisionObjectWrapper* body1Wrap)
+	{
+		// The dispatcher frees algorithms from its pool or the heap, whichever they came from
+		btPersistentManifold* manifold = ci.m_manifold;
+		bool ownManifold = !manifold;
+		if (ownManifold)
+			manifold = ci.m_dispatcher1->getNewManifold(body0Wrap->getCollisionObject(), body1Wrap->getCollisionObject());
+		void* memory = btAlignedAlloc(sizeof(ThreadedConvexAlgorithm), 16);
+		return new(memory) ThreadedConvexAlgorithm(manifold, ownManifold, ci, body0Wrap, body1Wrap);
+	}
+};
+
+static ThreadedConvexCreateFunc threadedConvexCreateFunc;
+
+/// Return whether a pair of convex shape types gets the threaded convex algorithm. Sphere-sphere, box-box and sphere-triangle
+/// keep their own algorithms, which create their manifold when created already.
+static bool UsesConvexAlgorithm(int type0, int type1)
+{
+	if (!btBroadphaseProxy::isConvex(type0) || !btBroadphaseProxy::isConvex(type1))
+		return false;
+	if (type0 == type1 && (type0 == SPHERE_SHAPE_PROXYTYPE || type0 == BOX_SHAPE_PROXYTYPE))
+		return false;
+	if ((type0 == SPHERE_SHAPE_PROXYTYPE && type1 == TRIANGLE_SHAPE_PROXYTYPE) ||
+		(type0 == TRIANGLE_SHAPE_PROXYTYPE && type1 == SPHERE_SHAPE_PROXYTYPE))
+		return false;
+	return true;
+}
+
+/// Range of pairs or island batches for one work item.
+struct ThreadedChunk
+{
+	/// Solver doing the work.
+	ThreadedConstraintSolver* owner_;
+	/// First index.
+	unsigned begin_;
+	/// One past the last index.
+	unsigned end_;
+	/// Chunk index, which selects the island solver.
+	unsigned index_;
+};
+
+/// Island batch handed to the solver.
+struct ThreadedBatch
+{
+	/// First body.
+	unsigned bodies_;
+	/// Number of bodies.
+	unsigned numBodies_;
+	/// First manifold.
+	unsigned manifolds_;
+	/// Number of manifolds.
+	unsigned numManifolds_;
+	/// First constraint.
+	unsigned constraints_;
+	/// Number of constraints.
+	unsigned numConstraints_;
+};
+
+static void ProcessPairsWork(const WorkItem* item, unsigned threadIndex);
+static void SolveBatchesWork(const WorkItem* item, unsigned threadIndex);
+
+/// Constraint solver wrapper that runs the deferred contact generation before the solve, and solves the queued island batches
+/// in parallel once all have been handed over.
+class ThreadedConstraintSolver : public btConstraintSolver
+{
+public:
+	ThreadedConstraintSolver(btConstraintSolver* solver, btCollisionDispatcher* dispatcher, WorkQueue* queue,
+		PhysicsProfiler* profiler, ThreadedPhysicsStats& stats) :
+		solver_(solver),
+		dispatcher_(dispatcher),
+		nearCallback_(btCollisionDispatcher::defaultNearCallback),
+		queue_(queue),
+		profiler_(profiler),
+		stats_(stats),
+		dispatchInfo_(0),
+		solverInfo_(0),
+		numThreads_(1),
+		serial_(false)
+	{
+	}
+
+	~ThreadedConstraintSolver()
+	{
+		for (unsigned i = 0; i < solvers_.Size(); ++i)
+			delete solvers_[i];
+	}
+
+	virtual void prepareSolve(int numBodies, int numManifolds)
+	{
+		// Islands are built after this and from the manifolds only, so contacts can still be generated here
+		HiresTimer timer;
+		SplitEven(pairs_.Size());
+		Run(ProcessPairsWork);
+		stats_.narrowphaseUSec_ += timer.GetUSec(false);
+		stats_.pairs_ += pairs_.Size();
+		pairs_.Clear();
+
+		bodies_.Clear();
+		manifolds_.Clear();
+		constraints_.Clear();
+		batches_.Clear();
+		serial_ = false;
+		solver_->prepareSolve(numBodies, numManifolds);
+	}
+
+	virtual btScalar solveGroup(btCollisionObject** bodies, int numBodies, btPersistentManifold** manifolds, int numManifolds,
+		btTypedConstraint** constraints, int numConstraints, const btContactSolverInfo& info, btIDebugDraw* debugDrawer,
+		btDispatcher* dispatcher)
+	{
+		// The island callback reuses its arrays for the next batch, so they are copied
+		ThreadedBatch batch;
+		batch.bodies_ = bodies_.Size();
+		batch.numBodies_ = numBodies;
+		batch.manifolds_ = manifolds_.Size();
+		batch.numManifolds_ = numManifolds;
+		batch.constraints_ = constraints_.Size();
+		batch.numConstraints_ = numConstraints;
+		batches_.Push(batch);
+		for (int i = 0; i < numBodies; ++i)
+			bodies_.Push(bodies[i]);
+		for (int i = 0; i < numManifolds; ++i)
+		{
+			manifolds_.Push(manifolds[i]);
+			// A kinematic body gets a solver body in every island it touches, so islands sharing one cannot be solved at once
+			if (manifolds[i]->getBody0()->isKinematicObject() || manifolds[i]->getBody1()->isKinematicObject())
+				serial_ = true;
+		}
+		for (int i = 0; i < numConstraints; ++i)
+		{
+			constraints_.Push(constraints[i]);
+			if (constraints[i]->getRigidBodyA().isKinematicObject() || constraints[i]->getRigidBodyB().isKinematicObject())
+				serial_ = true;
+		}
+		solverInfo_ = &info;
+		return 0.0f;
+	}
+
+	virtual void allSolved(const btContactSolverInfo& info, btIDebugDraw* debugDrawer)
+	{
+		HiresTimer timer;
+		SplitBatches();
+		Run(SolveBatchesWork);
+		stats_.solverUSec_ += timer.GetUSec(false);
+		stats_.batches_ += batches_.Size();
+		if (serial_)
+			++stats_.serialSteps_;
+		++stats_.steps_;
+		solver_->allSolved(info, debugDrawer);
+	}
+
+	virtual void reset()
+	{
+		solver_->reset();
+		for (unsigned i = 0; i < solvers_.Size(); ++i)
+			solvers_[i]->reset();
+	}
+
+	virtual btConstraintSolverType getSolverType() const { return solver_->getSolverType(); }
+
+	/// Set number of threads.
+	void SetNumThreads(unsigned threads)
+	{
+		numThreads_ = Max(threads, 1U);
+		while (solvers_.Size() < numThreads_)
+			solvers_.Push(new btSequentialImpulseConstraintSolver());
+	}
+
+	/// Handle a pair from the near callback. Convex pairs are found an algorithm and queued; the rest go through Bullet's own
+	/// near callback right away.
+	void OnPair(btBroadphasePair& pair, btCollisionDispatcher& dispatcher, const btDispatcherInfo& info)
+	{
+		if (profiler_)
+			profiler_->OnNarrowphasePair();
+
+		btCollisionObject* colObj0 = static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject);
+		btCollisionObject* colObj1 = static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject);
+		int type0 = colObj0->getCollisionShape()->getShapeType();
+		int type1 = colObj1->getCollisionShape()->getShapeType();
+		if (info.m_dispatchFunc != btDispatcherInfo::DISPATCH_DISCRETE || !btBroadphaseProxy::isConvex(type0) ||
+			!btBroadphaseProxy::isConvex(type1))
+		{
+			btCollisionDispatcher::defaultNearCallback(pair, dispatcher, info);
+			return;
+		}
+		if (!dispatcher.needsCollision(colObj0, colObj1))
+			return;
+
+		if (!pair.m_algorithm)
+		{
+			btCollisionObjectWrapper obj0Wrap(0, colObj0->getCollisionShape(), colObj0, colObj0->getWorldTransform(), -1, -1);
+			btCollisionObjectWrapper obj1Wrap(0, colObj1->getCollisionShape(), colObj1, colObj1->getWorldTransform(), -1, -1);
+			pair.m_algorithm = dispatcher.findAlgorithm(&obj0Wrap, &obj1Wrap);
+		}
+		if (pair.m_algorithm)
+		{
+			pairs_.Push(&pair);
+			dispatchInfo_ = &info;
+		}
+	}
+
+	/// Generate contacts for a range of queued pairs.
+	void ProcessPairs(unsigned begin, unsigned end)
+	{
+		for (unsigned i = begin; i < end; ++i)
+		{
+			btBroadphasePair& pair = *pairs_[i];
+			btCollisionObject* colObj0 = static_cast<btCollisionObject*>(pair.m_pProxy0->m_clientObject);
+			btCollisionObject* colObj1 = static_cast<btCollisionObject*>(pair.m_pProxy1->m_clientObject);
+			btCollisionObjectWrapper obj0Wrap(0, colObj0->getCollisionShape(), colObj0, colObj0->getWorldTransform(), -1, -1);
+			btCollisionObjectWrapper obj1Wrap(0, colObj1->getCollisionShape(), colObj1, colObj1->getWorldTransform(), -1, -1);
+			btManifoldResult contactPointResult(&obj0Wrap, &obj1Wrap);
+			pair.m_algorithm->processCollision(&obj0Wrap, &obj1Wrap, *dispatchInfo_, &contactPointResult);
+			// Bullet's convex algorithm only drops separated contacts from a manifold it created itself. The threaded one is handed
+			// the manifold it owns, so the stale points are removed here
+			if (UsesConvexAlgorithm(colObj0->getCollisionShape()->getShapeType(), colObj1->getCollisionShape()->getShapeType()) &&
+				contactPointResult.getPersistentManifold())
+				contactPointResult.refreshContactPoints();
+		}
+	}
+
+	/// Solve a range of queued island batches with the solver of a chunk.
+	void SolveBatches(unsigned chunk, unsigned begin, unsigned end)
+	{
+		btConstraintSolver* solver = solvers_[chunk];
+		for (unsigned i = begin; i < end; ++i)
+		{
+			const ThreadedBatch& batch = batches_[i];
+			solver->solveGroup(bodies_.Buffer() + batch.bodies_, batch.numBodies_, manifolds_.Buffer() + batch.manifolds_,
+				batch.numManifolds_, constraints_.Buffer() + batch.constraints_, batch.numConstraints_, *solverInfo_, 0,
+				dispatcher_);
+		}
+	}
+
+	/// Wrapped solver.
+	btConstraintSolver* solver_;
+	/// Dispatcher of the world.
+	btCollisionDispatcher* dispatcher_;
+	/// Near callback of the dispatcher before attaching.
+	btNearCallback nearCallback_;
+
+private:
+	/// Split a number of items evenly between the threads.
+	void SplitEven(unsigned count)
+	{
+		unsigned numChunks = Min(numThreads_, count);
+		bounds_.Clear();
+		for (unsigned i = 0; i <= numChunks; ++i)
+			bounds_.Push(numChunks ? count * i / numChunks : 0);
+	}
+
+	/// Split the island batches between the threads by their manifold and constraint counts, or all to one when solving
+	/// serially.
+	void SplitBatches()
+	{
+		unsigned count = batches_.Size();
+		unsigned numChunks = serial_ ? Min(1U, count) : Min(numThreads_, count);
+		unsigned total = 0;
+		for (unsigned i = 0; i < count; ++i)
+			total += batches_[i].numManifolds_ + batches_[i].numConstraints_ + 1;
+
+		bounds_.Clear();
+		bounds_.Push(0);
+		unsigned weight = 0;
+		for (unsigned i = 0; i < count && bounds_.Size() < numChunks; ++i)
+		{
+			weight += batches_[i].numManifolds_ + batches_[i].numConstraints_ + 1;
+			if ((unsigned long long)weight * numChunks >= (unsigned long long)total * bounds_.Size())
+				bounds_.Push(i + 1);
+		}
+		if (numChunks)
+		{
+			while (bounds_.Size() < numChunks)
+				bounds_.Push(count);
+			bounds_.Push(count);
+		}
+	}
+
+	/// Run a work function for the chunks between the bounds, on the worker threads and the main thread.
+	void Run(void (*workFunction)(const WorkItem*, unsigned))
+	{
+		if (bounds_.Size() < 2)
+			return;
+
+		unsigned numChunks = bounds_.Size() - 1;
+		chunks_.Resize(numChunks);
+		for (unsigned i = 0; i < numChunks; ++i)
+		{
+			chunks_[i].owner_ = this;
+			chunks_[i].begin_ = bounds_[i];
+			chunks_[i].end_ = bounds_[i + 1];
+			chunks_[i].index_ = i;
+		}
+
+		if (numChunks == 1 || !queue_)
+		{
+			WorkItem item;
+			for (unsigned i = 0; i < numChunks; ++i)
+			{
+				item.start_ = &chunks_[i];
+				workFunction(&item, 0);
+			}
+			return;
+		}
+
+		for (unsigned i = 0; i < numChunks; ++i)
+		{
+			SharedPtr<WorkItem> item(new WorkItem());
+			item->workFunction_ = workFunction;
+			item->start_ = &chunks_[i];
+			item->priority_ = M_MAX_UNSIGNED;
+			queue_->AddWorkItem(item);
+		}
+		queue_->Complete(M_MAX_UNSIGNED);
+	}
+
+	/// Work queue.
+	WorkQueue* queue_;
+	/// Profiler of the world, or null.
+	PhysicsProfiler* profiler_;
+	/// Counters.
+	ThreadedPhysicsStats& stats_;
+	/// Solvers of the chunks.
+	PODVector<btSequentialImpulseConstraintSolver*> solvers_;
+	/// Pairs queued for contact generation.
+	PODVector<btBroadphasePair*> pairs_;
+	/// Dispatch info of the queued pairs.
+	const btDispatcherInfo* dispatchInfo_;
+	/// Bodies of the queued island batches.
+	PODVector<btCollisionObject*> bodies_;
+	/// Manifolds of the queued island batches.
+	PODVector<btPersistentManifold*> manifolds_;
+	/// Constraints of the queued island batches.
+	PODVector<btTypedConstraint*> constraints_;
+	/// Queued island batches.
+	PODVector<ThreadedBatch> batches_;
+	/// Solver info of the queued island batches.
+	const btContactSolverInfo* solverInfo_;
+	/// Chunk bounds.
+	PODVector<unsigned> bounds_;
+	/// Chunks.
+	PODVector<ThreadedChunk> chunks_;
+	/// Number of threads.
+	unsigned numThreads_;
+	/// Island batches must be solved on one thread this step.
+	bool serial_;
+};
+
+static void ProcessPairsWork(const WorkItem* item, unsigned threadIndex)
+{
+	const ThreadedChunk* chunk = static_cast<const ThreadedChunk*>(item->start_);
+	chunk->owner_->ProcessPairs(chunk->begin_, chunk->end_);
+}
+
+static void SolveBatchesWork(const WorkItem* item, unsigned threadIndex)
+{
+	const ThreadedChunk* chunk = static_cast<const ThreadedChunk*>(item->start_);
+	chunk->owner_->SolveBatches(chunk->index_, chunk->begin_, chunk->end_);
+}
+
+/// Attached solvers. Bullet near callbacks are plain functions without user data, so the solver is found by dispatcher.
+static PODVector<ThreadedConstraintSolver*> attachedSolvers;
+
+static void ThreadedNearCallback(btBroadphasePair& collisionPair, btCollisionDispatcher& dispatcher, const btDispatcherInfo& dispatchInfo)
+{
+	for (unsigned i = 0; i < attachedSolvers.Size(); ++i)
+	{
+		if (attachedSolvers[i]->dispatcher_ == &dispatcher)
+		{
+			attachedSolvers[i]->OnPair(collisionPair, dispatcher, dispatchInfo);
+			return;
+		}
+	}
+	btCollisionDispatcher::defaultNearCallback(collisionPair, dispatcher, dispatchInfo);
+}
+
+/// Set the convex pair algorithms of a dispatcher, or restore the configuration's, and drop the algorithms of existing pairs
+/// so that they are created again.
+static void SetConvexAlgorithms(btDiscreteDynamicsWorld* btWorld, bool threaded)
+{
+	btCollisionDispatcher* dispatcher = static_cast<btCollisionDispatcher*>(btWorld->getDispatcher());
+	btCollisionConfiguration* configuration = dispatcher->getCollisionConfiguration();
+	for (int i = 0; i < CONCAVE_SHAPES_START_HERE; ++i)
+	{
+		for (int j = 0; j < CONCAVE_SHAPES_START_HERE; ++j)
+		{
+			if (UsesConvexAlgorithm(i, j))
+				dispatcher->registerCollisionCreateFunc(i, j, threaded ? &threadedConvexCreateFunc :
+					configuration->getCollisionAlgorithmCreateFunc(i, j));
+		}
+	}
+
+	btOverlappingPairCache* pairCache = btWorld->getBroadphase()->getOverlappingPairCache();
+	btBroadphasePair* pairs = pairCache->getOverlappingPairArrayPtr();
+	for (int i = 0; i < pairCache->getNumOverlappingPairs(); ++i)
+		pairCache->cleanOverlappingPair(pairs[i], dispatcher);
+}
+
+ThreadedPhysics::ThreadedPhysics(Context* context) :
+	Object(context),
+	solver_(0),
+	numThreads_(1)
+{
+	SetNumThreads(GetMaxThreads());
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(ThreadedPhysics, HandleCollectMetrics));
+}
+
+ThreadedPhysics::~ThreadedPhysics()
+{
+	Detach();
+}
+
+void ThreadedPhysics::SetWorld(PhysicsWorld* world)
+{
+	if (world == world_)
+		return;
+
+	Detach();
+	world_ = world;
+	if (!world_)
+		return;
+
+	// The profiler is only told about pairs of the world it profiles
+	btDiscreteDynamicsWorld* btWorld = world_->GetWorld();
+	btCollisionDispatcher* dispatcher = static_cast<btCollisionDispatcher*>(btWorld->getDispatcher());
+	PhysicsProfiler* profiler = GetSubsystem<PhysicsProfiler>();
+	if (profiler && profiler->GetWorld() != world_)
+		profiler = 0;
+
+	solver_ = new ThreadedConstraintSolver(btWorld->getConstraintSolver(), dispatcher, GetSubsystem<WorkQueue>(), profiler, stats_);
+	solver_->SetNumThreads(numThreads_);
+	solver_->nearCallback_ = dispatcher->getNearCallback();
+	btWorld->setConstraintSolver(solver_);
+	SetConvexAlgorithms(btWorld, true);
+	dispatcher->setNearCallback(ThreadedNearCallback);
+	attachedSolvers.Push(solver_);
+}
+
+void ThreadedPhysics::SetNumThreads(unsigned threads)
+{
+	numThreads_ = Clamp(threads, 1U, GetMaxThreads());
+	if (solver_)
+		solver_->SetNumThreads(numThreads_);
+}
+
+unsigned ThreadedPhysics::GetMaxThreads() const
+{
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	return queue ? queue->GetNumThreads() + 1 : 1;
+}
+
+void ThreadedPhysics::Detach()
+{
+	if (world_)
+	{
+		btDiscreteDynamicsWorld* btWorld = world_->GetWorld();
+		btCollisionDispatcher* dispatcher = static_cast<btCollisionDispatcher*>(btWorld->getDispatcher());
+		dispatcher->setNearCallback(solver_->nearCallback_);
+		SetConvexAlgorithms(btWorld, false);
+		btWorld->setConstraintSolver(solver_->solver_);
+	}
+
+	// The old world may already be destroyed along with its scene, in which case the wrapper is no longer referenced
+	attachedSolvers.Remove(solver_);
+	delete solver_;
+	solver_ = 0;
+	world_.Reset();
+}
+
+void ThreadedPhysics::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& physics = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["physicsThreads"];
+	float steps = (float)Max(stats_.steps_, 1U);
+	physics["threads"] = numThreads_;
+	physics["steps"] = stats_.steps_;
+	physics["parallelPairsPerStep"] = stats_.pairs_ / steps;
+	physics["islandBatchesPerStep"] = stats_.batches_ / steps;
+	physics["serialSteps"] = stats_.serialSteps_;
+	physics["narrowphaseMsPerStep"] = stats_.narrowphaseUSec_ / 1000.0f / steps;
+	physics["solverMsPerStep"] = stats_.solverUSec_ / 1000.0f / steps;
+}
+
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+
+#ifdef PHYSICS_THREADING
+
+#include <Urho3D/Core/Object.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class PhysicsWorld;
+}
+
+class ThreadedConstraintSolver;
+
+/// Counters of the parallel physics work.
+struct ThreadedPhysicsStats
+{
+	/// Construct with zero values.
+	ThreadedPhysicsStats() :
+		steps_(0),
+		pairs_(0),
+		batches_(0),
+		serialSteps_(0),
+		narrowphaseUSec_(0),
+		solverUSec_(0)
+	{
+	}
+
+	/// Physics steps.
+	unsigned steps_;
+	/// Pairs with contact generation run in parallel.
+	unsigned long long pairs_;
+	/// Island batches solved.
+	unsigned long long batches_;
+	/// Steps solved on the main thread as a kinematic body touched the islands.
+	unsigned serialSteps_;
+	/// Time in parallel contact generation.
+	long long narrowphaseUSec_;
+	/// Time in parallel island solving.
+	long long solverUSec_;
+};
+
+/// Runs the narrowphase and island solving of a physics world on the engine's worker threads. Bullet 2.83, which the engine
+/// bundles, predates its multithreaded world, so this works around the single-threaded one: the near callback only finds
+/// the collision algorithm of each pair and creates its manifold, in pair order, and contact generation for the pairs then
+/// runs in parallel before the solver starts. Islands handed to the solver are queued and solved in parallel when all have
+/// been built, each batch by a solver of its own. As neither depends on which thread or solver does the work, results are
+/// the same for any thread count.
+class ThreadedPhysics : public Object
+{
+	URHO3D_OBJECT(ThreadedPhysics, Object);
+
+public:
+	/// Construct.
+	ThreadedPhysics(Context* context);
+	/// Destruct. Restores the world's own solver and near callback.
+	~ThreadedPhysics();
+
+	/// Attach to a physics world. Attach after the physics profiler, so that the profiler sees the parallel work as narrowphase
+	/// and solver time. Must be called again when the world is recreated, e.g. after scene load.
+	void SetWorld(PhysicsWorld* world);
+	/// Set number of threads, including the main thread. 1 takes the same path on the main thread only.
+	void SetNumThreads(unsigned threads);
+
+	/// Return number of threads.
+	unsigned GetNumThreads() const { return numThreads_; }
+	/// Return maximum number of threads, the worker threads and the main thread.
+	unsigned GetMaxThreads() const;
+	/// Return counters.
+	const ThreadedPhysicsStats& GetStats() const { return stats_; }
+
+private:
+	/// Detach from the current world.
+	void Detach();
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Physics world.
+	WeakPtr<PhysicsWorld> world_;
+	/// Constraint solver wrapper installed into the world.
+	ThreadedConstraintSolver* solver_;
+	/// Number of threads.
+	unsigned numThreads_;
+	/// Counters.
+	ThreadedPhysicsStats stats_;
+};
+
+#endif
@@ -0,0 +1,133 @@
+#include <Urho3D/Graphics/AnimatedModel.h>
+#include <Urho3D/Graphics/AnimationController.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "Character.h"
+#include "CollisionMatrix.h"
+#include "ResourceProfiler.h"
+#include "TrackBuilder.h"
+#include "TrackEntities.h"
+#include "TrackLayout.h"
+#include "TrackPrefab.h"
+
+// Utworzenie fragmentu podlogi lub sciany wzdluz toru
+static Node* CreateTrackPiece(Scene* scene, const TrackSpline& spline, const String& name, const Vector3& trackPosition,
+	const Vector3& scale, const String& material, CollisionLayer layer)
+{
+	ResourceProfiler* profiler = scene->GetSubsystem<ResourceProfiler>();
+
+	Node* pieceNode = scene->CreateChild(name);
+	pieceNode->SetPosition(spline.ToWorld(trackPosition));
+	pieceNode->SetRotation(spline.GetRotation(trackPosition.z_));
+	pieceNode->SetScale(scale);
+	StaticModel* object = pieceNode->CreateComponent<StaticModel>();
+	object->SetModel(profiler->GetResource<Model>("Models/Box.mdl", __FUNCTION__));
+	object->SetMaterial(profiler->GetResource<Material>(material, __FUNCTION__));
+
+	RigidBody* body = pieceNode->CreateComponent<RigidBody>();
+	ApplyCollisionLayer(body, layer);
+	CollisionShape* shape = pieceNode->CreateComponent<CollisionShape>();
+	shape->SetBox(Vector3::ONE);
+	return pieceNode;
+}
+
+void CreateTrackPieces(Scene* scene, const TrackSpline& spline, PODVector<Node*>* floorPieces)
+{
+	// Floor and walls follow the track in pieces, each aligned to the track frame at its center. Pieces overlap a little so
+	// that there are no gaps on the outside of turns. Both are camera blockers, which is what we will raycast against to
+	// prevent camera from going inside geometry
+	const TrackTheme& theme = TrackLayout::GetThemeData(0);
+	for (unsigned i = 0; GetTrackPieceCenter(i) - 0.5f * TRACK_PIECE_LENGTH < spline.GetLength(); ++i)
+	{
+		float center = GetTrackPieceCenter(i);
+		Node* floorNode = CreateTrackPiece(scene, spline, "Floor", Vector3(0.0f, -0.5f, center),
+			Vector3(10.0f, 1.0f, TRACK_PIECE_LENGTH + 0.5f), theme.floorMaterial_, LAYER_FLOOR);
+		if (floorPieces)
+			floorPieces->Push(floorNode);
+		CreateTrackPiece(scene, spline, "LeftWall", Vector3(-4.5f, 2.0f, center), Vector3(1.0f, 4.0f, TRACK_PIECE_LENGTH + 0.5f),
+			theme.wallMaterial_, LAYER_WALL);
+		CreateTrackPiece(scene, spline, "RightWall", Vector3(4.5f, 2.0f, center), Vector3(1.0f, 4.0f, TRACK_PIECE_LENGTH + 0.5f),
+			theme.wallMaterial_, LAYER_WALL);
+	}
+}
+
+bool AddTrackContent(TrackEntityStore& store, Node* contentNode, const TrackLayout& layout, TrackPrefabLibrary* prefabs)
+{
+	// Archetypes come from prefabs of the first theme: the model is drawn by instance groups in the content node, promoted
+	// nodes get the prefab's physics
+	const TrackTheme& theme = TrackLayout::GetThemeData(0);
+	const char* prefabNames[] = { theme.obstaclePrefab_, theme.pickupPrefab_ };
+	store.SetRenderNode(contentNode);
+	Vector3 scales[MAX_TRACK_ARCHETYPES];
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		TrackPrefab* prefab = prefabs ? prefabs->GetPrefab(prefabNames[i]) : 0;
+		if (!prefab)
+			return false;
+		store.SetPrefab((TrackArchetype)i, prefab);
+		scales[i] = prefab->GetScale();
+	}
+
+	// Przeszkody i marchewki z ziarna toru, ten sam uklad w kazdym uruchomieniu z tym samym -seed
+	const TrackSpline& spline = layout.GetSpline();
+	TrackCollider colliders[MAX_TRACK_ARCHETYPES];
+	colliders[ARCHETYPE_OBSTACLE].size_ = Vector3::ONE;
+	colliders[ARCHETYPE_OBSTACLE].layer_ = LAYER_OBSTACLE;
+	colliders[ARCHETYPE_PICKUP].size_ = Vector3::ONE;
+	colliders[ARCHETYPE_PICKUP].layer_ = LAYER_PICKUP;
+	const PODVector<TrackItem>& items = layout.GetItems();
+	for (unsigned i = 0; i < items.Size(); ++i)
+	{
+		const TrackItem& item = items[i];
+		TrackArchetype archetype = item.type_ == TRACK_BOX ? ARCHETYPE_OBSTACLE : ARCHETYPE_PICKUP;
+		float height = archetype == ARCHETYPE_OBSTACLE ? BOX_HALF_SIZE : CARROT_HEIGHT;
+		Vector3 position = spline.ToWorld(Vector3(TrackLayout::GetLaneX(item.lane_), height, item.z_));
+		Matrix3x4 transform(position, spline.GetRotation(item.z_), scales[archetype]);
+		store.Add(archetype, transform, item.z_, item.lane_, colliders[archetype]);
+	}
+	return true;
+}
+
+Character* CreateRunner(Scene* scene)
+{
+	ResourceProfiler* profiler = scene->GetSubsystem<ResourceProfiler>();
+
+	Node* objectNode = scene->CreateChild("Jack");
+	objectNode->SetPosition(Vector3(0.0f, 1.1f, 0.0f));
+
+	// Create the rendering component + animation controller
+	AnimatedModel* object = objectNode->CreateComponent<AnimatedModel>();
+	object->SetModel(profiler->GetResource<Model>("Models/Mutant/Mutant.mdl", __FUNCTION__));
+	object->SetMaterial(profiler->GetResource<Material>("Models/Mutant/Materials/mutant_M.xml", __FUNCTION__));
+	object->SetCastShadows(true);
+	objectNode->CreateComponent<AnimationController>();
+
+	// Set the head bone for manual control
+	Bone* head = object->GetSkeleton().GetBone("Mutant:Head");
+	if (head)
+		head->animated_ = false;
+
+	// Create rigidbody, and set non-zero mass so that the body becomes dynamic
+	RigidBody* body = objectNode->CreateComponent<RigidBody>();
+	ApplyCollisionLayer(body, LAYER_RUNNER);
+	body->SetMass(1.0f);
+
+	// Set zero angular factor so that physics doesn't turn the character on its own.
+	// Instead we will control the character yaw manually
+	body->SetAngularFactor(Vector3::ZERO);
+
+	// Set the rigidbody to signal collision also when in rest, so that we get ground collisions properly
+	body->SetCollisionEventMode(COLLISION_ALWAYS);
+
+	// Set a capsule shape for collision
+	CollisionShape* shape = objectNode->CreateComponent<CollisionShape>();
+	shape->SetCapsule(0.7f, 1.8f, Vector3(0.0f, 0.9f, 0.0f));
+
+	// Create the character logic component, which takes care of steering the rigidbody
+	return objectNode->CreateComponent<Character>();
+}
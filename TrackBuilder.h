@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+
+namespace Urho3D
+{
+	class Node;
+	class Scene;
+}
+
+using namespace Urho3D;
+
+class Character;
+class TrackEntityStore;
+class TrackLayout;
+class TrackPrefabLibrary;
+class TrackSpline;
+
+/// Length of the floor and wall pieces along the track.
+const float TRACK_PIECE_LENGTH = 10.0f;
+
+/// Return track distance of the center of a floor or wall piece by its index along the track.
+inline float GetTrackPieceCenter(unsigned index) { return (index - 0.5f) * TRACK_PIECE_LENGTH; }
+
+/// Create the floor and walls along a track as "Floor", "LeftWall" and "RightWall" children of a scene, with the materials of
+/// the first theme. Optionally return the floor pieces in track order.
+void CreateTrackPieces(Scene* scene, const TrackSpline& spline, PODVector<Node*>* floorPieces = 0);
+/// Set the archetype prefabs of an entity store from the first theme, with the instance groups under a content node, and add
+/// the obstacles and pickups of a layout in item order, so that the pickup index of an item is also its entity index. Return
+/// false if a prefab is missing.
+bool AddTrackContent(TrackEntityStore& store, Node* contentNode, const TrackLayout& layout, TrackPrefabLibrary* prefabs);
+/// Create the runner node at the start of the track: animated model, dynamic capsule body and the Character component.
+/// Return the character.
+Character* CreateRunner(Scene* scene);
@@ -0,0 +1,307 @@
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "CollisionMatrix.h"
+#include "TrackEntities.h"
+#include "TrackInstanceGroup.h"
+#include "TrackPrefab.h"
+
+/// Names of the promoted nodes by archetype.
+static const char* archetypeNames[] =
+{
+	"Box",
+	"Carrot"
+};
+
+TrackEntityStore::TrackEntityStore()
+{
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		archetypes_[i].promotedBegin_ = 0;
+		archetypes_[i].promotedEnd_ = 0;
+	}
+}
+
+TrackEntityStore::~TrackEntityStore()
+{
+	Clear();
+}
+
+void TrackEntityStore::Clear()
+{
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		Archetype& archetype = archetypes_[i];
+		for (HashMap<unsigned, WeakPtr<Node> >::Iterator j = archetype.promoted_.Begin(); j != archetype.promoted_.End(); ++j)
+		{
+			if (j->second_)
+				j->second_->Remove();
+		}
+		archetype.promoted_.Clear();
+		archetype.promotedBegin_ = 0;
+		archetype.promotedEnd_ = 0;
+
+		archetype.transforms_.Clear();
+		archetype.distances_.Clear();
+		archetype.lanes_.Clear();
+		archetype.colliders_.Clear();
+		archetype.instanceIndices_.Clear();
+		for (unsigned j = 0; j < archetype.chunks_.Size(); ++j)
+		{
+			if (archetype.chunks_[j].renderGroup_)
+				archetype.chunks_[j].renderGroup_->Remove();
+		}
+		archetype.chunks_.Clear();
+	}
+}
+
+void TrackEntityStore::Reserve(TrackArchetype archetype, unsigned count)
+{
+	Archetype& arrays = archetypes_[archetype];
+	arrays.transforms_.Reserve(count);
+	arrays.distances_.Reserve(count);
+	arrays.lanes_.Reserve(count);
+	arrays.colliders_.Reserve(count);
+	arrays.instanceIndices_.Reserve(count);
+}
+
+unsigned TrackEntityStore::Add(TrackArchetype archetype, const Matrix3x4& transform, float distance, int lane, const TrackCollider& collider)
+{
+	Archetype& arrays = archetypes_[archetype];
+	unsigned index = arrays.distances_.Size();
+	arrays.transforms_.Push(transform);
+	arrays.distances_.Push(distance);
+	arrays.lanes_.Push((signed char)lane);
+	arrays.colliders_.Push(collider);
+
+	RenderChunk& chunk = GetOrCreateChunk(arrays, distance);
+	arrays.instanceIndices_.Push(chunk.instanceTransforms_.Size());
+	chunk.instanceTransforms_.Push(transform);
+	chunk.instanceEntities_.Push(index);
+	if (chunk.renderGroup_)
+		chunk.renderGroup_->MarkInstancesDirty();
+	return index;
+}
+
+void TrackEntityStore::SetVisible(TrackArchetype archetype, unsigned index, bool visible)
+{
+	Archetype& arrays = archetypes_[archetype];
+	unsigned instance = arrays.instanceIndices_[index];
+	if (visible == (instance != M_MAX_UNSIGNED))
+		return;
+
+	RenderChunk& chunk = arrays.chunks_[GetChunkIndex(arrays.distances_[index])];
+	if (visible)
+	{
+		arrays.instanceIndices_[index] = chunk.instanceTransforms_.Size();
+		chunk.instanceTransforms_.Push(arrays.transforms_[index]);
+		chunk.instanceEntities_.Push(index);
+	}
+	else
+	{
+		// Move the last instance into the freed slot to keep the instance array contiguous
+		unsigned last = chunk.instanceTransforms_.Size() - 1;
+		unsigned lastEntity = chunk.instanceEntities_[last];
+		chunk.instanceTransforms_[instance] = chunk.instanceTransforms_[last];
+		chunk.instanceEntities_[instance] = lastEntity;
+		arrays.instanceIndices_[lastEntity] = instance;
+		chunk.instanceTransforms_.Pop();
+		chunk.instanceEntities_.Pop();
+		arrays.instanceIndices_[index] = M_MAX_UNSIGNED;
+		Demote(arrays, index);
+	}
+
+	if (chunk.renderGroup_)
+		chunk.renderGroup_->MarkInstancesDirty();
+}
+
+void TrackEntityStore::SetPositions(TrackArchetype archetype, const unsigned* indices, const Vector3* positions, unsigned count)
+{
+	// Only the groups of the chunks with moved instances recalculate their bounding box. Marking a group dirty again in the
+	// same frame only sets a flag, so it is not tracked which ones already are
+	Archetype& arrays = archetypes_[archetype];
+	for (unsigned i = 0; i < count; ++i)
+	{
+		unsigned index = indices[i];
+		Matrix3x4& transform = arrays.transforms_[index];
+		transform.m03_ = positions[i].x_;
+		transform.m13_ = positions[i].y_;
+		transform.m23_ = positions[i].z_;
+		unsigned instance = arrays.instanceIndices_[index];
+		if (instance != M_MAX_UNSIGNED)
+		{
+			RenderChunk& chunk = arrays.chunks_[GetChunkIndex(arrays.distances_[index])];
+			chunk.instanceTransforms_[instance] = transform;
+			if (chunk.renderGroup_)
+				chunk.renderGroup_->MarkInstancesDirty();
+		}
+		if (index >= arrays.promotedBegin_ && index < arrays.promotedEnd_)
+		{
+			Node* node = GetNode(archetype, index);
+			if (node)
+				node->SetPosition(positions[i]);
+		}
+	}
+}
+
+void TrackEntityStore::SetPrefab(TrackArchetype archetype, TrackPrefab* prefab)
+{
+	Archetype& arrays = archetypes_[archetype];
+	arrays.prefab_ = prefab;
+	if (!prefab)
+		return;
+
+	for (unsigned i = 0; i < arrays.chunks_.Size(); ++i)
+	{
+		TrackInstanceGroup* group = arrays.chunks_[i].renderGroup_;
+		if (group)
+		{
+			group->SetModel(prefab->GetModel());
+			group->SetMaterial(prefab->GetMaterial());
+			group->SetCastShadows(prefab->GetCastShadows());
+		}
+	}
+}
+
+void TrackEntityStore::UpdatePromotion(Scene* scene, float minDistance, float maxDistance)
+{
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		Archetype& arrays = archetypes_[i];
+		unsigned begin = FindFirst((TrackArchetype)i, minDistance);
+		unsigned end = FindFirst((TrackArchetype)i, maxDistance);
+
+		for (unsigned j = arrays.promotedBegin_; j < arrays.promotedEnd_; ++j)
+		{
+			if (j < begin || j >= end)
+				Demote(arrays, j);
+		}
+		for (unsigned j = begin; j < end; ++j)
+		{
+			if (arrays.instanceIndices_[j] != M_MAX_UNSIGNED && !arrays.promoted_.Contains(j))
+				Promote(scene, arrays, j);
+		}
+
+		arrays.promotedBegin_ = begin;
+		arrays.promotedEnd_ = end;
+	}
+}
+
+Node* TrackEntityStore::GetNode(TrackArchetype archetype, unsigned index) const
+{
+	HashMap<unsigned, WeakPtr<Node> >::ConstIterator i = archetypes_[archetype].promoted_.Find(index);
+	return i != archetypes_[archetype].promoted_.End() ? i->second_.Get() : 0;
+}
+
+unsigned TrackEntityStore::FindFirst(TrackArchetype archetype, float distance) const
+{
+	const PODVector<float>& distances = archetypes_[archetype].distances_;
+	unsigned first = 0;
+	unsigned last = distances.Size();
+	while (first < last)
+	{
+		unsigned middle = (first + last) / 2;
+		if (distances[middle] < distance)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return first;
+}
+
+unsigned TrackEntityStore::GetNumPromoted() const
+{
+	unsigned count = 0;
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+		count += archetypes_[i].promoted_.Size();
+	return count;
+}
+
+unsigned TrackEntityStore::GetMemoryUse() const
+{
+	unsigned bytes = 0;
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		const Archetype& arrays = archetypes_[i];
+		bytes += arrays.transforms_.Capacity() * sizeof(Matrix3x4);
+		bytes += arrays.distances_.Capacity() * sizeof(float);
+		bytes += arrays.lanes_.Capacity() * sizeof(signed char);
+		bytes += arrays.colliders_.Capacity() * sizeof(TrackCollider);
+		bytes += arrays.instanceIndices_.Capacity() * sizeof(unsigned);
+		for (unsigned j = 0; j < arrays.chunks_.Size(); ++j)
+		{
+			bytes += arrays.chunks_[j].instanceTransforms_.Capacity() * sizeof(Matrix3x4);
+			bytes += arrays.chunks_[j].instanceEntities_.Capacity() * sizeof(unsigned);
+		}
+	}
+	return bytes;
+}
+
+void TrackEntityStore::Promote(Scene* scene, Archetype& archetype, unsigned index)
+{
+	const Matrix3x4& transform = archetype.transforms_[index];
+	const TrackCollider& collider = archetype.colliders_[index];
+
+	// Physics only, the entity is still drawn by the render group. Temporary, so that it is not saved with the scene. The
+	// collision layer comes from the collider in both cases, so prefabs do not carry their own layer, mask or trigger values
+	Node* node;
+	if (archetype.prefab_)
+	{
+		node = archetype.prefab_->Instantiate(scene, transform.Translation(), transform.Rotation(), true);
+		node->SetScale(transform.Scale());
+		ApplyCollisionLayer(node->GetComponent<RigidBody>(), (CollisionLayer)collider.layer_);
+	}
+	else
+	{
+		node = scene->CreateChild(archetypeNames[&archetype - archetypes_], LOCAL);
+		node->SetTransform(transform.Translation(), transform.Rotation(), transform.Scale());
+		RigidBody* body = node->CreateComponent<RigidBody>(LOCAL);
+		ApplyCollisionLayer(body, (CollisionLayer)collider.layer_);
+		CollisionShape* shape = node->CreateComponent<CollisionShape>(LOCAL);
+		shape->SetBox(collider.size_);
+	}
+	node->SetTemporary(true);
+	archetype.promoted_[index] = node;
+}
+
+void TrackEntityStore::Demote(Archetype& archetype, unsigned index)
+{
+	HashMap<unsigned, WeakPtr<Node> >::Iterator i = archetype.promoted_.Find(index);
+	if (i == archetype.promoted_.End())
+		return;
+
+	if (i->second_)
+		i->second_->Remove();
+	archetype.promoted_.Erase(i);
+}
+
+TrackEntityStore::RenderChunk& TrackEntityStore::GetOrCreateChunk(Archetype& archetype, float distance)
+{
+	unsigned index = GetChunkIndex(distance);
+	if (index >= archetype.chunks_.Size())
+	{
+		// Growing may move the chunks, and the groups reference the instance arrays inside them
+		archetype.chunks_.Resize(index + 1);
+		for (unsigned i = 0; i < archetype.chunks_.Size(); ++i)
+		{
+			if (archetype.chunks_[i].renderGroup_)
+				archetype.chunks_[i].renderGroup_->SetInstances(&archetype.chunks_[i].instanceTransforms_);
+		}
+	}
+
+	RenderChunk& chunk = archetype.chunks_[index];
+	if (!chunk.renderGroup_ && renderNode_)
+	{
+		TrackInstanceGroup* group = renderNode_->CreateComponent<TrackInstanceGroup>(LOCAL);
+		if (archetype.prefab_)
+		{
+			group->SetModel(archetype.prefab_->GetModel());
+			group->SetMaterial(archetype.prefab_->GetMaterial());
+			group->SetCastShadows(archetype.prefab_->GetCastShadows());
+		}
+		group->SetInstances(&chunk.instanceTransforms_);
+		chunk.renderGroup_ = group;
+	}
+	return chunk;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <Urho3D/Container/HashMap.h>
+#include <Urho3D/Container/Ptr.h>
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Matrix3x4.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Node;
+	class Scene;
+}
+
+class TrackInstanceGroup;
+class TrackPrefab;
+
+/// Track length drawn by one instance group of an archetype. Each group is culled on its own, and moving an entity only
+/// recalculates the bounding box of its chunk's group.
+const float TRACK_RENDER_CHUNK_LENGTH = 50.0f;
+
+/// Track entity archetype.
+enum TrackArchetype
+{
+	ARCHETYPE_OBSTACLE = 0,
+	ARCHETYPE_PICKUP,
+	MAX_TRACK_ARCHETYPES
+};
+
+/// Box collider of a track entity, in the entity's local space.
+struct TrackCollider
+{
+	/// Box size.
+	Vector3 size_;
+	/// Collision layer, one of CollisionLayer.
+	unsigned short layer_;
+};
+
+/// Storage for track content without a scene node per entity. Each archetype keeps its entities in contiguous arrays
+/// (transform, distance, lane, collider, render instance index), sorted by distance. Entities are drawn through one
+/// TrackInstanceGroup per archetype and track chunk, created in the render node with the archetype's prefab model, and only
+/// those near the runner get a scene node with a physics body.
+class TrackEntityStore
+{
+public:
+	/// Construct.
+	TrackEntityStore();
+	/// Destruct. Remove promoted nodes.
+	~TrackEntityStore();
+
+	/// Remove all entities, promoted nodes and render groups.
+	void Clear();
+	/// Reserve space for entities of an archetype.
+	void Reserve(TrackArchetype archetype, unsigned count);
+	/// Add an entity. Entities of one archetype must be added in increasing distance. Return its index within the archetype.
+	unsigned Add(TrackArchetype archetype, const Matrix3x4& transform, float distance, int lane, const TrackCollider& collider);
+	/// Show or hide an entity. Hidden entities are not drawn and not promoted.
+	void SetVisible(TrackArchetype archetype, unsigned index, bool visible);
+	/// Move entities, keeping their rotation and scale. Their track distance, and so their place in the index and their chunk,
+	/// stays. Promoted nodes move with them, and the render groups of the chunks they are in are marked dirty.
+	void SetPositions(TrackArchetype archetype, const unsigned* indices, const Vector3* positions, unsigned count);
+	/// Set the node the render groups are created in. Entities added before it is set are not drawn.
+	void SetRenderNode(Node* node) { renderNode_ = node; }
+	/// Set the prefab an archetype is drawn with and its promoted entities are created from, also changing the model and material
+	/// of its existing render groups. Without one entities are not drawn, and promoted ones get a body and box from their
+	/// collider.
+	void SetPrefab(TrackArchetype archetype, TrackPrefab* prefab);
+	/// Give scene nodes with physics bodies to the visible entities between the distances, and remove them from the rest.
+	void UpdatePromotion(Scene* scene, float minDistance, float maxDistance);
+
+	/// Return number of entities of an archetype.
+	unsigned GetNumEntities(TrackArchetype archetype) const { return archetypes_[archetype].distances_.Size(); }
+	/// Return world transforms of an archetype.
+	const PODVector<Matrix3x4>& GetTransforms(TrackArchetype archetype) const { return archetypes_[archetype].transforms_; }
+	/// Return track distances of an archetype.
+	const PODVector<float>& GetDistances(TrackArchetype archetype) const { return archetypes_[archetype].distances_; }
+	/// Return lanes of an archetype.
+	const PODVector<signed char>& GetLanes(TrackArchetype archetype) const { return archetypes_[archetype].lanes_; }
+	/// Return whether an entity is visible.
+	bool IsVisible(TrackArchetype archetype, unsigned index) const { return archetypes_[archetype].instanceIndices_[index] != M_MAX_UNSIGNED; }
+	/// Return render instance index of an entity within its chunk, M_MAX_UNSIGNED when hidden.
+	unsigned GetInstanceIndex(TrackArchetype archetype, unsigned index) const { return archetypes_[archetype].instanceIndices_[index]; }
+	/// Return chunk of an entity.
+	unsigned GetChunk(TrackArchetype archetype, unsigned index) const { return GetChunkIndex(archetypes_[archetype].distances_[index]); }
+	/// Return number of chunks of an archetype.
+	unsigned GetNumChunks(TrackArchetype archetype) const { return archetypes_[archetype].chunks_.Size(); }
+	/// Return transforms of the visible entities of a chunk, by render instance index.
+	const PODVector<Matrix3x4>& GetInstanceTransforms(TrackArchetype archetype, unsigned chunk) const
+	{
+		return archetypes_[archetype].chunks_[chunk].instanceTransforms_;
+	}
+	/// Return the drawable of a chunk, or null.
+	TrackInstanceGroup* GetRenderGroup(TrackArchetype archetype, unsigned chunk) const
+	{
+		return chunk < archetypes_[archetype].chunks_.Size() ? archetypes_[archetype].chunks_[chunk].renderGroup_.Get() : 0;
+	}
+	/// Return the promoted node of an entity, or null.
+	Node* GetNode(TrackArchetype archetype, unsigned index) const;
+	/// Return index of the first entity of an archetype at or beyond a distance.
+	unsigned FindFirst(TrackArchetype archetype, float distance) const;
+	/// Return number of promoted nodes.
+	unsigned GetNumPromoted() const;
+	/// Return bytes allocated for entity data.
+	unsigned GetMemoryUse() const;
+
+	/// Return the chunk at a track distance.
+	static unsigned GetChunkIndex(float distance) { return (unsigned)(Max(distance, 0.0f) / TRACK_RENDER_CHUNK_LENGTH); }
+
+private:
+	/// Visible entities of an archetype within one track chunk.
+	struct RenderChunk
+	{
+		/// Transforms of the visible entities, drawn by the render group.
+		PODVector<Matrix3x4> instanceTransforms_;
+		/// Entity of each render instance.
+		PODVector<unsigned> instanceEntities_;
+		/// Render group.
+		WeakPtr<TrackInstanceGroup> renderGroup_;
+	};
+
+	/// Arrays of one archetype.
+	struct Archetype
+	{
+		/// World transforms.
+		PODVector<Matrix3x4> transforms_;
+		/// Track distances.
+		PODVector<float> distances_;
+		/// Lanes.
+		PODVector<signed char> lanes_;
+		/// Colliders.
+		PODVector<TrackCollider> colliders_;
+		/// Render instance index of each entity within its chunk, M_MAX_UNSIGNED when hidden.
+		PODVector<unsigned> instanceIndices_;
+		/// Chunks by track distance.
+		Vector<RenderChunk> chunks_;
+		/// Prefab of promoted nodes.
+		SharedPtr<TrackPrefab> prefab_;
+		/// Promoted nodes by entity index.
+		HashMap<unsigned, WeakPtr<Node> > promoted_;
+		/// First promoted entity.
+		unsigned promotedBegin_;
+		/// One past the last promoted entity.
+		unsigned promotedEnd_;
+	};
+
+	/// Create the promoted node of an entity.
+	void Promote(Scene* scene, Archetype& archetype, unsigned index);
+	/// Remove the promoted node of an entity.
+	void Demote(Archetype& archetype, unsigned index);
+	/// Return the chunk at a track distance, creating it and its render group if needed.
+	RenderChunk& GetOrCreateChunk(Archetype& archetype, float distance);
+
+	/// Archetypes.
+	Archetype archetypes_[MAX_TRACK_ARCHETYPES];
+	/// Node of the render groups.
+	WeakPtr<Node> renderNode_;
+};
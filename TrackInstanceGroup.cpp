@@ -0,0 +1,91 @@
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Graphics/Batch.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Scene/Node.h>
+
+#include "TrackInstanceGroup.h"
+
+TrackInstanceGroup::TrackInstanceGroup(Context* context) :
+	StaticModel(context),
+	transforms_(0),
+	drawTransforms_(0),
+	numInstances_(0)
+{
+}
+
+void TrackInstanceGroup::RegisterObject(Context* context)
+{
+	context->RegisterFactory<TrackInstanceGroup>();
+}
+
+void TrackInstanceGroup::ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results)
+{
+}
+
+void TrackInstanceGroup::UpdateBatches(const FrameInfo& frame)
+{
+	// Getting the world bounding box ensures the instance count is up to date
+	const BoundingBox& worldBoundingBox = GetWorldBoundingBox();
+	distance_ = frame.camera_->GetDistance(worldBoundingBox.Center());
+
+	// The draw subset is only changed on the main thread before the view is culled
+	const PODVector<Matrix3x4>* transforms = drawTransforms_ ? drawTransforms_ : transforms_;
+	unsigned count = drawTransforms_ ? drawTransforms_->Size() : numInstances_;
+	const Matrix3x4* worldTransforms = count ? &(*transforms)[0] : &Matrix3x4::IDENTITY;
+	for (unsigned i = 0; i < batches_.Size(); ++i)
+	{
+		batches_[i].distance_ = distance_;
+		batches_[i].worldTransform_ = worldTransforms;
+		batches_[i].numWorldTransforms_ = count;
+	}
+}
+
+unsigned TrackInstanceGroup::GetNumOccluderTriangles()
+{
+	return 0;
+}
+
+bool TrackInstanceGroup::DrawOcclusion(OcclusionBuffer* buffer)
+{
+	return true;
+}
+
+void TrackInstanceGroup::SetInstances(const PODVector<Matrix3x4>* transforms)
+{
+	transforms_ = transforms;
+	MarkInstancesDirty();
+}
+
+void TrackInstanceGroup::MarkInstancesDirty()
+{
+	if (node_)
+		OnMarkedDirty(node_);
+}
+
+BoundingBox TrackInstanceGroup::GetInstanceBoundingBox() const
+{
+	// The nodes never move, so the animation is only known from the material parameters the shader reads
+	Material* material = batches_.Size() ? batches_[0].material_.Get() : 0;
+	if (!material || material->GetShaderParameter("SpinSpeed").IsEmpty())
+		return boundingBox_;
+
+	float bob = Abs(material->GetShaderParameter("BobHeight").GetFloat());
+	float x = Max(Abs(boundingBox_.min_.x_), Abs(boundingBox_.max_.x_));
+	float z = Max(Abs(boundingBox_.min_.z_), Abs(boundingBox_.max_.z_));
+	float radius = Sqrt(x * x + z * z);
+	return BoundingBox(Vector3(-radius, boundingBox_.min_.y_ - bob, -radius), Vector3(radius, boundingBox_.max_.y_ + bob, radius));
+}
+
+void TrackInstanceGroup::OnWorldBoundingBoxUpdate()
+{
+	BoundingBox worldBox;
+	BoundingBox instanceBox = GetInstanceBoundingBox();
+	unsigned count = transforms_ ? transforms_->Size() : 0;
+	for (unsigned i = 0; i < count; ++i)
+		worldBox.Merge(instanceBox.Transformed((*transforms_)[i]));
+
+	worldBoundingBox_ = worldBox;
+	// Count is stored here instead of read at draw time, as this may run in a worker thread during culling
+	numInstances_ = count;
+}
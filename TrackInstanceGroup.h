@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Urho3D/Graphics/StaticModel.h>
+
+using namespace Urho3D;
+
+/// Draws one model at many world transforms held outside the scene graph, like StaticModelGroup but without an instance node
+/// per transform. Used for track content kept in the archetype store, one group per archetype and track chunk.
+class TrackInstanceGroup : public StaticModel
+{
+	URHO3D_OBJECT(TrackInstanceGroup, StaticModel);
+
+public:
+	/// Construct.
+	TrackInstanceGroup(Context* context);
+
+	/// Register object factory.
+	static void RegisterObject(Context* context);
+
+	/// Process octree raycast. Track content is raycast through physics instead, so this does nothing.
+	virtual void ProcessRayQuery(const RayOctreeQuery& query, PODVector<RayQueryResult>& results);
+	/// Calculate distance and prepare batches for rendering.
+	virtual void UpdateBatches(const FrameInfo& frame);
+	/// Return number of occlusion geometry triangles.
+	virtual unsigned GetNumOccluderTriangles();
+	/// Draw to occlusion buffer. Return true if did not run out of triangles.
+	virtual bool DrawOcclusion(OcclusionBuffer* buffer);
+
+	/// Set the instance transform array. It is referenced, not copied.
+	void SetInstances(const PODVector<Matrix3x4>* transforms);
+	/// Notify that the instance transforms have changed.
+	void MarkInstancesDirty();
+	/// Return the bounding box of one instance in its own space. With a material animated in the vertex shader (one with a
+	/// SpinSpeed parameter) it holds every spin angle and both ends of the bob.
+	BoundingBox GetInstanceBoundingBox() const;
+	/// Set a subset of the instance transforms to draw instead of all of them, or null to draw all. It is referenced, not copied.
+	/// The bounding box still covers all instances.
+	void SetDrawInstances(const PODVector<Matrix3x4>* transforms) { drawTransforms_ = transforms; }
+
+protected:
+	/// Recalculate the world-space bounding box.
+	virtual void OnWorldBoundingBoxUpdate();
+
+private:
+	/// Instance transforms.
+	const PODVector<Matrix3x4>* transforms_;
+	/// Instance transforms to draw, or null to draw all.
+	const PODVector<Matrix3x4>* drawTransforms_;
+	/// Number of instances when the bounding box was last updated.
+	unsigned numInstances_;
+};
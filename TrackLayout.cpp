@@ -0,0 +1,223 @@
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TrackLayout.h"
+#include "TrackPrefab.h"
+
+/// Length of a center line control segment.
+static const float CONTROL_SPACING = 40.0f;
+/// Largest heading change between control segments in degrees.
+static const float MAX_TURN = 25.0f;
+/// Largest heading away from the start direction in degrees, keeps the track from looping back on itself.
+static const float MAX_HEADING = 60.0f;
+/// Largest height change between control points.
+static const float MAX_RISE = 2.0f;
+/// Highest control point.
+static const float MAX_HEIGHT = 6.0f;
+
+/// Built-in themes. The first is the original look of the track, which every run starts in.
+static const TrackTheme TRACK_THEMES[NUM_TRACK_THEMES] =
+{
+	{ "Meadow", TRACK_BOX_PREFAB, TRACK_CARROT_PREFAB, "Materials/Terrain.xml", "Materials/GreenTransparent.xml" },
+	{ "Quarry", "Objects/TrackStoneBlock", TRACK_CARROT_PREFAB, "Materials/StoneTiledH.xml", "Materials/StoneTiled.xml" },
+	{ "Snowfield", "Objects/TrackSnowCrate", TRACK_CARROT_PREFAB, "Materials/NinjaSnowWar/Snow.xml", "Materials/GreenTransparent.xml" }
+};
+
+static bool CompareTrackItems(const TrackItem& lhs, const TrackItem& rhs)
+{
+	return lhs.z_ < rhs.z_;
+}
+
+static unsigned HashBytes(unsigned hash, const void* data, unsigned size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (unsigned i = 0; i < size; ++i)
+		hash = SDBMHash(hash, bytes[i]);
+	return hash;
+}
+
+/// Return hash of everything in the patterns that the generator reads. Never 0, which is the built-in generator.
+static unsigned HashPatterns(const Vector<TrackPattern>& patterns)
+{
+	unsigned hash = 0;
+	for (unsigned i = 0; i < patterns.Size(); ++i)
+	{
+		const TrackPattern& pattern = patterns[i];
+		unsigned numItems = pattern.items_.Size();
+		hash = HashBytes(hash, &pattern.weight_, sizeof pattern.weight_);
+		hash = HashBytes(hash, &numItems, sizeof numItems);
+		for (unsigned j = 0; j < numItems; ++j)
+		{
+			const TrackPatternItem& item = pattern.items_[j];
+			hash = HashBytes(hash, &item.type_, sizeof item.type_);
+			hash = HashBytes(hash, &item.lane_, sizeof item.lane_);
+			hash = HashBytes(hash, &item.offset_, sizeof item.offset_);
+		}
+	}
+	return hash ? hash : 1;
+}
+
+TrackLayout::TrackLayout() :
+	numPickups_(0),
+	seed_(0),
+	contentHash_(0)
+{
+}
+
+void TrackLayout::Generate(unsigned seed, unsigned numBoxes, unsigned numCarrots, bool centerLine)
+{
+	seed_ = seed;
+	contentHash_ = 0;
+	items_.Clear();
+	numPickups_ = 0;
+	BuildCenterLine(seed, centerLine);
+	BuildThemes(seed);
+
+	TrackRandom random(seed);
+	numCarrots = Min(numCarrots, MAX_PICKUPS);
+
+	// Same spread as the original scene: distance 20 - 380 in one of three lanes
+	for (unsigned i = 0; i < numBoxes + numCarrots; ++i)
+	{
+		TrackItem item;
+		item.type_ = i < numBoxes ? TRACK_BOX : TRACK_CARROT;
+		item.lane_ = random.Int(3) - 1;
+		item.z_ = (random.Float(90.0f) + 5.0f) * 4.0f;
+		item.pickupIndex_ = M_MAX_UNSIGNED;
+		items_.Push(item);
+	}
+
+	FinishItems();
+}
+
+void TrackLayout::Generate(unsigned seed, const Vector<TrackPattern>& patterns, bool centerLine)
+{
+	if (patterns.Empty())
+	{
+		Generate(seed, 30, 30, centerLine);
+		return;
+	}
+
+	seed_ = seed;
+	contentHash_ = HashPatterns(patterns);
+	items_.Clear();
+	numPickups_ = 0;
+	BuildCenterLine(seed, centerLine);
+	BuildThemes(seed);
+
+	float totalWeight = 0.0f;
+	for (unsigned i = 0; i < patterns.Size(); ++i)
+		totalWeight += patterns[i].weight_;
+
+	TrackRandom random(seed);
+	unsigned numCarrots = 0;
+	for (unsigned i = 0; i < NUM_PATTERN_SEGMENTS; ++i)
+	{
+		// Weighted pick, the last pattern takes any rounding remainder
+		float pick = random.Float(totalWeight);
+		unsigned index = 0;
+		while (index + 1 < patterns.Size() && pick >= patterns[index].weight_)
+			pick -= patterns[index++].weight_;
+
+		const PODVector<TrackPatternItem>& patternItems = patterns[index].items_;
+		float segmentStart = 20.0f + i * PATTERN_SEGMENT_LENGTH;
+		for (unsigned j = 0; j < patternItems.Size(); ++j)
+		{
+			if (patternItems[j].type_ == TRACK_CARROT && numCarrots++ >= MAX_PICKUPS)
+				continue;
+			TrackItem item;
+			item.type_ = patternItems[j].type_;
+			item.lane_ = patternItems[j].lane_;
+			item.z_ = segmentStart + patternItems[j].offset_;
+			item.pickupIndex_ = M_MAX_UNSIGNED;
+			items_.Push(item);
+		}
+	}
+
+	FinishItems();
+}
+
+void TrackLayout::BuildCenterLine(unsigned seed, bool centerLine)
+{
+	// Center line: straight and level start, then a new heading and height every control segment. Uses its own generator so
+	// that item placement does not depend on the shape
+	PODVector<Vector3> controlPoints;
+	if (centerLine)
+	{
+		TrackRandom pathRandom(seed ^ 0x5bd1e995u);
+		Vector3 point = Vector3::ZERO;
+		float heading = 0.0f;
+		controlPoints.Push(point);
+		point.z_ += CONTROL_SPACING;
+		controlPoints.Push(point);
+		while (controlPoints.Size() < (unsigned)(TRACK_LENGTH / CONTROL_SPACING) + 2)
+		{
+			heading = Clamp(heading + pathRandom.Float(2.0f * MAX_TURN) - MAX_TURN, -MAX_HEADING, MAX_HEADING);
+			float height = Clamp(point.y_ + pathRandom.Float(2.0f * MAX_RISE) - MAX_RISE, 0.0f, MAX_HEIGHT);
+			point = Vector3(point.x_ + Sin(heading) * CONTROL_SPACING, height, point.z_ + Cos(heading) * CONTROL_SPACING);
+			controlPoints.Push(point);
+		}
+	}
+	spline_.Build(controlPoints);
+}
+
+void TrackLayout::BuildThemes(unsigned seed)
+{
+	// Every span changes to a different theme. Uses its own generator so that item placement does not depend on the themes
+	TrackRandom themeRandom(seed ^ 0x9e3779b9u);
+	themes_.Resize(NUM_THEME_SPANS);
+	themes_[0] = 0;
+	for (unsigned i = 1; i < NUM_THEME_SPANS; ++i)
+		themes_[i] = (unsigned char)((themes_[i - 1] + 1 + themeRandom.Int(NUM_TRACK_THEMES - 1)) % NUM_TRACK_THEMES);
+}
+
+void TrackLayout::FinishItems()
+{
+	Sort(items_.Begin(), items_.End(), CompareTrackItems);
+
+	// Pickup indices follow track order so that collected state is stable for a seed
+	for (unsigned i = 0; i < items_.Size(); ++i)
+	{
+		if (items_[i].type_ == TRACK_CARROT)
+			items_[i].pickupIndex_ = numPickups_++;
+	}
+}
+
+unsigned TrackLayout::FindFirst(float z) const
+{
+	unsigned first = 0;
+	unsigned last = items_.Size();
+	while (first < last)
+	{
+		unsigned middle = (first + last) / 2;
+		if (items_[middle].z_ < z)
+			first = middle + 1;
+		else
+			last = middle;
+	}
+	return first;
+}
+
+unsigned TrackLayout::GetSegmentTheme(int segment) const
+{
+	if (themes_.Empty() || segment < 0)
+		return 0;
+	return themes_[(segment / TRACK_THEME_SEGMENTS) % themes_.Size()];
+}
+
+void TrackLayout::GetUpcomingThemes(float z, unsigned numSegments, PODVector<unsigned>& themes) const
+{
+	themes.Clear();
+	int first = GetSegment(z);
+	for (int segment = first; segment <= first + (int)numSegments; ++segment)
+	{
+		unsigned theme = GetSegmentTheme(segment);
+		if (!themes.Contains(theme))
+			themes.Push(theme);
+	}
+}
+
+const TrackTheme& TrackLayout::GetThemeData(unsigned theme)
+{
+	return TRACK_THEMES[theme < NUM_TRACK_THEMES ? theme : 0];
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <Urho3D/Container/Str.h>
+#include <Urho3D/Container/Vector.h>
+
+#include "TrackSpline.h"
+
+using namespace Urho3D;
+
+/// Distance between lane centers.
+const float LANE_WIDTH = 3.0f;
+/// Box obstacle half size.
+const float BOX_HALF_SIZE = 0.75f;
+/// Height of carrots above the floor.
+const float CARROT_HEIGHT = 2.0f;
+/// Maximum number of pickups on a track, limited by the collected pickup bitset.
+const unsigned MAX_PICKUPS = 128;
+/// Track length. Items are placed between 20 and 380.
+const float TRACK_LENGTH = 420.0f;
+/// Length of the track segment covered by one content pattern.
+const float PATTERN_SEGMENT_LENGTH = 40.0f;
+/// Number of pattern segments, covering the same distances as the built-in generator.
+const unsigned NUM_PATTERN_SEGMENTS = 9;
+/// Number of built-in track themes.
+const unsigned NUM_TRACK_THEMES = 3;
+/// Track segments one theme lasts.
+const unsigned TRACK_THEME_SEGMENTS = 3;
+/// Theme changes generated for a track. The sequence repeats after them, over 60 km in.
+const unsigned NUM_THEME_SPANS = 512;
+
+/// Track content type.
+enum TrackItemType
+{
+	TRACK_BOX = 0,
+	TRACK_CARROT
+};
+
+/// Obstacle or pickup on the track.
+struct TrackItem
+{
+	/// Content type.
+	TrackItemType type_;
+	/// Lane: -1 left, 0 middle, 1 right.
+	int lane_;
+	/// Distance along the track.
+	float z_;
+	/// Pickup index for the collected pickup bitset, or M_MAX_UNSIGNED for obstacles.
+	unsigned pickupIndex_;
+};
+
+/// Item of a content pattern.
+struct TrackPatternItem
+{
+	/// Content type.
+	TrackItemType type_;
+	/// Lane: -1 left, 0 middle, 1 right.
+	int lane_;
+	/// Distance from the start of the segment.
+	float offset_;
+};
+
+/// Content of one track segment, compiled from a pattern script.
+struct TrackPattern
+{
+	/// Construct.
+	TrackPattern() : weight_(1.0f) {}
+
+	/// Name for diagnostics.
+	String name_;
+	/// Relative chance of being picked for a segment.
+	float weight_;
+	/// Items.
+	PODVector<TrackPatternItem> items_;
+};
+
+/// Look of a track section: the archetype prefabs and the floor and wall materials. Instances are placed once, so the prefabs
+/// of an archetype share the node scale and collision size across themes.
+struct TrackTheme
+{
+	/// Name for diagnostics.
+	const char* name_;
+	/// Obstacle prefab.
+	const char* obstaclePrefab_;
+	/// Pickup prefab.
+	const char* pickupPrefab_;
+	/// Floor material.
+	const char* floorMaterial_;
+	/// Wall material.
+	const char* wallMaterial_;
+};
+
+/// Deterministic random number generator, independent of the engine's global random state.
+class TrackRandom
+{
+public:
+	/// Construct with seed.
+	TrackRandom(unsigned seed) : state_(seed ? seed : 1) {}
+
+	/// Return next 32-bit random number (xorshift).
+	unsigned Next()
+	{
+		state_ ^= state_ << 13;
+		state_ ^= state_ >> 17;
+		state_ ^= state_ << 5;
+		return state_;
+	}
+	/// Return float in range [0, range).
+	float Float(float range) { return (Next() >> 8) * (range / 16777216.0f); }
+	/// Return integer in range [0, range).
+	int Int(int range) { return (int)(Next() % (unsigned)range); }
+
+private:
+	/// Generator state.
+	unsigned state_;
+};
+
+/// Track center line and obstacle and pickup placement generated from a seed. The same seed always gives the same track.
+/// Items are in track space, see TrackSpline.
+class TrackLayout
+{
+public:
+	/// Construct empty.
+	TrackLayout();
+
+	/// Generate the center line and content. Items are sorted by distance. The center line can be skipped when only the simulation needs the track.
+	void Generate(unsigned seed, unsigned numBoxes = 30, unsigned numCarrots = 30, bool centerLine = true);
+	/// Generate the center line and fill each segment with a pattern picked by the seed. Pickups beyond MAX_PICKUPS are dropped.
+	void Generate(unsigned seed, const Vector<TrackPattern>& patterns, bool centerLine = true);
+
+	/// Return seed.
+	unsigned GetSeed() const { return seed_; }
+	/// Return identity of the content generator: 0 for the built-in one, otherwise a hash of the patterns. A track is only
+	/// the same as another with both the seed and this equal.
+	unsigned GetContentHash() const { return contentHash_; }
+	/// Return center line.
+	const TrackSpline& GetSpline() const { return spline_; }
+	/// Return items sorted by distance.
+	const PODVector<TrackItem>& GetItems() const { return items_; }
+	/// Return number of pickups.
+	unsigned GetNumPickups() const { return numPickups_; }
+	/// Return index of the first item at or beyond a distance.
+	unsigned FindFirst(float z) const;
+	/// Return theme of a segment. Themes change every few segments, past the end of the track too; the first is always theme 0.
+	unsigned GetSegmentTheme(int segment) const;
+	/// Return theme at a distance.
+	unsigned GetTheme(float z) const { return GetSegmentTheme(GetSegment(z)); }
+	/// Return the themes needed from a distance up to a number of segments ahead, nearest first, each once.
+	void GetUpcomingThemes(float z, unsigned numSegments, PODVector<unsigned>& themes) const;
+
+	/// Return lateral offset of a lane.
+	static float GetLaneX(int lane) { return lane * LANE_WIDTH; }
+	/// Return segment of a distance.
+	static int GetSegment(float z) { return z > 0.0f ? (int)(z / PATTERN_SEGMENT_LENGTH) : 0; }
+	/// Return prefabs and materials of a theme.
+	static const TrackTheme& GetThemeData(unsigned theme);
+
+private:
+	/// Build the center line from the seed, or a straight one.
+	void BuildCenterLine(unsigned seed, bool centerLine);
+	/// Pick the theme sequence from the seed.
+	void BuildThemes(unsigned seed);
+	/// Sort the items and number the pickups.
+	void FinishItems();
+
+	/// Center line.
+	TrackSpline spline_;
+	/// Items sorted by distance.
+	PODVector<TrackItem> items_;
+	/// Theme of each span of TRACK_THEME_SEGMENTS segments.
+	PODVector<unsigned char> themes_;
+	/// Number of pickups.
+	unsigned numPickups_;
+	/// Seed.
+	unsigned seed_;
+	/// Identity of the content generator.
+	unsigned contentHash_;
+};
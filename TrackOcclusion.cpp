@@ -0,0 +1,230 @@
+#include <Urho3D/Container/Sort.h>
+#include <Urho3D/Core/Context.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/Core/WorkQueue.h>
+#include <Urho3D/Graphics/Camera.h>
+#include <Urho3D/Graphics/OcclusionBuffer.h>
+
+#include "EventStats.h"
+#include "MetricsExport.h"
+#include "TrackInstanceGroup.h"
+#include "TrackOcclusion.h"
+
+/// Unit box corners. Bit 0 of the index selects x, bit 1 y and bit 2 z.
+static const Vector3 boxVertices[] =
+{
+	Vector3(-0.5f, -0.5f, -0.5f),
+	Vector3(0.5f, -0.5f, -0.5f),
+	Vector3(-0.5f, 0.5f, -0.5f),
+	Vector3(0.5f, 0.5f, -0.5f),
+	Vector3(-0.5f, -0.5f, 0.5f),
+	Vector3(0.5f, -0.5f, 0.5f),
+	Vector3(-0.5f, 0.5f, 0.5f),
+	Vector3(0.5f, 0.5f, 0.5f)
+};
+
+/// Unit box triangles, clockwise seen from outside so that back faces are culled.
+static const unsigned short boxIndices[] =
+{
+	0, 2, 3, 0, 3, 1,	// -Z
+	4, 5, 7, 4, 7, 6,	// +Z
+	4, 6, 2, 4, 2, 0,	// -X
+	1, 3, 7, 1, 7, 5,	// +X
+	1, 5, 4, 1, 4, 0,	// -Y
+	2, 6, 7, 2, 7, 3	// +Y
+};
+
+static const unsigned NUM_BOX_INDICES = sizeof boxIndices / sizeof boxIndices[0];
+
+TrackOcclusion::TrackOcclusion(Context* context) :
+	Object(context),
+	buffer_(new OcclusionBuffer(context)),
+	lastUpdateUSec_(0),
+	maxUpdateUSec_(0),
+	totalUpdateUSec_(0),
+	lastTested_(0),
+	lastCulled_(0),
+	numUpdates_(0),
+	totalOccluders_(0),
+	totalTriangles_(0),
+	totalTested_(0),
+	totalCulled_(0)
+{
+	// Threaded rasterization splits the buffer into horizontal slices, one per worker
+	buffer_->SetSize(TRACK_OCCLUSION_WIDTH, TRACK_OCCLUSION_HEIGHT, true);
+
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(TrackOcclusion, HandleCollectMetrics));
+}
+
+TrackOcclusion::~TrackOcclusion()
+{
+	for (unsigned i = 0; i < groups_.Size(); ++i)
+	{
+		if (groups_[i])
+			groups_[i]->SetDrawInstances(0);
+	}
+}
+
+void TrackOcclusion::ClearFloor()
+{
+	floorTransforms_.Clear();
+	floorDistances_.Clear();
+}
+
+void TrackOcclusion::AddFloorPiece(const Matrix3x4& transform, float distance)
+{
+	floorTransforms_.Push(transform);
+	floorDistances_.Push(distance);
+}
+
+void TrackOcclusion::Update(Camera* camera, const TrackEntityStore& store, float distance)
+{
+	if (!camera)
+		return;
+
+	HiresTimer timer;
+	buffer_->SetView(camera);
+	buffer_->Clear();
+
+	// Occluders: the floor pieces ahead, then the nearest boxes in view
+	unsigned numOccluders = 0;
+	for (unsigned i = 0; i < floorDistances_.Size() && floorDistances_[i] < distance + TRACK_OCCLUDER_FLOOR_RANGE; ++i)
+	{
+		if (floorDistances_[i] < distance - TRACK_OCCLUSION_BEHIND)
+			continue;
+		buffer_->AddTriangles(floorTransforms_[i], boxVertices, sizeof(Vector3), boxIndices, sizeof(unsigned short), 0,
+			NUM_BOX_INDICES);
+		++numOccluders;
+	}
+
+	// Every box has the same model, so the bounding box is taken from the group of the first box's chunk
+	const Frustum& frustum = camera->GetFrustum();
+	const PODVector<Matrix3x4>& boxTransforms = store.GetTransforms(ARCHETYPE_OBSTACLE);
+	const PODVector<float>& boxDistances = store.GetDistances(ARCHETYPE_OBSTACLE);
+	unsigned firstBox = store.FindFirst(ARCHETYPE_OBSTACLE, distance);
+	TrackInstanceGroup* boxGroup = firstBox < boxDistances.Size() ?
+		store.GetRenderGroup(ARCHETYPE_OBSTACLE, store.GetChunk(ARCHETYPE_OBSTACLE, firstBox)) : 0;
+	if (boxGroup)
+	{
+		const BoundingBox& localBox = boxGroup->GetBoundingBox();
+		Matrix3x4 boxTransform(localBox.Center(), Quaternion::IDENTITY, localBox.Size());
+		unsigned numBoxes = 0;
+		for (unsigned i = firstBox; i < boxDistances.Size() && numBoxes < TRACK_OCCLUDER_BOXES &&
+			boxDistances[i] < distance + TRACK_OCCLUDER_BOX_RANGE; ++i)
+		{
+			if (!store.IsVisible(ARCHETYPE_OBSTACLE, i) || frustum.IsInsideFast(localBox.Transformed(boxTransforms[i])) == OUTSIDE)
+				continue;
+			buffer_->AddTriangles(boxTransforms[i] * boxTransform, boxVertices, sizeof(Vector3), boxIndices, sizeof(unsigned short),
+				0, NUM_BOX_INDICES);
+			++numBoxes;
+		}
+		numOccluders += numBoxes;
+	}
+
+	buffer_->DrawTriangles();
+	buffer_->BuildDepthHierarchy();
+
+	// Groups of chunks no longer in range draw all their instances again. Nothing is drawn until the update is done, so the
+	// groups still in range are simply set again
+	for (unsigned i = 0; i < groups_.Size(); ++i)
+	{
+		if (groups_[i])
+			groups_[i]->SetDrawInstances(0);
+	}
+	groups_.Clear();
+
+	// Each group keeps a pointer to its transforms, so there is one array per chunk in range before any is handed out
+	float beginDistance = distance - TRACK_OCCLUSION_BEHIND;
+	float endDistance = distance + camera->GetFarClip();
+	unsigned numChunks = 0;
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		TrackArchetype archetype = (TrackArchetype)i;
+		unsigned begin = store.FindFirst(archetype, beginDistance);
+		unsigned end = store.FindFirst(archetype, endDistance);
+		if (begin < end)
+			numChunks += store.GetChunk(archetype, end - 1) - store.GetChunk(archetype, begin) + 1;
+	}
+	if (drawTransforms_.Size() < numChunks)
+		drawTransforms_.Resize(numChunks);
+
+	// Test the entities in view chunk by chunk, and leave the hidden ones out of what the chunk's instance group draws.
+	// Entities outside the frustum are kept, as they may still cast shadows into view
+	lastTested_ = 0;
+	lastCulled_ = 0;
+	for (unsigned i = 0; i < MAX_TRACK_ARCHETYPES; ++i)
+	{
+		TrackArchetype archetype = (TrackArchetype)i;
+		const PODVector<Matrix3x4>& transforms = store.GetTransforms(archetype);
+		unsigned end = store.FindFirst(archetype, endDistance);
+		for (unsigned j = store.FindFirst(archetype, beginDistance); j < end;)
+		{
+			unsigned chunk = store.GetChunk(archetype, j);
+			TrackInstanceGroup* group = store.GetRenderGroup(archetype, chunk);
+			if (!group)
+			{
+				while (j < end && store.GetChunk(archetype, j) == chunk)
+					++j;
+				continue;
+			}
+
+			BoundingBox localBox = group->GetInstanceBoundingBox();
+			culled_.Clear();
+			for (; j < end && store.GetChunk(archetype, j) == chunk; ++j)
+			{
+				unsigned instance = store.GetInstanceIndex(archetype, j);
+				if (instance == M_MAX_UNSIGNED)
+					continue;
+				BoundingBox worldBox = localBox.Transformed(transforms[j]);
+				if (frustum.IsInsideFast(worldBox) == OUTSIDE)
+					continue;
+				++lastTested_;
+				if (!buffer_->IsVisible(worldBox))
+					culled_.Push(instance);
+			}
+			lastCulled_ += culled_.Size();
+
+			// Removing from the highest instance index down, the last instance moved into a freed slot is never a culled one
+			PODVector<Matrix3x4>& drawTransforms = drawTransforms_[groups_.Size()];
+			drawTransforms = store.GetInstanceTransforms(archetype, chunk);
+			Sort(culled_.Begin(), culled_.End());
+			for (unsigned k = culled_.Size(); k-- > 0;)
+			{
+				drawTransforms[culled_[k]] = drawTransforms.Back();
+				drawTransforms.Pop();
+			}
+
+			group->SetDrawInstances(&drawTransforms);
+			groups_.Push(WeakPtr<TrackInstanceGroup>(group));
+		}
+	}
+
+	lastUpdateUSec_ = timer.GetUSec(false);
+	maxUpdateUSec_ = Max(maxUpdateUSec_, lastUpdateUSec_);
+	totalUpdateUSec_ += lastUpdateUSec_;
+	totalOccluders_ += numOccluders;
+	totalTriangles_ += buffer_->GetNumTriangles();
+	totalTested_ += lastTested_;
+	totalCulled_ += lastCulled_;
+	++numUpdates_;
+}
+
+void TrackOcclusion::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& occlusion = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["occlusion"];
+	WorkQueue* queue = GetSubsystem<WorkQueue>();
+	float updates = (float)Max(numUpdates_, 1U);
+	occlusion["workerThreads"] = queue ? queue->GetNumThreads() : 0;
+	occlusion["bufferWidth"] = TRACK_OCCLUSION_WIDTH;
+	occlusion["bufferHeight"] = TRACK_OCCLUSION_HEIGHT;
+	occlusion["updates"] = numUpdates_;
+	occlusion["occludersPerFrame"] = totalOccluders_ / updates;
+	occlusion["occluderTrianglesPerFrame"] = totalTriangles_ / updates;
+	occlusion["testedPerFrame"] = totalTested_ / updates;
+	occlusion["culledPerFrame"] = totalCulled_ / updates;
+	occlusion["culledFraction"] = totalTested_ ? (float)((double)totalCulled_ / totalTested_) : 0.0f;
+	occlusion["updateMsPerFrame"] = totalUpdateUSec_ / 1000.0f / updates;
+	occlusion["maxUpdateMs"] = maxUpdateUSec_ / 1000.0f;
+}
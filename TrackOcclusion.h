@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/Math/Matrix3x4.h>
+
+#include "TrackEntities.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Camera;
+	class OcclusionBuffer;
+}
+
+/// Occlusion buffer width. Boxes cover many pixels even far down the corridor, so a coarse buffer is enough.
+const int TRACK_OCCLUSION_WIDTH = 128;
+/// Occlusion buffer height.
+const int TRACK_OCCLUSION_HEIGHT = 64;
+/// Number of nearest boxes ahead of the camera drawn as occluders.
+const unsigned TRACK_OCCLUDER_BOXES = 16;
+/// Track distance ahead of the camera within which boxes are occluders.
+const float TRACK_OCCLUDER_BOX_RANGE = 100.0f;
+/// Track distance ahead of the camera within which floor pieces are occluders. They hide content beyond crests.
+const float TRACK_OCCLUDER_FLOOR_RANGE = 150.0f;
+/// Track distance behind the camera from which entities are tested.
+const float TRACK_OCCLUSION_BEHIND = 10.0f;
+
+/// Culls track entities hidden behind the nearest boxes and the floor. Each frame the occluders are rasterized from the camera
+/// into a low resolution depth buffer on worker threads, and the entities in front of the camera are tested against it. The
+/// instance groups of their chunks then draw only the entities not found hidden; the same subset casts shadows, which is a
+/// small error as the shadow of a hidden box mostly falls behind the box hiding it. Walls are transparent, so they are not
+/// occluders.
+class TrackOcclusion : public Object
+{
+	URHO3D_OBJECT(TrackOcclusion, Object);
+
+public:
+	/// Construct.
+	TrackOcclusion(Context* context);
+	/// Destruct. Make the instance groups draw all instances again.
+	~TrackOcclusion();
+
+	/// Remove floor pieces.
+	void ClearFloor();
+	/// Add a floor piece, a unit box transformed to the piece, at its track distance. Pieces must be added in increasing distance.
+	void AddFloorPiece(const Matrix3x4& transform, float distance);
+	/// Cull the entities of the store seen by a camera at a track distance, and set what the instance groups draw.
+	void Update(Camera* camera, const TrackEntityStore& store, float distance);
+
+	/// Return time spent in the last update in microseconds.
+	long long GetLastUpdateUSec() const { return lastUpdateUSec_; }
+	/// Return number of entities tested in the last update.
+	unsigned GetNumTested() const { return lastTested_; }
+	/// Return number of entities culled in the last update.
+	unsigned GetNumCulled() const { return lastCulled_; }
+
+private:
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Depth buffer.
+	SharedPtr<OcclusionBuffer> buffer_;
+	/// Floor piece transforms.
+	PODVector<Matrix3x4> floorTransforms_;
+	/// Floor piece track distances.
+	PODVector<float> floorDistances_;
+	/// Render instance indices of the culled entities of the chunk being tested.
+	PODVector<unsigned> culled_;
+	/// Transforms drawn by each instance group drawing from this.
+	Vector<PODVector<Matrix3x4> > drawTransforms_;
+	/// Instance groups drawing from this, those of the chunks in view.
+	Vector<WeakPtr<TrackInstanceGroup> > groups_;
+	/// Time spent in the last update.
+	long long lastUpdateUSec_;
+	/// Slowest update.
+	long long maxUpdateUSec_;
+	/// Time spent in all updates.
+	long long totalUpdateUSec_;
+	/// Entities tested in the last update.
+	unsigned lastTested_;
+	/// Entities culled in the last update.
+	unsigned lastCulled_;
+	/// Updates.
+	unsigned numUpdates_;
+	/// Occluders drawn in all updates.
+	unsigned long long totalOccluders_;
+	/// Occluder triangles rasterized in all updates.
+	unsigned long long totalTriangles_;
+	/// Entities tested in all updates.
+	unsigned long long totalTested_;
+	/// Entities culled in all updates.
+	unsigned long long totalCulled_;
+};
@@ -0,0 +1,280 @@
+#include <Urho3D/Core/CoreEvents.h>
+#include <Urho3D/Core/Timer.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/FileWatcher.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/Resource/ResourceCache.h>
+
+#ifdef URHO3D_LUA
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+#endif
+
+#include "EventStats.h"
+#include "MemoryTracker.h"
+#include "MetricsExport.h"
+#include "TrackPatternLibrary.h"
+
+#ifdef URHO3D_LUA
+#if defined(MEMORY_TAGS) && !defined(URHO3D_LUAJIT)
+/// Lua allocator attributing the pattern scripts' memory to scripting. Shrinking never fails, as Lua expects.
+static void* AllocScripting(void* userData, void* ptr, size_t oldSize, size_t newSize)
+{
+	if (!newSize)
+	{
+		TaggedFree(ptr);
+		return 0;
+	}
+	void* newPtr = TaggedRealloc(ptr, newSize, MEMTAG_SCRIPTING);
+	return newPtr || newSize > oldSize ? newPtr : ptr;
+}
+#endif
+
+/// Return the error at the top of the stack. An error object that is not a string is described by its type.
+static String GetErrorMessage(lua_State* L)
+{
+	return lua_isstring(L, -1) ? String(lua_tostring(L, -1)) : "(error object is a " + String(luaL_typename(L, -1)) + ")";
+}
+
+/// Read the item list at the top of the stack into a pattern. Entries that are not tables are skipped.
+static void ReadPatternItems(lua_State* L, TrackPattern& pattern)
+{
+	unsigned count = (unsigned)lua_objlen(L, -1);
+	for (unsigned i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, -1, i);
+		if (lua_istable(L, -1))
+		{
+			TrackPatternItem item;
+			lua_getfield(L, -1, "type");
+			const char* type = lua_tostring(L, -1);
+			item.type_ = type && String(type).ToLower() == "carrot" ? TRACK_CARROT : TRACK_BOX;
+			lua_pop(L, 1);
+			lua_getfield(L, -1, "lane");
+			item.lane_ = Clamp((int)lua_tointeger(L, -1), -1, 1);
+			lua_pop(L, 1);
+			lua_getfield(L, -1, "offset");
+			item.offset_ = Clamp((float)lua_tonumber(L, -1), 0.0f, PATTERN_SEGMENT_LENGTH);
+			lua_pop(L, 1);
+			pattern.items_.Push(item);
+		}
+		lua_pop(L, 1);
+	}
+}
+#endif
+
+TrackPatternLibrary::TrackPatternLibrary(Context* context) :
+	Object(context),
+	compileUSec_(0),
+	generateUSec_(0),
+	generateSegments_(0),
+	numCompiles_(0),
+	numErrors_(0)
+{
+	SubscribeToEvent(E_COLLECTMETRICS, GAME_HANDLER(TrackPatternLibrary, HandleCollectMetrics));
+}
+
+TrackPatternLibrary::~TrackPatternLibrary()
+{
+}
+
+bool TrackPatternLibrary::Load(const String& resourceName)
+{
+	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	String fileName = cache->GetResourceFileName(resourceName);
+	if (fileName.Empty())
+	{
+		URHO3D_LOGINFO("Track pattern script " + resourceName + " not found, using the built-in generator");
+		return false;
+	}
+
+	// The script is read directly instead of through the cache, so that a reload always sees the file on disk. It is watched
+	// even when the first compile fails, so that fixing the script takes effect
+	fileName_ = fileName;
+	if (!watcher_)
+	{
+		watcher_ = new FileWatcher(context_);
+		watcher_->StartWatching(GetPath(fileName_), false);
+		SubscribeToEvent(E_UPDATE, GAME_HANDLER(TrackPatternLibrary, HandleUpdate));
+	}
+
+	Vector<TrackPattern> patterns;
+	HiresTimer timer;
+	if (!Compile(fileName_, patterns))
+	{
+		++numErrors_;
+		return false;
+	}
+	compileUSec_ = timer.GetUSec(false);
+	++numCompiles_;
+	patterns_ = patterns;
+
+	URHO3D_LOGINFO(ToString("Compiled %u track patterns from %s in %.2f ms", patterns_.Size(), resourceName.CString(),
+		compileUSec_ / 1000.0f));
+	return true;
+}
+
+void TrackPatternLibrary::RecordGeneration(long long usec, unsigned numSegments)
+{
+	generateUSec_ = usec;
+	generateSegments_ = numSegments;
+}
+
+bool TrackPatternLibrary::Compile(const String& fileName, Vector<TrackPattern>& patterns)
+{
+#ifdef URHO3D_LUA
+	File file(context_, fileName);
+	if (!file.IsOpen())
+		return false;
+	PODVector<char> source(file.GetSize());
+	if (!source.Empty())
+		file.Read(&source[0], source.Size());
+
+	// A fresh state per compile, closed right after, so nothing is left running between reloads
+	// LuaJIT on 64-bit platforms only runs with its own allocator
+#if defined(MEMORY_TAGS) && !defined(URHO3D_LUAJIT)
+	lua_State* L = lua_newstate(AllocScripting, 0);
+#else
+	lua_State* L = luaL_newstate();
+#endif
+	if (!L)
+		return false;
+	luaL_openlibs(L);
+	if (luaL_loadbuffer(L, source.Empty() ? "" : &source[0], source.Size(), GetFileNameAndExtension(fileName).CString()) ||
+		lua_pcall(L, 0, 0, 0))
+	{
+		URHO3D_LOGERROR("Track pattern script error: " + GetErrorMessage(L));
+		lua_close(L);
+		return false;
+	}
+
+	lua_getglobal(L, "TrackPatterns");
+	if (!lua_istable(L, -1))
+	{
+		URHO3D_LOGERROR("Track pattern script does not define the TrackPatterns table");
+		lua_close(L);
+		return false;
+	}
+
+	unsigned count = (unsigned)lua_objlen(L, -1);
+	for (unsigned i = 1; i <= count; ++i)
+	{
+		lua_rawgeti(L, -1, i);
+		if (!lua_istable(L, -1))
+		{
+			lua_pop(L, 1);
+			continue;
+		}
+
+		TrackPattern pattern;
+		lua_getfield(L, -1, "name");
+		pattern.name_ = lua_isstring(L, -1) ? String(lua_tostring(L, -1)) : "Pattern" + String(i);
+		lua_pop(L, 1);
+		lua_getfield(L, -1, "weight");
+		pattern.weight_ = lua_isnumber(L, -1) ? Max((float)lua_tonumber(L, -1), 0.0f) : 1.0f;
+		lua_pop(L, 1);
+
+		lua_getfield(L, -1, "build");
+		if (lua_isfunction(L, -1))
+		{
+			// Each variant becomes its own pattern, sharing the weight
+			for (unsigned j = 1; j <= TRACK_PATTERN_VARIANTS; ++j)
+			{
+				lua_pushvalue(L, -1);
+				lua_pushinteger(L, j);
+				if (lua_pcall(L, 1, 1, 0))
+				{
+					URHO3D_LOGERROR("Track pattern " + pattern.name_ + " build error: " + GetErrorMessage(L));
+					lua_close(L);
+					return false;
+				}
+				TrackPattern variant;
+				variant.name_ = pattern.name_ + "." + String(j);
+				variant.weight_ = pattern.weight_ / TRACK_PATTERN_VARIANTS;
+				if (lua_istable(L, -1))
+					ReadPatternItems(L, variant);
+				lua_pop(L, 1);
+				patterns.Push(variant);
+			}
+			lua_pop(L, 1);
+		}
+		else
+		{
+			lua_pop(L, 1);
+			lua_getfield(L, -1, "items");
+			if (lua_istable(L, -1))
+				ReadPatternItems(L, pattern);
+			lua_pop(L, 1);
+			patterns.Push(pattern);
+		}
+		lua_pop(L, 1);
+	}
+	lua_close(L);
+
+	// Patterns that can never be picked are dropped, and without any the built-in generator is used
+	for (unsigned i = patterns.Size() - 1; i < patterns.Size(); --i)
+	{
+		if (patterns[i].weight_ <= 0.0f)
+			patterns.Erase(i);
+	}
+	if (patterns.Empty())
+	{
+		URHO3D_LOGERROR("Track pattern script has no patterns");
+		return false;
+	}
+	return true;
+#else
+	URHO3D_LOGWARNING("Track pattern scripts need Lua, using the built-in generator");
+	return false;
+#endif
+}
+
+void TrackPatternLibrary::HandleUpdate(StringHash eventType, VariantMap& eventData)
+{
+	if (!watcher_)
+		return;
+
+	// The watcher reports each file once its changes have settled
+	String fileName = GetFileNameAndExtension(fileName_);
+	String changed;
+	bool reload = false;
+	while (watcher_->GetNextChange(changed))
+	{
+		if (GetFileNameAndExtension(changed) == fileName)
+			reload = true;
+	}
+	if (!reload)
+		return;
+
+	Vector<TrackPattern> patterns;
+	HiresTimer timer;
+	if (!Compile(fileName_, patterns))
+	{
+		++numErrors_;
+		URHO3D_LOGWARNING("Track pattern reload failed, keeping the previous patterns");
+		return;
+	}
+	compileUSec_ = timer.GetUSec(false);
+	++numCompiles_;
+	patterns_ = patterns;
+	URHO3D_LOGINFO(ToString("Reloaded %u track patterns in %.2f ms", patterns_.Size(), compileUSec_ / 1000.0f));
+	SendEvent(E_TRACKPATTERNSCHANGED);
+}
+
+void TrackPatternLibrary::HandleCollectMetrics(StringHash eventType, VariantMap& eventData)
+{
+	using namespace CollectMetrics;
+
+	JSONValue& patterns = (*static_cast<JSONValue*>(eventData[P_METRICS].GetVoidPtr()))["trackPatterns"];
+	patterns["patterns"] = patterns_.Size();
+	patterns["compiles"] = numCompiles_;
+	patterns["errors"] = numErrors_;
+	patterns["compileMs"] = compileUSec_ / 1000.0;
+	patterns["segments"] = generateSegments_;
+	patterns["segmentUs"] = generateSegments_ ? (double)generateUSec_ / generateSegments_ : 0.0;
+}
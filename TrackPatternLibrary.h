@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+
+#include "TrackLayout.h"
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class FileWatcher;
+}
+
+/// Track pattern script has been reloaded and compiled.
+URHO3D_EVENT(E_TRACKPATTERNSCHANGED, TrackPatternsChanged)
+{
+}
+
+/// Default track pattern script.
+const char* const TRACK_PATTERN_SCRIPT = "LuaScripts/TrackPatterns.lua";
+/// Variants compiled from each pattern that is given as a build function.
+const unsigned TRACK_PATTERN_VARIANTS = 4;
+
+/// Track content patterns authored in Lua. The script runs only when it is loaded: it returns the patterns as tables, or as
+/// functions that are called once per variant, and the result is compiled into TrackPattern arrays that the track generator
+/// reads without touching Lua. The script is compiled again when it changes on disk. Without Lua, or when the script fails,
+/// there are no patterns and the built-in generator is used.
+class TrackPatternLibrary : public Object
+{
+	URHO3D_OBJECT(TrackPatternLibrary, Object);
+
+public:
+	/// Construct.
+	TrackPatternLibrary(Context* context);
+	/// Destruct.
+	~TrackPatternLibrary();
+
+	/// Compile a pattern script and watch it for changes. Return true on success; on failure the previous patterns are kept.
+	bool Load(const String& resourceName = TRACK_PATTERN_SCRIPT);
+	/// Record the time taken to generate a track from the patterns.
+	void RecordGeneration(long long usec, unsigned numSegments);
+
+	/// Return compiled patterns.
+	const Vector<TrackPattern>& GetPatterns() const { return patterns_; }
+
+private:
+	/// Run the script and compile its patterns. Return true on success.
+	bool Compile(const String& fileName, Vector<TrackPattern>& patterns);
+
+	/// Handle frame update. Check for script changes.
+	void HandleUpdate(StringHash eventType, VariantMap& eventData);
+	/// Handle metrics collection.
+	void HandleCollectMetrics(StringHash eventType, VariantMap& eventData);
+
+	/// Compiled patterns.
+	Vector<TrackPattern> patterns_;
+	/// Watcher of the script directory.
+	SharedPtr<FileWatcher> watcher_;
+	/// Full path of the script.
+	String fileName_;
+	/// Time taken by the last compile.
+	long long compileUSec_;
+	/// Time taken by the last track generation.
+	long long generateUSec_;
+	/// Segments in the last track generation.
+	unsigned generateSegments_;
+	/// Successful compiles.
+	unsigned numCompiles_;
+	/// Failed compiles.
+	unsigned numErrors_;
+};
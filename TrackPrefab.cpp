@@ -0,0 +1,229 @@
+#include <Urho3D/Graphics/Material.h>
+#include <Urho3D/Graphics/Model.h>
+#include <Urho3D/Graphics/StaticModel.h>
+#include <Urho3D/IO/File.h>
+#include <Urho3D/IO/FileSystem.h>
+#include <Urho3D/IO/Log.h>
+#include <Urho3D/IO/MemoryBuffer.h>
+#include <Urho3D/Physics/CollisionShape.h>
+#include <Urho3D/Physics/RigidBody.h>
+#include <Urho3D/Resource/ResourceCache.h>
+#include <Urho3D/Resource/XMLFile.h>
+#include <Urho3D/Scene/Scene.h>
+
+#include "ResourceProfiler.h"
+#include "TrackPrefab.h"
+
+TrackPrefab::TrackPrefab() :
+	scale_(Vector3::ONE),
+	shapeSize_(Vector3::ONE),
+	shapePosition_(Vector3::ZERO),
+	shapeRotation_(Quaternion::IDENTITY),
+	mass_(0.0f),
+	friction_(0.5f),
+	layer_(1),
+	mask_(M_MAX_UNSIGNED),
+	trigger_(false),
+	castShadows_(false),
+	hasModel_(false),
+	hasBody_(false),
+	hasShape_(false),
+	fast_(false)
+{
+}
+
+Node* TrackPrefab::Instantiate(Node* parent, const Vector3& position, const Quaternion& rotation, bool physicsOnly,
+	CreateMode mode) const
+{
+	if (!parent)
+		return 0;
+
+	if (!fast_)
+	{
+		Node* node = InstantiateBinary(parent, position, rotation, mode);
+		if (node && physicsOnly)
+		{
+			PODVector<Drawable*> drawables;
+			node->GetDerivedComponents(drawables, true);
+			for (unsigned i = 0; i < drawables.Size(); ++i)
+				drawables[i]->Remove();
+		}
+		return node;
+	}
+
+	// Same result as deserializing the prefab, with the resources and settings already at hand
+	Node* node = parent->CreateChild(name_, mode);
+	node->SetTransform(position, rotation, scale_);
+	if (hasModel_ && !physicsOnly)
+	{
+		StaticModel* model = node->CreateComponent<StaticModel>(mode);
+		model->SetModel(model_);
+		model->SetMaterial(material_);
+		model->SetCastShadows(castShadows_);
+	}
+	if (hasBody_)
+	{
+		RigidBody* body = node->CreateComponent<RigidBody>(mode);
+		body->SetCollisionLayerAndMask(layer_, mask_);
+		body->SetTrigger(trigger_);
+		body->SetFriction(friction_);
+		body->SetMass(mass_);
+	}
+	if (hasShape_)
+	{
+		CollisionShape* shape = node->CreateComponent<CollisionShape>(mode);
+		shape->SetBox(shapeSize_, shapePosition_, shapeRotation_);
+	}
+	return node;
+}
+
+Node* TrackPrefab::InstantiateBinary(Node* parent, const Vector3& position, const Quaternion& rotation, CreateMode mode) const
+{
+	Scene* scene = parent ? parent->GetScene() : 0;
+	if (!scene)
+		return 0;
+
+	MemoryBuffer buffer(binary_.GetData(), binary_.GetSize());
+	Node* node = scene->Instantiate(buffer, position, rotation, mode);
+	if (node && parent != scene)
+	{
+		node->SetParent(parent);
+		node->SetTransform(position, rotation);
+	}
+	return node;
+}
+
+TrackPrefabLibrary::TrackPrefabLibrary(Context* context) :
+	Object(context),
+	templateScene_(new Scene(context))
+{
+}
+
+TrackPrefabLibrary::~TrackPrefabLibrary()
+{
+}
+
+TrackPrefab* TrackPrefabLibrary::GetPrefab(const String& name)
+{
+	HashMap<String, SharedPtr<TrackPrefab> >::Iterator i = prefabs_.Find(name);
+	if (i != prefabs_.End())
+		return i->second_;
+
+	ResourceCache* cache = GetSubsystem<ResourceCache>();
+	FileSystem* fileSystem = GetSubsystem<FileSystem>();
+	String xmlFileName = cache->GetResourceFileName(name + ".xml");
+	String binFileName = cache->GetResourceFileName(name + ".bin");
+
+	// The compiled form is used unless the XML has been edited since, or is already in the cache, e.g. prefetched, so that
+	// building the prefab opens no files
+	Node* node = 0;
+	XMLFile* cachedXml = cache->GetExistingResource<XMLFile>(name + ".xml");
+	if (cachedXml)
+		node = templateScene_->InstantiateXML(cachedXml->GetRoot(), Vector3::ZERO, Quaternion::IDENTITY, LOCAL);
+	if (!node && !binFileName.Empty() && (xmlFileName.Empty() ||
+		fileSystem->GetLastModifiedTime(binFileName) >= fileSystem->GetLastModifiedTime(xmlFileName)))
+	{
+		SharedPtr<File> file = cache->GetFile(name + ".bin");
+		if (file)
+			node = templateScene_->Instantiate(*file, Vector3::ZERO, Quaternion::IDENTITY, LOCAL);
+	}
+	if (!node)
+	{
+		XMLFile* xml = GetSubsystem<ResourceProfiler>()->GetResource<XMLFile>(name + ".xml", __FUNCTION__);
+		if (xml)
+			node = templateScene_->InstantiateXML(xml->GetRoot(), Vector3::ZERO, Quaternion::IDENTITY, LOCAL);
+	}
+	if (!node)
+	{
+		URHO3D_LOGERROR("Could not load prefab " + name);
+		return 0;
+	}
+
+	SharedPtr<TrackPrefab> prefab = CreatePrefab(node);
+	node->Remove();
+	prefabs_[name] = prefab;
+	return prefab;
+}
+
+void TrackPrefabLibrary::ReleasePrefab(const String& name)
+{
+	prefabs_.Erase(name);
+}
+
+bool TrackPrefabLibrary::Compile(const String& name)
+{
+	String xmlFileName = GetSubsystem<ResourceCache>()->GetResourceFileName(name + ".xml");
+	XMLFile* xml = GetSubsystem<ResourceProfiler>()->GetResource<XMLFile>(name + ".xml", __FUNCTION__);
+	Node* node = xml ? templateScene_->InstantiateXML(xml->GetRoot(), Vector3::ZERO, Quaternion::IDENTITY, LOCAL) : 0;
+	if (!node || xmlFileName.Empty())
+	{
+		URHO3D_LOGERROR("Could not compile prefab " + name);
+		return false;
+	}
+
+	String binFileName = ReplaceExtension(xmlFileName, ".bin");
+	File file(context_, binFileName, FILE_WRITE);
+	bool success = file.IsOpen() && node->Save(file);
+	node->Remove();
+	prefabs_.Erase(name);
+
+	if (success)
+		URHO3D_LOGINFO(ToString("Compiled prefab %s to %s (%u bytes)", name.CString(), binFileName.CString(), file.GetSize()));
+	else
+		URHO3D_LOGERROR("Could not write " + binFileName);
+	return success;
+}
+
+SharedPtr<TrackPrefab> TrackPrefabLibrary::CreatePrefab(Node* node)
+{
+	SharedPtr<TrackPrefab> prefab(new TrackPrefab());
+	prefab->name_ = node->GetName();
+	prefab->scale_ = node->GetScale();
+	node->Save(prefab->binary_);
+
+	// The recipe covers a childless node with at most one each of the known components; anything else is deserialized
+	prefab->fast_ = node->GetNumChildren() == 0;
+	const Vector<SharedPtr<Component> >& components = node->GetComponents();
+	for (unsigned i = 0; i < components.Size(); ++i)
+	{
+		Component* component = components[i];
+		StringHash type = component->GetType();
+		if (type == StaticModel::GetTypeStatic() && !prefab->hasModel_)
+		{
+			StaticModel* model = static_cast<StaticModel*>(component);
+			prefab->model_ = model->GetModel();
+			prefab->material_ = model->GetMaterial(0);
+			prefab->castShadows_ = model->GetCastShadows();
+			prefab->hasModel_ = true;
+			for (unsigned j = 1; j < model->GetNumGeometries(); ++j)
+			{
+				if (model->GetMaterial(j) != prefab->material_)
+					prefab->fast_ = false;
+			}
+		}
+		else if (type == RigidBody::GetTypeStatic() && !prefab->hasBody_)
+		{
+			RigidBody* body = static_cast<RigidBody*>(component);
+			prefab->mass_ = body->GetMass();
+			prefab->friction_ = body->GetFriction();
+			prefab->layer_ = body->GetCollisionLayer();
+			prefab->mask_ = body->GetCollisionMask();
+			prefab->trigger_ = body->IsTrigger();
+			prefab->hasBody_ = true;
+			if (body->IsKinematic())
+				prefab->fast_ = false;
+		}
+		else if (type == CollisionShape::GetTypeStatic() && !prefab->hasShape_ &&
+			static_cast<CollisionShape*>(component)->GetShapeType() == SHAPE_BOX)
+		{
+			CollisionShape* shape = static_cast<CollisionShape*>(component);
+			prefab->shapeSize_ = shape->GetSize();
+			prefab->shapePosition_ = shape->GetPosition();
+			prefab->shapeRotation_ = shape->GetRotation();
+			prefab->hasShape_ = true;
+		}
+		else
+			prefab->fast_ = false;
+	}
+	return prefab;
+}
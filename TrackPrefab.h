@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Urho3D/Core/Object.h>
+#include <Urho3D/IO/VectorBuffer.h>
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Scene/Node.h>
+
+using namespace Urho3D;
+
+namespace Urho3D
+{
+	class Material;
+	class Model;
+	class Scene;
+}
+
+/// Track obstacle prefab.
+const char* const TRACK_BOX_PREFAB = "Objects/TrackBox";
+/// Track pickup prefab.
+const char* const TRACK_CARROT_PREFAB = "Objects/TrackCarrot";
+
+/// Node prefab authored in the editor or in code as node XML, kept in compiled binary form. Prefabs that only use a static model,
+/// a rigid body and a box collision shape also get a clone recipe: resources resolved up front and component settings read once,
+/// so that instantiating is a few setter calls without attribute deserialization. Trigger bodies are part of the recipe;
+/// children, other components, several materials and kinematic bodies make the prefab instantiate from the binary data.
+class TrackPrefab : public RefCounted
+{
+	friend class TrackPrefabLibrary;
+
+public:
+	/// Construct.
+	TrackPrefab();
+
+	/// Create an instance under a parent node. Physics only leaves out the drawable.
+	Node* Instantiate(Node* parent, const Vector3& position, const Quaternion& rotation, bool physicsOnly = false,
+		CreateMode mode = LOCAL) const;
+	/// Create an instance through binary deserialization, as Scene::Instantiate does.
+	Node* InstantiateBinary(Node* parent, const Vector3& position, const Quaternion& rotation, CreateMode mode = LOCAL) const;
+
+	/// Return node name.
+	const String& GetName() const { return name_; }
+	/// Return node scale.
+	const Vector3& GetScale() const { return scale_; }
+	/// Return model, or null if the prefab has no static model.
+	Model* GetModel() const { return model_; }
+	/// Return material.
+	Material* GetMaterial() const { return material_; }
+	/// Return whether the model casts shadows.
+	bool GetCastShadows() const { return castShadows_; }
+	/// Return compiled binary node data.
+	const VectorBuffer& GetBinary() const { return binary_; }
+	/// Return whether the clone recipe is used.
+	bool IsFast() const { return fast_; }
+
+private:
+	/// Node name.
+	String name_;
+	/// Node scale.
+	Vector3 scale_;
+	/// Compiled binary node data.
+	VectorBuffer binary_;
+	/// Model.
+	SharedPtr<Model> model_;
+	/// Material.
+	SharedPtr<Material> material_;
+	/// Box shape size.
+	Vector3 shapeSize_;
+	/// Box shape offset position.
+	Vector3 shapePosition_;
+	/// Box shape offset rotation.
+	Quaternion shapeRotation_;
+	/// Body mass.
+	float mass_;
+	/// Body friction.
+	float friction_;
+	/// Body collision layer.
+	unsigned layer_;
+	/// Body collision mask.
+	unsigned mask_;
+	/// Body is a trigger.
+	bool trigger_;
+	/// Cast shadows flag.
+	bool castShadows_;
+	/// Has a static model.
+	bool hasModel_;
+	/// Has a rigid body.
+	bool hasBody_;
+	/// Has a box collision shape.
+	bool hasShape_;
+	/// Clone recipe covers the whole prefab.
+	bool fast_;
+};
+
+/// Loads and caches track prefabs. A prefab is read from its compiled .bin file when that is up to date, otherwise from its .xml.
+class TrackPrefabLibrary : public Object
+{
+	URHO3D_OBJECT(TrackPrefabLibrary, Object);
+
+public:
+	/// Construct.
+	TrackPrefabLibrary(Context* context);
+	/// Destruct.
+	~TrackPrefabLibrary();
+
+	/// Return a prefab by resource name without extension, loading it on first use. Return null on failure.
+	TrackPrefab* GetPrefab(const String& name);
+	/// Forget a prefab, so that its resources can be released. Instances and holders of the prefab keep it alive.
+	void ReleasePrefab(const String& name);
+	/// Compile a prefab's XML into a .bin file next to it. Return true on success.
+	bool Compile(const String& name);
+
+private:
+	/// Build a prefab from a node instantiated into the template scene.
+	SharedPtr<TrackPrefab> CreatePrefab(Node* node);
+
+	/// Scene holding the template nodes while prefabs are built.
+	SharedPtr<Scene> templateScene_;
+	/// Loaded prefabs.
+	HashMap<String, SharedPtr<TrackPrefab> > prefabs_;
+};
@@ -0,0 +1,253 @@
+#include <Urho3D/Math/MathDefs.h>
+
+#include "TrackSpline.h"
+
+/// Parameter steps per control segment in the arc-length tables.
+static const unsigned SEGMENT_STEPS = 32;
+/// World to track lookup grid cell size.
+static const float GRID_CELL_SIZE = 2.0f;
+
+static Vector3 CatmullRom(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& p3, float t)
+{
+	float t2 = t * t;
+	float t3 = t2 * t;
+	return (p1 * 2.0f + (p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+}
+
+static Vector3 CatmullRomTangent(const Vector3& p0, const Vector3& p1, const Vector3& p2, const Vector3& p3, float t)
+{
+	return ((p2 - p0) + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * (2.0f * t) + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * (3.0f * t * t)) * 0.5f;
+}
+
+TrackSpline::TrackSpline() :
+	gridOrigin_(Vector2::ZERO),
+	gridWidth_(0),
+	gridHeight_(0),
+	length_(0.0f)
+{
+}
+
+void TrackSpline::Build(const PODVector<Vector3>& controlPoints)
+{
+	samples_.Clear();
+	length_ = 0.0f;
+	if (controlPoints.Size() < 2)
+		return;
+
+	// Phantom end points continue the end segments straight
+	PODVector<Vector3> points;
+	points.Push(controlPoints[0] * 2.0f - controlPoints[1]);
+	points.Push(controlPoints);
+	points.Push(controlPoints.Back() * 2.0f - controlPoints[controlPoints.Size() - 2]);
+
+	// Arc-length tables of all segments back to back: cumulative length at each parameter step
+	unsigned numSegments = controlPoints.Size() - 1;
+	unsigned numSteps = numSegments * SEGMENT_STEPS;
+	PODVector<float> lengths(numSteps + 1);
+	float totalLength = 0.0f;
+	Vector3 previous = points[1];
+	lengths[0] = 0.0f;
+	for (unsigned j = 1; j <= numSteps; ++j)
+	{
+		unsigned segment = (j - 1) / SEGMENT_STEPS;
+		float t = (float)(j - segment * SEGMENT_STEPS) / SEGMENT_STEPS;
+		Vector3 point = CatmullRom(points[segment], points[segment + 1], points[segment + 2], points[segment + 3], t);
+		totalLength += (point - previous).Length();
+		lengths[j] = totalLength;
+		previous = point;
+	}
+
+	// Resample at uniform arc length by inverting the tables. Distances only grow, so the search continues where it left off
+	unsigned numSamples = (unsigned)(totalLength / TRACK_SAMPLE_SPACING) + 1;
+	samples_.Resize(numSamples);
+	unsigned j = 0;
+	for (unsigned i = 0; i < numSamples; ++i)
+	{
+		float distance = i * TRACK_SAMPLE_SPACING;
+		while (j + 1 < numSteps && lengths[j + 1] < distance)
+			++j;
+
+		float stepLength = lengths[j + 1] - lengths[j];
+		float fraction = stepLength > 0.0f ? Clamp((distance - lengths[j]) / stepLength, 0.0f, 1.0f) : 0.0f;
+		unsigned segment = j / SEGMENT_STEPS;
+		float t = ((j - segment * SEGMENT_STEPS) + fraction) / SEGMENT_STEPS;
+
+		const Vector3& p0 = points[segment];
+		const Vector3& p1 = points[segment + 1];
+		const Vector3& p2 = points[segment + 2];
+		const Vector3& p3 = points[segment + 3];
+		TrackSample& sample = samples_[i];
+		sample.position_ = CatmullRom(p0, p1, p2, p3, t);
+		sample.forward_ = CatmullRomTangent(p0, p1, p2, p3, t).Normalized();
+		sample.right_ = Vector3::UP.CrossProduct(sample.forward_).Normalized();
+		sample.up_ = sample.forward_.CrossProduct(sample.right_);
+	}
+
+	length_ = (numSamples - 1) * TRACK_SAMPLE_SPACING;
+	BuildGrid();
+}
+
+Vector3 TrackSpline::ToWorld(const Vector3& trackPosition) const
+{
+	if (samples_.Size() < 2)
+		return trackPosition;
+
+	float fraction;
+	unsigned i = GetInterval(trackPosition.z_, fraction);
+	const TrackSample& a = samples_[i];
+	const TrackSample& b = samples_[i + 1];
+	return a.position_.Lerp(b.position_, fraction) + a.right_.Lerp(b.right_, fraction) * trackPosition.x_ +
+		a.up_.Lerp(b.up_, fraction) * trackPosition.y_;
+}
+
+Vector3 TrackSpline::ToTrack(const Vector3& worldPosition) const
+{
+	if (samples_.Size() < 2)
+		return worldPosition;
+
+	unsigned last = samples_.Size() - 2;
+	int x = Clamp((int)floorf((worldPosition.x_ - gridOrigin_.x_) / GRID_CELL_SIZE), 0, gridWidth_ - 1);
+	int z = Clamp((int)floorf((worldPosition.z_ - gridOrigin_.y_) / GRID_CELL_SIZE), 0, gridHeight_ - 1);
+	unsigned cell = z * gridWidth_ + x;
+	const unsigned* begin = &gridIntervals_[0] + gridStarts_[cell];
+	const unsigned* end = &gridIntervals_[0] + gridStarts_[cell + 1];
+	// Too far from the center line for the grid, resolve against the ends
+	const unsigned ends[] = {0, last};
+	if (begin == end)
+	{
+		begin = ends;
+		end = ends + 2;
+	}
+
+	float bestDistance = M_INFINITY;
+	unsigned bestInterval = 0;
+	float bestT = 0.0f;
+	for (const unsigned* i = begin; i != end; ++i)
+	{
+		const Vector3& a = samples_[*i].position_;
+		Vector3 chord = samples_[*i + 1].position_ - a;
+		float t = (worldPosition - a).DotProduct(chord) / chord.LengthSquared();
+		// The end intervals extend beyond the track, like ToWorld
+		if (*i > 0)
+			t = Max(t, 0.0f);
+		if (*i < last)
+			t = Min(t, 1.0f);
+
+		float distance = (worldPosition - (a + chord * t)).LengthSquared();
+		if (distance < bestDistance)
+		{
+			bestDistance = distance;
+			bestInterval = *i;
+			bestT = t;
+		}
+	}
+
+	const TrackSample& a = samples_[bestInterval];
+	const TrackSample& b = samples_[bestInterval + 1];
+	Vector3 offset = worldPosition - a.position_.Lerp(b.position_, bestT);
+	return Vector3(offset.DotProduct(a.right_.Lerp(b.right_, bestT)), offset.DotProduct(a.up_.Lerp(b.up_, bestT)),
+		(bestInterval + bestT) * TRACK_SAMPLE_SPACING);
+}
+
+TrackSample TrackSpline::GetFrame(float distance) const
+{
+	TrackSample frame;
+	if (samples_.Size() < 2)
+	{
+		frame.position_ = Vector3(0.0f, 0.0f, distance);
+		frame.forward_ = Vector3::FORWARD;
+		frame.right_ = Vector3::RIGHT;
+		frame.up_ = Vector3::UP;
+		return frame;
+	}
+
+	float fraction;
+	unsigned i = GetInterval(distance, fraction);
+	const TrackSample& a = samples_[i];
+	const TrackSample& b = samples_[i + 1];
+	frame.position_ = a.position_.Lerp(b.position_, fraction);
+	frame.forward_ = a.forward_.Lerp(b.forward_, fraction).Normalized();
+	frame.right_ = a.right_.Lerp(b.right_, fraction).Normalized();
+	frame.up_ = a.up_.Lerp(b.up_, fraction).Normalized();
+	return frame;
+}
+
+Quaternion TrackSpline::GetRotation(float distance) const
+{
+	TrackSample frame = GetFrame(distance);
+	Quaternion rotation;
+	rotation.FromLookRotation(frame.forward_, frame.up_);
+	return rotation;
+}
+
+float TrackSpline::GetYaw(float distance) const
+{
+	TrackSample frame = GetFrame(distance);
+	return Atan2(frame.forward_.x_, frame.forward_.z_);
+}
+
+unsigned TrackSpline::GetInterval(float distance, float& fraction) const
+{
+	float position = distance * (1.0f / TRACK_SAMPLE_SPACING);
+	int i = Clamp((int)floorf(position), 0, (int)samples_.Size() - 2);
+	fraction = position - i;
+	return (unsigned)i;
+}
+
+void TrackSpline::BuildGrid()
+{
+	Vector2 min(M_INFINITY, M_INFINITY);
+	Vector2 max(-M_INFINITY, -M_INFINITY);
+	for (unsigned i = 0; i < samples_.Size(); ++i)
+	{
+		const Vector3& position = samples_[i].position_;
+		min = Vector2(Min(min.x_, position.x_), Min(min.y_, position.z_));
+		max = Vector2(Max(max.x_, position.x_), Max(max.y_, position.z_));
+	}
+	gridOrigin_ = min - Vector2(TRACK_MAX_LATERAL, TRACK_MAX_LATERAL);
+	gridWidth_ = (int)((max.x_ - min.x_ + 2.0f * TRACK_MAX_LATERAL) / GRID_CELL_SIZE) + 1;
+	gridHeight_ = (int)((max.y_ - min.y_ + 2.0f * TRACK_MAX_LATERAL) / GRID_CELL_SIZE) + 1;
+
+	// Count, then fill: each interval goes to every cell within TRACK_MAX_LATERAL of it
+	gridStarts_.Resize(gridWidth_ * gridHeight_ + 1);
+	for (unsigned i = 0; i < gridStarts_.Size(); ++i)
+		gridStarts_[i] = 0;
+
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (unsigned i = 0; i + 1 < samples_.Size(); ++i)
+		{
+			const Vector3& a = samples_[i].position_;
+			const Vector3& b = samples_[i + 1].position_;
+			int x0 = (int)((Min(a.x_, b.x_) - TRACK_MAX_LATERAL - gridOrigin_.x_) / GRID_CELL_SIZE);
+			int x1 = (int)((Max(a.x_, b.x_) + TRACK_MAX_LATERAL - gridOrigin_.x_) / GRID_CELL_SIZE);
+			int z0 = (int)((Min(a.z_, b.z_) - TRACK_MAX_LATERAL - gridOrigin_.y_) / GRID_CELL_SIZE);
+			int z1 = (int)((Max(a.z_, b.z_) + TRACK_MAX_LATERAL - gridOrigin_.y_) / GRID_CELL_SIZE);
+			for (int z = Max(z0, 0); z <= Min(z1, gridHeight_ - 1); ++z)
+			{
+				for (int x = Max(x0, 0); x <= Min(x1, gridWidth_ - 1); ++x)
+				{
+					unsigned cell = z * gridWidth_ + x;
+					if (pass == 0)
+						++gridStarts_[cell + 1];
+					else
+						gridIntervals_[gridStarts_[cell]++] = i;
+				}
+			}
+		}
+
+		if (pass == 0)
+		{
+			for (unsigned i = 1; i < gridStarts_.Size(); ++i)
+				gridStarts_[i] += gridStarts_[i - 1];
+			gridIntervals_.Resize(gridStarts_.Back());
+		}
+		else
+		{
+			// The fill pass advanced each start to the next cell's start, shift back
+			for (unsigned i = gridStarts_.Size() - 1; i > 0; --i)
+				gridStarts_[i] = gridStarts_[i - 1];
+			gridStarts_[0] = 0;
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <Urho3D/Container/Vector.h>
+#include <Urho3D/Math/Quaternion.h>
+#include <Urho3D/Math/Vector3.h>
+
+using namespace Urho3D;
+
+/// Distance between arc-length samples.
+const float TRACK_SAMPLE_SPACING = 0.5f;
+/// Largest lateral offset resolved by the world to track lookup.
+const float TRACK_MAX_LATERAL = 6.0f;
+
+/// Track frame at an arc-length sample.
+struct TrackSample
+{
+	/// Center line position.
+	Vector3 position_;
+	/// Unit direction of travel.
+	Vector3 forward_;
+	/// Unit lateral direction, level with the ground.
+	Vector3 right_;
+	/// Unit up direction of the track surface.
+	Vector3 up_;
+};
+
+/// Curved, sloped track center line. A Catmull-Rom spline through control points is resampled at uniform arc length
+/// from per-segment length tables, so that mapping track space to the world is an array lookup, and a grid over the samples
+/// makes the way back constant time as well. Track space is X = lateral offset, Y = height above the surface, Z = distance,
+/// so a straight track maps it to the world unchanged.
+class TrackSpline
+{
+public:
+	/// Construct empty.
+	TrackSpline();
+
+	/// Build from control points. The spline passes through all of them.
+	void Build(const PODVector<Vector3>& controlPoints);
+
+	/// Return length along the center line.
+	float GetLength() const { return length_; }
+	/// Return number of arc-length samples.
+	unsigned GetNumSamples() const { return samples_.Size(); }
+
+	/// Return world position of a track space point. Distances beyond the ends extrapolate along the end direction.
+	Vector3 ToWorld(const Vector3& trackPosition) const;
+	/// Return track space position of a world point. Points farther than TRACK_MAX_LATERAL from the center line are resolved
+	/// against the nearest end.
+	Vector3 ToTrack(const Vector3& worldPosition) const;
+	/// Return interpolated track frame at a distance.
+	TrackSample GetFrame(float distance) const;
+	/// Return world rotation of the track frame at a distance.
+	Quaternion GetRotation(float distance) const;
+	/// Return yaw angle in degrees of the direction of travel at a distance.
+	float GetYaw(float distance) const;
+
+private:
+	/// Return sample interval index and fraction for a distance.
+	unsigned GetInterval(float distance, float& fraction) const;
+	/// Build the world to track lookup grid.
+	void BuildGrid();
+
+	/// Samples at uniform arc length.
+	PODVector<TrackSample> samples_;
+	/// Sample intervals near each grid cell, indexed by gridStarts_.
+	PODVector<unsigned> gridIntervals_;
+	/// Start of each grid cell in gridIntervals_, one extra at the end.
+	PODVector<unsigned> gridStarts_;
+	/// Grid origin on the XZ plane.
+	Vector2 gridOrigin_;
+	/// Grid cell count along X.
+	int gridWidth_;
+	/// Grid cell count along Z.
+	int gridHeight_;
+	/// Length along the center line.
+	float length_;
+};
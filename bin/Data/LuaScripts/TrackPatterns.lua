@@ -0,0 +1,67 @@
+-- Track obstacle and pickup patterns
+-- Each pattern fills one 40 m segment of the track. The game runs this script only when it is loaded or changed on disk,
+-- never during play, and picks one pattern per segment from the track seed.
+--
+-- A pattern has:
+--   name    shown in the log
+--   weight  relative chance of being picked (default 1)
+--   items   list of { type = "box" or "carrot", lane = -1, 0 or 1, offset = metres from the segment start (0 - 40) }
+-- or, instead of items:
+--   build   function(variant) returning an items list, called once for each of the variants 1 - 4
+
+TrackPatterns =
+{
+    {
+        name = "Slalom",
+        weight = 2,
+        items =
+        {
+            { type = "box", lane = -1, offset = 4 },
+            { type = "carrot", lane = 1, offset = 4 },
+            { type = "box", lane = 1, offset = 16 },
+            { type = "carrot", lane = -1, offset = 16 },
+            { type = "box", lane = -1, offset = 28 },
+            { type = "carrot", lane = 1, offset = 28 },
+        }
+    },
+    {
+        name = "Gate",
+        items =
+        {
+            { type = "box", lane = -1, offset = 10 },
+            { type = "box", lane = 1, offset = 10 },
+            { type = "carrot", lane = 0, offset = 10 },
+            { type = "box", lane = 0, offset = 30 },
+            { type = "carrot", lane = -1, offset = 30 },
+            { type = "carrot", lane = 1, offset = 30 },
+        }
+    },
+    {
+        name = "CarrotLine",
+        weight = 2,
+        build = function(variant)
+            local lane = (variant % 3) - 1
+            local items = {}
+            for i = 0, 3 do
+                table.insert(items, { type = "carrot", lane = lane, offset = 6 + i * 5 })
+            end
+            table.insert(items, { type = "box", lane = (lane == 0) and -1 or -lane, offset = 12 })
+            table.insert(items, { type = "box", lane = lane, offset = 34 })
+            table.insert(items, { type = "box", lane = (lane == 0) and 1 or 0, offset = 34 })
+            return items
+        end
+    },
+    {
+        name = "Staircase",
+        build = function(variant)
+            local direction = (variant % 2 == 0) and 1 or -1
+            local items = {}
+            for i = 0, 2 do
+                local lane = (i - 1) * direction
+                table.insert(items, { type = "box", lane = lane, offset = 8 + i * 10 })
+                table.insert(items, { type = "carrot", lane = lane, offset = 3 + i * 10 })
+            end
+            return items
+        end
+    },
+}
@@ -0,0 +1,27 @@
+// Pickup idle animation: a spin around the local up axis and a bob along it. The phase is taken from the instance position,
+// so that neighbouring pickups do not move in step and nothing needs to be set per instance
+
+uniform float cSpinSpeed;
+uniform float cBobHeight;
+uniform float cBobPeriod;
+uniform vec2 cPhaseSpacing;
+
+float GetPickupPhase(mat4 modelMatrix)
+{
+    return dot(vec2(modelMatrix[0][3], modelMatrix[2][3]), cPhaseSpacing);
+}
+
+vec3 GetPickupDir(vec3 dir, float phase)
+{
+    float angle = cElapsedTime * cSpinSpeed + phase;
+    float s = sin(angle);
+    float c = cos(angle);
+    return vec3(c * dir.x + s * dir.z, dir.y, c * dir.z - s * dir.x);
+}
+
+vec4 GetPickupPos(vec4 pos, float phase)
+{
+    vec3 spun = GetPickupDir(pos.xyz, phase);
+    spun.y += cBobHeight * sin(cElapsedTime * cBobPeriod + phase);
+    return vec4(spun, 1.0);
+}
@@ -0,0 +1,13 @@
+#include "Uniforms.glsl"
+#include "Transform.glsl"
+#include "PickupAnimation.glsl"
+
+varying vec3 vTexCoord;
+
+void VS()
+{
+    mat4 modelMatrix = iModelMatrix;
+    vec3 worldPos = (GetPickupPos(iPos, GetPickupPhase(modelMatrix)) * modelMatrix).xyz;
+    gl_Position = GetClipPos(worldPos);
+    vTexCoord = vec3(GetTexCoord(iTexCoord), GetDepth(gl_Position));
+}
@@ -0,0 +1,21 @@
+#include "Uniforms.glsl"
+#include "Transform.glsl"
+#include "PickupAnimation.glsl"
+
+#ifdef VSM_SHADOW
+    varying vec4 vTexCoord;
+#else
+    varying vec2 vTexCoord;
+#endif
+
+void VS()
+{
+    mat4 modelMatrix = iModelMatrix;
+    vec3 worldPos = (GetPickupPos(iPos, GetPickupPhase(modelMatrix)) * modelMatrix).xyz;
+    gl_Position = GetClipPos(worldPos);
+    #ifdef VSM_SHADOW
+        vTexCoord = vec4(GetTexCoord(iTexCoord), gl_Position.z, gl_Position.w);
+    #else
+        vTexCoord = GetTexCoord(iTexCoord);
+    #endif
+}
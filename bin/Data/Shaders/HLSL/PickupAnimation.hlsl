@@ -0,0 +1,43 @@
+// Pickup idle animation: a spin around the local up axis and a bob along it. The phase is taken from the instance position,
+// so that neighbouring pickups do not move in step and nothing needs to be set per instance
+
+#ifndef D3D11
+
+// D3D9 uniforms
+uniform float cSpinSpeed;
+uniform float cBobHeight;
+uniform float cBobPeriod;
+uniform float2 cPhaseSpacing;
+
+#else
+
+// D3D11 constant buffer
+cbuffer CustomVS : register(b6)
+{
+    float cSpinSpeed;
+    float cBobHeight;
+    float cBobPeriod;
+    float2 cPhaseSpacing;
+}
+
+#endif
+
+float GetPickupPhase(float4x3 modelMatrix)
+{
+    return dot(modelMatrix[3].xz, cPhaseSpacing);
+}
+
+float3 GetPickupDir(float3 dir, float phase)
+{
+    float s;
+    float c;
+    sincos(cElapsedTime * cSpinSpeed + phase, s, c);
+    return float3(c * dir.x + s * dir.z, dir.y, c * dir.z - s * dir.x);
+}
+
+float4 GetPickupPos(float4 pos, float phase)
+{
+    float3 spun = GetPickupDir(pos.xyz, phase);
+    spun.y += cBobHeight * sin(cElapsedTime * cBobPeriod + phase);
+    return float4(spun, 1.0);
+}
@@ -0,0 +1,40 @@
+#include "Uniforms.hlsl"
+#include "Transform.hlsl"
+#include "PickupAnimation.hlsl"
+
+void VS(float4 iPos : POSITION,
+    #ifndef NOUV
+        float2 iTexCoord : TEXCOORD0,
+    #endif
+    #ifdef SKINNED
+        float4 iBlendWeights : BLENDWEIGHT,
+        int4 iBlendIndices : BLENDINDICES,
+    #endif
+    #ifdef INSTANCED
+        float4x3 iModelInstance : TEXCOORD4,
+    #endif
+    #if defined(BILLBOARD) || defined(DIRBILLBOARD)
+        float2 iSize : TEXCOORD1,
+    #endif
+    #ifdef VSM_SHADOW
+        out float4 oTexCoord : TEXCOORD0,
+    #else
+        out float2 oTexCoord : TEXCOORD0,
+    #endif
+    out float4 oPos : OUTPOSITION)
+{
+    // Define a 0,0 UV coord if not expected from the vertex data
+    #ifdef NOUV
+    float2 iTexCoord = float2(0.0, 0.0);
+    #endif
+
+    float4x3 modelMatrix = iModelMatrix;
+    iPos = GetPickupPos(iPos, GetPickupPhase(modelMatrix));
+    float3 worldPos = GetWorldPos(modelMatrix);
+    oPos = GetClipPos(worldPos);
+    #ifdef VSM_SHADOW
+        oTexCoord = float4(GetTexCoord(iTexCoord), oPos.z, oPos.w);
+    #else
+        oTexCoord = GetTexCoord(iTexCoord);
+    #endif
+}